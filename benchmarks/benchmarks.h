@@ -0,0 +1,23 @@
+#pragma once
+
+#include "harness.h"
+
+namespace smlt {
+
+class Stage;
+
+namespace benchmark {
+
+/* Each of these adds a group of benchmarks to the runner. Benchmarks
+ * which need assets or stage nodes create them in the stage. */
+
+void register_container_benchmarks(BenchmarkRunner& runner);
+void register_json_benchmarks(BenchmarkRunner& runner);
+void register_loader_benchmarks(BenchmarkRunner& runner, Stage* stage);
+void register_particle_benchmarks(BenchmarkRunner& runner, Stage* stage);
+void register_render_queue_benchmarks(BenchmarkRunner& runner, Stage* stage);
+void register_spatial_hash_benchmarks(BenchmarkRunner& runner);
+void register_vertex_data_benchmarks(BenchmarkRunner& runner);
+
+}
+}
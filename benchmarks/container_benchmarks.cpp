@@ -0,0 +1,207 @@
+#include <random>
+
+#include "simulant/generic/containers/contiguous_map.h"
+#include "simulant/generic/containers/polylist.h"
+
+#include "benchmarks.h"
+
+namespace smlt {
+namespace benchmark {
+
+static const std::size_t MAP_ENTRY_COUNT = 10000;
+static const std::size_t POLYLIST_ENTRY_COUNT = 10000;
+
+/* Keys with plenty of duplicates, like the render group keys the
+ * map was written for */
+static std::vector<int> build_keys() {
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> key(0, MAP_ENTRY_COUNT / 4);
+
+    std::vector<int> keys;
+    for(std::size_t i = 0; i < MAP_ENTRY_COUNT; ++i) {
+        keys.push_back(key(rng));
+    }
+    return keys;
+}
+
+class MultiMapInsert : public Benchmark {
+public:
+    MultiMapInsert():
+        Benchmark("contiguous_multi_map/insert", MAP_ENTRY_COUNT) {}
+
+    void set_up() override {
+        keys_ = build_keys();
+    }
+
+    void prepare() override {
+        map_.clear();
+    }
+
+    void run() override {
+        for(std::size_t i = 0; i < keys_.size(); ++i) {
+            map_.insert(keys_[i], i);
+        }
+    }
+
+private:
+    std::vector<int> keys_;
+    ContiguousMultiMap<int, std::size_t> map_;
+};
+
+class MultiMapIterate : public Benchmark {
+public:
+    MultiMapIterate():
+        Benchmark("contiguous_multi_map/iterate", MAP_ENTRY_COUNT) {}
+
+    void set_up() override {
+        auto keys = build_keys();
+        for(std::size_t i = 0; i < keys.size(); ++i) {
+            map_.insert(keys[i], i);
+        }
+    }
+
+    void run() override {
+        for(auto& p: map_) {
+            total_ += p.second;
+        }
+    }
+
+private:
+    ContiguousMultiMap<int, std::size_t> map_;
+    std::size_t total_ = 0;
+};
+
+class MultiMapFind : public Benchmark {
+public:
+    MultiMapFind():
+        Benchmark("contiguous_multi_map/find", MAP_ENTRY_COUNT) {}
+
+    void set_up() override {
+        keys_ = build_keys();
+        for(std::size_t i = 0; i < keys_.size(); ++i) {
+            map_.insert(keys_[i], i);
+        }
+    }
+
+    void run() override {
+        for(auto key: keys_) {
+            found_ += (map_.find(key) != map_.end()) ? 1 : 0;
+        }
+    }
+
+private:
+    std::vector<int> keys_;
+    ContiguousMultiMap<int, std::size_t> map_;
+    std::size_t found_ = 0;
+};
+
+namespace {
+
+class Base {
+public:
+    virtual ~Base() {}
+    virtual int value() const = 0;
+};
+
+class Small : public Base {
+public:
+    int value() const override { return 1; }
+};
+
+class Large : public Base {
+public:
+    int value() const override { return data[0]; }
+    int data[32] = {2};
+};
+
+typedef Polylist<Base, Small, Large> List;
+
+}
+
+class PolylistCreateErase : public Benchmark {
+public:
+    PolylistCreateErase():
+        Benchmark("polylist/create_erase", POLYLIST_ENTRY_COUNT) {}
+
+    void set_up() override {
+        list_.reset(new List(64));
+        ids_.reserve(POLYLIST_ENTRY_COUNT);
+    }
+
+    void run() override {
+        for(std::size_t i = 0; i < POLYLIST_ENTRY_COUNT; ++i) {
+            if(i % 2) {
+                ids_.push_back(list_->create<Small>().second);
+            } else {
+                ids_.push_back(list_->create<Large>().second);
+            }
+        }
+
+        /* Erase in a different order to the creation, so that
+         * the free lists get shuffled */
+        for(std::size_t i = 0; i < ids_.size(); i += 2) {
+            list_->erase(list_->find(ids_[i]));
+        }
+
+        for(std::size_t i = 1; i < ids_.size(); i += 2) {
+            list_->erase(list_->find(ids_[i]));
+        }
+    }
+
+    void clean_up() override {
+        ids_.clear();
+    }
+
+    void tear_down() override {
+        list_.reset();
+    }
+
+private:
+    std::unique_ptr<List> list_;
+    std::vector<List::id> ids_;
+};
+
+class PolylistIterate : public Benchmark {
+public:
+    PolylistIterate():
+        Benchmark("polylist/iterate", POLYLIST_ENTRY_COUNT / 2) {}
+
+    void set_up() override {
+        list_.reset(new List(64));
+
+        /* Leave holes, as a stage node pool would have */
+        std::vector<List::id> ids;
+        for(std::size_t i = 0; i < POLYLIST_ENTRY_COUNT; ++i) {
+            ids.push_back(list_->create<Small>().second);
+        }
+
+        for(std::size_t i = 0; i < ids.size(); i += 2) {
+            list_->erase(list_->find(ids[i]));
+        }
+    }
+
+    void run() override {
+        for(auto node: *list_) {
+            total_ += node->value();
+        }
+    }
+
+    void tear_down() override {
+        list_.reset();
+    }
+
+private:
+    std::unique_ptr<List> list_;
+    int64_t total_ = 0;
+};
+
+void register_container_benchmarks(BenchmarkRunner& runner) {
+    runner.add(std::make_shared<MultiMapInsert>());
+    runner.add(std::make_shared<MultiMapIterate>());
+    runner.add(std::make_shared<MultiMapFind>());
+    runner.add(std::make_shared<PolylistCreateErase>());
+    runner.add(std::make_shared<PolylistIterate>());
+}
+
+}
+}
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+
+#include "harness.h"
+#include "simulant/utils/json.h"
+
+namespace smlt {
+namespace benchmark {
+
+/* Nearest-rank percentile of sorted samples */
+static double percentile(const std::vector<double>& sorted, double p) {
+    if(sorted.empty()) {
+        return 0;
+    }
+
+    std::size_t rank = (std::size_t) std::ceil(p * sorted.size());
+    rank = std::max<std::size_t>(rank, 1);
+    return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+BenchmarkResult summarise(const std::string& name, uint64_t items, std::vector<double> samples) {
+    BenchmarkResult result;
+    result.name = name;
+    result.items = items;
+    result.iterations = samples.size();
+
+    if(samples.empty()) {
+        return result;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    double total = 0;
+    for(auto s: samples) {
+        total += s;
+    }
+
+    result.mean = total / samples.size();
+
+    double variance = 0;
+    for(auto s: samples) {
+        variance += (s - result.mean) * (s - result.mean);
+    }
+
+    result.stddev = std::sqrt(variance / samples.size());
+    result.min = samples.front();
+    result.max = samples.back();
+    result.median = percentile(samples, 0.5);
+    result.p90 = percentile(samples, 0.9);
+    result.p99 = percentile(samples, 0.99);
+
+    return result;
+}
+
+void BenchmarkRunner::add(BenchmarkPtr benchmark) {
+    benchmarks_.push_back(benchmark);
+}
+
+void BenchmarkRunner::add(const std::string& name, std::function<void ()> func, uint64_t items) {
+    add(std::make_shared<FunctionBenchmark>(name, func, items));
+}
+
+std::vector<BenchmarkResult> BenchmarkRunner::run(const BenchmarkOptions& options) {
+    typedef std::chrono::high_resolution_clock Clock;
+
+    std::vector<BenchmarkResult> results;
+
+    printf("%-40s %10s %10s %10s %10s %10s %14s\n", "(us)", "min", "median", "p90", "p99", "max", "items/s");
+
+    for(auto& benchmark: benchmarks_) {
+        if(!options.filter.empty() && benchmark->name().find(options.filter) == std::string::npos) {
+            continue;
+        }
+
+        benchmark->set_up();
+
+        for(uint32_t i = 0; i < options.warmup_iterations; ++i) {
+            benchmark->prepare();
+            benchmark->run();
+            benchmark->clean_up();
+        }
+
+        std::vector<double> samples;
+        samples.reserve(options.iterations);
+
+        for(uint32_t i = 0; i < options.iterations; ++i) {
+            benchmark->prepare();
+
+            auto start = Clock::now();
+            benchmark->run();
+            auto end = Clock::now();
+
+            benchmark->clean_up();
+
+            samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+
+        benchmark->tear_down();
+
+        auto result = summarise(benchmark->name(), benchmark->items(), samples);
+
+        printf(
+            "%-40s %10.1f %10.1f %10.1f %10.1f %10.1f %14.0f\n",
+            result.name.c_str(), result.min, result.median,
+            result.p90, result.p99, result.max, result.items_per_second()
+        );
+
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+/* Benchmark names are plain identifiers, but escape them anyway */
+static std::string escape(const std::string& str) {
+    std::string ret;
+    for(auto c: str) {
+        if(c == '"' || c == '\\') {
+            ret += '\\';
+        }
+        ret += c;
+    }
+    return ret;
+}
+
+bool write_json(const std::string& path, const std::string& label, const std::vector<BenchmarkResult>& results) {
+    FILE* out = fopen(path.c_str(), "w");
+    if(!out) {
+        return false;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "    \"label\": \"%s\",\n", escape(label).c_str());
+    fprintf(out, "    \"timestamp\": %lld,\n", (long long) std::time(nullptr));
+    fprintf(out, "    \"benchmarks\": [");
+
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+        fprintf(out, "%s\n        {", (i) ? "," : "");
+        fprintf(out, "\"name\": \"%s\", ", escape(r.name).c_str());
+        fprintf(out, "\"iterations\": %u, ", r.iterations);
+        fprintf(out, "\"items\": %llu, ", (unsigned long long) r.items);
+        fprintf(out, "\"min_us\": %.3f, ", r.min);
+        fprintf(out, "\"max_us\": %.3f, ", r.max);
+        fprintf(out, "\"mean_us\": %.3f, ", r.mean);
+        fprintf(out, "\"stddev_us\": %.3f, ", r.stddev);
+        fprintf(out, "\"median_us\": %.3f, ", r.median);
+        fprintf(out, "\"p90_us\": %.3f, ", r.p90);
+        fprintf(out, "\"p99_us\": %.3f", r.p99);
+        fprintf(out, "}");
+    }
+
+    fprintf(out, "\n    ]\n}\n");
+    fclose(out);
+    return true;
+}
+
+std::vector<BenchmarkResult> read_json(const std::string& path) {
+    std::vector<BenchmarkResult> results;
+
+    if(!std::ifstream(path).good()) {
+        return results;
+    }
+
+    auto json = json_load(path);
+    if(!json || !json->has_key("benchmarks")) {
+        return results;
+    }
+
+    auto benchmarks = json["benchmarks"];
+    for(std::size_t i = 0; i < benchmarks->size(); ++i) {
+        auto item = benchmarks[i];
+
+        BenchmarkResult result;
+        result.name = item["name"]->to_str().value_or("");
+        result.iterations = item["iterations"]->to_int().value_or(0);
+        result.items = item["items"]->to_int().value_or(0);
+        result.min = item["min_us"]->to_float().value_or(0);
+        result.max = item["max_us"]->to_float().value_or(0);
+        result.mean = item["mean_us"]->to_float().value_or(0);
+        result.stddev = item["stddev_us"]->to_float().value_or(0);
+        result.median = item["median_us"]->to_float().value_or(0);
+        result.p90 = item["p90_us"]->to_float().value_or(0);
+        result.p99 = item["p99_us"]->to_float().value_or(0);
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+void print_comparison(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& results) {
+    printf("\n%-40s %12s %12s %9s\n", "(median us)", "baseline", "current", "change");
+
+    for(auto& result: results) {
+        auto it = std::find_if(baseline.begin(), baseline.end(), [&](const BenchmarkResult& b) {
+            return b.name == result.name;
+        });
+
+        if(it == baseline.end()) {
+            printf("%-40s %12s %12.1f %9s\n", result.name.c_str(), "-", result.median, "new");
+            continue;
+        }
+
+        double change = (it->median > 0) ? ((result.median - it->median) / it->median) * 100.0 : 0.0;
+        printf("%-40s %12.1f %12.1f %+8.1f%%\n", result.name.c_str(), it->median, result.median, change);
+    }
+}
+
+}
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+/*
+ * A small timing harness for the engine's hot paths.
+ *
+ * Each benchmark runs a number of untimed warmup iterations, followed by
+ * the timed iterations. The run() of each iteration is timed on its own,
+ * so the results include the spread (percentiles) and not just the mean.
+ *
+ * Usage:
+ *
+ * class MyBenchmark : public Benchmark {
+ * public:
+ *     MyBenchmark(): Benchmark("my/benchmark", 1000) {}
+ *
+ *     void set_up() override { ... }  // Once, before the warmup
+ *     void prepare() override { ... } // Before each iteration, untimed
+ *     void run() override { ... }     // Timed
+ * };
+ *
+ * runner.add(std::make_shared<MyBenchmark>());
+ *
+ * Workloads should be built from fixed seeds so that results from
+ * different commits can be compared.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace smlt {
+namespace benchmark {
+
+class Benchmark {
+public:
+    /* items is the number of things (e.g. particles, or renderables)
+     * processed by each call to run(), and is used to report throughput */
+    Benchmark(const std::string& name, uint64_t items=0):
+        name_(name),
+        items_(items) {}
+
+    virtual ~Benchmark() {}
+
+    const std::string& name() const {
+        return name_;
+    }
+
+    uint64_t items() const {
+        return items_;
+    }
+
+    virtual void set_up() {}
+    virtual void prepare() {}
+    virtual void run() = 0;
+    virtual void clean_up() {}
+    virtual void tear_down() {}
+
+private:
+    std::string name_;
+    uint64_t items_ = 0;
+};
+
+typedef std::shared_ptr<Benchmark> BenchmarkPtr;
+
+/* For benchmarks which don't need any per-iteration preparation */
+class FunctionBenchmark : public Benchmark {
+public:
+    FunctionBenchmark(const std::string& name, std::function<void ()> func, uint64_t items=0):
+        Benchmark(name, items),
+        func_(func) {}
+
+    void run() override {
+        func_();
+    }
+
+private:
+    std::function<void ()> func_;
+};
+
+struct BenchmarkOptions {
+    uint32_t warmup_iterations = 3;
+    uint32_t iterations = 25;
+
+    /* Only benchmarks with this in their name are run */
+    std::string filter;
+};
+
+/* All times are in microseconds */
+struct BenchmarkResult {
+    std::string name;
+    uint32_t iterations = 0;
+    uint64_t items = 0;
+
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double stddev = 0;
+    double median = 0;
+    double p90 = 0;
+    double p99 = 0;
+
+    /* Items per second, based on the median */
+    double items_per_second() const {
+        return (median > 0) ? double(items) * 1000000.0 / median : 0;
+    }
+};
+
+/* Returns the result for the given per-iteration timings */
+BenchmarkResult summarise(const std::string& name, uint64_t items, std::vector<double> samples);
+
+class BenchmarkRunner {
+public:
+    void add(BenchmarkPtr benchmark);
+    void add(const std::string& name, std::function<void ()> func, uint64_t items=0);
+
+    const std::vector<BenchmarkPtr>& benchmarks() const {
+        return benchmarks_;
+    }
+
+    /* Runs the benchmarks matching the filter, printing a line for each */
+    std::vector<BenchmarkResult> run(const BenchmarkOptions& options);
+
+private:
+    std::vector<BenchmarkPtr> benchmarks_;
+};
+
+/* Writes the results as a JSON document. label is stored alongside the
+ * results to identify the run (e.g. a commit hash). */
+bool write_json(const std::string& path, const std::string& label, const std::vector<BenchmarkResult>& results);
+
+/* Reads the results written by write_json() */
+std::vector<BenchmarkResult> read_json(const std::string& path);
+
+/* Prints the change in the median time of each benchmark, compared
+ * with the baseline results */
+void print_comparison(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& results);
+
+}
+}
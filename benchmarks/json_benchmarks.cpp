@@ -0,0 +1,75 @@
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include "simulant/utils/json.h"
+
+#include "benchmarks.h"
+
+namespace smlt {
+namespace benchmark {
+
+static const std::size_t JSON_OBJECT_COUNT = 500;
+
+/* Something shaped like a scene or particle script file, an array of
+ * small objects with nested arrays and objects */
+static std::string build_document() {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> value(-100.0f, 100.0f);
+
+    std::stringstream ss;
+    ss << "{\"name\": \"benchmark\", \"nodes\": [";
+    for(std::size_t i = 0; i < JSON_OBJECT_COUNT; ++i) {
+        ss << ((i) ? "," : "") << "\n    {";
+        ss << "\"name\": \"node_" << i << "\", ";
+        ss << "\"visible\": " << ((i % 2) ? "true" : "false") << ", ";
+        ss << "\"position\": [" << value(rng) << ", " << value(rng) << ", " << value(rng) << "], ";
+        ss << "\"material\": {\"colour\": [1.0, 0.5, 0.25, 1.0], \"texture\": null}";
+        ss << "}";
+    }
+    ss << "\n]}";
+    return ss.str();
+}
+
+/* Parses the document and reads back every value */
+class JSONRead : public Benchmark {
+public:
+    JSONRead():
+        Benchmark("json/read", JSON_OBJECT_COUNT) {}
+
+    void set_up() override {
+        document_ = build_document();
+    }
+
+    void run() override {
+        auto stream = std::make_shared<std::istringstream>(document_);
+        auto json = json_read(stream);
+
+        auto nodes = json["nodes"];
+        for(std::size_t i = 0; i < nodes->size(); ++i) {
+            auto node = nodes[i];
+
+            total_ += node["name"]->to_str().value_or("").size();
+            total_ += node["visible"]->to_bool().value_or(false) ? 1 : 0;
+
+            auto position = node["position"];
+            for(std::size_t j = 0; j < position->size(); ++j) {
+                total_ += double(position[j]->to_float().value_or(0));
+            }
+
+            auto colour = node["material"]["colour"];
+            total_ += double(colour[0]->to_float().value_or(0));
+        }
+    }
+
+private:
+    std::string document_;
+    double total_ = 0;
+};
+
+void register_json_benchmarks(BenchmarkRunner& runner) {
+    runner.add(std::make_shared<JSONRead>());
+}
+
+}
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+/*
+ * The std::map based SpatialHash which was replaced by the flat grid in
+ * simulant/partitioners/impl/spatial_hash.h. It's kept here (header-only,
+ * and only built with the benchmarks) as the baseline for the spatial_hash
+ * benchmarks.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <unordered_set>
+#include <algorithm>
+#include <iterator>
+
+#include "simulant/types.h"
+#include "simulant/frustum.h"
+
+namespace smlt {
+namespace legacy {
+
+const uint32_t MAX_GRID_LEVELS = 16;
+
+struct Hash {
+    Hash() = default;
+    Hash(int16_t x, int16_t y, int16_t z):
+        x(x), y(y), z(z) {}
+
+    int16_t x = 0;
+    int16_t y = 0;
+    int16_t z = 0;
+};
+
+struct Key {
+    Hash hash_path[MAX_GRID_LEVELS];
+    std::size_t ancestors = 0;
+    std::size_t hash_code = 0;
+
+    bool operator<(const Key& other) const {
+        auto len = std::min(other.ancestors, ancestors) + 1;
+        auto ret = memcmp(hash_path, other.hash_path, sizeof(Hash) * len);
+        return ret < 0 || (ret == 0 && ancestors < other.ancestors);
+    }
+
+    bool operator==(const Key& other) const {
+        return (
+            ancestors == other.ancestors &&
+            memcmp(hash_path, other.hash_path, sizeof(Hash) * (ancestors + 1)) == 0
+        );
+    }
+
+    bool is_root() const { return ancestors == 0; }
+
+    Key parent_key() const {
+        Key ret;
+        memcpy(ret.hash_path, hash_path, sizeof(Hash) * ancestors);
+        ret.ancestors = ancestors - 1;
+        return ret;
+    }
+
+    bool is_ancestor_of(const Key& other) const {
+        if(ancestors > other.ancestors) return false;
+        return memcmp(hash_path, other.hash_path, sizeof(Hash) * (ancestors + 1)) == 0;
+    }
+};
+
+struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+        return key.hash_code;
+    }
+};
+
+inline Hash make_hash(int32_t cell_size, float x, float y, float z) {
+    Hash hash;
+    hash.x = int16_t(std::floor(x / cell_size));
+    hash.y = int16_t(std::floor(y / cell_size));
+    hash.z = int16_t(std::floor(z / cell_size));
+    return hash;
+}
+
+inline Key make_key(int32_t cell_size, float x, float y, float z) {
+    static const int32_t MAX_PATH_SIZE = pow(2, MAX_GRID_LEVELS - 1);
+
+    Key key;
+    key.ancestors = 15 - (int(::log2(cell_size)));
+
+    int32_t size = MAX_PATH_SIZE;
+    for(uint32_t i = 0; i < MAX_GRID_LEVELS; ++i) {
+        key.hash_path[i] = (i == 0 || key.ancestors > i - 1) ? make_hash(size, x, y, z) : Hash();
+        size /= 2;
+    }
+
+    key.hash_code = 0;
+    for(uint8_t i = 0; i < MAX_GRID_LEVELS; ++i) {
+        std::hash_combine(key.hash_code, key.hash_path[i].x);
+        std::hash_combine(key.hash_code, key.hash_path[i].y);
+        std::hash_combine(key.hash_code, key.hash_path[i].z);
+    }
+
+    return key;
+}
+
+typedef std::unordered_set<Key, KeyHash> KeyList;
+
+class SpatialHashEntry {
+public:
+    virtual ~SpatialHashEntry() {}
+
+    void set_hash_aabb(const AABB& aabb) { hash_aabb_ = aabb; }
+    const AABB& hash_aabb() const { return hash_aabb_; }
+
+    void push_key(const Key& key) { keys_.insert(key); }
+    void set_keys(const KeyList& keys) { keys_ = keys; }
+    const KeyList& keys() const { return keys_; }
+
+private:
+    KeyList keys_;
+    AABB hash_aabb_;
+};
+
+typedef std::unordered_set<SpatialHashEntry*> HGSHEntryList;
+
+class SpatialHash {
+public:
+    void insert_object_for_box(const AABB& box, SpatialHashEntry* object) {
+        auto cell_size = find_cell_size_for_box(box);
+
+        object->set_hash_aabb(box);
+        for(auto& corner: box.corners()) {
+            insert_object_for_key(make_key(cell_size, corner.x, corner.y, corner.z), object);
+        }
+    }
+
+    void remove_object(SpatialHashEntry* object) {
+        for(auto key: object->keys()) {
+            erase_object_from_key(key, object);
+        }
+        object->set_keys(KeyList());
+    }
+
+    void update_object_for_box(const AABB& new_box, SpatialHashEntry* object) {
+        auto cell_size = find_cell_size_for_box(new_box);
+
+        KeyList new_keys;
+        const KeyList& old_keys = object->keys();
+
+        for(auto& corner: new_box.corners()) {
+            new_keys.insert(make_key(cell_size, corner.x, corner.y, corner.z));
+        }
+
+        KeyList keys_to_add, keys_to_remove;
+
+        std::set_difference(
+            new_keys.begin(), new_keys.end(), old_keys.begin(), old_keys.end(),
+            std::inserter(keys_to_add, keys_to_add.end())
+        );
+
+        std::set_difference(
+            old_keys.begin(), old_keys.end(), new_keys.begin(), new_keys.end(),
+            std::inserter(keys_to_remove, keys_to_remove.end())
+        );
+
+        for(auto& key: keys_to_remove) {
+            erase_object_from_key(key, object);
+        }
+
+        for(auto& key: keys_to_add) {
+            insert_object_for_key(key, object);
+        }
+
+        object->set_hash_aabb(new_box);
+        object->set_keys(new_keys);
+    }
+
+    HGSHEntryList find_objects_within_box(const AABB& box) {
+        HGSHEntryList objects;
+
+        auto cell_size = find_cell_size_for_box(box);
+
+        KeyList seen;
+        for(auto& corner: box.corners()) {
+            seen.insert(make_key(cell_size, corner.x, corner.y, corner.z));
+        }
+
+        for(auto& key: seen) {
+            auto it = index_.lower_bound(key);
+            while(it != index_.end() && key.is_ancestor_of(it->first)) {
+                objects.insert(it->second.begin(), it->second.end());
+                ++it;
+            }
+
+            auto path = key;
+            while(!path.is_root()) {
+                path = path.parent_key();
+                it = index_.find(path);
+                if(it != index_.end() && path.is_ancestor_of(it->first)) {
+                    objects.insert(it->second.begin(), it->second.end());
+                }
+            }
+        }
+
+        return objects;
+    }
+
+    HGSHEntryList find_objects_within_frustum(const Frustum& frustum) {
+        auto corners = frustum.near_corners();
+        auto far_corners = frustum.far_corners();
+        corners.insert(corners.end(), far_corners.begin(), far_corners.end());
+
+        HGSHEntryList results;
+        for(auto& result: find_objects_within_box(AABB(corners.data(), corners.size()))) {
+            if(frustum.intersects_aabb(result->hash_aabb())) {
+                results.insert(result);
+            }
+        }
+
+        return results;
+    }
+
+private:
+    void erase_object_from_key(Key key, SpatialHashEntry* object) {
+        auto it = index_.find(key);
+        if(it != index_.end()) {
+            it->second.erase(object);
+            if(it->second.empty()) {
+                index_.erase(it);
+            }
+        }
+    }
+
+    int32_t find_cell_size_for_box(const AABB& box) const {
+        auto maxd = box.max_dimension();
+        if(maxd < 1.0f) {
+            return 1;
+        } else {
+            return 1 << uint32_t(std::ceil(::log2(maxd)));
+        }
+    }
+
+    void insert_object_for_key(Key key, SpatialHashEntry* entry) {
+        index_[key].insert(entry);
+        entry->push_key(key);
+    }
+
+    typedef std::map<Key, std::unordered_set<SpatialHashEntry*>> Index;
+    Index index_;
+};
+
+}
+}
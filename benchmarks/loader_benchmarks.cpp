@@ -0,0 +1,63 @@
+#include "simulant/simulant.h"
+
+#include "benchmarks.h"
+
+namespace smlt {
+namespace benchmark {
+
+/* Loads a mesh from the sample data. The mesh (and anything it loaded,
+ * like textures) is released between iterations so each load is cold
+ * as far as the asset manager is concerned. */
+class MeshLoadBenchmark : public Benchmark {
+public:
+    MeshLoadBenchmark(const std::string& name, Stage* stage, const Path& path):
+        Benchmark(name),
+        stage_(stage),
+        path_(path) {}
+
+    void run() override {
+        mesh_ = load();
+    }
+
+    void clean_up() override {
+        if(mesh_) {
+            stage_->assets->destroy_mesh(mesh_->id());
+            mesh_.reset();
+        }
+
+        stage_->assets->run_garbage_collection();
+    }
+
+protected:
+    virtual MeshPtr load() {
+        return stage_->assets->new_mesh_from_file(path_);
+    }
+
+    Stage* stage_;
+    Path path_;
+
+private:
+    MeshPtr mesh_;
+};
+
+class HeightmapLoadBenchmark : public MeshLoadBenchmark {
+public:
+    HeightmapLoadBenchmark(Stage* stage):
+        MeshLoadBenchmark("loaders/heightmap", stage, "terrain.png") {}
+
+private:
+    MeshPtr load() override {
+        return stage_->assets->new_mesh_from_heightmap(path_, HeightmapSpecification());
+    }
+};
+
+void register_loader_benchmarks(BenchmarkRunner& runner, Stage* stage) {
+    runner.add(std::make_shared<MeshLoadBenchmark>("loaders/obj", stage, "tank.obj"));
+    runner.add(std::make_shared<MeshLoadBenchmark>("loaders/ms3d", stage, "fellguard/fellguard_animated-ms3d.ms3d"));
+    runner.add(std::make_shared<MeshLoadBenchmark>("loaders/md2", stage, "ogro.md2"));
+    runner.add(std::make_shared<MeshLoadBenchmark>("loaders/q2bsp", stage, "quake2/maps/demo1.bsp"));
+    runner.add(std::make_shared<HeightmapLoadBenchmark>(stage));
+}
+
+}
+}
@@ -0,0 +1,122 @@
+/*
+ * simulant_benchmarks
+ *
+ * Runs the engine microbenchmarks. Nothing is rendered, the window is
+ * only there because the asset managers and stages need an application.
+ *
+ *  --filter render_queue    Only run benchmarks with this in their name
+ *  --iterations 50          Timed iterations per benchmark
+ *  --warmup 5               Untimed iterations per benchmark
+ *  --json results.json      Write the results to a file
+ *  --label abc123           Stored in the JSON (e.g. the commit hash)
+ *  --compare results.json   Compare with previously written results
+ *  --list                   List the benchmarks and exit
+ */
+
+#include <cstdio>
+
+#include "simulant/simulant.h"
+#include "benchmarks.h"
+
+using namespace smlt;
+using namespace smlt::benchmark;
+
+class BenchmarkScene : public Scene<BenchmarkScene> {
+public:
+    BenchmarkScene(Window* window):
+        Scene<BenchmarkScene>(window) {}
+
+    void load() override {
+        stage_ = new_stage(PARTITIONER_NULL);
+    }
+
+    void activate() override {
+        BenchmarkRunner runner;
+        register_container_benchmarks(runner);
+        register_vertex_data_benchmarks(runner);
+        register_spatial_hash_benchmarks(runner);
+        register_render_queue_benchmarks(runner, stage_);
+        register_particle_benchmarks(runner, stage_);
+        register_json_benchmarks(runner);
+        register_loader_benchmarks(runner, stage_);
+
+        auto args = app->args.get();
+        if(args->arg_value<bool>("list", false).value()) {
+            for(auto& benchmark: runner.benchmarks()) {
+                printf("%s\n", benchmark->name().c_str());
+            }
+
+            app->stop_running();
+            return;
+        }
+
+        BenchmarkOptions options;
+        options.filter = args->arg_value<std::string>("filter", "").value();
+        options.iterations = args->arg_value<int>("iterations", options.iterations).value();
+        options.warmup_iterations = args->arg_value<int>("warmup", options.warmup_iterations).value();
+
+        auto results = runner.run(options);
+
+        auto json = args->arg_value<std::string>("json", "").value();
+        if(!json.empty() && !write_json(json, args->arg_value<std::string>("label", "").value(), results)) {
+            S_ERROR("Unable to write benchmark results to {0}", json);
+        }
+
+        auto compare = args->arg_value<std::string>("compare", "").value();
+        if(!compare.empty()) {
+            auto baseline = read_json(compare);
+            if(baseline.empty()) {
+                S_ERROR("Unable to read benchmark results from {0}", compare);
+            } else {
+                print_comparison(baseline, results);
+            }
+        }
+
+        app->stop_running();
+    }
+
+private:
+    StagePtr stage_;
+};
+
+class BenchmarkApp : public Application {
+public:
+    BenchmarkApp(const AppConfig& config):
+        Application(config) {
+
+        args->define_arg("--filter", ARG_TYPE_STRING, "only run benchmarks containing this string");
+        args->define_arg("--iterations", ARG_TYPE_INTEGER, "timed iterations per benchmark");
+        args->define_arg("--warmup", ARG_TYPE_INTEGER, "untimed warmup iterations per benchmark");
+        args->define_arg("--json", ARG_TYPE_STRING, "write the results to this JSON file");
+        args->define_arg("--label", ARG_TYPE_STRING, "a label to store with the JSON results");
+        args->define_arg("--compare", ARG_TYPE_STRING, "compare with results from a previous --json run");
+        args->define_arg("--list", ARG_TYPE_BOOLEAN, "list the benchmarks");
+    }
+
+private:
+    bool init() override {
+        scenes->register_scene<BenchmarkScene>("main");
+        return true;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    AppConfig config;
+    config.title = "Simulant Benchmarks";
+    config.width = 640;
+    config.height = 480;
+    config.fullscreen = false;
+    config.log_level = LOG_LEVEL_WARN;
+
+    /* Nothing is drawn, so run headless: the null renderer doesn't need a
+     * GL context or a display, which lets the benchmarks run on CI.
+     * SIMULANT_RENDERER and SIMULANT_SOUND_DRIVER still override these */
+    config.development.force_renderer = "null";
+    config.development.force_sound_driver = "null";
+
+    config.search_paths.push_back("assets");
+    config.search_paths.push_back("sample_data");
+
+    BenchmarkApp app(config);
+    return app.run(argc, argv);
+}
@@ -0,0 +1,93 @@
+#include "simulant/simulant.h"
+#include "simulant/renderers/batching/render_queue.h"
+
+#include "benchmarks.h"
+
+namespace smlt {
+namespace benchmark {
+
+/* A system that's kept full, so each update integrates (and emits
+ * to replace) a steady number of particles */
+class ParticleSystemBenchmark : public Benchmark {
+public:
+    ParticleSystemBenchmark(const std::string& name, Stage* stage, std::size_t particle_count):
+        Benchmark(name, particle_count),
+        stage_(stage),
+        particle_count_(particle_count) {}
+
+    void set_up() override {
+        script_ = stage_->assets->new_particle_script_from_file(
+            ParticleScript::BuiltIns::FIRE
+        );
+
+        script_->set_quota(particle_count_);
+        for(auto i = 0u; i < script_->emitter_count(); ++i) {
+            auto emitter = script_->mutable_emitter(i);
+            emitter->emission_rate = particle_count_ * 60.0f;
+            emitter->duration_range = std::make_pair(0.0f, 0.0f);
+        }
+
+        system_ = stage_->new_particle_system(script_);
+
+        /* Fill the system up */
+        system_->update(1.0f / 60.0f);
+        camera_ = stage_->new_camera();
+    }
+
+    void tear_down() override {
+        system_->destroy();
+        camera_->destroy();
+        stage_->assets->destroy_particle_script(script_->id());
+    }
+
+protected:
+    Stage* stage_;
+    std::size_t particle_count_;
+
+    ParticleScriptPtr script_;
+    ParticleSystemPtr system_;
+    CameraPtr camera_;
+};
+
+class ParticleSystemUpdate : public ParticleSystemBenchmark {
+public:
+    ParticleSystemUpdate(const std::string& name, Stage* stage, std::size_t particle_count):
+        ParticleSystemBenchmark(name, stage, particle_count) {}
+
+    void run() override {
+        system_->update(1.0f / 60.0f);
+    }
+};
+
+/* Gathering the renderable expands the billboards for the camera */
+class ParticleSystemRenderables : public ParticleSystemBenchmark {
+public:
+    ParticleSystemRenderables(const std::string& name, Stage* stage, std::size_t particle_count):
+        ParticleSystemBenchmark(name, stage, particle_count) {}
+
+    void prepare() override {
+        queue_.reset(stage_, get_app()->window->renderer.get(), camera_);
+    }
+
+    void run() override {
+        system_->_get_renderables(&queue_, camera_, DETAIL_LEVEL_NEAREST);
+    }
+
+    void tear_down() override {
+        queue_.clear();
+        ParticleSystemBenchmark::tear_down();
+    }
+
+private:
+    batcher::RenderQueue queue_;
+};
+
+void register_particle_benchmarks(BenchmarkRunner& runner, Stage* stage) {
+    /* Below and above the size where updates are split across threads */
+    runner.add(std::make_shared<ParticleSystemUpdate>("particle_system/update_1k", stage, 1000));
+    runner.add(std::make_shared<ParticleSystemUpdate>("particle_system/update_20k", stage, 20000));
+    runner.add(std::make_shared<ParticleSystemRenderables>("particle_system/billboards_20k", stage, 20000));
+}
+
+}
+}
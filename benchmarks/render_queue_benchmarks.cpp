@@ -0,0 +1,169 @@
+#include <random>
+
+#include "simulant/simulant.h"
+#include "simulant/renderers/batching/render_queue.h"
+
+#include "benchmarks.h"
+
+namespace smlt {
+namespace benchmark {
+
+static const std::size_t RENDERABLE_COUNT = 10000;
+static const std::size_t MATERIAL_COUNT = 16;
+
+/* Records each call, so that traversal isn't optimised away and the
+ * cost of the visitor itself stays small and constant */
+class RecordingVisitor : public batcher::RenderQueueVisitor {
+public:
+    void start_traversal(const batcher::RenderQueue&, uint64_t, Stage*) override {
+        visited.clear();
+        group_changes = 0;
+        pass_changes = 0;
+    }
+
+    void change_render_group(const batcher::RenderGroup*, const batcher::RenderGroup*) override {
+        ++group_changes;
+    }
+
+    void change_material_pass(const MaterialPass*, const MaterialPass*) override {
+        ++pass_changes;
+    }
+
+    void apply_lights(const LightPtr*, const uint8_t) override {}
+
+    void visit(const Renderable* renderable, const MaterialPass*, batcher::Iteration) override {
+        visited.push_back(renderable);
+    }
+
+    void end_traversal(const batcher::RenderQueue&, Stage*) override {}
+
+    std::vector<const Renderable*> visited;
+    uint32_t group_changes = 0;
+    uint32_t pass_changes = 0;
+};
+
+class RenderQueueBenchmark : public Benchmark {
+public:
+    RenderQueueBenchmark(const std::string& name, Stage* stage):
+        Benchmark(name, RENDERABLE_COUNT),
+        stage_(stage) {}
+
+    void set_up() override {
+        camera_ = stage_->new_camera();
+
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+        std::uniform_int_distribution<int> material(0, MATERIAL_COUNT - 1);
+
+        for(std::size_t i = 0; i < MATERIAL_COUNT; ++i) {
+            auto mat = stage_->assets->new_material();
+
+            /* A quarter of the materials are blended, so both the
+             * front-to-back and back-to-front paths are measured */
+            if(i % 4 == 0) {
+                mat->pass(0)->set_blend_func(BLEND_ALPHA);
+            }
+
+            materials_.push_back(mat);
+        }
+
+        for(std::size_t i = 0; i < RENDERABLE_COUNT; ++i) {
+            Renderable renderable;
+            renderable.material = materials_[material(rng)].get();
+            renderable.vertex_range_count = 1;
+            renderable.render_priority = RENDER_PRIORITY_MAIN;
+            renderable.centre = Vec3(position(rng), position(rng), position(rng));
+            renderables_.push_back(renderable);
+        }
+
+        visitor_.visited.reserve(RENDERABLE_COUNT);
+    }
+
+    void tear_down() override {
+        queue_.clear();
+        renderables_.clear();
+
+        for(auto& mat: materials_) {
+            stage_->assets->destroy_material(mat->id());
+        }
+
+        materials_.clear();
+        camera_->destroy();
+    }
+
+protected:
+    void fill_queue() {
+        queue_.reset(stage_, get_app()->window->renderer.get(), camera_);
+
+        for(auto& renderable: renderables_) {
+            auto copy = renderable;
+            queue_.insert_renderable(std::move(copy));
+        }
+    }
+
+    Stage* stage_;
+    CameraPtr camera_;
+    std::vector<MaterialPtr> materials_;
+    std::vector<Renderable> renderables_;
+
+    batcher::RenderQueue queue_;
+    RecordingVisitor visitor_;
+};
+
+class RenderQueueInsert : public RenderQueueBenchmark {
+public:
+    RenderQueueInsert(Stage* stage):
+        RenderQueueBenchmark("render_queue/insert", stage) {}
+
+    void prepare() override {
+        queue_.reset(stage_, get_app()->window->renderer.get(), camera_);
+    }
+
+    void run() override {
+        for(auto& renderable: renderables_) {
+            auto copy = renderable;
+            queue_.insert_renderable(std::move(copy));
+        }
+    }
+};
+
+class RenderQueueSort : public RenderQueueBenchmark {
+public:
+    RenderQueueSort(Stage* stage):
+        RenderQueueBenchmark("render_queue/sort", stage) {}
+
+    void prepare() override {
+        fill_queue();
+    }
+
+    void run() override {
+        queue_.sort();
+    }
+};
+
+class RenderQueueTraverse : public RenderQueueBenchmark {
+public:
+    RenderQueueTraverse(Stage* stage):
+        RenderQueueBenchmark("render_queue/traverse", stage) {}
+
+    void prepare() override {
+        fill_queue();
+        queue_.sort();
+    }
+
+    void run() override {
+        queue_.traverse(&visitor_, frame_id_++);
+    }
+
+private:
+    uint64_t frame_id_ = 0;
+};
+
+void register_render_queue_benchmarks(BenchmarkRunner& runner, Stage* stage) {
+    runner.add(std::make_shared<RenderQueueInsert>(stage));
+    runner.add(std::make_shared<RenderQueueSort>(stage));
+    runner.add(std::make_shared<RenderQueueTraverse>(stage));
+}
+
+}
+}
@@ -0,0 +1,170 @@
+#include <memory>
+#include <random>
+
+#include "simulant/partitioners/impl/spatial_hash.h"
+#include "simulant/frustum.h"
+
+#include "benchmarks.h"
+#include "legacy_spatial_hash.h"
+
+namespace smlt {
+namespace benchmark {
+
+static const std::size_t OBJECT_COUNT = 5000;
+static const std::size_t FRAME_COUNT = 16;
+static const float WORLD_SIZE = 1000.0f;
+
+/* A few thousand small objects scattered through the world, moving a
+ * little each frame (like actors walking around) and culled against a
+ * camera spinning around the middle of the world.
+ *
+ * Each benchmark runs against the flat SpatialHash, and the std::map
+ * based one it replaced (under spatial_hash/legacy/) for comparison. */
+template<typename HashType, typename EntryType>
+class SpatialHashBenchmark : public Benchmark {
+public:
+    SpatialHashBenchmark(const std::string& name):
+        Benchmark(name, OBJECT_COUNT) {}
+
+    void set_up() override {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> position(-WORLD_SIZE * 0.5f, WORLD_SIZE * 0.5f);
+        std::uniform_real_distribution<float> size(0.25f, 4.0f);
+        std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+
+        std::vector<Vec3> positions;
+        std::vector<float> sizes;
+        for(std::size_t i = 0; i < OBJECT_COUNT; ++i) {
+            positions.push_back(Vec3(position(rng), position(rng) * 0.1f, position(rng)));
+            sizes.push_back(size(rng));
+            initial_.push_back(AABB(positions.back(), sizes.back()));
+        }
+
+        Mat4 projection = Mat4::as_projection(Degrees(45.0f), 16.0f / 9.0f, 0.1f, 250.0f);
+
+        for(std::size_t f = 0; f < FRAME_COUNT; ++f) {
+            for(std::size_t i = 0; i < OBJECT_COUNT; ++i) {
+                positions[i] += Vec3(step(rng), 0, step(rng));
+                moves_.push_back(AABB(positions[i], sizes[i]));
+            }
+
+            Mat4 view = Mat4::as_rotation_y(Degrees(f * (360.0f / FRAME_COUNT)));
+            Mat4 mvp = projection * view;
+
+            Frustum frustum;
+            frustum.build(&mvp);
+            frustums_.push_back(frustum);
+        }
+    }
+
+    void tear_down() override {
+        hash_.reset();
+        entries_.clear();
+        initial_.clear();
+        moves_.clear();
+        frustums_.clear();
+    }
+
+protected:
+    /* Entries remember which hash they were inserted into, so
+     * every new hash needs new entries */
+    void reset_hash() {
+        hash_.reset(new HashType());
+        entries_.clear();
+        entries_.resize(OBJECT_COUNT);
+    }
+
+    void fill_hash() {
+        reset_hash();
+        for(std::size_t i = 0; i < OBJECT_COUNT; ++i) {
+            hash_->insert_object_for_box(initial_[i], &entries_[i]);
+        }
+    }
+
+    std::unique_ptr<HashType> hash_;
+    std::vector<EntryType> entries_;
+
+    std::vector<AABB> initial_;
+
+    /* One box per object, per frame */
+    std::vector<AABB> moves_;
+    std::vector<Frustum> frustums_;
+
+    std::size_t frame_ = 0;
+};
+
+template<typename HashType, typename EntryType>
+class SpatialHashInsert : public SpatialHashBenchmark<HashType, EntryType> {
+public:
+    SpatialHashInsert(const std::string& prefix):
+        SpatialHashBenchmark<HashType, EntryType>(prefix + "/insert") {}
+
+    void prepare() override {
+        this->reset_hash();
+    }
+
+    void run() override {
+        for(std::size_t i = 0; i < OBJECT_COUNT; ++i) {
+            this->hash_->insert_object_for_box(this->initial_[i], &this->entries_[i]);
+        }
+    }
+
+    void clean_up() override {
+        this->hash_.reset();
+    }
+};
+
+template<typename HashType, typename EntryType>
+class SpatialHashUpdate : public SpatialHashBenchmark<HashType, EntryType> {
+public:
+    SpatialHashUpdate(const std::string& prefix):
+        SpatialHashBenchmark<HashType, EntryType>(prefix + "/update") {}
+
+    void set_up() override {
+        SpatialHashBenchmark<HashType, EntryType>::set_up();
+        this->fill_hash();
+    }
+
+    void run() override {
+        auto moves = &this->moves_[(this->frame_++ % FRAME_COUNT) * OBJECT_COUNT];
+        for(std::size_t i = 0; i < OBJECT_COUNT; ++i) {
+            this->hash_->update_object_for_box(moves[i], &this->entries_[i]);
+        }
+    }
+};
+
+template<typename HashType, typename EntryType>
+class SpatialHashFrustumQuery : public SpatialHashBenchmark<HashType, EntryType> {
+public:
+    SpatialHashFrustumQuery(const std::string& prefix):
+        SpatialHashBenchmark<HashType, EntryType>(prefix + "/frustum_query") {}
+
+    void set_up() override {
+        SpatialHashBenchmark<HashType, EntryType>::set_up();
+        this->fill_hash();
+    }
+
+    void run() override {
+        visible_ += this->hash_->find_objects_within_frustum(
+            this->frustums_[this->frame_++ % FRAME_COUNT]
+        ).size();
+    }
+
+private:
+    std::size_t visible_ = 0;
+};
+
+template<typename HashType, typename EntryType>
+static void add_spatial_hash_benchmarks(BenchmarkRunner& runner, const std::string& prefix) {
+    runner.add(std::make_shared<SpatialHashInsert<HashType, EntryType>>(prefix));
+    runner.add(std::make_shared<SpatialHashUpdate<HashType, EntryType>>(prefix));
+    runner.add(std::make_shared<SpatialHashFrustumQuery<HashType, EntryType>>(prefix));
+}
+
+void register_spatial_hash_benchmarks(BenchmarkRunner& runner) {
+    add_spatial_hash_benchmarks<SpatialHash, SpatialHashEntry>(runner, "spatial_hash");
+    add_spatial_hash_benchmarks<legacy::SpatialHash, legacy::SpatialHashEntry>(runner, "spatial_hash/legacy");
+}
+
+}
+}
@@ -0,0 +1,119 @@
+#include "simulant/vertex_data.h"
+
+#include "benchmarks.h"
+
+namespace smlt {
+namespace benchmark {
+
+static const uint32_t VERTEX_COUNT = 10000;
+
+/* Writes a mesh worth of vertices through the cursor API, the
+ * way the procedural mesh generators and loaders do */
+class VertexDataWrite : public Benchmark {
+public:
+    VertexDataWrite():
+        Benchmark("vertex_data/write", VERTEX_COUNT) {}
+
+    void set_up() override {
+        vertex_data_.reset(new VertexData(VertexSpecification::DEFAULT));
+    }
+
+    void prepare() override {
+        vertex_data_->clear();
+    }
+
+    void run() override {
+        for(uint32_t i = 0; i < VERTEX_COUNT; ++i) {
+            float f = float(i);
+            vertex_data_->position(f, f * 0.5f, -f);
+            vertex_data_->normal(0, 1, 0);
+            vertex_data_->tex_coord0(f * 0.01f, f * 0.02f);
+            vertex_data_->diffuse(Colour::WHITE);
+            vertex_data_->move_next();
+        }
+
+        vertex_data_->done();
+    }
+
+    void tear_down() override {
+        vertex_data_.reset();
+    }
+
+private:
+    std::unique_ptr<VertexData> vertex_data_;
+};
+
+/* The same again, but overwriting existing vertices rather
+ * than appending */
+class VertexDataOverwrite : public Benchmark {
+public:
+    VertexDataOverwrite():
+        Benchmark("vertex_data/overwrite", VERTEX_COUNT) {}
+
+    void set_up() override {
+        vertex_data_.reset(new VertexData(VertexSpecification::DEFAULT));
+        vertex_data_->resize(VERTEX_COUNT);
+    }
+
+    void prepare() override {
+        vertex_data_->move_to_start();
+    }
+
+    void run() override {
+        for(uint32_t i = 0; i < VERTEX_COUNT; ++i) {
+            float f = float(i);
+            vertex_data_->position(f, f * 0.5f, -f);
+            vertex_data_->normal(0, 1, 0);
+            vertex_data_->tex_coord0(f * 0.01f, f * 0.02f);
+            vertex_data_->diffuse(Colour::WHITE);
+            vertex_data_->move_next();
+        }
+
+        vertex_data_->done();
+    }
+
+    void tear_down() override {
+        vertex_data_.reset();
+    }
+
+private:
+    std::unique_ptr<VertexData> vertex_data_;
+};
+
+class VertexDataRead : public Benchmark {
+public:
+    VertexDataRead():
+        Benchmark("vertex_data/read_positions", VERTEX_COUNT) {}
+
+    void set_up() override {
+        vertex_data_.reset(new VertexData(VertexSpecification::DEFAULT));
+        for(uint32_t i = 0; i < VERTEX_COUNT; ++i) {
+            vertex_data_->position(float(i), 0, 0);
+            vertex_data_->move_next();
+        }
+        vertex_data_->done();
+    }
+
+    void run() override {
+        for(uint32_t i = 0; i < VERTEX_COUNT; ++i) {
+            total_ += vertex_data_->position_at<Vec3>(i)->x;
+        }
+    }
+
+    void tear_down() override {
+        vertex_data_.reset();
+    }
+
+private:
+    std::unique_ptr<VertexData> vertex_data_;
+    float total_ = 0;
+};
+
+void register_vertex_data_benchmarks(BenchmarkRunner& runner) {
+    runner.add(std::make_shared<VertexDataWrite>());
+    runner.add(std::make_shared<VertexDataOverwrite>());
+    runner.add(std::make_shared<VertexDataRead>());
+}
+
+}
+}
@@ -76,6 +76,7 @@ namespace smlt { typedef SDL2Window SysWindow; }
 #include "utils/json.h"
 #include "utils/string.h"
 #include "scenes/scene_manager.h"
+#include "threads/job_system.h"
 
 #define SIMULANT_PROFILE_KEY "SIMULANT_PROFILE"
 #define SIMULANT_SHOW_CURSOR_KEY "SIMULANT_SHOW_CURSOR"
@@ -112,9 +113,13 @@ Application::Application(const AppConfig &config):
     time_keeper_(TimeKeeper::create(1.0f / float(config.target_fixed_step_rate))),
     stats_(StatsRecorder::create()),
     vfs_(VirtualFileSystem::create()),
+    job_system_(std::make_shared<thread::JobSystem>(config.general.job_worker_count)),
     config_(config),
     node_pool_(new StageNodePool(config_.general.stage_node_pool_size)) {
 
+    /* Route thread::async and engine jobs through our worker pool */
+    thread::set_default_job_system(job_system_.get());
+
     args->define_arg("--help", ARG_TYPE_BOOLEAN, "display this help and exit");
 
     /* Set the global app instance
@@ -188,6 +193,9 @@ Application::~Application() {
     scene_manager_.reset();
     asset_manager_.reset();
 
+    /* Let any outstanding jobs finish before the node pool goes */
+    job_system_->shutdown();
+
     delete node_pool_;
 }
 
@@ -481,12 +489,18 @@ bool Application::run_frame() {
         if(window_->has_context()) {
 
             stats->reset_polygons_rendered();
+            stats->reset_draw_calls();
+            stats->reset_streaming();
+            stats->reset_render_state_changes();
             window_->compositor->run();
 
             signal_pre_swap_();
 
             window_->swap_buffers();
-            GLChecker::end_of_frame_check();
+
+            if(window_->renderer->requires_gl_context()) {
+                GLChecker::end_of_frame_check();
+            }
         }
     }
 
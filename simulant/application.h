@@ -53,6 +53,10 @@ class StatsRecorder;
 class VirtualFileSystem;
 class SoundDriver;
 
+namespace thread {
+class JobSystem;
+}
+
 class BackgroundLoadException : public std::runtime_error {
 public:
     BackgroundLoadException():
@@ -90,6 +94,15 @@ struct AppConfig {
 
     struct General {
         uint32_t stage_node_pool_size = 64;
+
+        /* Number of worker threads in the job system. If zero, this
+         * is derived from the number of available cores */
+        uint32_t job_worker_count = 0;
+
+        /* If not empty, linked GPU programs are saved to this directory
+         * and loaded from it on later runs, rather than compiling the
+         * shaders again. Ignored if the driver can't do this */
+        std::string gpu_program_cache_directory = "";
     } general;
 
     struct UI {
@@ -290,6 +303,7 @@ private:
     std::shared_ptr<StatsRecorder> stats_;
     std::shared_ptr<VirtualFileSystem> vfs_;
     std::shared_ptr<SoundDriver> sound_driver_;
+    std::shared_ptr<thread::JobSystem> job_system_;
 
     std::vector<LoaderTypePtr> loaders_;
 
@@ -359,6 +373,7 @@ public:
     S_DEFINE_PROPERTY(stats, &Application::stats_);
     S_DEFINE_PROPERTY(vfs, &Application::vfs_);
     S_DEFINE_PROPERTY(sound_driver, &Application::sound_driver_);
+    S_DEFINE_PROPERTY(jobs, &Application::job_system_);
 private:
     friend Application* get_app();
     static Application* global_app;
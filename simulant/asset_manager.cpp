@@ -27,6 +27,8 @@
 #include "application.h"
 #include "generic/lru_cache.h"
 #include "vfs.h"
+#include "window.h"
+#include "renderers/renderer.h"
 
 /** FIXME
  *
@@ -80,6 +82,54 @@ void AssetManager::update(float dt) {
     texture_manager_.each([dt](uint32_t, TexturePtr tex) {
         tex->update(dt);
     });
+
+    apply_decoded_textures();
+}
+
+/* Written by the decode job, only read once the job is complete */
+struct AssetManager::DecodedTexture {
+    TextureLoadResult result;
+    std::vector<Texture::Data> mipmaps;
+    bool failed = false;
+};
+
+void AssetManager::apply_decoded_textures() {
+    uint32_t applied = 0;
+
+    /* Textures are applied in the order they were requested, so a
+     * large one at the front holds up the rest until the next frame */
+    auto it = pending_textures_.begin();
+    while(it != pending_textures_.end()) {
+        if(!it->job->is_complete()) {
+            ++it;
+            continue;
+        }
+
+        auto decoded = it->decoded;
+        if(decoded->failed || !has_texture(it->id)) {
+            it = pending_textures_.erase(it);
+            continue;
+        }
+
+        uint32_t bytes = decoded->result.data.size();
+        for(auto& level: decoded->mipmaps) {
+            bytes += level.size();
+        }
+
+        if(applied && applied + bytes > texture_upload_budget_) {
+            break;
+        }
+
+        auto tex = texture_manager_.get(it->id);
+        tex->set_format(decoded->result.format);
+        tex->resize(decoded->result.width, decoded->result.height);
+        tex->set_data(decoded->result.data);
+        tex->_set_mipmap_data(std::move(decoded->mipmaps));
+        tex->_set_data_from_source(true);
+
+        applied += bytes;
+        it = pending_textures_.erase(it);
+    }
 }
 
 void SharedAssetManager::set_default_material_filename(const Path& filename) {
@@ -534,8 +584,11 @@ TexturePtr AssetManager::new_texture_from_file(const Path& path, TextureFlags fl
         if(flags.flip_vertically) {
             S_DEBUG("Flipping texture vertically");
             tex->flip_vertically();
+            tex->_set_source_flipped(true);
         }
 
+        tex->_set_data_from_source(true);
+
         tex->set_mipmap_generation(flags.mipmap);
         tex->set_texture_wrap(flags.wrap, flags.wrap, flags.wrap);
         tex->set_texture_filter(flags.filter);
@@ -546,6 +599,68 @@ TexturePtr AssetManager::new_texture_from_file(const Path& path, TextureFlags fl
     return tex;
 }
 
+TexturePtr AssetManager::new_texture_from_file_async(const Path& path, TextureFlags flags, GarbageCollectMethod garbage_collect) {
+    S_DEBUG("Loading texture asynchronously from file: {0}", path);
+
+    auto loader = std::dynamic_pointer_cast<loaders::BaseTextureLoader>(
+        get_app()->loader_for(path, LOADER_HINT_TEXTURE)
+    );
+
+    if(!loader) {
+        S_WARN("Couldn't find loader for texture");
+        return smlt::TexturePtr();
+    }
+
+    std::vector<uint8_t> grey(8 * 8 * 4, 128);
+    for(std::size_t i = 3; i < grey.size(); i += 4) {
+        grey[i] = 255;
+    }
+
+    smlt::TexturePtr tex = new_texture(8, 8, TEXTURE_FORMAT_RGBA_4UB_8888, garbage_collect);
+    tex->set_source(path);
+    tex->_set_source_flipped(flags.flip_vertically);
+    tex->set_data(grey);
+    tex->set_mipmap_generation(flags.mipmap);
+    tex->set_texture_wrap(flags.wrap, flags.wrap, flags.wrap);
+    tex->set_texture_filter(flags.filter);
+    tex->set_auto_upload(flags.auto_upload);
+
+    /* The job only touches the loader and its own result, the texture
+     * is updated on this thread by apply_decoded_textures() */
+    auto decoded = std::make_shared<DecodedTexture>();
+    auto renderer = get_app()->window->renderer.get();
+
+    PendingTexture pending;
+    pending.id = tex->id();
+    pending.decoded = decoded;
+    pending.job = get_app()->jobs->schedule([=]() {
+        try {
+            auto& result = decoded->result;
+            result = loader->load_data();
+
+            if(flags.flip_vertically) {
+                flip_texture_data_vertically(&result.data[0], result.width, result.height, result.format);
+            }
+
+            if(!renderer->convert_texture_data(result.format, result.data, result.width, result.height)) {
+                S_ERROR("Unable to convert texture {0} to a supported format", path);
+                decoded->failed = true;
+                return;
+            }
+
+            if(flags.mipmap == MIPMAP_GENERATE_COMPLETE) {
+                decoded->mipmaps = generate_mipmap_data(&result.data[0], result.width, result.height, result.format);
+            }
+        } catch(std::exception& e) {
+            S_ERROR("Unable to load texture {0}: {1}", path, e.what());
+            decoded->failed = true;
+        }
+    });
+
+    pending_textures_.push_back(pending);
+    return tex;
+}
+
 void AssetManager::destroy_texture(TextureID t) {
     texture_manager_.set_garbage_collection_method(t, GARBAGE_COLLECT_PERIODIC);
 }
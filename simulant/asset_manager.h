@@ -33,6 +33,7 @@
 #include "assets/particle_script.h"
 #include "path.h"
 #include "assets/binary_data.h"
+#include "threads/job_system.h"
 
 namespace smlt {
 
@@ -65,6 +66,9 @@ struct TextureFlags {
     bool auto_upload = true; // Should the texture be uploaded automatically?
 };
 
+/* The default for AssetManager::set_texture_upload_budget() */
+const uint32_t DEFAULT_TEXTURE_UPLOAD_BUDGET = 1024 * 1024 * 4;
+
 struct FontFlags {
     uint16_t size = 0;
     FontWeight weight = FONT_WEIGHT_NORMAL;
@@ -199,6 +203,30 @@ public:
     TexturePtr new_texture(uint16_t width, uint16_t height, TextureFormat format=TEXTURE_FORMAT_RGBA_4UB_8888, GarbageCollectMethod garbage_collect=GARBAGE_COLLECT_PERIODIC);
     TexturePtr new_texture_from_file(const Path& path, TextureFlags flags, GarbageCollectMethod garbage_collect=GARBAGE_COLLECT_PERIODIC);
 
+    /*
+     * Returns a grey placeholder texture straight away and decodes the file
+     * on a worker thread. The decoded data replaces the placeholder during a
+     * later update(). Returns a null pointer if there's no loader for the file.
+     */
+    TexturePtr new_texture_from_file_async(const Path& path, TextureFlags flags=TextureFlags(), GarbageCollectMethod garbage_collect=GARBAGE_COLLECT_PERIODIC);
+
+    /* The number of textures from new_texture_from_file_async() which
+     * haven't replaced their placeholder yet */
+    std::size_t pending_texture_count() const {
+        return pending_textures_.size();
+    }
+
+    /* The number of bytes of decoded texture data that update() will hand
+     * to textures each frame. At least one texture is always applied, so
+     * textures larger than the budget still load. */
+    void set_texture_upload_budget(uint32_t bytes) {
+        texture_upload_budget_ = bytes;
+    }
+
+    uint32_t texture_upload_budget() const {
+        return texture_upload_budget_;
+    }
+
     MaterialPtr new_material(GarbageCollectMethod garbage_collect=GARBAGE_COLLECT_PERIODIC);
 
     MeshPtr new_mesh(VertexSpecification vertex_specification, GarbageCollectMethod garbage_collect=GARBAGE_COLLECT_PERIODIC);
@@ -264,6 +292,19 @@ private:
 
     MaterialPtr get_template_material(const Path &path);
 
+    struct DecodedTexture;
+
+    struct PendingTexture {
+        TextureID id;
+        thread::JobHandle job;
+        std::shared_ptr<DecodedTexture> decoded;
+    };
+
+    std::vector<PendingTexture> pending_textures_;
+    uint32_t texture_upload_budget_ = DEFAULT_TEXTURE_UPLOAD_BUDGET;
+
+    void apply_decoded_textures();
+
     std::vector<AssetManager*> children_;
     void register_child(AssetManager* child) {
         children_.push_back(child);
@@ -100,6 +100,15 @@ MaterialPass *Material::pass(uint8_t pass) {
     return nullptr;
 }
 
+const MaterialPass* Material::pass(uint8_t pass) const {
+    if(pass < passes_.size()) {
+        return &passes_[pass];
+    }
+
+    assert(pass < passes_.size());
+    return nullptr;
+}
+
 void Material::update(float dt) {
     _S_UNUSED(dt);
 }
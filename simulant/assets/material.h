@@ -116,6 +116,7 @@ public:
     }
 
     MaterialPass* pass(uint8_t pass);
+    const MaterialPass* pass(uint8_t pass) const;
 
     void each(std::function<void (uint32_t, MaterialPass*)> callback) {
         for(std::size_t i = 0; i != passes_.size(); ++i) {
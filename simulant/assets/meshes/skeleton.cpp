@@ -1,4 +1,11 @@
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 #include <cstring>
+#include <algorithm>
 
 #include "skeleton.h"
 #include "rig.h"
@@ -84,6 +91,112 @@ void Joint::recalc_absolute_transformation() {
     }
 }
 
+namespace {
+
+/* A joint's transformation from its bind pose to its current pose, as the
+ * top three rows of a 4x4 matrix (the rotation, then the translation) */
+struct SkinningMatrix {
+    float m[12];
+};
+
+/* Vertices are skinned in batches. The blended matrices, positions and
+ * normals are split into streams so that the transform can work on
+ * several vertices at once */
+const std::size_t SKINNING_BATCH_SIZE = 64;
+
+struct SkinningBatch {
+    float m[12][SKINNING_BATCH_SIZE];
+    float p[3][SKINNING_BATCH_SIZE];
+    float n[3][SKINNING_BATCH_SIZE];
+};
+
+/* Transforms the positions by the full matrix, and the normals by
+ * the rotation, writing the results back over the inputs */
+void skin_batch(SkinningBatch& batch, std::size_t count) {
+    std::size_t i = 0;
+
+    auto m = batch.m;
+    auto p = batch.p;
+    auto n = batch.n;
+
+#if defined(__AVX__)
+    for(; i + 8 <= count; i += 8) {
+        __m256 r[12];
+        for(auto e = 0; e < 12; ++e) {
+            r[e] = _mm256_loadu_ps(m[e] + i);
+        }
+
+        __m256 x = _mm256_loadu_ps(p[0] + i);
+        __m256 y = _mm256_loadu_ps(p[1] + i);
+        __m256 z = _mm256_loadu_ps(p[2] + i);
+
+        for(auto row = 0; row < 3; ++row) {
+            const __m256* rm = r + (row * 4);
+            _mm256_storeu_ps(p[row] + i, _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(rm[0], x), _mm256_mul_ps(rm[1], y)),
+                _mm256_add_ps(_mm256_mul_ps(rm[2], z), rm[3])
+            ));
+        }
+
+        x = _mm256_loadu_ps(n[0] + i);
+        y = _mm256_loadu_ps(n[1] + i);
+        z = _mm256_loadu_ps(n[2] + i);
+
+        for(auto row = 0; row < 3; ++row) {
+            const __m256* rm = r + (row * 4);
+            _mm256_storeu_ps(n[row] + i, _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(rm[0], x), _mm256_mul_ps(rm[1], y)),
+                _mm256_mul_ps(rm[2], z)
+            ));
+        }
+    }
+#elif defined(__SSE__)
+    for(; i + 4 <= count; i += 4) {
+        __m128 r[12];
+        for(auto e = 0; e < 12; ++e) {
+            r[e] = _mm_loadu_ps(m[e] + i);
+        }
+
+        __m128 x = _mm_loadu_ps(p[0] + i);
+        __m128 y = _mm_loadu_ps(p[1] + i);
+        __m128 z = _mm_loadu_ps(p[2] + i);
+
+        for(auto row = 0; row < 3; ++row) {
+            const __m128* rm = r + (row * 4);
+            _mm_storeu_ps(p[row] + i, _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(rm[0], x), _mm_mul_ps(rm[1], y)),
+                _mm_add_ps(_mm_mul_ps(rm[2], z), rm[3])
+            ));
+        }
+
+        x = _mm_loadu_ps(n[0] + i);
+        y = _mm_loadu_ps(n[1] + i);
+        z = _mm_loadu_ps(n[2] + i);
+
+        for(auto row = 0; row < 3; ++row) {
+            const __m128* rm = r + (row * 4);
+            _mm_storeu_ps(n[row] + i, _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(rm[0], x), _mm_mul_ps(rm[1], y)),
+                _mm_mul_ps(rm[2], z)
+            ));
+        }
+    }
+#endif
+
+    for(; i < count; ++i) {
+        const float x = p[0][i], y = p[1][i], z = p[2][i];
+        const float nx = n[0][i], ny = n[1][i], nz = n[2][i];
+
+        for(auto row = 0; row < 3; ++row) {
+            const auto e = row * 4;
+            p[row][i] = m[e][i] * x + m[e + 1][i] * y + m[e + 2][i] * z + m[e + 3][i];
+            n[row][i] = m[e][i] * nx + m[e + 1][i] * ny + m[e + 2][i] * nz;
+        }
+    }
+}
+
+}
+
 SkeletalFrameUnpacker::SkeletalFrameUnpacker(Mesh* mesh, std::size_t num_frames, std::size_t num_vertices):
     mesh_(mesh) {
 
@@ -159,14 +272,31 @@ void SkeletalFrameUnpacker::unpack_frame(
         }
     }
 
-    auto vdata = mesh_->vertex_data.get();
+    /* Build the palette, the transformation of each joint from its bind
+     * pose to where the rig has it now */
+    const auto jcount = rig->joint_count();
+    std::vector<SkinningMatrix> palette(jcount);
+    for(std::size_t j = 0; j < jcount; ++j) {
+        auto rjoint = &rig->joints_[j];
+        auto joint = &skeleton->joints_[j];
+
+        Quaternion rot = rjoint->absolute_rotation_ * joint->absolute_rotation().inversed();
+        Vec3 t = rjoint->absolute_translation_ - (rot * joint->absolute_translation());
 
-    /* Go through each skeleton vertex, and update the counterpart
-     * actual vertex by manipulating its position to take into account the current
-     * joint position vs the original joint position for each joint that has a
-     * weighting */
-    vdata->move_to_start();
+        Vec3 c0 = rot * Vec3(1, 0, 0);
+        Vec3 c1 = rot * Vec3(0, 1, 0);
+        Vec3 c2 = rot * Vec3(0, 0, 1);
 
+        float* m = palette[j].m;
+        m[0] = c0.x; m[1] = c1.x; m[2] = c2.x; m[3] = t.x;
+        m[4] = c0.y; m[5] = c1.y; m[6] = c2.y; m[7] = t.y;
+        m[8] = c0.z; m[9] = c1.z; m[10] = c2.z; m[11] = t.z;
+    }
+
+    auto vdata = mesh_->vertex_data.get();
+
+    /* The mesh data is shared with other actors being skinned at the
+     * same time, so it's only read (the cursor isn't touched) */
     assert(vdata->vertex_specification().position_attribute == VERTEX_ATTRIBUTE_3F);
     assert(vdata->vertex_specification().normal_attribute == VERTEX_ATTRIBUTE_3F);
     assert(out->vertex_specification().position_attribute == VERTEX_ATTRIBUTE_3F);
@@ -180,33 +310,59 @@ void SkeletalFrameUnpacker::unpack_frame(
     uint8_t* vout = (uint8_t*) out->position_at<Vec3>(0);
     uint8_t* nout = (uint8_t*) out->normal_at<Vec3>(0);
 
-    Vec3 p, n;
+    SkinningBatch batch;
+
+    for(std::size_t first = 0; first < vertices_.size(); first += SKINNING_BATCH_SIZE) {
+        const std::size_t count = std::min(SKINNING_BATCH_SIZE, vertices_.size() - first);
+
+        /* Blend the palette matrices of each vertex's joints by their
+         * weights, and split everything into streams */
+        for(std::size_t i = 0; i < count; ++i, vin += stride, nin += stride) {
+            const auto& sv = vertices_[first + i];
+
+            float blended[12] = {0};
+            for(auto k = 0; k < MAX_JOINTS_PER_VERTEX; ++k) {
+                const auto j = sv.joints[k];
+                if(j < 0) {
+                    /* Joints are linked in order, there are no more */
+                    break;
+                }
+
+                const float w = sv.weights[k];
+                const float* m = palette[j].m;
+                for(auto e = 0; e < 12; ++e) {
+                    blended[e] += m[e] * w;
+                }
+            }
+
+            for(auto e = 0; e < 12; ++e) {
+                batch.m[e][i] = blended[e];
+            }
 
-    for(std::size_t i = 0; i < vertices_.size(); ++i, vin += stride, nin += stride, vout += out_stride, nout += out_stride) {
-        const auto& sv = vertices_[i];
+            const Vec3* p = (const Vec3*) vin;
+            const Vec3* n = (const Vec3*) nin;
 
-        p = *((Vec3*) vin);
-        n = *((Vec3*) nin);
+            batch.p[0][i] = p->x;
+            batch.p[1][i] = p->y;
+            batch.p[2][i] = p->z;
+            batch.n[0][i] = n->x;
+            batch.n[1][i] = n->y;
+            batch.n[2][i] = n->z;
+        }
 
-        Vec3 po, no;
-        for(auto k = 0; k < MAX_JOINTS_PER_VERTEX; ++k) {
-            const auto j = sv.joints[k];
-            if(j > -1) {
-                auto rjoint = &rig->joints_[j];
-                const auto& q = rjoint->absolute_rotation_;
-                const auto& d = rjoint->absolute_translation_;
+        skin_batch(batch, count);
 
-                auto joint = &skeleton->joints_[j];
+        for(std::size_t i = 0; i < count; ++i, vout += out_stride, nout += out_stride) {
+            Vec3* p = (Vec3*) vout;
+            Vec3* n = (Vec3*) nout;
 
-                /* FIXME: Optimise! Using matrices may be fewer instructions */
-                Quaternion rot = q * joint->absolute_rotation().inversed();
-                po += ((p - joint->absolute_translation()) * rot) + d * sv.weights[k];
-                no += rot * n;
-            }
+            p->x = batch.p[0][i];
+            p->y = batch.p[1][i];
+            p->z = batch.p[2][i];
+            n->x = batch.n[0][i];
+            n->y = batch.n[1][i];
+            n->z = batch.n[2][i];
         }
-
-        *((Vec3*) vout) = po;
-        *((Vec3*) nout) = no;
     }
 
     out->done();
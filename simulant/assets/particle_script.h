@@ -32,7 +32,10 @@ struct Emitter {
 };
 
 
-struct Particle;
+namespace particles {
+struct ParticleRange;
+}
+
 class ParticleScript;
 
 class Manipulator {
@@ -43,8 +46,10 @@ public:
 
     virtual ~Manipulator() {}
 
-    void manipulate(ParticleSystem* system, Particle* particles, std::size_t particle_count, float dt) const {
-        do_manipulate(system, particles, particle_count, dt);
+    /* Large systems are split into chunks which are manipulated in
+     * parallel, so this may be called from several threads at once */
+    void manipulate(ParticleSystem* system, const particles::ParticleRange& particles, float dt) const {
+        do_manipulate(system, particles, dt);
     }
 
     virtual void set_linear_curve(float rate);
@@ -53,7 +58,7 @@ public:
 
 private:
     std::string name_;
-    virtual void do_manipulate(ParticleSystem* system, Particle* particles, std::size_t particle_count, float dt) const = 0;
+    virtual void do_manipulate(ParticleSystem* system, const particles::ParticleRange& particles, float dt) const = 0;
 
 protected:
     typedef std::function<float (float, float, float)> CurveFunc;
@@ -2,6 +2,7 @@
 
 #include "../particle_script.h"
 #include "curves.h"
+#include "../../nodes/particles/particle.h"
 
 namespace smlt {
 
@@ -14,24 +15,38 @@ public:
         interpolate_(interpolate) {}
 
 private:
-    void do_manipulate(ParticleSystem*, Particle* particles, std::size_t particle_count, float) const {
+    void do_manipulate(ParticleSystem*, const particles::ParticleRange& particles, float) const {
+        using namespace particles;
+
         auto size = (float) colours_.size();
         float fsize = float(size);
-        auto particle = particles;
-        for(auto i = 0u; i < particle_count; ++i, ++particle) {
-            const float e = (particle->lifetime - particle->ttl);
-            const float n = smlt::fast_divide(e, particle->lifetime);
+
+        const float* ttl = particles[PARTICLE_STREAM_TTL];
+        const float* lifetime = particles[PARTICLE_STREAM_LIFETIME];
+        float* r = particles[PARTICLE_STREAM_COLOUR_R];
+        float* g = particles[PARTICLE_STREAM_COLOUR_G];
+        float* b = particles[PARTICLE_STREAM_COLOUR_B];
+        float* a = particles[PARTICLE_STREAM_COLOUR_A];
+
+        for(auto i = 0u; i < particles.count; ++i) {
+            const float e = (lifetime[i] - ttl[i]);
+            const float n = smlt::fast_divide(e, lifetime[i]);
             const float fsizen = fsize * n;
 
             uint8_t colour = smlt::clamp(fsizen, 0.0f, fsize);
 
-            particle->colour = colours_[colour];
+            Colour result = colours_[colour];
 
             if(interpolate_) {
                 const float f = fsizen - std::floor(fsizen);
                 auto next_colour = colours_[std::min((uint32_t) colour + 1, (uint32_t) size - 1)];
-                particle->colour = (particle->colour * (1.0f - f)) + (next_colour * f);
+                result = (result * (1.0f - f)) + (next_colour * f);
             }
+
+            r[i] = result.r;
+            g[i] = result.g;
+            b[i] = result.b;
+            a[i] = result.a;
         }
     }
 
@@ -3,13 +3,23 @@
 
 namespace smlt {
 
-void DirectionManipulator::do_manipulate(ParticleSystem *system, Particle *particles, std::size_t particle_count, float dt) const {
+void DirectionManipulator::do_manipulate(ParticleSystem *system, const particles::ParticleRange& particles, float dt) const {
     _S_UNUSED(system);
 
-    Particle* it = particles;
-    while(particle_count--) {
-        it->position += dir_ * dt;
-        ++it;
+    using namespace particles;
+
+    const float dx = dir_.x * dt;
+    const float dy = dir_.y * dt;
+    const float dz = dir_.z * dt;
+
+    float* x = particles[PARTICLE_STREAM_POSITION_X];
+    float* y = particles[PARTICLE_STREAM_POSITION_Y];
+    float* z = particles[PARTICLE_STREAM_POSITION_Z];
+
+    for(auto i = 0u; i < particles.count; ++i) {
+        x[i] += dx;
+        y[i] += dy;
+        z[i] += dz;
     }
 }
 
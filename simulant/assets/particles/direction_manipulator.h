@@ -17,8 +17,8 @@ public:
 private:
     void do_manipulate(
         ParticleSystem* system,
-        Particle* particles,
-        std::size_t particle_count, float dt) const override;
+        const particles::ParticleRange& particles,
+        float dt) const override;
 
     smlt::Vec3 dir_;
 };
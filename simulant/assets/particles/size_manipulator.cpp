@@ -6,35 +6,41 @@
 
 namespace smlt {
 
-void SizeManipulator::do_manipulate(ParticleSystem* system, Particle* particles, std::size_t particle_count, float dt) const {
+void SizeManipulator::do_manipulate(ParticleSystem* system, const particles::ParticleRange& particles, float dt) const {
     _S_UNUSED(dt);
 
-    /* We always have to set the curve before manipulation to take into
-         * account any scaling of the particle system */
-
-    auto create_scaled_curve = [this](float size) -> CurveFunc {
-        using namespace std::placeholders;
-
-        if(is_bell_curve_) {
-            return std::bind(&bell_curve, _1, _2, _3, peak_ * size, deviation_);
-        } else {
-            assert(is_linear_curve_);
-            return std::bind(&linear_curve, _1, _2, _3, rate_ * size);
+    using namespace particles;
+
+    /* We have to only respect X scale here, no other option! The curve
+     * is scaled each time to take into account any scaling of the
+     * particle system */
+    const float scale = system->scale().x;
+
+    const float* ttl = particles[PARTICLE_STREAM_TTL];
+    const float* lifetime = particles[PARTICLE_STREAM_LIFETIME];
+    const float* initial_width = particles[PARTICLE_STREAM_INITIAL_WIDTH];
+    const float* initial_height = particles[PARTICLE_STREAM_INITIAL_HEIGHT];
+    float* width = particles[PARTICLE_STREAM_WIDTH];
+    float* height = particles[PARTICLE_STREAM_HEIGHT];
+
+    if(is_bell_curve_) {
+        const float peak = peak_ * scale;
+        for(auto i = 0u; i < particles.count; ++i) {
+            float e = (lifetime[i] - ttl[i]);
+            float n = smlt::fast_divide(e, lifetime[i]);
+            width[i] = bell_curve(initial_width[i], n, e, peak, deviation_);
+            height[i] = bell_curve(initial_height[i], n, e, peak, deviation_);
+        }
+    } else {
+        assert(is_linear_curve_);
+
+        /* Inlined linear_curve() so that this loop vectorizes */
+        const float rate = rate_ * scale;
+        for(auto i = 0u; i < particles.count; ++i) {
+            float e = (lifetime[i] - ttl[i]);
+            width[i] = initial_width[i] + (e * rate);
+            height[i] = initial_height[i] + (e * rate);
         }
-    };
-
-
-    /* We have to only respect X scale here, no other option! */
-    auto curve = create_scaled_curve(system->scale().x);
-
-    Particle* particle = particles;
-    for(auto i = 0u; i < particle_count; ++i) {
-        float e = (particle->lifetime - particle->ttl);
-        float n =  smlt::fast_divide(e, particle->lifetime);
-        particle->dimensions.x = curve(particle->initial_dimensions.x, n, e);
-        particle->dimensions.y = curve(particle->initial_dimensions.y, n, e);
-
-        ++particle;
     }
 }
 
@@ -18,6 +18,7 @@
 //
 
 #include <unordered_map>
+#include <algorithm>
 
 #include "generic/algorithm.h"
 #include "compositor.h"
@@ -30,6 +31,7 @@
 #include "partitioner.h"
 #include "loader.h"
 #include "application.h"
+#include "threads/job_system.h"
 
 namespace smlt {
 
@@ -107,6 +109,13 @@ void Compositor::clean_destroyed_pipelines() {
         assert(ordered_pipelines_.size() < c);
 #endif
 
+        /* Release the render queue (and its cache) for the pipeline */
+        for(auto& frame: frames_) {
+            if(frame->pipeline == pip) {
+                frame.reset(new PipelineFrame());
+            }
+        }
+
         auto id = pip->id_;
         pool_.remove_if([id](const Pipeline::ptr& pip) -> bool {
             return pip->id_ == id;
@@ -174,16 +183,32 @@ void Compositor::run() {
     clean_destroyed_pipelines();  /* Clean up any destroyed pipelines before rendering */
 
     targets_rendered_this_frame_.clear();
+    ++render_frame_;
+
+    /* Bring everything that's moved this frame up to date in one go,
+     * before anything's culled */
+    for(auto& pipeline: ordered_pipelines_) {
+        if(pipeline->is_active() && pipeline->stage()) {
+            pipeline->stage()->update_transformations();
+        }
+    }
 
     /* Perform any pre-rendering tasks */
     renderer_->pre_render();
 
+    render_queue_sort_time_us_ = 0;
+    render_queue_entries_sorted_ = 0;
+
     int actors_rendered = 0;
-    for(auto& pipeline: ordered_pipelines_) {
-        run_pipeline(pipeline, actors_rendered);
+    if(parallel_frame_building_) {
+        run_pipelines_in_parallel(actors_rendered);
+    } else {
+        run_pipelines_serially(actors_rendered);
     }
 
     get_app()->stats->set_subactors_rendered(actors_rendered);
+    get_app()->stats->set_render_queue_sort_time_us(render_queue_sort_time_us_);
+    get_app()->stats->set_render_queue_entries_sorted(render_queue_entries_sorted_);
 }
 
 
@@ -192,30 +217,143 @@ uint64_t generate_frame_id() {
     return ++frame_id;
 }
 
-void Compositor::run_pipeline(PipelinePtr pipeline_stage, int &actors_rendered) {
+Compositor::PipelineFrame* Compositor::pipeline_frame(PipelinePtr pipeline) {
+    /* Each pipeline keeps its own frame, so that the render queue can
+     * reuse what it built for the same camera last time */
+    PipelineFrame* unused = nullptr;
+    for(auto& frame: frames_) {
+        if(frame->pipeline == pipeline) {
+            return frame.get();
+        } else if(!frame->pipeline && !unused) {
+            unused = frame.get();
+        }
+    }
+
+    if(!unused) {
+        frames_.push_back(std::unique_ptr<PipelineFrame>(new PipelineFrame()));
+        unused = frames_.back().get();
+    }
+
+    unused->pipeline = pipeline;
+    return unused;
+}
+
+void Compositor::run_pipelines_serially(int& actors_rendered) {
+    /* Each pipeline is built and rendered before moving onto the next */
+    for(auto& pipeline: ordered_pipelines_) {
+        auto frame_id = generate_frame_id();
+
+        if(!validate_pipeline(pipeline)) {
+            continue;
+        }
+
+        auto frame = pipeline_frame(pipeline);
+        frame->frame_id = frame_id;
+
+        clear_pipeline_target(frame);
+        prepare_pipeline(frame);
+        update_animated_actors(&frame, 1);
+        build_render_queue(frame);
+        render_pipeline(frame, actors_rendered);
+    }
+}
+
+void Compositor::run_pipelines_in_parallel(int& actors_rendered) {
+    active_frames_.clear();
+
+    for(auto& pipeline: ordered_pipelines_) {
+        auto frame_id = generate_frame_id();
+
+        if(!validate_pipeline(pipeline)) {
+            continue;
+        }
+
+        auto frame = pipeline_frame(pipeline);
+        frame->frame_id = frame_id;
+        active_frames_.push_back(frame);
+
+        /* Signals and partitioner writes happen here, on the main thread */
+        prepare_pipeline(frame);
+
+        /* Node transformations and bounds are calculated lazily, and updating
+         * the bounds can notify the partitioner. Do that here rather than
+         * racing to do it from several workers */
+        for(auto node: frame->nodes_visible) {
+            node->absolute_transformation();
+            node->transformed_aabb();
+        }
+    }
+
+    update_animated_actors(active_frames_.data(), active_frames_.size());
+
+    get_app()->jobs->parallel_for(active_frames_.size(), [this](std::size_t i) {
+        build_render_queue(active_frames_[i]);
+    });
+
+    for(auto frame: active_frames_) {
+        clear_pipeline_target(frame);
+        render_pipeline(frame, actors_rendered);
+    }
+}
+
+void Compositor::update_animated_actors(PipelineFrame* const* frames, std::size_t count) {
+    animated_actors_.resize(0);
+
+    for(std::size_t i = 0; i < count; ++i) {
+        for(auto node: frames[i]->nodes_visible) {
+            if(node->node_type() != STAGE_NODE_TYPE_ACTOR || !node->is_visible()) {
+                continue;
+            }
+
+            auto actor = static_cast<Actor*>(node);
+            if(actor->has_animated_mesh()) {
+                animated_actors_.push_back(actor);
+            }
+        }
+    }
+
+    /* The same actor can be visible to several pipelines. The actor would
+     * skip the repeats itself, but they'd still hold up a worker */
+    std::sort(animated_actors_.begin(), animated_actors_.end());
+    animated_actors_.erase(
+        std::unique(animated_actors_.begin(), animated_actors_.end()),
+        animated_actors_.end()
+    );
+
+    auto render_frame = render_frame_;
+    get_app()->jobs->parallel_for(animated_actors_.size(), [this, render_frame](std::size_t i) {
+        animated_actors_[i]->_update_animated_vertices(render_frame);
+    });
+}
+
+bool Compositor::validate_pipeline(PipelinePtr pipeline) {
     /*
-     * This is where rendering actually happens.
-     *
      * FIXME: This needs some serious thought regarding thread-safety. There is no locking here
      * and another thread could be adding/removing objects, updating the partitioner, or changing materials
      * and/or textures on renderables. We need to make sure that we render a consistent snapshot of the world
      * which means figuring out some kind of locking around the render queue building and traversal, or
      * some deep-copying (of materials/textures/renderables) to make sure that nothing changes during traversal
      */
-    uint64_t frame_id = generate_frame_id();
-
-    if(!pipeline_stage->is_active()) {
-        return;
+    if(!pipeline->is_active()) {
+        return false;
     }
 
-    if(!pipeline_stage->is_complete()) {
+    if(!pipeline->is_complete()) {
         S_DEBUG("Stage or camera has been destroyed, disabling pipeline");
-        pipeline_stage->deactivate();
+        pipeline->deactivate();
+        return false;
+    }
+
+    return true;
+}
+
+void Compositor::clear_pipeline_target(PipelineFrame* frame) {
+    /* Viewports clear and apply themselves through GL directly */
+    if(!window_->renderer->requires_gl_context()) {
         return;
     }
 
-    auto stage = pipeline_stage->stage();
-    auto camera = pipeline_stage->camera();
+    auto pipeline_stage = frame->pipeline;
 
     RenderTarget& target = *window_; //FIXME: Should be window or texture
 
@@ -241,49 +379,62 @@ void Compositor::run_pipeline(PipelinePtr pipeline_stage, int &actors_rendered)
     } else {
         viewport->apply(target); //FIXME apply shouldn't exist, it ties Viewport to OpenGL...
     }
+}
+
+void Compositor::prepare_pipeline(PipelineFrame* frame) {
+    auto pipeline_stage = frame->pipeline;
+    auto stage = pipeline_stage->stage();
+    auto camera = pipeline_stage->camera();
 
     signal_pipeline_started_(*pipeline_stage);
 
     // Trigger a signal to indicate the stage is about to be rendered
-    stage->signal_stage_pre_render()(camera->id(), viewport);
+    stage->signal_stage_pre_render()(camera->id(), pipeline_stage->viewport);
 
     // Apply any outstanding writes to the partitioner
     stage->partitioner->_apply_writes();
 
-    static std::vector<LightID> light_ids;
-    static std::vector<StageNode*> nodes_visible;
-
     /* Empty out, but leave capacity to prevent constant allocations */
-    light_ids.resize(0);
-    nodes_visible.resize(0);
+    frame->light_ids.resize(0);
+    frame->nodes_visible.resize(0);
+    frame->lights_visible.resize(0);
 
     // Gather the lights and geometry visible to the camera
-    stage->partitioner->lights_and_geometry_visible_from(camera->id(), light_ids, nodes_visible);
+    stage->partitioner->lights_and_geometry_visible_from(camera->id(), frame->light_ids, frame->nodes_visible);
 
     // Get the actual lights from the IDs
-    auto lights_visible = map<decltype(light_ids), std::vector<LightPtr>>(
-        light_ids, [&](const LightID& light_id) -> LightPtr { return stage->light(light_id); }
-    );
+    for(auto& light_id: frame->light_ids) {
+        frame->lights_visible.push_back(stage->light(light_id));
+    }
+}
+
+void Compositor::build_render_queue(PipelineFrame* frame) {
+    auto pipeline_stage = frame->pipeline;
+    auto stage = pipeline_stage->stage();
+    auto camera = pipeline_stage->camera();
+
+    auto& render_queue = frame->render_queue;
+    auto& renderable_lights = frame->renderable_lights;
 
     // Reset it, ready for this pipeline
-    render_queue_.reset(stage, window->renderer.get(), camera);
+    render_queue.reset(stage, window->renderer.get(), camera);
 
     // Mark the visible objects as visible
-    for(auto& node: nodes_visible) {
+    for(auto& node: frame->nodes_visible) {
         assert(node);
 
         if(!node->is_visible()) {
             continue;
         }
 
-        auto renderable_lights = filter(lights_visible, [&node](const LightPtr& light) -> bool {
+        renderable_lights.resize(0);
+        for(auto& light: frame->lights_visible) {
             // Filter by whether or not the renderable bounds intersects the light bounds
-            if(light->type() == LIGHT_TYPE_DIRECTIONAL) {
-                return true;
-            } else {
-                return node->transformed_aabb().intersects_sphere(light->absolute_position(), light->range() * 2);
+            if(light->type() == LIGHT_TYPE_DIRECTIONAL ||
+                node->transformed_aabb().intersects_sphere(light->absolute_position(), light->range() * 2)) {
+                renderable_lights.push_back(light);
             }
-        });
+        }
 
         std::partial_sort(
             renderable_lights.begin(),
@@ -311,15 +462,25 @@ void Compositor::run_pipeline(PipelinePtr pipeline_stage, int &actors_rendered)
         /* Find the ideal detail level at this distance from the camera */
         auto level = pipeline_stage->detail_level_at_distance(distance_to_camera);
 
-        /* Push any renderables for this node */
-        auto initial = render_queue_.renderable_count();
-        node->_get_renderables(&render_queue_, camera, level);
+        /* Push any renderables for this node, reusing the ones from
+         * last frame if nothing has changed */
+        auto initial = render_queue.renderable_count();
+        if(node->has_static_renderables()) {
+            auto version = node->renderables_version(camera, level);
+            if(!render_queue.insert_cached_renderables(node, version)) {
+                render_queue.begin_caching(node, version);
+                node->_get_renderables(&render_queue, camera, level);
+                render_queue.end_caching();
+            }
+        } else {
+            node->_get_renderables(&render_queue, camera, level);
+        }
 
         // FIXME: Change _get_renderables to return the number inserted
-        auto count = render_queue_.renderable_count() - initial;
+        auto count = render_queue.renderable_count() - initial;
 
         for(auto i = initial; i < initial + count; ++i) {
-            auto renderable = render_queue_.renderable(i);
+            auto renderable = render_queue.renderable(i);
 
             assert(
                 renderable->arrangement == MESH_ARRANGEMENT_LINES ||
@@ -333,27 +494,40 @@ void Compositor::run_pipeline(PipelinePtr pipeline_stage, int &actors_rendered)
             assert(renderable->material);
             assert(renderable->vertex_data);
 
-            renderable->light_count = renderable_lights.size();
+            renderable->light_count = std::min(MAX_LIGHTS_PER_RENDERABLE, (uint32_t) renderable_lights.size());
             for(auto i = 0u; i < renderable->light_count; ++i) {
                 renderable->lights_affecting_this_frame[i] = renderable_lights[i];
             }
         }
     }
 
-    actors_rendered += render_queue_.renderable_count();
+    /* Sort now, so that when frames are built in parallel the
+     * sorting (and matrix calculation) happens on the workers too */
+    render_queue.sort();
+    render_queue.calculate_matrices();
+}
 
-    using namespace std::placeholders;
+void Compositor::render_pipeline(PipelineFrame* frame, int& actors_rendered) {
+    auto pipeline_stage = frame->pipeline;
+    auto stage = pipeline_stage->stage();
+    auto camera = pipeline_stage->camera();
+    auto& render_queue = frame->render_queue;
+
+    actors_rendered += render_queue.renderable_count();
 
     auto visitor = renderer_->get_render_queue_visitor(camera);
 
     // Render the visible objects
-    render_queue_.traverse(visitor.get(), frame_id);
+    render_queue.traverse(visitor.get(), frame->frame_id);
+
+    render_queue_sort_time_us_ += render_queue.last_sort_time_us();
+    render_queue_entries_sorted_ += render_queue.last_sort_count();
 
     // Trigger a signal to indicate the stage has been rendered
-    stage->signal_stage_post_render()(camera->id(), viewport);
+    stage->signal_stage_post_render()(camera->id(), pipeline_stage->viewport);
 
     signal_pipeline_finished_(*pipeline_stage);
-    render_queue_.clear();
+    render_queue.clear();
 }
 
 }
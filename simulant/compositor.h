@@ -72,6 +72,27 @@ public:
     void run();
     void clean_destroyed_pipelines();
 
+    /* When enabled, the culling, light filtering and render queue
+     * building for all active pipelines runs in parallel on the job
+     * system before any pipeline is rendered. Only the viewport clears
+     * and render queue traversal run serially on the render thread.
+     *
+     * In this mode signal_stage_pre_render fires for every pipeline
+     * before any pipeline is rendered. */
+    void set_parallel_frame_building(bool value=true) {
+        parallel_frame_building_ = value;
+    }
+
+    bool parallel_frame_building() const {
+        return parallel_frame_building_;
+    }
+
+    /* Incremented each time run() is called. Unlike the per-pipeline
+     * frame ids, this is the same for every pipeline in a frame */
+    uint64_t render_frame() const {
+        return render_frame_;
+    }
+
     sig::signal<void (Pipeline&)>& signal_pipeline_started() { return signal_pipeline_started_; }
     sig::signal<void (Pipeline&)>& signal_pipeline_finished() { return signal_pipeline_finished_; }
 
@@ -85,12 +106,52 @@ public:
     }
 
 private:
+    /* Per-pipeline render queue and scratch space. These persist
+     * between frames so that their capacity, and the renderables
+     * cached by the render queue, are reused */
+    struct PipelineFrame {
+        PipelinePtr pipeline = nullptr;
+        uint64_t frame_id = 0;
+
+        batcher::RenderQueue render_queue;
+
+        std::vector<LightID> light_ids;
+        std::vector<StageNode*> nodes_visible;
+        std::vector<LightPtr> lights_visible;
+        std::vector<LightPtr> renderable_lights;
+    };
+
     void sort_pipelines();
-    void run_pipeline(PipelinePtr stage, int& actors_rendered);
+
+    PipelineFrame* pipeline_frame(PipelinePtr pipeline);
+
+    /* Returns false if the pipeline shouldn't be rendered this frame */
+    bool validate_pipeline(PipelinePtr pipeline);
+
+    void clear_pipeline_target(PipelineFrame* frame);
+    void prepare_pipeline(PipelineFrame* frame);
+    void build_render_queue(PipelineFrame* frame);
+    void render_pipeline(PipelineFrame* frame, int& actors_rendered);
+
+    void run_pipelines_serially(int& actors_rendered);
+    void run_pipelines_in_parallel(int& actors_rendered);
+
+    /* Skins (or interpolates) the visible animated actors of the frames which
+     * haven't been already this render frame, in parallel on the job system */
+    void update_animated_actors(PipelineFrame* const* frames, std::size_t count);
+    std::vector<Actor*> animated_actors_;
 
     Window* window_ = nullptr;
     Renderer* renderer_ = nullptr;
-    batcher::RenderQueue render_queue_;
+
+    bool parallel_frame_building_ = false;
+    uint64_t render_frame_ = 0;
+    std::vector<std::unique_ptr<PipelineFrame>> frames_;
+    std::vector<PipelineFrame*> active_frames_;
+
+    /* Accumulated across the pipelines rendered this frame */
+    uint64_t render_queue_sort_time_us_ = 0;
+    uint32_t render_queue_entries_sorted_ = 0;
 
     std::list<std::shared_ptr<Pipeline>> pool_;
     std::list<PipelinePtr> ordered_pipelines_;
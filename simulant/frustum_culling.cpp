@@ -0,0 +1,182 @@
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "frustum_culling.h"
+#include "frustum.h"
+
+namespace smlt {
+
+void AABBList::clear() {
+    for(uint8_t i = 0; i < 3; ++i) {
+        min_[i].clear();
+        max_[i].clear();
+    }
+}
+
+void AABBList::reserve(std::size_t count) {
+    for(uint8_t i = 0; i < 3; ++i) {
+        min_[i].reserve(count);
+        max_[i].reserve(count);
+    }
+}
+
+void AABBList::resize(std::size_t count) {
+    for(uint8_t i = 0; i < 3; ++i) {
+        min_[i].resize(count);
+        max_[i].resize(count);
+    }
+}
+
+void AABBList::push_back(const AABB& box) {
+    auto min = box.min();
+    auto max = box.max();
+
+    min_[0].push_back(min.x);
+    min_[1].push_back(min.y);
+    min_[2].push_back(min.z);
+    max_[0].push_back(max.x);
+    max_[1].push_back(max.y);
+    max_[2].push_back(max.z);
+}
+
+void AABBList::set(std::size_t i, const AABB& box) {
+    auto min = box.min();
+    auto max = box.max();
+
+    min_[0][i] = min.x;
+    min_[1][i] = min.y;
+    min_[2][i] = min.z;
+    max_[0][i] = max.x;
+    max_[1][i] = max.y;
+    max_[2][i] = max.z;
+}
+
+AABB AABBList::at(std::size_t i) const {
+    AABB ret;
+    ret.set_min_max(
+        Vec3(min_[0][i], min_[1][i], min_[2][i]),
+        Vec3(max_[0][i], max_[1][i], max_[2][i])
+    );
+    return ret;
+}
+
+std::size_t VisibilityMask::count() const {
+    std::size_t ret = 0;
+    for(auto word: words_) {
+        ret += __builtin_popcount(word);
+    }
+    return ret;
+}
+
+namespace {
+
+/* A frustum plane, with the arrays holding the box corner furthest
+ * along the plane normal (the "positive vertex") selected up front. As
+ * the choice only depends on the plane it's the same for every box. */
+struct CullPlane {
+    float nx, ny, nz;
+    float neg_d;
+    const float* px;
+    const float* py;
+    const float* pz;
+};
+
+}
+
+std::size_t cull_aabbs(const Frustum& frustum, const float* const mins[3], const float* const maxs[3], std::size_t count, uint32_t* out_words) {
+    std::memset(out_words, 0, sizeof(uint32_t) * ((count + 31) / 32));
+
+    CullPlane planes[FRUSTUM_PLANE_MAX];
+    for(uint32_t p = 0; p < FRUSTUM_PLANE_MAX; ++p) {
+        auto plane = frustum.plane((FrustumPlane) p);
+
+        planes[p].nx = plane.n.x;
+        planes[p].ny = plane.n.y;
+        planes[p].nz = plane.n.z;
+        planes[p].neg_d = -plane.d;
+        planes[p].px = (plane.n.x > 0) ? maxs[0] : mins[0];
+        planes[p].py = (plane.n.y > 0) ? maxs[1] : mins[1];
+        planes[p].pz = (plane.n.z > 0) ? maxs[2] : mins[2];
+    }
+
+    std::size_t visible = 0;
+    std::size_t i = 0;
+
+#if defined(__AVX__)
+    for(; i + 8 <= count; i += 8) {
+        __m256 outside = _mm256_setzero_ps();
+        for(auto& p: planes) {
+            __m256 m = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(_mm256_loadu_ps(p.px + i), _mm256_set1_ps(p.nx)),
+                    _mm256_mul_ps(_mm256_loadu_ps(p.py + i), _mm256_set1_ps(p.ny))
+                ),
+                _mm256_mul_ps(_mm256_loadu_ps(p.pz + i), _mm256_set1_ps(p.nz))
+            );
+
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(m, _mm256_set1_ps(p.neg_d), _CMP_LT_OQ));
+        }
+
+        uint32_t bits = ~uint32_t(_mm256_movemask_ps(outside)) & 0xFF;
+        out_words[i / 32] |= bits << (i % 32);
+        visible += __builtin_popcount(bits);
+    }
+#elif defined(__SSE__)
+    for(; i + 4 <= count; i += 4) {
+        __m128 outside = _mm_setzero_ps();
+        for(auto& p: planes) {
+            __m128 m = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(_mm_loadu_ps(p.px + i), _mm_set1_ps(p.nx)),
+                    _mm_mul_ps(_mm_loadu_ps(p.py + i), _mm_set1_ps(p.ny))
+                ),
+                _mm_mul_ps(_mm_loadu_ps(p.pz + i), _mm_set1_ps(p.nz))
+            );
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(m, _mm_set1_ps(p.neg_d)));
+        }
+
+        uint32_t bits = ~uint32_t(_mm_movemask_ps(outside)) & 0xF;
+        out_words[i / 32] |= bits << (i % 32);
+        visible += __builtin_popcount(bits);
+    }
+#endif
+
+    /* Scalar fallback, and the remainder of the SIMD loops */
+    for(; i < count; ++i) {
+        bool outside = false;
+        for(auto& p: planes) {
+            float m = p.px[i] * p.nx + p.py[i] * p.ny + p.pz[i] * p.nz;
+            if(m < p.neg_d) {
+                outside = true;
+                break;
+            }
+        }
+
+        if(!outside) {
+            out_words[i / 32] |= (1u << (i % 32));
+            ++visible;
+        }
+    }
+
+    return visible;
+}
+
+std::size_t cull_aabbs(const Frustum& frustum, const AABBList& boxes, VisibilityMask& visible) {
+    visible.reset(boxes.size());
+    if(boxes.empty()) {
+        return 0;
+    }
+
+    const float* mins[3] = {boxes.mins(0), boxes.mins(1), boxes.mins(2)};
+    const float* maxs[3] = {boxes.maxs(0), boxes.maxs(1), boxes.maxs(2)};
+
+    return cull_aabbs(frustum, mins, maxs, boxes.size(), visible.words());
+}
+
+}
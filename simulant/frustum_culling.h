@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "math/aabb.h"
+
+/*
+ * Batch frustum culling.
+ *
+ * Bounds are stored as a structure of arrays so the culling kernel can
+ * test several boxes against each frustum plane at once (8 with AVX, 4 with
+ * SSE, otherwise one at a time). The result is a bitmask with one bit
+ * per box.
+ *
+ * Usage:
+ *
+ * AABBList bounds;
+ * for(auto& node: nodes) {
+ *     bounds.push_back(node->transformed_aabb());
+ * }
+ *
+ * VisibilityMask visible;
+ * cull_aabbs(frustum, bounds, visible);
+ *
+ * visible.each_set([&](std::size_t i) {
+ *     render(nodes[i]);
+ * });
+ */
+
+namespace smlt {
+
+class Frustum;
+
+class AABBList {
+public:
+    std::size_t size() const {
+        return min_[0].size();
+    }
+
+    bool empty() const {
+        return min_[0].empty();
+    }
+
+    void clear();
+    void reserve(std::size_t count);
+    void resize(std::size_t count);
+
+    void push_back(const AABB& box);
+    void set(std::size_t i, const AABB& box);
+    AABB at(std::size_t i) const;
+
+    /* The per-axis arrays, axis is 0, 1 or 2 for x, y and z */
+    const float* mins(uint8_t axis) const {
+        return min_[axis].data();
+    }
+
+    const float* maxs(uint8_t axis) const {
+        return max_[axis].data();
+    }
+
+private:
+    std::vector<float> min_[3];
+    std::vector<float> max_[3];
+};
+
+class VisibilityMask {
+public:
+    /* Resizes the mask and clears every bit */
+    void reset(std::size_t count) {
+        count_ = count;
+        words_.assign((count + 31) / 32, 0);
+    }
+
+    std::size_t size() const {
+        return count_;
+    }
+
+    bool test(std::size_t i) const {
+        return words_[i / 32] & (1u << (i % 32));
+    }
+
+    void set(std::size_t i) {
+        words_[i / 32] |= (1u << (i % 32));
+    }
+
+    /* Returns the number of set bits */
+    std::size_t count() const;
+
+    /* Calls func(i) for each set bit, in order */
+    template<typename Func>
+    void each_set(Func&& func) const {
+        for(std::size_t w = 0; w < words_.size(); ++w) {
+            uint32_t word = words_[w];
+            while(word) {
+                uint32_t bit = __builtin_ctz(word);
+                func(w * 32 + bit);
+                word &= word - 1;
+            }
+        }
+    }
+
+    uint32_t* words() {
+        return words_.data();
+    }
+
+    const uint32_t* words() const {
+        return words_.data();
+    }
+
+    std::size_t word_count() const {
+        return words_.size();
+    }
+
+    bool operator==(const VisibilityMask& rhs) const {
+        return count_ == rhs.count_ && words_ == rhs.words_;
+    }
+
+    bool operator!=(const VisibilityMask& rhs) const {
+        return !(*this == rhs);
+    }
+
+private:
+    std::size_t count_ = 0;
+    std::vector<uint32_t> words_;
+};
+
+/*
+ * Tests count boxes (given as per-axis min/max arrays) against the frustum
+ * and sets bit i of out_words for each box that intersects it. out_words
+ * must have room for (count + 31) / 32 words and will be cleared first.
+ *
+ * This gives exactly the same results as Frustum::intersects_aabb.
+ * Returns the number of visible boxes.
+ */
+std::size_t cull_aabbs(
+    const Frustum& frustum,
+    const float* const mins[3],
+    const float* const maxs[3],
+    std::size_t count,
+    uint32_t* out_words
+);
+
+std::size_t cull_aabbs(const Frustum& frustum, const AABBList& boxes, VisibilityMask& visible);
+
+}
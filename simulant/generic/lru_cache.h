@@ -62,6 +62,28 @@ private:
     }
 #endif
 
+    void move_to_front(Entry* entry) const {
+        if(entry != entries_) {
+            // Remove from list
+            if(entry->prev) entry->prev->next = entry->next;
+            if(entry->next) entry->next->prev = entry->prev;
+
+            if(tail_ == entry) {
+                tail_ = entry->prev;
+            }
+
+            // Insert at the beginning
+            entry->prev = nullptr;
+            entry->next = entries_;
+            entries_->prev = entry;
+            entries_ = entry;
+        }
+
+#ifndef NDEBUG
+        check_valid();
+#endif
+    }
+
 public:
     ~LRUCache() {
         clear();
@@ -70,33 +92,46 @@ public:
     optional<Value> get(const Key& key) const {
         auto it = cache_.find(key);
         if(it != cache_.end()) {
-            auto entry = it->second;
-
-            if(entry != entries_) {
-                // Remove from list
-                if(entry->prev) entry->prev->next = entry->next;
-                if(entry->next) entry->next->prev = entry->prev;
-
-                if(tail_ == entry) {
-                    tail_ = entry->prev;
-                }
-
-                // Insert at the beginning
-                entry->prev = nullptr;
-                entry->next = entries_;
-                entries_->prev = entry;
-                entries_ = entry;
-            }
+            move_to_front(it->second);
+            return optional<Value>(it->second->value);
+        }
 
-#ifndef NDEBUG
-            check_valid();
-#endif
-            return optional<Value>(entry->value);
+        return optional<Value>();
+    }
+
+    /* Marks the entry as the most recently used, and returns a pointer
+     * to its value so that it can be updated in place. Returns nullptr
+     * if there is no entry for the key */
+    Value* touch(const Key& key) {
+        auto it = cache_.find(key);
+        if(it != cache_.end()) {
+            move_to_front(it->second);
+            return &it->second->value;
+        }
+
+        return nullptr;
+    }
+
+    /* Returns the value without marking it as used */
+    optional<Value> peek(const Key& key) const {
+        auto it = cache_.find(key);
+        if(it != cache_.end()) {
+            return optional<Value>(it->second->value);
         }
 
         return optional<Value>();
     }
 
+    /* Returns the key of the least recently used entry, which is the
+     * next one to be dropped if the cache grows too big */
+    optional<Key> oldest_key() const {
+        if(tail_) {
+            return optional<Key>(tail_->key);
+        }
+
+        return optional<Key>();
+    }
+
     void clear() {
         while(size()) {
             pop_tail();
@@ -143,15 +178,17 @@ public:
             return false;
         }
 
-        assert(it->second.key == key);
+        assert(it->second->key == key);
 
         /* Move to the end. Just saves duplicating removal code */
         auto entry = it->second;
         if(entry != tail_) {
+            if(entry == entries_) entries_ = entry->next;
             if(entry->prev) entry->prev->next = entry->next;
             if(entry->next) entry->next->prev = entry->prev;
 
             entry->prev = tail_;
+            entry->next = nullptr;
             tail_->next = entry;
             tail_ = entry;
         }
@@ -62,11 +62,7 @@ Loader::~Loader() {
 namespace loaders {
 
 
-void BaseTextureLoader::into(Loadable& resource, const LoaderOptions& options) {
-    Loadable* res_ptr = &resource;
-    Texture* tex = dynamic_cast<Texture*>(res_ptr);
-    assert(tex && "You passed a Resource that is not a texture to the texture loader");
-
+TextureLoadResult BaseTextureLoader::load_data() {
     assert(data_);
 
     std::shared_ptr<FileIfstream> ifstream = std::dynamic_pointer_cast<FileIfstream>(
@@ -77,26 +73,36 @@ void BaseTextureLoader::into(Loadable& resource, const LoaderOptions& options) {
 
     auto result = do_load(ifstream);
 
+    if (result.data.empty()) {
+        S_ERROR(_F("Unable to load texture with name: {0}").format(filename_));
+        throw std::runtime_error("Couldn't load the file: " + filename_.str());
+    }
+
+    if(format_stored_upside_down()) {
+        flip_texture_data_vertically(&result.data[0], result.width, result.height, result.format);
+    }
+
+    return result;
+}
+
+void BaseTextureLoader::into(Loadable& resource, const LoaderOptions& options) {
+    Loadable* res_ptr = &resource;
+    Texture* tex = dynamic_cast<Texture*>(res_ptr);
+    assert(tex && "You passed a Resource that is not a texture to the texture loader");
+
+    auto result = load_data();
+
     /* Respect the auto_upload option if it exists*/
     bool auto_upload = true;
     if(options.count("auto_upload")) {
         auto_upload = smlt::any_cast<bool>(options.at("auto_upload"));
     }
 
-    if (result.data.empty()) {
-        S_ERROR(_F("Unable to load texture with name: {0}").format(filename_));
-        throw std::runtime_error("Couldn't load the file: " + filename_.str());
-    } else {
-        tex->set_source(filename_);
-        tex->set_format(result.format);
-        tex->resize(result.width, result.height);
-        tex->set_data(result.data);
-        tex->set_auto_upload(auto_upload);
-
-        if(format_stored_upside_down()) {
-            tex->flip_vertically();
-        }
-    }
+    tex->set_source(filename_);
+    tex->set_format(result.format);
+    tex->resize(result.width, result.height);
+    tex->set_data(result.data);
+    tex->set_auto_upload(auto_upload);
 }
 
 }
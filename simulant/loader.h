@@ -148,6 +148,11 @@ public:
 
     void into(Loadable& resource, const LoaderOptions& options = LoaderOptions()) override;
 
+    /* Reads and decodes the image, flipped the right way up, without touching
+     * a Texture. This is how textures are decoded on worker threads. Throws
+     * if the image couldn't be loaded */
+    TextureLoadResult load_data();
+
 private:
     virtual bool format_stored_upside_down() const { return true; }
     virtual TextureLoadResult do_load(std::shared_ptr<FileIfstream> stream) = 0;
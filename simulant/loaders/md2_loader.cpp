@@ -18,11 +18,14 @@
 //
 
 
+#include <limits>
+#include <algorithm>
+
 #include "md2_loader.h"
 #include "../meshes/mesh.h"
 #include "../asset_manager.h"
 #include "../vfs.h"
-#include "../time_keeper.h"
+#include "../threads/mutex.h"
 
 namespace smlt {
 namespace loaders{
@@ -74,6 +77,32 @@ static Vec3 ANORMS [] = {
     #include "md2_anorms.h"
 };
 
+static const uint16_t ANORM_COUNT = sizeof(ANORMS) / sizeof(Vec3);
+
+/* MD2 models are Z-up, this converts to our coordinate system */
+static const Mat4& md2_vertex_rotation() {
+    static const Mat4 ROT_X = Mat4::as_rotation_x(Degrees(90.0f));
+    static const Mat4 ROT_Y = Mat4::as_rotation_y(Degrees(90.0f));
+    static const Mat4 VERTEX_ROTATION = ROT_Y * ROT_X;
+    return VERTEX_ROTATION;
+}
+
+/* The normal table, already converted to our coordinate system */
+static const Vec3* md2_rotated_normals() {
+    struct Table {
+        Table() {
+            for(uint16_t i = 0; i < ANORM_COUNT; ++i) {
+                normals[i] = ANORMS[i].rotated_by(md2_vertex_rotation());
+            }
+        }
+
+        Vec3 normals[ANORM_COUNT];
+    };
+
+    static const Table table;
+    return table.normals;
+}
+
 
 uint16_t MD2Loader::MAX_RESIDENT_FRAMES = 32;
 
@@ -90,9 +119,10 @@ public:
         Vec3 translate;
     };
 
+    /* Same as the file, texture coordinates don't change between frames
+     * so they're stored once in tex_coords_ */
     struct FrameVertex {
         uint8_t v[3];
-        Vec2 st;
         uint8_t normal;
     };
 
@@ -101,66 +131,148 @@ public:
     /* This contains all the vertices for all frames sequentially */
     std::vector<FrameVertex> vertices_;
 
+    /* The texture coordinate of each vertex */
+    std::vector<Vec2> tex_coords_;
+
     /* This contains the scale/translate data for each frame */
     std::vector<FrameTransform> frames_;
 
+    /* Normals are kept as an index into the normal table */
     struct UnpackedVertex {
         Vec3 v;
-        Vec3 n;
+        uint8_t normal;
     };
 
-    typedef std::vector<UnpackedVertex> UnpackedFrame;
+    /*
+     * Cache of recently used frames, trying to balance memory usage with
+     * performance. Each resident frame has a slot in unpacked_vertices_,
+     * the slots are kept in a list ordered from most to least recently used
+     * so finding a frame, marking it used, and evicting the oldest are all
+     * constant time.
+     */
+    struct ResidentFrame {
+        uint16_t frame = NO_FRAME;
+        uint16_t prev = NO_SLOT;
+        uint16_t next = NO_SLOT;
+    };
+
+    static const uint16_t NO_FRAME = std::numeric_limits<uint16_t>::max();
+    static const uint16_t NO_SLOT = std::numeric_limits<uint16_t>::max();
+
+    std::vector<UnpackedVertex> unpacked_vertices_;
+    std::vector<ResidentFrame> resident_frames_;
+    std::vector<uint16_t> slot_for_frame_;
+
+    /* The number of frames which can be resident. reserve() may give more
+     * capacity than asked for, and unpacked_vertices_ must never grow past
+     * this or the vertices handed out would move */
+    uint16_t slot_count_ = 0;
+    uint16_t most_recent_ = NO_SLOT;
+    uint16_t least_recent_ = NO_SLOT;
 
-    /* Cache of recently used frames, trying to balance memory usage with
-     * performance */
-    std::unordered_map<uint16_t, UnpackedFrame> frame_cache;
-    std::unordered_map<uint16_t, uint64_t> frame_usage_times;
+    uint32_t frames_decoded_ = 0;
+    uint32_t frames_unpacked_ = 0;
 
-    void _expand_verts(uint16_t frame) {
-        /* Decompresses a single frame of MD2 data into the frame cache */
+    /* Actors sharing the mesh can be unpacked on different threads,
+     * and they all use the frame cache */
+    mutable thread::Mutex frame_cache_lock_;
 
-        static const Mat4 ROT_X = Mat4::as_rotation_x(Degrees(90.0f));
-        static const Mat4 ROT_Y = Mat4::as_rotation_y(Degrees(90.0f));
-        static const Mat4 VERTEX_ROTATION = ROT_Y * ROT_X;
+    void _unlink(uint16_t slot) {
+        auto& resident = resident_frames_[slot];
 
-        if(frame_cache.count(frame)) {
-            frame_usage_times[frame] = TimeKeeper::now_in_us();
+        if(resident.prev != NO_SLOT) {
+            resident_frames_[resident.prev].next = resident.next;
         } else {
-            if(frame_cache.size() == MD2Loader::MAX_RESIDENT_FRAMES) {
-                /* We need to clear out the oldest frame */
+            most_recent_ = resident.next;
+        }
 
-                uint64_t oldest_time = std::numeric_limits<uint64_t>::max();
-                uint16_t oldest_frame = std::numeric_limits<uint16_t>::max();
+        if(resident.next != NO_SLOT) {
+            resident_frames_[resident.next].prev = resident.prev;
+        } else {
+            least_recent_ = resident.prev;
+        }
 
-                for(auto it = frame_usage_times.begin(); it != frame_usage_times.end(); ++it) {
-                    if(it->second < oldest_time) {
-                        oldest_time = it->second;
-                        oldest_frame = it->first;
-                    }
-                }
+        resident.prev = resident.next = NO_SLOT;
+    }
 
-                frame_cache.erase(oldest_frame);
-                frame_usage_times.erase(oldest_frame);
-            }
+    void _push_front(uint16_t slot) {
+        auto& resident = resident_frames_[slot];
+        resident.prev = NO_SLOT;
+        resident.next = most_recent_;
+
+        if(most_recent_ != NO_SLOT) {
+            resident_frames_[most_recent_].prev = slot;
+        }
+
+        most_recent_ = slot;
+        if(least_recent_ == NO_SLOT) {
+            least_recent_ = slot;
+        }
+    }
 
-            auto& verts = frame_cache[frame];
-            frame_usage_times[frame] = TimeKeeper::now_in_us();
+    void _decode_frame(uint16_t frame, UnpackedVertex* out) {
+        /* Fold the coordinate system change into the frame transform so
+         * each vertex is a multiply-add per component */
+        const Mat4& rot = md2_vertex_rotation();
+        const FrameTransform& transform = frames_[frame];
+
+        const Vec3 cx = Vec3(transform.scale.x, 0, 0).rotated_by(rot);
+        const Vec3 cy = Vec3(0, transform.scale.y, 0).rotated_by(rot);
+        const Vec3 cz = Vec3(0, 0, transform.scale.z).rotated_by(rot);
+        const Vec3 t = transform.translate.rotated_by(rot);
+
+        const FrameVertex* in = &vertices_[vertex_count * frame];
+        for(uint16_t i = 0; i < vertex_count; ++i, ++in, ++out) {
+            const float x = in->v[0], y = in->v[1], z = in->v[2];
+
+            out->v.x = cx.x * x + cy.x * y + cz.x * z + t.x;
+            out->v.y = cx.y * x + cy.y * y + cz.y * z + t.y;
+            out->v.z = cx.z * x + cy.z * y + cz.z * z + t.z;
+            out->normal = in->normal;
+        }
 
-            FrameTransform& frame1 = frames_[frame];
-            FrameVertex* v1 = &vertices_[vertex_count * frame];
+        ++frames_decoded_;
+    }
 
-            verts.resize(vertex_count);
-            for(uint16_t i = 0; i < vertex_count; ++i) {
-                float vx1 = float(v1->v[0]) * frame1.scale.x + frame1.translate.x;
-                float vy1 = float(v1->v[1]) * frame1.scale.y + frame1.translate.y;
-                float vz1 = float(v1->v[2]) * frame1.scale.z + frame1.translate.z;
+    /* Decompresses a single frame of MD2 data into the frame cache (if it
+     * isn't already there) and returns its vertices */
+    const UnpackedVertex* _expand_verts(uint16_t frame) {
+        if(slot_for_frame_.empty()) {
+            /* Two frames are needed at once, so at least that many are kept */
+            slot_count_ = std::max<uint16_t>(
+                2, std::min<uint16_t>(MD2Loader::MAX_RESIDENT_FRAMES, frames_.size())
+            );
+
+            slot_for_frame_.resize(frames_.size(), NO_SLOT);
+            resident_frames_.reserve(slot_count_);
+            unpacked_vertices_.reserve(slot_count_ * vertex_count);
+        }
 
-                verts[i].v = Vec3(vx1, vy1, vz1).rotated_by(VERTEX_ROTATION);
-                verts[i].n = ANORMS[v1->normal].rotated_by(VERTEX_ROTATION);
+        uint16_t slot = slot_for_frame_[frame];
+        if(slot != NO_SLOT) {
+            _unlink(slot);
+            _push_front(slot);
+            return &unpacked_vertices_[slot * vertex_count];
+        }
 
-                v1++;
-            }
+        if(resident_frames_.size() < slot_count_) {
+            slot = resident_frames_.size();
+            resident_frames_.push_back(ResidentFrame());
+            unpacked_vertices_.resize(unpacked_vertices_.size() + vertex_count);
+        } else {
+            /* We need to clear out the oldest frame */
+            slot = least_recent_;
+            _unlink(slot);
+            slot_for_frame_[resident_frames_[slot].frame] = NO_SLOT;
         }
+
+        resident_frames_[slot].frame = frame;
+        slot_for_frame_[frame] = slot;
+        _push_front(slot);
+
+        auto verts = &unpacked_vertices_[slot * vertex_count];
+        _decode_frame(frame, verts);
+        return verts;
     }
 
     void prepare_unpack(uint32_t, uint32_t, float, Rig* const, Debug* const = nullptr) override {
@@ -178,38 +290,60 @@ public:
         _S_UNUSED(rig);
         _S_UNUSED(debug);  // We don't have any debugging for MD2 models. Maybe normals?
 
-        _expand_verts(current_frame);
-        _expand_verts(next_frame);
+        thread::Lock<thread::Mutex> lock(frame_cache_lock_);
+
+        /* The current frame was used most recently, so expanding the next
+         * one can't evict it */
+        const UnpackedVertex* v1 = _expand_verts(current_frame);
+        const UnpackedVertex* v2 = _expand_verts(next_frame);
 
-        FrameVertex* v1 = &vertices_[vertex_count * current_frame];
-        FrameVertex* v2 = &vertices_[vertex_count * next_frame];
+        const Vec3* normals = md2_rotated_normals();
+        const Vec2* st = &tex_coords_[0];
 
         out->resize(vertex_count);
         out->move_to_start();
 
-        const auto& current_cache = frame_cache[current_frame];
-        const auto& next_cache = frame_cache[next_frame];
+        for(uint16_t i = 0; i < vertex_count; ++i, ++v1, ++v2, ++st) {
+            const Vec3& n1 = normals[v1->normal];
+            const Vec3& n2 = normals[v2->normal];
 
-        for(uint16_t i = 0; i < vertex_count; ++i) {
-            const auto& v1v = current_cache[i].v;
-            const auto& v2v = next_cache[i].v;
-            const auto& n1 = current_cache[i].n;
-            const auto& n2 = next_cache[i].n;
-
-            out->position(v1v + (v2v - v1v) * t);
-            out->tex_coord0(v1->st);
+            out->position(v1->v + (v2->v - v1->v) * t);
+            out->tex_coord0(*st);
             out->diffuse(smlt::Colour::WHITE);
             out->normal(n1 + (n2 - n1) * t);
             out->move_next();
-
-            ++v1;
-            ++v2;
         }
 
         out->done();
+
+        ++frames_unpacked_;
+    }
+
+    FrameUnpackerStats stats() const override {
+        thread::Lock<thread::Mutex> lock(frame_cache_lock_);
+
+        FrameUnpackerStats ret;
+        ret.compressed_bytes = (
+            vertices_.size() * sizeof(FrameVertex) +
+            tex_coords_.size() * sizeof(Vec2) +
+            frames_.size() * sizeof(FrameTransform)
+        );
+
+        ret.resident_bytes = (
+            unpacked_vertices_.capacity() * sizeof(UnpackedVertex) +
+            resident_frames_.capacity() * sizeof(ResidentFrame) +
+            slot_for_frame_.capacity() * sizeof(uint16_t)
+        );
+
+        ret.frames_decoded = frames_decoded_;
+        ret.frames_unpacked = frames_unpacked_;
+        return ret;
     }
 };
 
+const uint16_t MD2MeshFrameData::NO_FRAME;
+const uint16_t MD2MeshFrameData::NO_SLOT;
+
 typedef std::shared_ptr<MD2MeshFrameData> MD2MeshFrameDataPtr;
 
 
@@ -353,17 +487,19 @@ void MD2Loader::into(Loadable &resource, const LoaderOptions &options) {
                     vert.v[0] = source_vert.v[0];
                     vert.v[1] = source_vert.v[1];
                     vert.v[2] = source_vert.v[2];
-                    vert.normal = source_vert.normal;
-                    vert.st = Vec2(
-                        float(texture_coordinates[triangle.st[i]].s),
-                        float(texture_coordinates[triangle.st[i]].t)
-                    );
-
-                    vert.st.x /= float(header.skinwidth);
-                    vert.st.y /= float(header.skinheight);
-                    vert.st.y *= -1.0f;
+                    vert.normal = (source_vert.normal < ANORM_COUNT) ? source_vert.normal : 0;
 
                     if(current_frame == 0) {
+                        Vec2 st(
+                            float(texture_coordinates[triangle.st[i]].s),
+                            float(texture_coordinates[triangle.st[i]].t)
+                        );
+
+                        st.x /= float(header.skinwidth);
+                        st.y /= float(header.skinheight);
+                        st.y *= -1.0f;
+
+                        frame_data->tex_coords_.push_back(st);
                         submesh->index_data->index(frame_data->vertices_.size());
                     }
 
@@ -381,7 +517,10 @@ void MD2Loader::into(Loadable &resource, const LoaderOptions &options) {
         ++current_frame;
     }
 
-    S_DEBUG("Loaded MD2 data, converting to mesh");
+    S_DEBUG(
+        "Loaded MD2 data ({0} bytes of frame data), converting to mesh",
+        frame_data->stats().compressed_bytes
+    );
 
     mesh->enable_animation(MESH_ANIMATION_TYPE_VERTEX_MORPH, header.num_frames, frame_data);
 
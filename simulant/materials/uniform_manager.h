@@ -50,8 +50,10 @@ enum ShaderAvailableAuto {
     SP_AUTO_LIGHTS_CONSTANT_ATTENUATION,
     SP_AUTO_LIGHTS_LINEAR_ATTENUATION,
     SP_AUTO_LIGHTS_QUADRATIC_ATTENUATION,
-    SP_AUTO_LIGHT_COUNT
+    SP_AUTO_LIGHT_COUNT,
     //TODO: cameras(?)
+
+    SP_AUTO_MAX
 };
 
 }
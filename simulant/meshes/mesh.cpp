@@ -21,6 +21,7 @@
 
 #include "mesh.h"
 #include "adjacency_info.h"
+#include "pose_cache.h"
 #include "../assets/meshes/skeleton.h"
 
 #include "../window.h"
@@ -60,6 +61,7 @@ void Mesh::reset(VertexDataPtr vertex_data) {
 
     animation_type_ = MESH_ANIMATION_TYPE_NONE;
     animation_frames_ = 0;
+    pose_cache_.reset();
 
     done_connection_.disconnect();
 
@@ -80,6 +82,7 @@ void Mesh::reset(VertexSpecification vertex_specification) {
 
     animation_type_ = MESH_ANIMATION_TYPE_NONE;
     animation_frames_ = 0;
+    pose_cache_.reset();
 
     done_connection_.disconnect();
 
@@ -132,10 +135,24 @@ void Mesh::enable_animation(MeshAnimationType animation_type, uint32_t animation
     animation_frames_ = animation_frames;
     animated_frame_data_ = data;
 
+    /* Skeletal poses depend on each actor's rig, so they can't be shared */
+    if(animation_type == MESH_ANIMATION_TYPE_VERTEX_MORPH) {
+        pose_cache_.reset(new PoseCache(this));
+    }
+
+    mark_renderables_changed();
+
     signal_animation_enabled_(this, animation_type_, animation_frames_);
 }
 
+void Mesh::mark_renderables_changed() {
+    renderables_version_ = next_renderables_version();
+}
+
 void Mesh::rebuild_aabb() {
+    /* Called whenever the vertex or index data changes */
+    mark_renderables_changed();
+
     AABB& result = aabb_;
 
     if(!this->submesh_count()) {
@@ -162,6 +179,10 @@ void Mesh::vertex_data_updated() {
         sm->_recalc_bounds(sm->bounds_);
     }
     rebuild_aabb();
+
+    if(pose_cache_) {
+        pose_cache_->clear();
+    }
 }
 
 void Mesh::submesh_index_data_updated(SubMesh* sm) {
@@ -205,6 +226,7 @@ SubMesh* Mesh::new_submesh(
         this, name, mat, index_data, arrangement
     );
     submeshes_.push_back(new_submesh);
+    mark_renderables_changed();
 
     signal_submesh_created_(id(), new_submesh.get());
 
@@ -227,6 +249,7 @@ SubMesh* Mesh::new_submesh(
         this, name, mat, arrangement
     );
     submeshes_.push_back(new_submesh);
+    mark_renderables_changed();
 
     signal_submesh_created_(id(), new_submesh.get());
 
@@ -643,6 +666,8 @@ void Mesh::destroy_submesh(const std::string& name) {
     if(it != submeshes_.end()) {
         auto submesh = (*it);
         submeshes_.erase(it);
+        mark_renderables_changed();
+
         signal_submesh_destroyed_(id(), submesh.get());
     }
 }
@@ -662,22 +687,89 @@ void Mesh::set_material(MaterialPtr material) {
     }
 }
 
+/* Transforms positions by the transform, and normals by the inverse-transpose
+ * of its upper 3x3 so that they stay perpendicular under non-uniform scaling */
+static void transform_vertex_data(VertexData& data, const smlt::Mat4& transform) {
+    auto& spec = data.vertex_specification();
+
+    Mat3 normal_matrix;
+    if(spec.has_normals()) {
+        normal_matrix = Mat3(transform).inversed().transposed();
+    }
+
+    data.move_to_start();
+
+    for(uint32_t i = 0; i < data.count(); ++i) {
+        if(spec.has_positions()) {
+            auto v = data.position_at<Vec3>(i);
+            data.position(v->transformed_by(transform));
+        }
+
+        if(spec.has_normals()) {
+            auto n = data.normal_at<Vec3>(i);
+            data.normal(n->rotated_by(normal_matrix).normalized());
+        }
+        data.move_next();
+    }
+}
+
 void Mesh::transform_vertices(const smlt::Mat4& transform) {
-    vertex_data->move_to_start();
+    transform_vertex_data(*vertex_data, transform);
+    vertex_data->done();
+}
 
-    for(uint32_t i = 0; i < vertex_data->count(); ++i) {
-        if(vertex_data->vertex_specification().has_positions()) {
-            auto v = vertex_data->position_at<Vec3>(i);
-            vertex_data->position(v->transformed_by(transform));
+bool Mesh::append(const MeshPtr& other, const smlt::Mat4& transform, MaterialSlot slot) {
+    auto& spec = vertex_data->vertex_specification();
+    if(other->vertex_data->vertex_specification() != spec) {
+        return false;
+    }
+
+    VertexData vertices(spec);
+    other->vertex_data->clone_into(vertices);
+    transform_vertex_data(vertices, transform);
+
+    uint32_t offset = vertex_data->count();
+    vertex_data->extend(vertices);
+
+    for(auto submesh: other->each_submesh()) {
+        auto arrangement = submesh->arrangement();
+        if(arrangement == MESH_ARRANGEMENT_LINES || arrangement == MESH_ARRANGEMENT_LINE_STRIP) {
+            continue;
         }
 
-        if(vertex_data->vertex_specification().has_normals()) {
-            auto n = vertex_data->normal_at<Vec3>(i);
-            vertex_data->normal(n->rotated_by(transform).normalized());
+        auto material = submesh->material_at_slot(slot, true);
+
+        /* Only reuse submeshes which can hold any index */
+        SubMeshPtr target;
+        for(auto candidate: find_all_submeshes_with_material(material)) {
+            if(candidate->type() == SUBMESH_TYPE_INDEXED &&
+                candidate->arrangement() == MESH_ARRANGEMENT_TRIANGLES &&
+                candidate->index_data->index_type() == INDEX_TYPE_32_BIT) {
+                target = candidate;
+                break;
+            }
         }
-        vertex_data->move_next();
+
+        if(!target) {
+            target = new_submesh(
+                _F("merged{0}").format(submesh_count()),
+                material->id(),
+                INDEX_TYPE_32_BIT
+            );
+        }
+
+        auto& indexes = *target->index_data;
+        submesh->each_triangle([&](uint32_t a, uint32_t b, uint32_t c) {
+            indexes.index(offset + a);
+            indexes.index(offset + b);
+            indexes.index(offset + c);
+        });
+        indexes.done();
     }
+
     vertex_data->done();
+
+    return true;
 }
 
 SubMeshIteratorPair Mesh::each_submesh() {
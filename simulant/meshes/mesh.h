@@ -44,6 +44,7 @@ namespace smlt {
 
 class AssetManager;
 class AdjacencyInfo;
+class PoseCache;
 class Renderer;
 class Rig;
 class Skeleton;
@@ -59,6 +60,21 @@ enum MeshAnimationType {
 typedef sig::signal<void (Mesh*, MeshAnimationType, uint32_t)> SignalAnimationEnabled;
 
 
+/* The memory used by a mesh's animation data, and the work done unpacking it */
+struct FrameUnpackerStats {
+    /* The animation data as loaded */
+    std::size_t compressed_bytes = 0;
+
+    /* Anything decoded from it and kept around to speed up unpacking */
+    std::size_t resident_bytes = 0;
+
+    /* The number of key frames that have been decoded */
+    uint32_t frames_decoded = 0;
+
+    /* The number of times an interpolated frame has been unpacked */
+    uint32_t frames_unpacked = 0;
+};
+
 /* When enabling animations you must pass MeshFrameData which holds all the data necessary to
  * produce a frame
  */
@@ -66,6 +82,10 @@ class FrameUnpacker {
 public:
     virtual ~FrameUnpacker() {}
 
+    virtual FrameUnpackerStats stats() const {
+        return FrameUnpackerStats();
+    }
+
     /*
      * Used to interpolate the rig (if any) or do
      * any other kind of preparation during update()
@@ -273,13 +293,33 @@ public:
     void normalize(); //Scales the mesh so it has a radius of 1.0
     void transform_vertices(const smlt::Mat4& transform);
 
+    /* Appends a copy of other's vertices, transformed by `transform`, along with
+     * its triangles. Triangles are added to an indexed submesh here which uses
+     * the same material (from `slot` of each of other's submeshes), one is
+     * created if necessary. Line submeshes are ignored.
+     *
+     * Returns false, and does nothing, if the vertex specifications differ */
+    bool append(const MeshPtr& other, const smlt::Mat4& transform, MaterialSlot slot=MATERIAL_SLOT0);
+
     SubMeshIteratorPair each_submesh();
 
     void enable_animation(MeshAnimationType animation_type, uint32_t animation_frames, FrameUnpackerPtr data);
     bool is_animated() const { return animation_type_ != MESH_ANIMATION_TYPE_NONE; }
+
+    /* Changes whenever the submeshes, their materials or the vertex/index data change */
+    uint64_t renderables_version() const { return renderables_version_; }
     uint32_t animation_frames() const { return animation_frames_; }
     MeshAnimationType animation_type() const { return animation_type_; }
 
+    /* Returns empty stats if the mesh isn't animated */
+    FrameUnpackerStats animation_stats() const {
+        return (animated_frame_data_) ? animated_frame_data_->stats() : FrameUnpackerStats();
+    }
+
+    /* Vertex-morph animated meshes share interpolated poses between
+     * actors, returns nullptr for anything else */
+    PoseCache* pose_cache() const { return pose_cache_.get(); }
+
     /* Generates adjacency information for this mesh. This is necessary for stencil shadowing
      * to work */
     void generate_adjacency_info();
@@ -302,6 +342,7 @@ public:
 private:
     friend class SubMesh;
     friend class Actor;
+    friend class PoseCache;
 
     Skeleton* skeleton_ = nullptr;
 
@@ -309,6 +350,7 @@ private:
     MeshAnimationType animation_type_ = MESH_ANIMATION_TYPE_NONE;
     uint32_t animation_frames_ = 0;
     FrameUnpackerPtr animated_frame_data_;
+    std::unique_ptr<PoseCache> pose_cache_;
 
     std::vector<std::shared_ptr<SubMesh>> submeshes_;
 
@@ -319,6 +361,9 @@ private:
     void rebuild_aabb();
     AABB aabb_;
 
+    uint64_t renderables_version_ = 0;
+    void mark_renderables_changed();
+
     /* Automatically maintain adjacency info for submeshes or not */
     bool maintain_adjacency_info_ = true;
     std::unique_ptr<AdjacencyInfo> adjacency_;
@@ -0,0 +1,90 @@
+#include <cmath>
+#include <algorithm>
+
+#include "pose_cache.h"
+#include "mesh.h"
+
+namespace smlt {
+
+std::shared_ptr<VertexData> PoseCache::fetch(uint32_t current_frame, uint32_t next_frame, float interp, uint64_t render_frame) {
+    const uint8_t step = uint8_t(std::round(
+        std::min(std::max(interp, 0.0f), 1.0f) * POSE_CACHE_INTERP_STEPS
+    ));
+
+    Pose* pose = nullptr;
+
+    {
+        thread::Lock<thread::Mutex> lock(lock_);
+
+        if(render_frame != render_frame_) {
+            recycle_unused_poses(render_frame);
+        }
+
+        auto& slot = poses_[PoseKey(current_frame, next_frame, step)];
+        if(!slot) {
+            if(spare_poses_.empty()) {
+                slot.reset(new Pose());
+                slot->vertex_data = std::make_shared<VertexData>(
+                    mesh_->vertex_data->vertex_specification()
+                );
+            } else {
+                slot = std::move(spare_poses_.back());
+                spare_poses_.pop_back();
+                slot->unpacked = false;
+            }
+        }
+
+        slot->render_frame = render_frame;
+        pose = slot.get();
+    }
+
+    /* Poses are only recycled between frames, so this is safe outside
+     * the cache lock */
+    thread::Lock<thread::Mutex> lock(pose->lock);
+    if(!pose->unpacked) {
+        mesh_->animated_frame_data_->unpack_frame(
+            current_frame, next_frame,
+            float(step) / float(POSE_CACHE_INTERP_STEPS),
+            nullptr,
+            pose->vertex_data.get()
+        );
+
+        pose->unpacked = true;
+
+        thread::Lock<thread::Mutex> cache_lock(lock_);
+        ++unpack_count_;
+    }
+
+    return pose->vertex_data;
+}
+
+void PoseCache::recycle_unused_poses(uint64_t render_frame) {
+    /* Anything used during the last frame is likely to be used again */
+    for(auto it = poses_.begin(); it != poses_.end();) {
+        if(it->second->render_frame != render_frame_) {
+            spare_poses_.push_back(std::move(it->second));
+            it = poses_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    render_frame_ = render_frame;
+}
+
+void PoseCache::clear() {
+    thread::Lock<thread::Mutex> lock(lock_);
+
+    for(auto& pair: poses_) {
+        spare_poses_.push_back(std::move(pair.second));
+    }
+
+    poses_.clear();
+}
+
+std::size_t PoseCache::pose_count() const {
+    thread::Lock<thread::Mutex> lock(lock_);
+    return poses_.size();
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "../threads/mutex.h"
+
+namespace smlt {
+
+class Mesh;
+class VertexData;
+
+/*
+ * The interpolated poses of a vertex-morph animated mesh, shared between
+ * the actors using it. A crowd of actors playing the same animation land
+ * on the same few poses, each pose is unpacked once and the actors render
+ * the same vertex data (and so the same GPU buffer).
+ *
+ * Poses are looked up by their key frames and the interpolation between
+ * them, quantised to POSE_CACHE_INTERP_STEPS. A pose that wasn't used
+ * during the previous render frame is recycled.
+ *
+ * Skeletal meshes don't have one, the pose depends on the actor's rig.
+ */
+
+const uint8_t POSE_CACHE_INTERP_STEPS = 64;
+
+class PoseCache {
+public:
+    PoseCache(Mesh* mesh):
+        mesh_(mesh) {}
+
+    /* Returns vertex data with the pose unpacked into it. Thread-safe, actors
+     * asking for the same pose at the same time will wait for one of them
+     * to unpack it */
+    std::shared_ptr<VertexData> fetch(
+        uint32_t current_frame,
+        uint32_t next_frame,
+        float interp,
+        uint64_t render_frame
+    );
+
+    /* Forgets every pose, e.g. when the mesh vertex data changes */
+    void clear();
+
+    std::size_t pose_count() const;
+
+    /* The number of times a pose has been unpacked */
+    uint32_t unpack_count() const { return unpack_count_; }
+
+private:
+    typedef std::tuple<uint32_t, uint32_t, uint8_t> PoseKey;
+
+    struct Pose {
+        uint64_t render_frame = 0;
+        bool unpacked = false;
+        std::shared_ptr<VertexData> vertex_data;
+        thread::Mutex lock;
+    };
+
+    void recycle_unused_poses(uint64_t render_frame);
+
+    Mesh* mesh_ = nullptr;
+
+    mutable thread::Mutex lock_;
+    uint64_t render_frame_ = 0;
+    uint32_t unpack_count_ = 0;
+
+    std::map<PoseKey, std::unique_ptr<Pose>> poses_;
+
+    /* Recycled poses keep their vertex data, so it doesn't need to be
+     * reallocated (or a GPU buffer found for it) */
+    std::vector<std::unique_ptr<Pose>> spare_poses_;
+};
+
+}
@@ -63,11 +63,13 @@ bool SubMesh::add_vertex_range(uint32_t start, uint32_t count) {
     }
 
     vertex_ranges_.push_back(VertexRange{start, count});
+    parent_->mark_renderables_changed();
     return true;
 }
 
 void SubMesh::remove_all_vertex_ranges() {
     vertex_ranges_.clear();
+    parent_->mark_renderables_changed();
 }
 
 void SubMesh::set_diffuse(const smlt::Colour& colour) {
@@ -448,6 +450,8 @@ void SubMesh::set_material_at_slot(MaterialSlot var, const MaterialPtr &mat) {
         materials_[var].reset();
     }
 
+    parent_->mark_renderables_changed();
+
     signal_material_changed_(this, var, old_material_id, mat->id());
     parent_->signal_submesh_material_changed_(
         parent_->id(),
@@ -24,6 +24,10 @@
 #include "../animation.h"
 #include "../renderers/renderer.h"
 #include "../assets/meshes/rig.h"
+#include "../meshes/pose_cache.h"
+#include "../application.h"
+#include "../window.h"
+#include "../compositor.h"
 
 #define DEBUG_ANIMATION 0  /* If enabled, will show debug animation overlay */
 
@@ -94,6 +98,7 @@ void Actor::set_mesh(MeshID mesh, DetailLevel detail_level) {
         meshes_[detail_level].reset();
         interpolated_vertex_data_.reset();
         recalc_effective_meshes();
+        mark_renderables_changed();
 
         // FIXME: Delete vertex buffer!
         return;
@@ -118,6 +123,7 @@ void Actor::set_mesh(MeshID mesh, DetailLevel detail_level) {
         using namespace std::placeholders;
 
         interpolated_vertex_data_ = std::make_shared<VertexData>(meshes_[DETAIL_LEVEL_NEAREST]->vertex_data->vertex_specification());
+        interpolated_frame_ = NEVER_INTERPOLATED;
         animation_state_ = std::make_shared<KeyFrameAnimationState>(
             meshes_[detail_level].get(),
             std::bind(&Actor::refresh_animation_state, this, _1, _2, _3)
@@ -147,6 +153,7 @@ void Actor::set_mesh(MeshID mesh, DetailLevel detail_level) {
     }
 
     recalc_effective_meshes();
+    mark_renderables_changed();
 
     /* Recalculate the AABB if necessary */
     mark_transformed_aabb_dirty();
@@ -241,21 +248,8 @@ void Actor::_get_renderables(batcher::RenderQueue* render_queue, const CameraPtr
     }
 
     if(mesh->is_animated()) {
-        /*
-         * Update the vertices for the animated base mesh if that's the
-         * detail level we're using - if this is a skeletal animation then
-         * the current rig will be used
-         */
-        mesh->animated_frame_data_->unpack_frame(
-            animation_state->current_frame(),
-            animation_state->next_frame(),
-            animation_state->interp(),
-            rig_.get(),
-            interpolated_vertex_data_.get()
-    #if DEBUG_ANIMATION
-            , stage->debug
-    #endif
-        );
+        /* Normally a no-op, the compositor will have done this already */
+        _update_animated_vertices(get_app()->window->compositor->render_frame());
     }
 
     auto vdata = (has_animated_mesh()) ?
@@ -281,6 +275,63 @@ void Actor::_get_renderables(batcher::RenderQueue* render_queue, const CameraPtr
     }
 }
 
+void Actor::_update_animated_vertices(uint64_t render_frame) {
+    auto& mesh = meshes_[DETAIL_LEVEL_NEAREST];
+    if(!has_animated_mesh_ || !mesh) {
+        return;
+    }
+
+    thread::Lock<thread::Mutex> lock(interpolation_lock_);
+    if(interpolated_frame_ == render_frame) {
+        return;
+    }
+
+    if(mesh->pose_cache()) {
+        /* Other actors showing the same pose share the vertex data */
+        interpolated_vertex_data_ = mesh->pose_cache()->fetch(
+            animation_state->current_frame(),
+            animation_state->next_frame(),
+            animation_state->interp(),
+            render_frame
+        );
+    } else {
+        /* If this is a skeletal animation then the current rig will be used */
+        mesh->animated_frame_data_->unpack_frame(
+            animation_state->current_frame(),
+            animation_state->next_frame(),
+            animation_state->interp(),
+            rig_.get(),
+            interpolated_vertex_data_.get()
+#if DEBUG_ANIMATION
+            , stage->debug
+#endif
+        );
+    }
+
+    interpolated_frame_ = render_frame;
+}
+
+uint64_t Actor::renderables_version(const CameraPtr& camera, DetailLevel detail_level) const {
+    auto version = StageNode::renderables_version(camera, detail_level);
+
+    /* Versions are never reused, so whichever is newest tells us
+     * if either the actor or its mesh has changed */
+    auto& mesh = find_mesh(detail_level);
+    if(mesh) {
+        auto mesh_version = (mesh->renderables_version() << 3) | uint64_t(detail_level);
+        version = std::max(version, mesh_version);
+    }
+
+    return version;
+}
+
+void Actor::on_render_priority_changed(RenderPriority old_priority, RenderPriority new_priority) {
+    _S_UNUSED(old_priority);
+    _S_UNUSED(new_priority);
+
+    mark_renderables_changed();
+}
+
 void Actor::recalc_effective_meshes() {
     MeshPtr current = meshes_[0];
     for(auto i = 0; i < DETAIL_LEVEL_MAX; ++i) {
@@ -19,6 +19,8 @@
 #ifndef ENTITY_H
 #define ENTITY_H
 
+#include <limits>
+
 #include "../generic/identifiable.h"
 #include "../generic/managed.h"
 
@@ -32,6 +34,7 @@
 
 #include "../renderers/batching/render_queue.h"
 #include "../renderers/batching/renderable.h"
+#include "../threads/mutex.h"
 
 namespace smlt {
 
@@ -80,8 +83,25 @@ public:
 
     void _get_renderables(batcher::RenderQueue* render_queue, const CameraPtr camera, const DetailLevel detail_level) override;
 
+    /* Unpacks the current animation frame (skinning it with the rig, if any)
+     * into the vertex data that's rendered, unless that's already been done
+     * for render_frame. The compositor calls this for every visible animated
+     * actor before building the render queues, so an actor seen by several
+     * pipelines is only skinned once per frame. Thread-safe. */
+    void _update_animated_vertices(uint64_t render_frame);
+
+    /* Animated meshes are unpacked each frame, everything else can be cached */
+    bool has_static_renderables() const override {
+        return !has_animated_mesh_;
+    }
+
+    uint64_t renderables_version(const CameraPtr& camera, DetailLevel detail_level) const override;
+
     void use_material_slot(MaterialSlot var) {
-        material_slot_ = var;
+        if(var != material_slot_) {
+            material_slot_ = var;
+            mark_renderables_changed();
+        }
     }
 
     MaterialSlot active_material_slot() const {
@@ -110,6 +130,14 @@ private:
     // Used for animated meshes
     std::shared_ptr<VertexData> interpolated_vertex_data_;
 
+    /* Several pipelines can gather renderables at the same time, this
+     * stops them unpacking into interpolated_vertex_data_ at once */
+    thread::Mutex interpolation_lock_;
+
+    /* The compositor frame interpolated_vertex_data_ was last unpacked for */
+    static const uint64_t NEVER_INTERPOLATED = std::numeric_limits<uint64_t>::max();
+    uint64_t interpolated_frame_ = NEVER_INTERPOLATED;
+
     /* Meshes specified for each level */
     MeshPtr meshes_[DETAIL_LEVEL_MAX];
 
@@ -128,6 +156,8 @@ private:
 
     void update(float dt) override;
 
+    void on_render_priority_changed(RenderPriority old_priority, RenderPriority new_priority) override;
+
     sig::connection submesh_created_connection_;
     sig::connection submesh_destroyed_connection_;
 
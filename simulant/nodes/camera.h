@@ -47,10 +47,17 @@ public:
     // Converts a pixel to OpenGL units (z-input should be read from the depth buffer)
     smlt::optional<Vec3> unproject_point(const RenderTarget& target, const Viewport& viewport, const Vec3& win_point);
 
-    const Mat4& view_matrix() const { return view_matrix_; }
+    const Mat4& view_matrix() const {
+        update_transformation_if_necessary();
+        return view_matrix_;
+    }
+
     const Mat4& projection_matrix() const { return projection_matrix_; }
 
-    Frustum& frustum() { return frustum_; }
+    Frustum& frustum() {
+        update_transformation_if_necessary();
+        return frustum_;
+    }
 
     void set_perspective_projection(const Degrees &fov, float aspect, float near=1.0f, float far=1000.0f);
     void set_orthographic_projection(float left, float right, float bottom, float top, float near=-1.0, float far=1.0);
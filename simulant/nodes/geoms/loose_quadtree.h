@@ -3,6 +3,7 @@
 #include <cstdint>
 #include "../../math/aabb.h"
 #include "../../frustum.h"
+#include "../../frustum_culling.h"
 #include "../../generic/check_signature.h"
 
 namespace smlt {
@@ -154,13 +155,45 @@ private:
     template<typename Callback>
     void _visible_visitor(const Frustum& frustum, const Callback& callback, Quadtree::Node& node) {
         if(frustum.intersects_cube(node.centre, node.size * 2.0f)) {
-            callback(&node);
+            _visit_visible_node(frustum, callback, node);
+        }
+    }
 
-            if(!is_leaf(node)) {
-                for(auto child: node.child_indexes) {
-                    assert(child < nodes_.size());
-                    _visible_visitor(frustum, callback, nodes_[child]);
-                }
+    template<typename Callback>
+    void _visit_visible_node(const Frustum& frustum, const Callback& callback, Quadtree::Node& node) {
+        callback(&node);
+
+        if(is_leaf(node)) {
+            return;
+        }
+
+        /* Cull all the children in one go. Nodes are loose
+         * so their bounds are double their size */
+        const uint32_t count = 4;
+        float mins[3][count];
+        float maxs[3][count];
+
+        for(uint32_t i = 0; i < count; ++i) {
+            assert(node.child_indexes[i] < nodes_.size());
+            auto& child = nodes_[node.child_indexes[i]];
+
+            mins[0][i] = child.centre.x - child.size;
+            mins[1][i] = child.centre.y - child.size;
+            mins[2][i] = child.centre.z - child.size;
+            maxs[0][i] = child.centre.x + child.size;
+            maxs[1][i] = child.centre.y + child.size;
+            maxs[2][i] = child.centre.z + child.size;
+        }
+
+        const float* min_arrays[3] = {mins[0], mins[1], mins[2]};
+        const float* max_arrays[3] = {maxs[0], maxs[1], maxs[2]};
+
+        uint32_t visible = 0;
+        cull_aabbs(frustum, min_arrays, max_arrays, count, &visible);
+
+        for(uint32_t i = 0; i < count; ++i) {
+            if(visible & (1u << i)) {
+                _visit_visible_node(frustum, callback, nodes_[node.child_indexes[i]]);
             }
         }
     }
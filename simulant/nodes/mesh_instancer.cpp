@@ -1,6 +1,10 @@
+#include <cstring>
+#include <algorithm>
+
 #include "mesh_instancer.h"
 #include "../stage.h"
 #include "../meshes/mesh.h"
+#include "camera.h"
 
 namespace smlt {
 
@@ -24,6 +28,7 @@ const AABB &MeshInstancer::aabb() const {
 
 void MeshInstancer::set_mesh(MeshPtr mesh) {
     mesh_ = mesh;
+    mark_renderables_changed();
 
     /* Recalc the local AABBs for the new mesh */
     for(auto& i: instances_) {
@@ -32,6 +37,7 @@ void MeshInstancer::set_mesh(MeshPtr mesh) {
 
     /* recalc as a whole */
     recalc_aabb();
+    mark_instance_bounds_dirty();
 }
 
 MeshPtr MeshInstancer::mesh() const {
@@ -46,6 +52,8 @@ MeshInstanceID MeshInstancer::new_mesh_instance(const Vec3 &position, const Quat
     i.recalc_aabb(mesh_);
 
     instances_.insert(std::make_pair(i.id, i));
+    mark_renderables_changed();
+    mark_instance_bounds_dirty();
 
     /* Recalculate the aabb for the instancer as a whole */
     recalc_aabb();
@@ -58,6 +66,8 @@ bool MeshInstancer::destroy_mesh_instance(MeshInstanceID mid) {
     if(it != instances_.end()) {
         instances_.erase(it);
         recalc_aabb();
+        mark_renderables_changed();
+        mark_instance_bounds_dirty();
 
         return true;
     }
@@ -69,6 +79,7 @@ bool MeshInstancer::show_mesh_instance(MeshInstanceID mid) {
     auto it = instances_.find(mid);
     if(it != instances_.end()) {
         it->second.is_visible = true;
+        mark_renderables_changed();
         return true;
     }
 
@@ -79,12 +90,73 @@ bool MeshInstancer::hide_mesh_instance(MeshInstanceID mid) {
     auto it = instances_.find(mid);
     if(it != instances_.end()) {
         it->second.is_visible = false;
+        mark_renderables_changed();
         return true;
     }
 
     return false;
 }
 
+uint64_t MeshInstancer::renderables_version(const CameraPtr& camera, DetailLevel detail_level) const {
+    thread::Lock<thread::Mutex> lock(culling_lock_);
+
+    auto version = StageNode::renderables_version(camera, detail_level);
+
+    if(camera && !instances_.empty()) {
+        /* Which instances are culled changes the renderables, but only
+         * for this camera's queue */
+        auto entry = visibility_for_camera(camera);
+
+        VisibilityMask visible;
+        cull_instances(camera, visible);
+
+        if(!entry->version || visible != entry->visible) {
+            entry->visible = std::move(visible);
+            entry->version = next_renderables_version();
+        }
+
+        entry->is_current = true;
+
+        version = std::max(version, (entry->version << 3) | uint64_t(detail_level));
+    }
+
+    if(mesh_) {
+        version = std::max(
+            version, (mesh_->renderables_version() << 3) | uint64_t(detail_level)
+        );
+    }
+
+    return version;
+}
+
+MeshInstancer::CameraVisibility* MeshInstancer::visibility_for_camera(const CameraPtr& camera) const {
+    auto camera_id = camera->id();
+    for(auto& entry: camera_visibility_) {
+        if(entry.camera_id == camera_id) {
+            return &entry;
+        }
+    }
+
+    /* IDs aren't reused, but destroyed cameras would build up */
+    camera_visibility_.erase(
+        std::remove_if(camera_visibility_.begin(), camera_visibility_.end(), [this](const CameraVisibility& entry) {
+            return !get_stage()->has_camera(entry.camera_id);
+        }),
+        camera_visibility_.end()
+    );
+
+    camera_visibility_.push_back(CameraVisibility());
+    camera_visibility_.back().camera_id = camera_id;
+    return &camera_visibility_.back();
+}
+
+void MeshInstancer::on_render_priority_changed(RenderPriority old_priority, RenderPriority new_priority) {
+    _S_UNUSED(old_priority);
+    _S_UNUSED(new_priority);
+
+    mark_renderables_changed();
+}
+
 void MeshInstancer::recalc_aabb() {
     AABB new_aabb;
 
@@ -97,6 +169,54 @@ void MeshInstancer::recalc_aabb() {
     std::swap(aabb_, new_aabb);
 }
 
+void MeshInstancer::mark_instance_bounds_dirty() {
+    thread::Lock<thread::Mutex> lock(culling_lock_);
+    instance_bounds_dirty_ = true;
+
+    /* The masks were for the previous instances */
+    for(auto& entry: camera_visibility_) {
+        entry.is_current = false;
+    }
+}
+
+void MeshInstancer::cull_instances(const CameraPtr& camera, VisibilityMask& visible) const {
+    /* The instancer can be moved by its parent without being told,
+     * so check the transformation too */
+    auto transform = absolute_transformation();
+    if(std::memcmp(transform.data(), instance_bounds_transform_.data(), sizeof(float) * 16) != 0) {
+        instance_bounds_transform_ = transform;
+        instance_bounds_dirty_ = true;
+    }
+
+    if(instance_bounds_dirty_) {
+        culled_instances_.clear();
+        instance_bounds_.clear();
+        instance_bounds_.reserve(instances_.size());
+
+        for(auto& instance: instances_) {
+            auto corners = instance.second.aabb.corners();
+            for(auto& corner: corners) {
+                corner = corner.transformed_by(transform);
+            }
+
+            culled_instances_.push_back(&instance.second);
+            instance_bounds_.push_back(AABB(corners.data(), corners.size()));
+        }
+
+        instance_bounds_dirty_ = false;
+    }
+
+    if(camera) {
+        cull_aabbs(camera->frustum(), instance_bounds_, visible);
+    } else {
+        /* No camera to cull against, everything is visible */
+        visible.reset(instance_bounds_.size());
+        for(std::size_t i = 0; i < visible.size(); ++i) {
+            visible.set(i);
+        }
+    }
+}
+
 void MeshInstancer::on_transformation_changed() {
     StageNode::on_transformation_changed();
 
@@ -120,9 +240,23 @@ void MeshInstancer::_get_renderables(
         return;
     }
 
-    _S_UNUSED(camera);
     _S_UNUSED(detail_level);  // FIXME: Support detail levels like actors?
 
+    thread::Lock<thread::Mutex> lock(culling_lock_);
+
+    /* Use the mask from renderables_version() if nothing has been culled
+     * for this camera since */
+    VisibilityMask culled;
+    const VisibilityMask* visible = &culled;
+
+    auto entry = (camera) ? visibility_for_camera(camera) : nullptr;
+    if(entry && entry->is_current) {
+        entry->is_current = false;
+        visible = &entry->visible;
+    } else {
+        cull_instances(camera, culled);
+    }
+
     for(auto submesh: mesh_->each_submesh()) {
         Renderable new_renderable;
 
@@ -137,13 +271,28 @@ void MeshInstancer::_get_renderables(
         // FIXME: Support material slots like actors?
         new_renderable.material = submesh->material_at_slot(MATERIAL_SLOT0, true).get();
 
-        for(auto& mesh_instance: instances_) {
+        /* Opaque instances all share the same centre, so that they stay
+         * together when the render queue is sorted and the renderer can
+         * draw them in one go. Blended instances must be sorted individually */
+        bool is_blended = false;
+        for(auto i = 0u; i < new_renderable.material->pass_count(); ++i) {
+            is_blended = is_blended || new_renderable.material->pass(i)->is_blending_enabled();
+        }
+
+        new_renderable.centre = transformed_aabb().centre();
+
+        visible->each_set([&](std::size_t i) {
+            auto mesh_instance = culled_instances_[i];
+
             auto to_insert = new_renderable;  // Create a copy
-            to_insert.final_transformation = mesh_instance.second.abs_transformation;
-            to_insert.is_visible = mesh_instance.second.is_visible;
-            to_insert.centre = mesh_instance.second.aabb.centre();
+            to_insert.final_transformation = mesh_instance->abs_transformation;
+            to_insert.is_visible = mesh_instance->is_visible;
+            if(is_blended) {
+                to_insert.centre = instance_bounds_.at(i).centre();
+            }
+
             render_queue->insert_renderable(std::move(to_insert));
-        }
+        });
     }
 }
 
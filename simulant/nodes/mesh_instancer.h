@@ -9,6 +9,8 @@
 #include "../sound.h"
 #include "../generic/manual_object.h"
 #include "../generic/containers/contiguous_map.h"
+#include "../threads/mutex.h"
+#include "../frustum_culling.h"
 
 namespace smlt {
 
@@ -31,6 +33,8 @@ typedef std::size_t MeshInstanceID;
  * instance, or remove an instance.
  *
  * The bounds of a MeshInstancer are the sum bounds of all its instances.
+ * Instances outside of the camera frustum are culled individually when
+ * gathering renderables.
  *
  * Spawning animated meshes is currently unsupported.
  */
@@ -89,6 +93,12 @@ public:
         const DetailLevel detail_level
     ) override;
 
+    bool has_static_renderables() const override {
+        return true;
+    }
+
+    uint64_t renderables_version(const CameraPtr& camera, DetailLevel detail_level) const override;
+
 private:
     UniqueIDKey make_key() const override {
         return make_unique_id_key(id());
@@ -103,6 +113,8 @@ private:
 
     void on_transformation_changed();
 
+    void on_render_priority_changed(RenderPriority old_priority, RenderPriority new_priority) override;
+
     struct MeshInstance {
         uint32_t id = 0;
         bool is_visible = true;
@@ -118,6 +130,38 @@ private:
 
     /* FIXME: Convert to ContiguousMap when it has erase... */
     std::unordered_map<uint32_t, MeshInstance> instances_;
+
+    /* World space bounds of each instance for culling, in the same
+     * order as culled_instances_. Rebuilt lazily as render queues can be
+     * built from several threads */
+    mutable thread::Mutex culling_lock_;
+    mutable bool instance_bounds_dirty_ = true;
+    mutable Mat4 instance_bounds_transform_;
+    mutable std::vector<const MeshInstance*> culled_instances_;
+    mutable AABBList instance_bounds_;
+
+    void mark_instance_bounds_dirty();
+
+    /* The instances visible to each camera when renderables_version() was
+     * last called with it. Each camera has its own version, which changes
+     * when its mask does, and _get_renderables reuses a mask once rather
+     * than culling again. culling_lock_ must be held */
+    struct CameraVisibility {
+        CameraID camera_id;
+        VisibilityMask visible;
+        uint64_t version = 0;
+        bool is_current = false;
+    };
+
+    mutable std::vector<CameraVisibility> camera_visibility_;
+
+    /* Returns the entry for the camera, adding one (and dropping any for
+     * destroyed cameras) if there isn't one yet */
+    CameraVisibility* visibility_for_camera(const CameraPtr& camera) const;
+
+    /* Sets a bit in visible for each entry in culled_instances_ which
+     * intersects the camera frustum. culling_lock_ must be held */
+    void cull_instances(const CameraPtr& camera, VisibilityMask& visible) const;
 };
 
 
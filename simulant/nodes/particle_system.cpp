@@ -1,8 +1,10 @@
 #include "particle_system.h"
 
+#include "../application.h"
 #include "../frustum.h"
 #include "../stage.h"
 #include "../types.h"
+#include "../threads/job_system.h"
 #include "camera.h"
 
 namespace smlt {
@@ -26,7 +28,6 @@ ParticleSystem::ParticleSystem(Stage* stage, SoundDriver* sound_driver, Particle
     StageNode(stage, STAGE_NODE_TYPE_PARTICLE_SYSTEM),
     AudioSource(stage, this, sound_driver),
     script_(script),
-    vertex_data_(new VertexData(PS_VERTEX_SPEC)),
     index_data_(new IndexData(INDEX_TYPE_16_BIT)) {
 
     // Initialize the emitter states
@@ -41,7 +42,7 @@ ParticleSystem::ParticleSystem(Stage* stage, SoundDriver* sound_driver, Particle
 }
 
 ParticleSystem::~ParticleSystem() {
-    delete vertex_data_;
+    camera_vertex_data_.clear();
     vertex_data_ = nullptr;
 
     delete index_data_;
@@ -129,15 +130,28 @@ void ParticleSystem::_get_renderables(batcher::RenderQueue* render_queue, const
         return;
     }
 
-    /* Rebuild the vertex data with the current camera direction */
-    rebuild_vertex_data(camera->up(), camera->right());
+    VertexData* vertex_data = nullptr;
+    {
+        thread::Lock<thread::Mutex> lock(vertex_data_lock_);
+
+        /* Rebuild the vertex data with the current camera direction */
+        vertex_data = vertex_data_for_camera(camera);
+        rebuild_vertex_data(vertex_data, camera->up(), camera->right());
+
+        /* The indexes only depend on the particle count */
+        if(index_data_->count() != particle_count_ * 4) {
+            rebuild_index_data();
+        }
+
+        vertex_data_ = vertex_data;
+    }
 
     Renderable new_renderable;
     new_renderable.arrangement = MESH_ARRANGEMENT_QUADS;
     new_renderable.render_priority = render_priority();
     new_renderable.final_transformation = Mat4();
     new_renderable.index_data = index_data_;
-    new_renderable.vertex_data = vertex_data_;
+    new_renderable.vertex_data = vertex_data;
     new_renderable.index_element_count = index_data_->count();
     new_renderable.is_visible = true;
     new_renderable.material = script_->material().get();
@@ -146,97 +160,116 @@ void ParticleSystem::_get_renderables(batcher::RenderQueue* render_queue, const
     render_queue->insert_renderable(std::move(new_renderable));
 }
 
-void ParticleSystem::rebuild_vertex_data(const smlt::Vec3& up, const smlt::Vec3& right) {
-    vertex_data_->resize(particle_count_ * 4);
-    vertex_data_->move_to_start();
+VertexData* ParticleSystem::vertex_data_for_camera(const Camera* camera) {
+    for(auto& entry: camera_vertex_data_) {
+        if(entry.camera == camera) {
+            entry.last_used_update = update_count_;
+            return entry.vertex_data.get();
+        }
+    }
+
+    CameraVertexData entry;
+    entry.camera = camera;
+    entry.vertex_data.reset(new VertexData(PS_VERTEX_SPEC));
+    entry.last_used_update = update_count_;
+    camera_vertex_data_.push_back(std::move(entry));
+    return camera_vertex_data_.back().vertex_data.get();
+}
+
+void ParticleSystem::release_unused_vertex_data() {
+    thread::Lock<thread::Mutex> lock(vertex_data_lock_);
+
+    /* Drop the vertex data for cameras that haven't seen us for
+     * a couple of updates (e.g. they were destroyed) */
+    for(auto it = camera_vertex_data_.begin(); it != camera_vertex_data_.end();) {
+        if(it->last_used_update + 2 < update_count_) {
+            if(it->vertex_data.get() == vertex_data_) {
+                vertex_data_ = nullptr;
+            }
+
+            it = camera_vertex_data_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ParticleSystem::rebuild_vertex_data(VertexData* vertex_data, const smlt::Vec3& up, const smlt::Vec3& right) {
+    vertex_data->resize(particle_count_ * 4);
+
+    if(particle_count_) {
+        auto& spec = vertex_data->vertex_specification();
+        auto stride = vertex_data->stride();
+        auto position_offset = spec.position_offset();
+        auto texcoord_offset = spec.texcoord0_offset();
+        auto diffuse_offset = spec.diffuse_offset();
+        auto data = vertex_data->data();
+
+        for_each_chunk([&](std::size_t first, std::size_t count) {
+            particles::expand_billboards(
+                particles_.range(first, count), up, right,
+                data + (first * 4 * stride), stride,
+                position_offset, texcoord_offset, diffuse_offset
+            );
+        });
+    }
+
+    vertex_data->done();
+}
 
+void ParticleSystem::rebuild_index_data() {
     /* FIXME: Remove this when #193 is complete */
     index_data_->resize(particle_count_ * 4);
     index_data_->clear();
 
-    auto i = 0;
-    for(auto j = 0u; j < particle_count_; ++j) {
-        auto& p = particles_[j];
-
-        auto scaled_up = up * p.dimensions.y;
-        auto scaled_right = right * p.dimensions.x;
-        auto half_up = scaled_up * 0.5f;
-        auto half_right = scaled_right * 0.5f;
-
-        auto pos = p.position;
-        pos += -half_up;
-        pos += -half_right;
-
-        vertex_data_->position(pos);
-        vertex_data_->diffuse(p.colour);
-        vertex_data_->tex_coord0(0, 0);
-        vertex_data_->move_next();
-
-        pos += scaled_right;
-        vertex_data_->position(pos);
-        vertex_data_->diffuse(p.colour);
-        vertex_data_->tex_coord0(1, 0);
-        vertex_data_->move_next();
-
-        pos += scaled_up;
-        vertex_data_->position(pos);
-        vertex_data_->diffuse(p.colour);
-        vertex_data_->tex_coord0(1, 1);
-        vertex_data_->move_next();
-
-        pos += -scaled_right;
-        vertex_data_->position(pos);
-        vertex_data_->diffuse(p.colour);
-        vertex_data_->tex_coord0(0, 1);
-        vertex_data_->move_next();
-
-        index_data_->index(i++);
-        index_data_->index(i++);
-        index_data_->index(i++);
-        index_data_->index(i++);
+    for(auto i = 0u; i < particle_count_ * 4; ++i) {
+        index_data_->index(i);
     }
 
-    vertex_data_->done();
     index_data_->done();
 }
 
 void ParticleSystem::update(float dt) {
+    ++update_count_;
+    release_unused_vertex_data();
+
     /* Don't update anything at all if we're hidden */
     if(!is_visible() && !update_when_hidden()) {
         return;
     }
 
-    if(particles_.size() != script_->quota()) {
+    if(particles_.capacity() != script_->quota()) {
         particles_.resize(script_->quota());
-        particles_.shrink_to_fit();
-        particle_count_ = std::min(particle_count_, particles_.size());
+        particle_count_ = std::min(particle_count_, particles_.capacity());
     }
 
-    // Update existing particles, erase any that are dead
-    for(auto i = 0u; i < particle_count_; ++i) {
-        Particle& particle = particles_[i];
-
-        particle.position += particle.velocity * dt;
-        particle.ttl -= dt;
-
-        if(particle.ttl <= 0) {
-            // Swap dead particles to the end of the
-            // vector and decrease the particle count
-            // this means active particles are at the
-            // start of the vector
-            std::swap(particles_[i], particles_[particle_count_ - 1]);
-
+    for_each_chunk([&](std::size_t first, std::size_t count) {
+        particles::integrate_particles(particles_.range(first, count), dt);
+    });
+
+    // Erase any dead particles by moving the last live particle
+    // into their slot and decreasing the particle count. This means
+    // active particles are at the start of the streams
+    const float* ttl = particles_.stream(particles::PARTICLE_STREAM_TTL);
+    for(std::size_t i = 0; i < particle_count_;) {
+        if(ttl[i] <= 0) {
+            particles_.move(particle_count_ - 1, i);
             --particle_count_;
-            assert(particle_count_ < particles_.size());
+        } else {
+            ++i;
         }
     }
 
     // Run any manipulations on the particles, we do this before
     // we add new particles - otherwise they get manipulated before they're
     // even displayed!
-    for(auto i = 0u; i < script_->manipulator_count(); ++i) {
-        auto manipulator = script_->manipulator(i);
-        manipulator->manipulate(this, &particles_[0], particle_count_, dt);
+    if(particle_count_ && script_->manipulator_count()) {
+        for_each_chunk([&](std::size_t first, std::size_t count) {
+            auto range = particles_.range(first, count);
+            for(auto i = 0u; i < script_->manipulator_count(); ++i) {
+                script_->manipulator(i)->manipulate(this, range, dt);
+            }
+        });
     }
 
     for(auto i = 0u; i < script_->emitter_count(); ++i) {
@@ -247,7 +280,7 @@ void ParticleSystem::update(float dt) {
         update_emitter(i, dt);
 
         /* FIXME: This always means the first emitter gets all the particles ! */
-        auto max_can_emit = particles_.size() - particle_count_;
+        auto max_can_emit = particles_.capacity() - particle_count_;
         emit_particles(i, dt, max_can_emit);
 
         // We do this after emission so that we always emit particles
@@ -265,6 +298,17 @@ void ParticleSystem::update(float dt) {
     }
 }
 
+void ParticleSystem::for_each_chunk(const std::function<void (std::size_t, std::size_t)>& func) {
+    if(particle_count_ < PARALLEL_UPDATE_THRESHOLD) {
+        func(0, particle_count_);
+        return;
+    }
+
+    get_app()->jobs->parallel_for_batches(particle_count_, [&func](std::size_t begin, std::size_t end) {
+        func(begin, end - begin);
+    }, PARALLEL_UPDATE_CHUNK_SIZE);
+}
+
 void ParticleSystem::update_active_state(uint16_t e, float dt) {
     auto& state = emitter_states_[e];
     auto emitter = script_->emitter(e);
@@ -358,9 +402,9 @@ void ParticleSystem::emit_particles(uint16_t e, float dt, uint32_t max) {
         p.initial_dimensions = p.dimensions = smlt::Vec2(script_->particle_width() * scale.x, script_->particle_height() * scale.y);
 
         //FIXME: Initialize other properties
-        particles_[particle_count_++] = p;
+        particles_.set(particle_count_++, p);
 
-        assert(particle_count_ <= particles_.size());
+        assert(particle_count_ <= particles_.capacity());
 
         state.emission_accumulator -= decrement; //Decrement the accumulator while we can
         to_emit--;
@@ -15,20 +15,11 @@
 #include "../vertex_data.h"
 #include "../utils/random.h"
 #include "../assets/particle_script.h"
+#include "../threads/mutex.h"
+#include "particles/particle.h"
 
 namespace smlt {
 
-struct Particle {
-    smlt::Vec3 position;
-    smlt::Vec3 velocity;
-    smlt::Vec2 dimensions;
-    smlt::Vec2 initial_dimensions;
-    float ttl;
-    float lifetime;
-    smlt::Colour colour;
-};
-
-
 class ParticleSystem;
 
 typedef sig::signal<void (ParticleSystem*, MaterialID, MaterialID)> ParticleSystemMaterialChangedSignal;
@@ -68,6 +59,7 @@ public:
     bool update_when_hidden() const;
     void set_update_when_hidden(bool value=true);
 
+    /* Returns the vertex data most recently built for a camera */
     VertexData* vertex_data() const {
         return vertex_data_;
     }
@@ -92,8 +84,8 @@ public:
         return particle_count_;
     }
 
-    const Particle& particle(const std::size_t i) const {
-        return particles_[i];
+    Particle particle(const std::size_t i) const {
+        return particles_.get(i);
     }
 
 private:
@@ -122,16 +114,42 @@ private:
 
     ParticleScriptPtr script_;
 
-    std::vector<Particle> particles_;
+    particles::ParticleStreams particles_;
     std::size_t particle_count_ = 0;
 
+    /* Systems with at least this many particles are split into
+     * chunks which are updated on the worker threads */
+    const static std::size_t PARALLEL_UPDATE_THRESHOLD = 4096;
+    const static std::size_t PARALLEL_UPDATE_CHUNK_SIZE = 1024;
+
+    /* Calls func(first, count) over the live particles, in parallel
+     * chunks if there are enough of them */
+    void for_each_chunk(const std::function<void (std::size_t, std::size_t)>& func);
+
     VertexData* vertex_data_ = nullptr;
     IndexData* index_data_ = nullptr;
 
+    /* Billboards face the camera, so every camera that sees the
+     * system gets its own vertex data. Pipelines can gather
+     * renderables in parallel, hence the lock. */
+    struct CameraVertexData {
+        const Camera* camera = nullptr;
+        std::unique_ptr<VertexData> vertex_data;
+        uint64_t last_used_update = 0;
+    };
+
+    std::vector<CameraVertexData> camera_vertex_data_;
+    thread::Mutex vertex_data_lock_;
+    uint64_t update_count_ = 0;
+
+    VertexData* vertex_data_for_camera(const Camera* camera);
+    void release_unused_vertex_data();
+
     bool destroy_on_completion_ = false;
     bool update_when_hidden_ = false;
 
-    void rebuild_vertex_data(const smlt::Vec3& up, const smlt::Vec3& right);
+    void rebuild_vertex_data(VertexData* vertex_data, const smlt::Vec3& up, const smlt::Vec3& right);
+    void rebuild_index_data();
 
     bool emitters_active_ = true;
 
@@ -0,0 +1,188 @@
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "particle.h"
+
+namespace smlt {
+namespace particles {
+
+void ParticleStreams::resize(std::size_t capacity) {
+    for(auto& stream: streams_) {
+        stream.resize(capacity);
+        stream.shrink_to_fit();
+    }
+}
+
+Particle ParticleStreams::get(std::size_t i) const {
+    Particle ret;
+    ret.position.x = streams_[PARTICLE_STREAM_POSITION_X][i];
+    ret.position.y = streams_[PARTICLE_STREAM_POSITION_Y][i];
+    ret.position.z = streams_[PARTICLE_STREAM_POSITION_Z][i];
+    ret.velocity.x = streams_[PARTICLE_STREAM_VELOCITY_X][i];
+    ret.velocity.y = streams_[PARTICLE_STREAM_VELOCITY_Y][i];
+    ret.velocity.z = streams_[PARTICLE_STREAM_VELOCITY_Z][i];
+    ret.dimensions.x = streams_[PARTICLE_STREAM_WIDTH][i];
+    ret.dimensions.y = streams_[PARTICLE_STREAM_HEIGHT][i];
+    ret.initial_dimensions.x = streams_[PARTICLE_STREAM_INITIAL_WIDTH][i];
+    ret.initial_dimensions.y = streams_[PARTICLE_STREAM_INITIAL_HEIGHT][i];
+    ret.ttl = streams_[PARTICLE_STREAM_TTL][i];
+    ret.lifetime = streams_[PARTICLE_STREAM_LIFETIME][i];
+    ret.colour.r = streams_[PARTICLE_STREAM_COLOUR_R][i];
+    ret.colour.g = streams_[PARTICLE_STREAM_COLOUR_G][i];
+    ret.colour.b = streams_[PARTICLE_STREAM_COLOUR_B][i];
+    ret.colour.a = streams_[PARTICLE_STREAM_COLOUR_A][i];
+    return ret;
+}
+
+void ParticleStreams::set(std::size_t i, const Particle& particle) {
+    streams_[PARTICLE_STREAM_POSITION_X][i] = particle.position.x;
+    streams_[PARTICLE_STREAM_POSITION_Y][i] = particle.position.y;
+    streams_[PARTICLE_STREAM_POSITION_Z][i] = particle.position.z;
+    streams_[PARTICLE_STREAM_VELOCITY_X][i] = particle.velocity.x;
+    streams_[PARTICLE_STREAM_VELOCITY_Y][i] = particle.velocity.y;
+    streams_[PARTICLE_STREAM_VELOCITY_Z][i] = particle.velocity.z;
+    streams_[PARTICLE_STREAM_WIDTH][i] = particle.dimensions.x;
+    streams_[PARTICLE_STREAM_HEIGHT][i] = particle.dimensions.y;
+    streams_[PARTICLE_STREAM_INITIAL_WIDTH][i] = particle.initial_dimensions.x;
+    streams_[PARTICLE_STREAM_INITIAL_HEIGHT][i] = particle.initial_dimensions.y;
+    streams_[PARTICLE_STREAM_TTL][i] = particle.ttl;
+    streams_[PARTICLE_STREAM_LIFETIME][i] = particle.lifetime;
+    streams_[PARTICLE_STREAM_COLOUR_R][i] = particle.colour.r;
+    streams_[PARTICLE_STREAM_COLOUR_G][i] = particle.colour.g;
+    streams_[PARTICLE_STREAM_COLOUR_B][i] = particle.colour.b;
+    streams_[PARTICLE_STREAM_COLOUR_A][i] = particle.colour.a;
+}
+
+void ParticleStreams::move(std::size_t from, std::size_t to) {
+    for(auto& stream: streams_) {
+        stream[to] = stream[from];
+    }
+}
+
+ParticleRange ParticleStreams::range(std::size_t first, std::size_t count) {
+    ParticleRange ret;
+    for(uint32_t i = 0; i < PARTICLE_STREAM_MAX; ++i) {
+        ret.streams[i] = streams_[i].data() + first;
+    }
+    ret.count = count;
+    return ret;
+}
+
+namespace {
+
+/* values[i] += rates[i] * scale */
+void multiply_add(float* values, const float* rates, float scale, std::size_t count) {
+    std::size_t i = 0;
+
+#if defined(__AVX__)
+    __m256 s = _mm256_set1_ps(scale);
+    for(; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(values + i, _mm256_add_ps(
+            _mm256_loadu_ps(values + i),
+            _mm256_mul_ps(_mm256_loadu_ps(rates + i), s)
+        ));
+    }
+#elif defined(__SSE__)
+    __m128 s = _mm_set1_ps(scale);
+    for(; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(values + i, _mm_add_ps(
+            _mm_loadu_ps(values + i),
+            _mm_mul_ps(_mm_loadu_ps(rates + i), s)
+        ));
+    }
+#endif
+
+    for(; i < count; ++i) {
+        values[i] += rates[i] * scale;
+    }
+}
+
+/* values[i] -= amount */
+void subtract(float* values, float amount, std::size_t count) {
+    std::size_t i = 0;
+
+#if defined(__AVX__)
+    __m256 a = _mm256_set1_ps(amount);
+    for(; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(values + i, _mm256_sub_ps(_mm256_loadu_ps(values + i), a));
+    }
+#elif defined(__SSE__)
+    __m128 a = _mm_set1_ps(amount);
+    for(; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(values + i, _mm_sub_ps(_mm_loadu_ps(values + i), a));
+    }
+#endif
+
+    for(; i < count; ++i) {
+        values[i] -= amount;
+    }
+}
+
+}
+
+void integrate_particles(const ParticleRange& particles, float dt) {
+    multiply_add(particles[PARTICLE_STREAM_POSITION_X], particles[PARTICLE_STREAM_VELOCITY_X], dt, particles.count);
+    multiply_add(particles[PARTICLE_STREAM_POSITION_Y], particles[PARTICLE_STREAM_VELOCITY_Y], dt, particles.count);
+    multiply_add(particles[PARTICLE_STREAM_POSITION_Z], particles[PARTICLE_STREAM_VELOCITY_Z], dt, particles.count);
+    subtract(particles[PARTICLE_STREAM_TTL], dt, particles.count);
+}
+
+void expand_billboards(
+    const ParticleRange& particles,
+    const Vec3& up,
+    const Vec3& right,
+    uint8_t* vertices,
+    uint32_t stride,
+    uint32_t position_offset,
+    uint32_t texcoord_offset,
+    uint32_t diffuse_offset) {
+
+    const float* px = particles[PARTICLE_STREAM_POSITION_X];
+    const float* py = particles[PARTICLE_STREAM_POSITION_Y];
+    const float* pz = particles[PARTICLE_STREAM_POSITION_Z];
+    const float* width = particles[PARTICLE_STREAM_WIDTH];
+    const float* height = particles[PARTICLE_STREAM_HEIGHT];
+    const float* colour[4] = {
+        particles[PARTICLE_STREAM_COLOUR_R],
+        particles[PARTICLE_STREAM_COLOUR_G],
+        particles[PARTICLE_STREAM_COLOUR_B],
+        particles[PARTICLE_STREAM_COLOUR_A]
+    };
+
+    /* Corner order and texture coordinates match the QUADS arrangement:
+     * bottom-left, bottom-right, top-right, top-left */
+    const float su[4] = {-0.5f, -0.5f, 0.5f, 0.5f};
+    const float sr[4] = {-0.5f, 0.5f, 0.5f, -0.5f};
+    const float uv[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+    uint8_t* out = vertices;
+    for(std::size_t i = 0; i < particles.count; ++i) {
+        const float w = width[i];
+        const float h = height[i];
+
+        for(uint32_t c = 0; c < 4; ++c) {
+            float* pos = (float*) (out + position_offset);
+            pos[0] = px[i] + up.x * h * su[c] + right.x * w * sr[c];
+            pos[1] = py[i] + up.y * h * su[c] + right.y * w * sr[c];
+            pos[2] = pz[i] + up.z * h * su[c] + right.z * w * sr[c];
+
+            float* tex = (float*) (out + texcoord_offset);
+            tex[0] = uv[c][0];
+            tex[1] = uv[c][1];
+
+            float* diffuse = (float*) (out + diffuse_offset);
+            diffuse[0] = colour[0][i];
+            diffuse[1] = colour[1][i];
+            diffuse[2] = colour[2][i];
+            diffuse[3] = colour[3][i];
+
+            out += stride;
+        }
+    }
+}
+
+}
+}
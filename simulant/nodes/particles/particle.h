@@ -1,12 +1,113 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include "../../math/vec3.h"
 #include "../../math/vec2.h"
 #include "../../colour.h"
 
 namespace smlt {
+
+struct Particle {
+    smlt::Vec3 position;
+    smlt::Vec3 velocity;
+    smlt::Vec2 dimensions;
+    smlt::Vec2 initial_dimensions;
+    float ttl;
+    float lifetime;
+    smlt::Colour colour;
+};
+
 namespace particles {
 
+/*
+ * Particles are stored as a structure of arrays, one float stream per
+ * component. This lets the update kernels work through several particles
+ * at a time and lets a large system be split into chunks which are
+ * updated on different threads.
+ */
+
+enum ParticleStream {
+    PARTICLE_STREAM_POSITION_X,
+    PARTICLE_STREAM_POSITION_Y,
+    PARTICLE_STREAM_POSITION_Z,
+    PARTICLE_STREAM_VELOCITY_X,
+    PARTICLE_STREAM_VELOCITY_Y,
+    PARTICLE_STREAM_VELOCITY_Z,
+    PARTICLE_STREAM_WIDTH,
+    PARTICLE_STREAM_HEIGHT,
+    PARTICLE_STREAM_INITIAL_WIDTH,
+    PARTICLE_STREAM_INITIAL_HEIGHT,
+    PARTICLE_STREAM_TTL,
+    PARTICLE_STREAM_LIFETIME,
+    PARTICLE_STREAM_COLOUR_R,
+    PARTICLE_STREAM_COLOUR_G,
+    PARTICLE_STREAM_COLOUR_B,
+    PARTICLE_STREAM_COLOUR_A,
+    PARTICLE_STREAM_MAX
+};
+
+/* A run of count particles, with a pointer to the first
+ * particle in each stream */
+struct ParticleRange {
+    float* streams[PARTICLE_STREAM_MAX];
+    std::size_t count = 0;
+
+    float* operator[](ParticleStream stream) const {
+        return streams[stream];
+    }
+};
+
+class ParticleStreams {
+public:
+    std::size_t capacity() const {
+        return streams_[0].size();
+    }
+
+    /* Resizes every stream, releasing any unused memory */
+    void resize(std::size_t capacity);
+
+    Particle get(std::size_t i) const;
+    void set(std::size_t i, const Particle& particle);
+
+    /* Copies particle from over the particle to */
+    void move(std::size_t from, std::size_t to);
+
+    float* stream(ParticleStream stream) {
+        return streams_[stream].data();
+    }
+
+    const float* stream(ParticleStream stream) const {
+        return streams_[stream].data();
+    }
+
+    ParticleRange range(std::size_t first, std::size_t count);
+
+private:
+    std::vector<float> streams_[PARTICLE_STREAM_MAX];
+};
+
+/* Moves each particle along its velocity and counts down its ttl */
+void integrate_particles(const ParticleRange& particles, float dt);
+
+/*
+ * Writes a quad facing along up and right for each particle, straight
+ * into an interleaved vertex buffer. vertices must point at the first
+ * vertex to write and have room for particles.count * 4 vertices. The
+ * offsets are the byte offsets of the 3F position, 2F texcoord and 4F
+ * diffuse attributes within each vertex.
+ */
+void expand_billboards(
+    const ParticleRange& particles,
+    const Vec3& up,
+    const Vec3& right,
+    uint8_t* vertices,
+    uint32_t stride,
+    uint32_t position_offset,
+    uint32_t texcoord_offset,
+    uint32_t diffuse_offset
+);
 
 }
 }
@@ -8,7 +8,8 @@ namespace smlt {
 StageNode::StageNode(Stage *stage, smlt::StageNodeType node_type):
     TreeNode(),
     stage_(stage),
-    node_type_(node_type) {
+    node_type_(node_type),
+    renderables_version_(next_renderables_version()) {
 
 }
 
@@ -58,22 +59,32 @@ void StageNode::clean_up() {
 
     detach(); // Make sure we're not connected to anything
 
+    if(transformation_queued_) {
+        stage_->dequeue_transformation_update(this);
+        transformation_queued_ = false;
+    }
+
     TwoPhaseConstructed::clean_up();
 }
 
 Vec3 StageNode::absolute_position() const {
+    update_transformation_if_necessary();
     return absolute_position_;
 }
 
 Quaternion StageNode::absolute_rotation() const {
+    update_transformation_if_necessary();
     return absolute_rotation_;
 }
 
 Vec3 StageNode::absolute_scaling() const {
+    update_transformation_if_necessary();
     return absolute_scale_;
 }
 
 Mat4 StageNode::absolute_transformation() const {
+    update_transformation_if_necessary();
+
     if(!absolute_transformation_is_dirty_) {
         return absolute_transformation_;
     }
@@ -118,6 +129,8 @@ void StageNode::recalc_visibility() {
     self_and_parents_visible_ = is_visible_ && ((parent_stage_node_) ? parent_stage_node_->is_visible() : true);
 
     if(previously_visible != self_and_parents_visible_) {
+        mark_renderables_changed();
+
         /* Recurse through children to update */
         for(auto& node: each_child()) {
             node.recalc_visibility();
@@ -134,6 +147,17 @@ void StageNode::set_visible(bool visible) {
     recalc_visibility();
 }
 
+uint64_t StageNode::renderables_version(const CameraPtr& camera, DetailLevel detail_level) const {
+    _S_UNUSED(camera);
+
+    /* Renderables depend on the detail level, so it's part of the version */
+    return (renderables_version_ << 3) | uint64_t(detail_level);
+}
+
+void StageNode::mark_renderables_changed() {
+    renderables_version_ = next_renderables_version();
+}
+
 void StageNode::set_parent(TreeNode* node) {
     if(!node) {
         /* If someone passes null, we reattach to the stage */
@@ -200,7 +224,41 @@ void StageNode::rotate_to_absolute(const Degrees& degrees, float x, float y, flo
 }
 
 void StageNode::on_transformation_changed() {
-    update_transformation_from_parent();
+    mark_transformation_dirty();
+
+    /* Moving a node any number of times in a frame only
+     * queues it once */
+    if(!transformation_queued_ && stage_) {
+        stage_->queue_transformation_update(this);
+        transformation_queued_ = true;
+    }
+}
+
+void StageNode::mark_transformation_dirty() {
+    if(transformation_dirty_) {
+        /* The descendents must be dirty already */
+        return;
+    }
+
+    transformation_dirty_ = true;
+
+    mark_transformed_aabb_dirty();
+    mark_absolute_transformation_dirty();
+
+    for(auto& node: each_child()) {
+        node.mark_transformation_dirty();
+    }
+}
+
+void StageNode::update_transformation_if_necessary() const {
+    if(!transformation_dirty_) {
+        return;
+    }
+
+    /* Like the matrix and the AABB, the absolute transformation is a
+     * cache of what we'd calculate from the parent. The parent is brought
+     * up to date first when its absolute transformation is read */
+    const_cast<StageNode*>(this)->update_transformation_from_parent();
 }
 
 void StageNode::update_transformation_from_parent() {
@@ -220,11 +278,25 @@ void StageNode::update_transformation_from_parent() {
         absolute_scale_ = parent_scale * scaling_;
     }
 
+    transformation_dirty_ = false;
+
     mark_transformed_aabb_dirty();
     mark_absolute_transformation_dirty();
+}
 
-    for(auto& node: each_child()) {
-        node.update_transformation_from_parent();
+void StageNode::update_transformation_subtree(std::vector<StageNode*>& nodes) {
+    /* The nodes are visited in order of depth, each is updated before
+     * its children are added to the end of the list */
+    nodes.clear();
+    nodes.push_back(this);
+
+    for(std::size_t i = 0; i < nodes.size(); ++i) {
+        auto node = nodes[i];
+        node->update_transformation_from_parent();
+
+        for(auto& child: node->each_child()) {
+            nodes.push_back(&child);
+        }
     }
 }
 
@@ -237,7 +309,9 @@ void StageNode::on_parent_set(TreeNode* oldp, TreeNode* newp) {
 
     assert(dynamic_cast<StageNode*>(newp));
     parent_stage_node_ = (StageNode*) (newp);
-    update_transformation_from_parent();
+
+    /* The absolute transformation is relative to a different parent now */
+    on_transformation_changed();
 }
 
 AABB StageNode::calculate_transformed_aabb() const {
@@ -274,18 +348,26 @@ bool StageNode::is_cullable() const {
     return cullable_;
 }
 
-void StageNode::recalc_bounds_if_necessary() const {
+bool StageNode::refresh_transformed_aabb() const {
     if(!transformed_aabb_dirty_) {
-        return;
+        return false;
     }
 
+    transformed_aabb_dirty_ = false;
+
     auto newb = calculate_transformed_aabb();
     if(newb.min() != transformed_aabb_.min() || newb.max() != transformed_aabb_.max()) {
         transformed_aabb_ = newb;
-        signal_bounds_updated_(transformed_aabb_);
+        return true;
     }
 
-    transformed_aabb_dirty_ = false;
+    return false;
+}
+
+void StageNode::recalc_bounds_if_necessary() const {
+    if(refresh_transformed_aabb()) {
+        signal_bounds_updated_(transformed_aabb_);
+    }
 }
 
 void StageNode::mark_transformed_aabb_dirty() {
@@ -294,6 +376,7 @@ void StageNode::mark_transformed_aabb_dirty() {
 
 void StageNode::mark_absolute_transformation_dirty() {
     absolute_transformation_is_dirty_ = true;
+    mark_renderables_changed();
 }
 
 void StageNode::update(float dt) {
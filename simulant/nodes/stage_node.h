@@ -73,6 +73,14 @@ private:
     bool partitioner_dirty_ = false;
     bool partitioner_added_ = false;
 
+    /* The latest bounds passed to Partitioner::update_stage_nodes, used
+     * when the writes are applied rather than recalculating them */
+    bool partitioner_has_bounds_ = false;
+    AABB partitioner_bounds_;
+
+    /* The stage updates dirty transformations in a single pass each frame */
+    friend class Stage;
+
 public:
     class SiblingIteratorPair {
         friend class StageNode;
@@ -236,6 +244,17 @@ public:
         const DetailLevel detail_level
     ) = 0;
 
+    /* Nodes whose renderables don't change from frame to frame unless the
+     * node itself changes (e.g. a non-animated actor) should return true. The
+     * render queue will then reuse the renderables from previous frames
+     * until renderables_version() changes. Nodes which cull their own
+     * renderables against the camera should include that in the version. */
+    virtual bool has_static_renderables() const {
+        return false;
+    }
+
+    virtual uint64_t renderables_version(const CameraPtr& camera, DetailLevel detail_level) const;
+
     void set_cullable(bool v);
     bool is_cullable() const;
 
@@ -254,15 +273,31 @@ protected:
     void on_transformation_changed() override;
     void on_parent_set(TreeNode* oldp, TreeNode* newp) override;
 
+    /* Recalculates the absolute transformation of this node from its parent
+     * (which must be up to date) and its own position, rotation and scaling */
     virtual void update_transformation_from_parent();
 
+    /* Absolute transformations are only calculated when they're needed, or
+     * once per frame by the stage. Moving a node marks it and its
+     * descendents as dirty instead of recalculating them */
+    void mark_transformation_dirty();
+    void update_transformation_if_necessary() const;
+
     void recalc_bounds_if_necessary() const;
     void mark_transformed_aabb_dirty();
 
     void mark_absolute_transformation_dirty();
+
+    /* Subclasses should call this when anything which affects the
+     * output of _get_renderables changes */
+    void mark_renderables_changed();
 private:
     AABB calculate_transformed_aabb() const;
 
+    /* Recalculates the bounds if they're dirty without firing
+     * signal_bounds_updated, returns true if they changed */
+    bool refresh_transformed_aabb() const;
+
     Stage* stage_ = nullptr;
     StageNode* parent_stage_node_ = nullptr;
 
@@ -281,6 +316,18 @@ private:
     Quaternion absolute_rotation_;
     Vec3 absolute_scale_ = Vec3(1, 1, 1);
 
+    /* If a node is dirty, all of its descendents are too */
+    bool transformation_dirty_ = false;
+
+    /* Whether this node is in the stage's list of moved nodes, and where */
+    bool transformation_queued_ = false;
+    std::size_t transformation_queue_index_ = 0;
+
+    /* Updates this node, then its descendents breadth-first, so
+     * parents are always up to date before their children. nodes is
+     * scratch space, reused between calls to save allocating */
+    void update_transformation_subtree(std::vector<StageNode*>& nodes);
+
     mutable Mat4 absolute_transformation_;
     mutable bool absolute_transformation_is_dirty_ = true;
 
@@ -289,6 +336,8 @@ private:
     mutable AABB transformed_aabb_;
     mutable bool transformed_aabb_dirty_ = false;
 
+    uint64_t renderables_version_ = 0;
+
     // By default, always cast and receive shadows
     ShadowCast shadow_cast_ = SHADOW_CAST_ALWAYS;
     ShadowReceive shadow_receive_ = SHADOW_RECEIVE_ALWAYS;
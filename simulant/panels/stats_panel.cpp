@@ -94,6 +94,10 @@ bool StatsPanel::init() {
     polygons_rendered_->move_to(hw, vheight);
     vheight -= diff;
 
+    draw_calls_ = overlay->ui->new_widget_as_label("Draw Calls: 0", label_width);
+    draw_calls_->move_to(hw, vheight);
+    vheight -= diff;
+
     stage_node_pool_size_ = overlay->ui->new_widget_as_label("", label_width);
     stage_node_pool_size_->move_to(hw, vheight);
     vheight -= diff;
@@ -128,6 +132,7 @@ void StatsPanel::clean_up() {
     ram_usage_ = nullptr;
     actors_rendered_ = nullptr;
     polygons_rendered_ = nullptr;
+    draw_calls_ = nullptr;
 }
 
 static float bytes_to_megabytes(uint64_t bytes) {
@@ -287,6 +292,11 @@ void StatsPanel::update() {
         vram_usage_->set_text(_F("VRAM Free: {0} MB").format(vram_usage));
         actors_rendered_->set_text(_F("Renderables Visible: {0}").format(actors_rendered));
         polygons_rendered_->set_text(_F("Polygons Rendered: {0}").format(get_app()->stats->polygons_rendered()));
+        draw_calls_->set_text(
+            _F("Draw Calls: {0} ({1} instances)").format(
+                get_app()->stats->draw_calls(), get_app()->stats->instances_rendered()
+            )
+        );
         stage_node_pool_size_->set_text(_F("Node pool size: {0}kb").format(get_app()->stage_node_pool_capacity_in_bytes() / 1024));
 
         last_update_ = 0.0f;
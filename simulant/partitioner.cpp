@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "partitioner.h"
 
 #include "nodes/actor.h"
@@ -8,13 +10,143 @@
 
 namespace smlt {
 
+static uint64_t next_partitioner_id() {
+    static thread::Mutex lock;
+    static uint64_t counter = 0;
+
+    thread::Lock<thread::Mutex> g(lock);
+    return ++counter;
+}
+
+#if !defined(__PSP__) && !defined(__DREAMCAST__)
+
+/* The last buffer this thread staged updates to. Most threads only
+ * ever update a single stage, so this avoids taking staging_lock_ */
+struct StagingCache {
+    uint64_t partitioner_id = 0;
+    StagedUpdateBuffer* buffer = nullptr;
+};
+
+static thread_local StagingCache STAGING_CACHE;
+
+#endif
+
+Partitioner::Partitioner(Stage* ss):
+    stage_(ss),
+    id_(next_partitioner_id()) {
+
+}
+
+StagedUpdateBuffer* Partitioner::update_buffer_for_this_thread() {
+#if !defined(__PSP__) && !defined(__DREAMCAST__)
+    if(STAGING_CACHE.partitioner_id == id_) {
+        return STAGING_CACHE.buffer;
+    }
+#endif
+
+    auto thread_id = thread::this_thread_id();
+
+    StagedUpdateBuffer* buffer = nullptr;
+
+    {
+        thread::Lock<thread::Mutex> lock(staging_lock_);
+        for(auto& b: update_buffers_) {
+            if(b->thread_id == thread_id) {
+                buffer = b.get();
+                break;
+            }
+        }
+
+        if(!buffer) {
+            update_buffers_.push_back(std::unique_ptr<StagedUpdateBuffer>(new StagedUpdateBuffer()));
+            buffer = update_buffers_.back().get();
+            buffer->thread_id = thread_id;
+        }
+    }
+
+#if !defined(__PSP__) && !defined(__DREAMCAST__)
+    STAGING_CACHE.partitioner_id = id_;
+    STAGING_CACHE.buffer = buffer;
+#endif
+
+    return buffer;
+}
+
+void Partitioner::update_stage_nodes(StageNode* const* nodes, const AABB* bounds, std::size_t count) {
+    auto buffer = update_buffer_for_this_thread();
+    auto& writes = buffer->writes;
+
+    for(std::size_t i = 0; i < count; ++i) {
+        StagedWrite write;
+        write.operation = WRITE_OPERATION_UPDATE;
+        write.new_bounds = bounds[i];
+        write.node = nodes[i];
+        writes.push_back(write);
+    }
+
+    if(writes.size() >= MAX_STAGED_WRITES * 4) {
+        /* Nothing has applied the writes for a while (e.g. the stage isn't
+         * being rendered) so drop all but the latest update for each node.
+         * Only this thread touches the buffer so this is safe. */
+        std::stable_sort(writes.begin(), writes.end(), [](const StagedWrite& lhs, const StagedWrite& rhs) {
+            return lhs.node < rhs.node;
+        });
+
+        auto out = writes.begin();
+        for(auto it = writes.begin(); it != writes.end(); ++it) {
+            auto next = it + 1;
+            if(next == writes.end() || next->node != it->node) {
+                *out++ = *it;
+            }
+        }
+
+        writes.erase(out, writes.end());
+    }
+}
+
+void Partitioner::collect_staged_updates() {
+    thread::Lock<thread::Mutex> lock(staging_lock_);
+
+    for(auto& buffer: update_buffers_) {
+        for(auto& write: buffer->writes) {
+            auto node = write.node;
+
+            /* The node might have been destroyed, the removal
+             * will be applied anyway so don't touch it */
+            if(removed_nodes_.count(node)) {
+                continue;
+            }
+
+            if(!node->partitioner_dirty_) {
+                staged_writes_.push_back(node);
+                node->partitioner_dirty_ = true;
+            }
+
+            node->partitioner_bounds_ = write.new_bounds;
+            node->partitioner_has_bounds_ = true;
+        }
+
+        buffer->writes.clear();
+    }
+}
+
+void Partitioner::apply_staged_writes(const std::vector<KeyedWrite>& writes) {
+    for(auto& write: writes) {
+        apply_staged_write(write.first, write.second);
+    }
+}
+
 void Partitioner::_apply_writes() {
+    collect_staged_updates();
+
+    batch_.clear();
+
     for(auto p: staged_writes_) {
         auto it = removed_nodes_.find(p);
         if(it != removed_nodes_.end()) {
             StagedWrite write;
             write.operation = WRITE_OPERATION_REMOVE;
-            apply_staged_write(it->second, write);
+            batch_.push_back(std::make_pair(it->second, write));
             removed_nodes_.erase(it);
         } else {
             auto key = p->key();
@@ -22,30 +154,39 @@ void Partitioner::_apply_writes() {
                 StagedWrite write;
                 write.operation = WRITE_OPERATION_ADD;
                 write.node = p;
-                apply_staged_write(key, write);
+                batch_.push_back(std::make_pair(key, write));
             }
 
             StagedWrite write;
             write.operation = WRITE_OPERATION_UPDATE;
-            write.new_bounds = p->transformed_aabb();
+            write.new_bounds = (p->partitioner_has_bounds_) ? p->partitioner_bounds_ : p->transformed_aabb();
             write.node = p;
-            apply_staged_write(key, write);
+            batch_.push_back(std::make_pair(key, write));
         }
 
         /* We always wipe this out once we've applied this node */
         p->partitioner_dirty_ = false;
         p->partitioner_added_ = false;
+        p->partitioner_has_bounds_ = false;
     }
 
     /* We've handled any writes, now deal with any remaining removed nodes */
     for(auto n: removed_nodes_) {
         StagedWrite write;
         write.operation = WRITE_OPERATION_REMOVE;
-        apply_staged_write(n.second, write);
+        batch_.push_back(std::make_pair(n.second, write));
     }
 
     staged_writes_.clear();
     removed_nodes_.clear();
+
+    if(!batch_.empty()) {
+        /* Swap out the batch in case applying it stages more writes */
+        std::vector<KeyedWrite> batch;
+        std::swap(batch, batch_);
+        apply_staged_writes(batch);
+        std::swap(batch, batch_);
+    }
 }
 
 void Partitioner::stage_write(StageNode* node, const StagedWrite& op) {
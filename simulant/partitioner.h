@@ -30,6 +30,8 @@
 #include "renderers/renderer.h"
 #include "types.h"
 #include "interfaces.h"
+#include "threads/mutex.h"
+#include "threads/thread.h"
 
 namespace smlt {
 
@@ -49,8 +51,17 @@ struct StagedWrite {
     StageNode* node = nullptr;
 };
 
+typedef std::pair<UniqueIDKey, StagedWrite> KeyedWrite;
+
 #define MAX_STAGED_WRITES 1024
 
+/* Bounds updates staged by a single thread. Only the owning thread
+ * appends to it, so no lock is needed until the writes are applied */
+struct StagedUpdateBuffer {
+    thread::ThreadID thread_id;
+    std::vector<StagedWrite> writes;
+};
+
 class Partitioner:
     public RefCounted<Partitioner> {
 
@@ -60,8 +71,7 @@ public:
         uint8_t bits = 0;
     };
 
-    Partitioner(Stage* ss):
-        stage_(ss) {}
+    Partitioner(Stage* ss);
 
     void add_stage_node(StageNode* node) {
         StagedWrite write;
@@ -70,12 +80,17 @@ public:
         stage_write(node, write);
     }
 
+    /* Bounds updates can be staged from any thread, as long as
+     * _apply_writes() isn't running at the same time */
     void update_stage_node(StageNode* node, const AABB& bounds) {
-        StagedWrite write;
-        write.operation = WRITE_OPERATION_UPDATE;
-        write.new_bounds = bounds;
-        write.node = node;
-        stage_write(node, write);
+        update_stage_nodes(&node, &bounds, 1);
+    }
+
+    void update_stage_nodes(StageNode* const* nodes, const AABB* bounds, std::size_t count);
+
+    void update_stage_nodes(const std::vector<StageNode*>& nodes, const std::vector<AABB>& bounds) {
+        assert(nodes.size() == bounds.size());
+        update_stage_nodes(nodes.data(), bounds.data(), std::min(nodes.size(), bounds.size()));
     }
 
     void remove_stage_node(StageNode* node) {
@@ -99,16 +114,31 @@ protected:
 
     virtual void apply_staged_write(const UniqueIDKey& key, const StagedWrite& write) = 0;
 
+    /* Called once by _apply_writes() with every write, in order. Override
+     * this to apply the whole batch in one pass (e.g. under a single lock) */
+    virtual void apply_staged_writes(const std::vector<KeyedWrite>& writes);
+
     void stage_write(StageNode* node, const StagedWrite& op);
 
 private:
+    StagedUpdateBuffer* update_buffer_for_this_thread();
+    void collect_staged_updates();
+
     Stage* stage_;
 
+    /* Used to identify the partitioner in each thread's buffer cache, unlike
+     * the address it's never reused */
+    uint64_t id_ = 0;
+
+    /* Protects update_buffers_ */
     thread::Mutex staging_lock_;
+    std::vector<std::unique_ptr<StagedUpdateBuffer>> update_buffers_;
 
     std::vector<StageNode*> staged_writes_;
     std::unordered_map<StageNode*, UniqueIDKey> removed_nodes_;
 
+    std::vector<KeyedWrite> batch_;
+
 protected:
     Property<decltype(&Partitioner::stage_)> stage = { this, &Partitioner::stage_ };
 
@@ -23,6 +23,7 @@
 #include "../nodes/light.h"
 #include "../nodes/particle_system.h"
 #include "../nodes/geom.h"
+#include "../frustum_culling.h"
 
 #include "frustum_partitioner.h"
 
@@ -36,6 +37,11 @@ void FrustumPartitioner::lights_and_geometry_visible_from(
 
     auto frustum = stage->camera(camera_id)->frustum();
 
+    thread::Lock<thread::Mutex> lock(cull_lock_);
+
+    candidates_.clear();
+    candidate_bounds_.clear();
+
     for(auto& node: stage->each_descendent()) {
         /* Check that the node is supposed to
          * be visible (otherwise we could end up doing work for nothing) */
@@ -55,11 +61,19 @@ void FrustumPartitioner::lights_and_geometry_visible_from(
             } else if(!node.is_cullable()) {
                 /* If the culling mode is NEVER then we always return */
                 geom_out.push_back(&node);
-            } else if(frustum.intersects_aabb(aabb)) {
-                geom_out.push_back(&node);
+            } else {
+                /* Gather the bounds so we can cull them all at once */
+                candidates_.push_back(&node);
+                candidate_bounds_.push_back(aabb);
             }
         }
     }
+
+    cull_aabbs(frustum, candidate_bounds_, candidates_visible_);
+
+    candidates_visible_.each_set([&](std::size_t i) {
+        geom_out.push_back(candidates_[i]);
+    });
 }
 
 void FrustumPartitioner::apply_staged_write(const UniqueIDKey& key, const StagedWrite &write) {
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "../partitioner.h"
+#include "../frustum_culling.h"
 
 namespace smlt {
 
@@ -37,6 +38,12 @@ public:
 
 private:
     void apply_staged_write(const UniqueIDKey& key, const StagedWrite& write);
+
+    /* Kept between calls to avoid allocating every frame */
+    thread::Mutex cull_lock_;
+    std::vector<StageNode*> candidates_;
+    AABBList candidate_bounds_;
+    VisibilityMask candidates_visible_;
 };
 
 }
@@ -1,301 +1,612 @@
+
+
 #include <cmath>
+#include <cassert>
+#include <algorithm>
 #include "../../frustum.h"
 #include "spatial_hash.h"
-#include "../../utils/endian.h"
 
 namespace smlt {
 
-SpatialHash::SpatialHash() {
+static uint64_t spread_bits(uint32_t v) {
+    /* Spreads the low 20 bits of v so there are two zero bits
+     * between each one */
+    uint64_t x = v & 0xFFFFF;
+    x = (x | (x << 32)) & 0x001F00000000FFFFull;
+    x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+    x = (x | (x << 8)) & 0x100F00F00F00F00Full;
+    x = (x | (x << 4)) & 0x10C30C30C30C30C3ull;
+    x = (x | (x << 2)) & 0x1249249249249249ull;
+    return x;
+}
 
+static uint32_t compact_bits(uint64_t x) {
+    x &= 0x1249249249249249ull;
+    x = (x ^ (x >> 2)) & 0x10C30C30C30C30C3ull;
+    x = (x ^ (x >> 4)) & 0x100F00F00F00F00Full;
+    x = (x ^ (x >> 8)) & 0x001F0000FF0000FFull;
+    x = (x ^ (x >> 16)) & 0x001F00000000FFFFull;
+    x = (x ^ (x >> 32)) & 0x00000000000FFFFFull;
+    return uint32_t(x);
 }
 
+static int32_t cell_coord(float v, float inv_cell_size) {
+    /* Clamp before converting, casting out-of-range floats is undefined */
+    float c = std::floor(v * inv_cell_size);
+    c = std::max(c, float(CELL_COORD_MIN));
+    c = std::min(c, float(CELL_COORD_MAX));
+    return int32_t(c);
+}
 
-void SpatialHash::insert_object_for_box(const AABB &box, SpatialHashEntry *object) {
-    auto cell_size = find_cell_size_for_box(box);
+static float inverse_cell_size(uint32_t level) {
+    return 1.0f / float(1u << level);
+}
 
-    object->set_hash_aabb(box);
-    for(auto& corner: box.corners()) {
-        auto key = make_key(cell_size, corner.x, corner.y, corner.z);
-        insert_object_for_key(key, object);
+static uint32_t hash_cell_key(CellKey key) {
+    key *= 0x9E3779B97F4A7C15ull;
+    return uint32_t(key ^ (key >> 32));
+}
+
+static bool contains_key(const std::array<CellKey, MAX_CELLS_PER_ENTRY>& keys, uint8_t count, CellKey key) {
+    for(uint8_t i = 0; i < count; ++i) {
+        if(keys[i] == key) {
+            return true;
+        }
     }
+    return false;
 }
 
-void SpatialHash::remove_object(SpatialHashEntry *object) {
-    for(auto key: object->keys()) {
-        erase_object_from_key(key, object);
+CellKey make_cell_key(uint32_t level, int32_t x, int32_t y, int32_t z) {
+    return (
+        (uint64_t(level & 0xF) << 60) |
+        spread_bits(uint32_t(x + CELL_COORD_BIAS)) |
+        (spread_bits(uint32_t(y + CELL_COORD_BIAS)) << 1) |
+        (spread_bits(uint32_t(z + CELL_COORD_BIAS)) << 2)
+    );
+}
+
+CellKey make_cell_key_for_point(uint32_t level, float x, float y, float z) {
+    auto inv = inverse_cell_size(level);
+    return make_cell_key(level, cell_coord(x, inv), cell_coord(y, inv), cell_coord(z, inv));
+}
+
+uint32_t cell_key_level(CellKey key) {
+    return uint32_t(key >> 60);
+}
+
+void cell_key_coords(CellKey key, int32_t& x, int32_t& y, int32_t& z) {
+    x = int32_t(compact_bits(key)) - CELL_COORD_BIAS;
+    y = int32_t(compact_bits(key >> 1)) - CELL_COORD_BIAS;
+    z = int32_t(compact_bits(key >> 2)) - CELL_COORD_BIAS;
+}
+
+SpatialHash::Level::Level():
+    slots(16, Slot{0, EMPTY_SLOT}) {
+
+    occupied.fill(0);
+    occupancy_counts.fill(0);
+}
+
+uint32_t SpatialHash::Level::find_slot(CellKey key) const {
+    const uint32_t mask = slots.size() - 1;
+    uint32_t i = hash_cell_key(key) & mask;
+
+    /* The load factor is kept below 0.5 so this always terminates */
+    while(slots[i].cell != EMPTY_SLOT && slots[i].key != key) {
+        i = (i + 1) & mask;
     }
-    object->set_keys(KeyList());
+
+    return i;
 }
 
-void SpatialHash::erase_object_from_key(Key key, SpatialHashEntry* object) {
-    auto it = index_.find(key);
-    if(it != index_.end()) {
-        it->second.erase(object);
+int32_t SpatialHash::Level::find_cell(CellKey key) const {
+    auto& slot = slots[find_slot(key)];
+    return (slot.cell == EMPTY_SLOT) ? -1 : int32_t(slot.cell);
+}
 
-        if(it->second.empty()) {
-            index_.erase(it);
-        }
+void SpatialHash::Level::grow() {
+    slots.assign(slots.size() * 2, Slot{0, EMPTY_SLOT});
+
+    for(uint32_t i = 0; i < cells.size(); ++i) {
+        auto& slot = slots[find_slot(cells[i].key)];
+        slot.key = cells[i].key;
+        slot.cell = i;
     }
 }
 
-void SpatialHash::update_object_for_box(const AABB& new_box, SpatialHashEntry* object) {
-    auto cell_size = find_cell_size_for_box(new_box);
+uint32_t SpatialHash::Level::insert_cell(CellKey key, int32_t x, int32_t y, int32_t z) {
+    if((cells.size() + 1) * 2 > slots.size()) {
+        grow();
+    }
+
+    uint32_t index = cells.size();
 
-    KeyList new_keys;
-    const KeyList& old_keys = object->keys();
+    Cell cell;
+    cell.key = key;
+    cell.x = x;
+    cell.y = y;
+    cell.z = z;
+    cells.push_back(std::move(cell));
 
-    for(auto& corner: new_box.corners()) {
-        auto key = make_key(cell_size, corner.x, corner.y, corner.z);
-        new_keys.insert(key);
+    auto& slot = slots[find_slot(key)];
+    assert(slot.cell == EMPTY_SLOT);
+    slot.key = key;
+    slot.cell = index;
+
+    auto bit = occupancy_bit(x, y, z);
+    if(!occupancy_counts[bit]++) {
+        occupied[bit >> 6] |= (uint64_t(1) << (bit & 63));
     }
 
-    KeyList keys_to_add, keys_to_remove;
+    return index;
+}
 
-    std::set_difference(
-        new_keys.begin(), new_keys.end(), old_keys.begin(), old_keys.end(),
-        std::inserter(keys_to_add, keys_to_add.end())
-    );
+void SpatialHash::Level::erase_cell(uint32_t index) {
+    const uint32_t mask = slots.size() - 1;
+
+    /* Remove the slot, then shift back any following slots in the
+     * same probe run so that lookups don't need tombstones */
+    uint32_t i = find_slot(cells[index].key);
+    uint32_t j = i;
+    while(true) {
+        j = (j + 1) & mask;
+        if(slots[j].cell == EMPTY_SLOT) {
+            break;
+        }
 
-    std::set_difference(
-        old_keys.begin(), old_keys.end(), new_keys.begin(), new_keys.end(),
-        std::inserter(keys_to_remove, keys_to_remove.end())
-    );
+        uint32_t home = hash_cell_key(slots[j].key) & mask;
 
-    if(new_keys.empty() && old_keys.empty()) {
-        return;
+        /* Move the slot back unless its home lies cyclically in (i, j] */
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if(!stays) {
+            slots[i] = slots[j];
+            i = j;
+        }
     }
 
-    for(auto& key: keys_to_remove) {
-        erase_object_from_key(key, object);
+    slots[i].cell = EMPTY_SLOT;
+
+    auto& cell = cells[index];
+    auto bit = occupancy_bit(cell.x, cell.y, cell.z);
+    if(!--occupancy_counts[bit]) {
+        occupied[bit >> 6] &= ~(uint64_t(1) << (bit & 63));
     }
 
-    for(auto& key: keys_to_add) {
-        insert_object_for_key(key, object);
+    /* Keep the cells contiguous by moving the last one into the gap */
+    uint32_t last = cells.size() - 1;
+    if(index != last) {
+        cells[index] = std::move(cells[last]);
+        slots[find_slot(cells[index].key)].cell = index;
     }
 
-    object->set_hash_aabb(new_box);
-    object->set_keys(new_keys);
+    cells.pop_back();
 }
 
-void generate_boxes_for_frustum(const Frustum& frustum, std::vector<AABB>& results) {
-    results.clear(); // Required
+SpatialHash::SpatialHash() {
 
-    auto corners = frustum.near_corners();
-    auto far_corners = frustum.far_corners();
-    for(auto& corner: far_corners) {
-        corners.push_back(corner);
+}
+
+SpatialHash::~SpatialHash() {
+
+}
+
+bool SpatialHash::calculate_keys(const AABB& box, std::array<CellKey, MAX_CELLS_PER_ENTRY>& keys, uint8_t& count) const {
+    count = 0;
+
+    auto min = box.min();
+    auto max = box.max();
+
+    if(!std::isfinite(min.x) || !std::isfinite(min.y) || !std::isfinite(min.z) ||
+       !std::isfinite(max.x) || !std::isfinite(max.y) || !std::isfinite(max.z)) {
+        return false;
     }
-    results.push_back(AABB(corners.data(), corners.size()));
-    return;
 
-    // start at the center of the near plane
-    Vec3 start_point = Vec3::find_average(frustum.far_corners());
+    /*
+     * We use the smallest cell size which is greater than the max dimension
+     * of the box. That way the box can only span 2 cells on each axis.
+     */
+    auto maxd = box.max_dimension();
+    uint32_t level = (maxd < 1.0f) ? 0 : uint32_t(std::ceil(std::log2(maxd)));
+    if(level < MAX_GRID_LEVELS && float(1u << level) < maxd) {
+        /* log2 rounded down */
+        ++level;
+    }
 
-    // We want to head in the reverse direction of the frustum
-    Vec3 direction = -frustum.direction().normalized();
+    if(level >= MAX_GRID_LEVELS) {
+        return false;
+    }
 
-    // Get the normals of the up and right planes so we can generated boxes
-    Vec3 up = frustum.plane(FRUSTUM_PLANE_BOTTOM).normal();
-    Vec3 right = frustum.plane(FRUSTUM_PLANE_LEFT).normal();
+    auto inv = inverse_cell_size(level);
 
-    auto near_plane = frustum.plane(FRUSTUM_PLANE_NEAR);
+    int32_t x0 = cell_coord(min.x, inv), x1 = cell_coord(max.x, inv);
+    int32_t y0 = cell_coord(min.y, inv), y1 = cell_coord(max.y, inv);
+    int32_t z0 = cell_coord(min.z, inv), z1 = cell_coord(max.z, inv);
 
-    // Project the up and right normals onto the near plane (otherwise they might be skewed)
-    up = near_plane.project(up).normalized();
-    right = near_plane.project(right).normalized();
+    for(int32_t x = x0; x <= x1; ++x) {
+        for(int32_t y = y0; y <= y1; ++y) {
+            for(int32_t z = z0; z <= z1; ++z) {
+                assert(count < MAX_CELLS_PER_ENTRY);
+                keys[count++] = make_cell_key(level, x, y, z);
+            }
+        }
+    }
 
-    float distance_left = frustum.depth();
-    auto p = start_point;
-    while(distance_left > 0) {
-        float box_size = std::max(frustum.width_at_distance(distance_left), frustum.height_at_distance(distance_left));
-        float hw = box_size / 2.0f;
+    return true;
+}
 
-        std::array<Vec3, 8> corners;
+void SpatialHash::insert_object_for_box(const AABB &box, SpatialHashEntry *object) {
+    if(object->inserted_) {
+        update_object_for_box(box, object);
+        return;
+    }
 
-        corners[0] = p - (direction * box_size) - (right * hw) - (up * hw);
-        corners[1] = p - (direction * box_size) + (right * hw) - (up * hw);
-        corners[2] = p - (direction * box_size) + (right * hw) + (up * hw);
-        corners[3] = p - (direction * box_size) - (right * hw) + (up * hw);
+    object->set_hash_aabb(box);
+    object->inserted_ = true;
 
-        corners[4] = p - (right * hw) - (up * hw);
-        corners[5] = p + (right * hw) - (up * hw);
-        corners[6] = p + (right * hw) + (up * hw);
-        corners[7] = p - (right * hw) + (up * hw);
+    if(!calculate_keys(box, object->keys_, object->key_count_)) {
+        object->oversized_ = true;
+        oversized_.push_back(object);
+        return;
+    }
 
+    for(uint8_t i = 0; i < object->key_count_; ++i) {
+        insert_object_for_key(object->keys_[i], object);
+    }
+}
 
-        AABB new_box(corners.data(), corners.size());
-        results.push_back(new_box);
+void SpatialHash::remove_object(SpatialHashEntry *object) {
+    if(!object->inserted_) {
+        return;
+    }
 
-        distance_left -= box_size;
-        p += direction * box_size;
+    if(object->oversized_) {
+        auto it = std::find(oversized_.begin(), oversized_.end(), object);
+        if(it != oversized_.end()) {
+            std::swap(*it, oversized_.back());
+            oversized_.pop_back();
+        }
+    } else {
+        for(uint8_t i = 0; i < object->key_count_; ++i) {
+            erase_object_from_key(object->keys_[i], object);
+        }
     }
+
+    object->key_count_ = 0;
+    object->oversized_ = false;
+    object->inserted_ = false;
 }
 
-HGSHEntryList SpatialHash::find_objects_within_frustum(const Frustum &frustum) {
-    static std::vector<AABB> boxes; // Static to avoid repeated allocations
+void SpatialHash::update_object_for_box(const AABB& new_box, SpatialHashEntry* object) {
+    if(!object->inserted_) {
+        insert_object_for_box(new_box, object);
+        return;
+    }
 
-    generate_boxes_for_frustum(frustum, boxes);
+    std::array<CellKey, MAX_CELLS_PER_ENTRY> new_keys;
+    uint8_t new_count = 0;
 
-    HGSHEntryList results;
+    if(!calculate_keys(new_box, new_keys, new_count) || object->oversized_) {
+        /* Moving to or from the oversized list, just start again */
+        remove_object(object);
+        insert_object_for_box(new_box, object);
+        return;
+    }
 
-    for(auto& box: boxes) {
-        for(auto& result: find_objects_within_box(box)) {
-            if(frustum.intersects_aabb(result->hash_aabb())) {
-                results.insert(result);
-            }
+    object->set_hash_aabb(new_box);
+
+    auto& old_keys = object->keys_;
+    auto old_count = object->key_count_;
+
+    /* Most updates are small movements within the same cells, in
+     * which case this does nothing */
+    for(uint8_t i = 0; i < old_count; ++i) {
+        if(!contains_key(new_keys, new_count, old_keys[i])) {
+            erase_object_from_key(old_keys[i], object);
         }
     }
 
-    return results;
+    for(uint8_t i = 0; i < new_count; ++i) {
+        if(!contains_key(old_keys, old_count, new_keys[i])) {
+            insert_object_for_key(new_keys[i], object);
+        }
+    }
+
+    object->keys_ = new_keys;
+    object->key_count_ = new_count;
 }
 
-HGSHEntryList SpatialHash::find_objects_within_box(const AABB &box) {
-    HGSHEntryList objects;
+void SpatialHash::update_objects_for_boxes(const AABB* new_boxes, SpatialHashEntry* const* objects, std::size_t count) {
+    changes_.clear();
+
+    for(std::size_t i = 0; i < count; ++i) {
+        auto& new_box = new_boxes[i];
+        auto object = objects[i];
+
+        std::array<CellKey, MAX_CELLS_PER_ENTRY> new_keys;
+        uint8_t new_count = 0;
+
+        if(!object->inserted_ || object->oversized_ || !calculate_keys(new_box, new_keys, new_count)) {
+            /* Inserting, or moving to or from the oversized list. These
+             * are rare so just do them directly */
+            update_object_for_box(new_box, object);
+            continue;
+        }
+
+        object->set_hash_aabb(new_box);
+
+        auto& old_keys = object->keys_;
+        auto old_count = object->key_count_;
+
+        for(uint8_t j = 0; j < old_count; ++j) {
+            if(!contains_key(new_keys, new_count, old_keys[j])) {
+                changes_.push_back(CellChange{old_keys[j], false, object});
+            }
+        }
+
+        for(uint8_t j = 0; j < new_count; ++j) {
+            if(!contains_key(old_keys, old_count, new_keys[j])) {
+                changes_.push_back(CellChange{new_keys[j], true, object});
+            }
+        }
+
+        object->keys_ = new_keys;
+        object->key_count_ = new_count;
+    }
+
+    /* Group the changes by cell, with each cell's removals first and
+     * sorted so that they can be searched */
+    std::sort(changes_.begin(), changes_.end(), [](const CellChange& lhs, const CellChange& rhs) {
+        if(lhs.key != rhs.key) {
+            return lhs.key < rhs.key;
+        }
+
+        if(lhs.insert != rhs.insert) {
+            return rhs.insert;
+        }
 
-    auto cell_size = find_cell_size_for_box(box);
+        return lhs.object < rhs.object;
+    });
+
+    auto it = changes_.begin();
+    while(it != changes_.end()) {
+        auto key = it->key;
+
+        auto removed_end = it;
+        while(removed_end != changes_.end() && removed_end->key == key && !removed_end->insert) {
+            ++removed_end;
+        }
 
-    auto gather_objects = [](Index& index, const Key& key, HGSHEntryList& objects) {
-        auto it = index.lower_bound(key);
-        if(it == index.end()) {
-            return;
+        auto inserted_end = removed_end;
+        while(inserted_end != changes_.end() && inserted_end->key == key) {
+            ++inserted_end;
         }
 
-        // First, iterate the index to find a key which isn't a descendent of this one
-        // then break
-        while(it != index.end() && key.is_ancestor_of(it->first)) {
-            objects.insert(it->second.begin(), it->second.end());
-            ++it;
+        auto& level = levels_[cell_key_level(key)];
+        if(!level) {
+            level.reset(new Level());
         }
 
-        // Now, go up the tree looking for objects which are ancestors of this key
-        auto path = key;
-        while(!path.is_root()) {
-            path = path.parent_key();
-            it = index.find(path);
-            if(it != index.end() && path.is_ancestor_of(it->first)) {
-                objects.insert(it->second.begin(), it->second.end());
+        auto index = level->find_cell(key);
+        if(index < 0 && removed_end != inserted_end) {
+            int32_t x, y, z;
+            cell_key_coords(key, x, y, z);
+            index = level->insert_cell(key, x, y, z);
+        }
+
+        if(index >= 0) {
+            auto& entries = level->cells[index].entries;
+
+            if(it != removed_end) {
+                auto removed = [it, removed_end](SpatialHashEntry* object) -> bool {
+                    return std::binary_search(
+                        it, removed_end, CellChange{0, false, object},
+                        [](const CellChange& lhs, const CellChange& rhs) {
+                            return lhs.object < rhs.object;
+                        }
+                    );
+                };
+
+                entries.erase(std::remove_if(entries.begin(), entries.end(), removed), entries.end());
+            }
+
+            for(auto c = removed_end; c != inserted_end; ++c) {
+                entries.push_back(c->object);
+            }
+
+            if(entries.empty()) {
+                level->erase_cell(index);
             }
         }
-    };
 
-    KeyList seen;
+        it = inserted_end;
+    }
+}
 
-    for(auto& corner: box.corners()) {
-        auto key = make_key(
-            cell_size,
-            corner.x,
-            corner.y,
-            corner.z
-        );
-        seen.insert(key);
+void SpatialHash::insert_object_for_key(CellKey key, SpatialHashEntry *object) {
+    auto& level = levels_[cell_key_level(key)];
+    if(!level) {
+        level.reset(new Level());
     }
 
-    for(auto& key: seen) {
-        gather_objects(index_, key, objects);
+    auto index = level->find_cell(key);
+    if(index < 0) {
+        int32_t x, y, z;
+        cell_key_coords(key, x, y, z);
+        index = level->insert_cell(key, x, y, z);
     }
 
-    return objects;
+    level->cells[index].entries.push_back(object);
 }
 
-int32_t SpatialHash::find_cell_size_for_box(const AABB &box) const {
-    /*
-     * We find the nearest hash size which is greater than double the max dimension of the
-     * box. This increases the likelyhood that the object will not wastefully span cells
-     */
+void SpatialHash::erase_object_from_key(CellKey key, SpatialHashEntry* object) {
+    auto& level = levels_[cell_key_level(key)];
+    if(!level) {
+        return;
+    }
 
-    auto maxd = box.max_dimension();
-    if(maxd < 1.0f) {
-        return 1;
-    } else {
-        return 1 << uint32_t(std::ceil(::log2(maxd)));
+    auto index = level->find_cell(key);
+    if(index < 0) {
+        return;
     }
-}
 
-void SpatialHash::insert_object_for_key(Key key, SpatialHashEntry *entry) {
-    auto it = index_.find(key);
-    if(it != index_.end()) {
-        it->second.insert(entry);
-    } else {
-        HGSHEntryList list;
-        list.insert(entry);
-        index_.insert(std::make_pair(key, list));
+    auto& entries = level->cells[index].entries;
+    auto it = std::find(entries.begin(), entries.end(), object);
+    if(it != entries.end()) {
+        std::swap(*it, entries.back());
+        entries.pop_back();
     }
-    entry->push_key(key);
-}
 
-Key make_key(int32_t cell_size, float x, float y, float z) {
-    static const int32_t MAX_PATH_SIZE = pow(2, MAX_GRID_LEVELS - 1);
-
-    Key key;
-    key.ancestors = 15 - (int(::log2(cell_size)));
-
-    key.hash_path[0] = make_hash(MAX_PATH_SIZE, x, y, z);
-    key.hash_path[1] = (key.ancestors > 0) ? make_hash(MAX_PATH_SIZE / 2, x, y, z) : Hash();
-    key.hash_path[2] = (key.ancestors > 1) ? make_hash(MAX_PATH_SIZE / 4, x, y, z) : Hash();
-    key.hash_path[3] = (key.ancestors > 2) ? make_hash(MAX_PATH_SIZE / 8, x, y, z) : Hash();
-    key.hash_path[4] = (key.ancestors > 3) ? make_hash(MAX_PATH_SIZE / 16, x, y, z) : Hash();
-    key.hash_path[5] = (key.ancestors > 4) ? make_hash(MAX_PATH_SIZE / 32, x, y, z) : Hash();
-    key.hash_path[6] = (key.ancestors > 5) ? make_hash(MAX_PATH_SIZE / 64, x, y, z) : Hash();
-    key.hash_path[7] = (key.ancestors > 6) ? make_hash(MAX_PATH_SIZE / 128, x, y, z) : Hash();
-    key.hash_path[8] = (key.ancestors > 7) ? make_hash(MAX_PATH_SIZE / 256, x, y, z) : Hash();
-    key.hash_path[9] = (key.ancestors > 8) ? make_hash(MAX_PATH_SIZE / 512, x, y, z) : Hash();
-    key.hash_path[10] = (key.ancestors > 9) ? make_hash(MAX_PATH_SIZE / 1024, x, y, z) : Hash();
-    key.hash_path[11] = (key.ancestors > 10) ? make_hash(MAX_PATH_SIZE / 2048, x, y, z) : Hash();
-    key.hash_path[12] = (key.ancestors > 11) ? make_hash(MAX_PATH_SIZE / 4096, x, y, z) : Hash();
-    key.hash_path[13] = (key.ancestors > 12) ? make_hash(MAX_PATH_SIZE / 8192, x, y, z) : Hash();
-    key.hash_path[14] = (key.ancestors > 13) ? make_hash(MAX_PATH_SIZE / 16384, x, y, z) : Hash();
-    key.hash_path[15] = (key.ancestors > 14) ? make_hash(1, x, y, z) : Hash();
-
-    /* Precalculate the hash_code for speed */
-    key.hash_code = 0;
-    for(uint8_t i = 0; i < smlt::MAX_GRID_LEVELS; ++i) {
-        std::hash_combine(key.hash_code, key.hash_path[i].x);
-        std::hash_combine(key.hash_code, key.hash_path[i].y);
-        std::hash_combine(key.hash_code, key.hash_path[i].z);
-    }
-
-    return key;
+    if(entries.empty()) {
+        level->erase_cell(index);
+    }
 }
 
-Hash make_hash(int32_t cell_size, float x, float y, float z) {
-    Hash hash;
+template<typename Func>
+void SpatialHash::gather(const AABB& bounds, HGSHEntryList& results, Func&& cell_visible) const {
+    auto min = bounds.min();
+    auto max = bounds.max();
 
-    hash.x = int16_t(std::floor(x / cell_size));
-    hash.y = int16_t(std::floor(y / cell_size));
-    hash.z = int16_t(std::floor(z / cell_size));
+    for(uint32_t l = 0; l < MAX_GRID_LEVELS; ++l) {
+        auto& level = levels_[l];
+        if(!level || level->cells.empty()) {
+            continue;
+        }
+
+        auto inv = inverse_cell_size(l);
+        int32_t x0 = cell_coord(min.x, inv), x1 = cell_coord(max.x, inv);
+        int32_t y0 = cell_coord(min.y, inv), y1 = cell_coord(max.y, inv);
+        int32_t z0 = cell_coord(min.z, inv), z1 = cell_coord(max.z, inv);
+
+        const float cell_size = float(1u << l);
 
-    return hash;
+        auto visit = [&](const Cell& cell) {
+            if(cell_visible(cell, cell_size)) {
+                results.insert(results.end(), cell.entries.begin(), cell.entries.end());
+            }
+        };
+
+        uint64_t range = uint64_t(x1 - x0 + 1) * uint64_t(y1 - y0 + 1) * uint64_t(z1 - z0 + 1);
+
+        if(range <= level->cells.size()) {
+            /* Small query relative to the level, walk the cells in range
+             * and skip the empty ones using the occupancy bits */
+            for(int32_t x = x0; x <= x1; ++x) {
+                for(int32_t y = y0; y <= y1; ++y) {
+                    for(int32_t z = z0; z <= z1; ++z) {
+                        if(!level->is_occupied(x, y, z)) {
+                            continue;
+                        }
+
+                        auto index = level->find_cell(make_cell_key(l, x, y, z));
+                        if(index >= 0) {
+                            visit(level->cells[index]);
+                        }
+                    }
+                }
+            }
+        } else {
+            /* Large query, it's cheaper to scan the level's cells */
+            for(auto& cell: level->cells) {
+                if(cell.x >= x0 && cell.x <= x1 &&
+                   cell.y >= y0 && cell.y <= y1 &&
+                   cell.z >= z0 && cell.z <= z1) {
+                    visit(cell);
+                }
+            }
+        }
+    }
+
+    /* Objects are in up to 8 cells, so remove the duplicates */
+    std::sort(results.begin(), results.end());
+    results.erase(std::unique(results.begin(), results.end()), results.end());
+
+    for(auto& entry: oversized_) {
+        if(bounds.intersects_aabb(entry->hash_aabb())) {
+            results.push_back(entry);
+        }
+    }
 }
 
-Key Key::parent_key() const {
-    assert(!is_root());
+HGSHEntryList SpatialHash::find_objects_within_frustum(const Frustum &frustum) const {
+    auto corners = frustum.near_corners();
+    auto far_corners = frustum.far_corners();
+    corners.insert(corners.end(), far_corners.begin(), far_corners.end());
+
+    HGSHEntryList candidates;
+    gather(AABB(corners.data(), corners.size()), candidates, [&frustum](const Cell& cell, float cell_size) -> bool {
+        /* An object is in every cell it overlaps, so if none of its
+         * cells are in the frustum then neither is the object. Cells on
+         * the edge of the grid hold clamped objects, so always check those. */
+        if(cell.x == CELL_COORD_MIN || cell.x == CELL_COORD_MAX ||
+           cell.y == CELL_COORD_MIN || cell.y == CELL_COORD_MAX ||
+           cell.z == CELL_COORD_MIN || cell.z == CELL_COORD_MAX) {
+            return true;
+        }
 
-    Key ret;
-    memcpy(ret.hash_path, hash_path, sizeof(Hash) * ancestors);
-    ret.ancestors = ancestors - 1;
-    return ret;
+        Vec3 min(cell.x * cell_size, cell.y * cell_size, cell.z * cell_size);
+        Vec3 max = min + Vec3(cell_size, cell_size, cell_size);
+
+        AABB cell_box;
+        cell_box.set_min_max(min, max);
+        return frustum.intersects_aabb(cell_box);
+    });
+
+    HGSHEntryList results;
+    results.reserve(candidates.size());
+
+    for(auto& candidate: candidates) {
+        if(frustum.intersects_aabb(candidate->hash_aabb())) {
+            results.push_back(candidate);
+        }
+    }
+
+    return results;
 }
 
-bool Key::is_ancestor_of(const Key &other) const {
-    if(ancestors > other.ancestors) return false;
+HGSHEntryList SpatialHash::find_objects_within_box(const AABB &box) const {
+    HGSHEntryList candidates;
+    gather(box, candidates, [](const Cell&, float) -> bool {
+        return true;
+    });
+
+    HGSHEntryList results;
+    results.reserve(candidates.size());
+
+    for(auto& candidate: candidates) {
+        if(box.intersects_aabb(candidate->hash_aabb())) {
+            results.push_back(candidate);
+        }
+    }
 
-    return memcmp(hash_path, other.hash_path, sizeof(Hash) * (ancestors + 1)) == 0;
+    return results;
 }
 
-std::ostream &operator<<(std::ostream &os, const Key &key) {
-    for(uint32_t i = 0; i < key.ancestors + 1; ++i) {
-        os << key.hash_path[i].x << key.hash_path[i].y << key.hash_path[i].z;
-        if(i != key.ancestors) {
-            os << " / ";
+std::size_t SpatialHash::cell_count() const {
+    std::size_t count = 0;
+    for(auto& level: levels_) {
+        if(level) {
+            count += level->cells.size();
         }
     }
 
-    return os;
+    return count;
 }
 
 std::ostream &operator<<(std::ostream &os, const SpatialHash &hash) {
-    for(auto& pair: hash.index_) {
-        os << pair.first << " : " << pair.second.size() << " items" << std::endl;
+    for(uint32_t l = 0; l < MAX_GRID_LEVELS; ++l) {
+        auto& level = hash.levels_[l];
+        if(!level) {
+            continue;
+        }
+
+        for(auto& cell: level->cells) {
+            os << (1u << l) << " : " << cell.x << ", " << cell.y << ", " << cell.z;
+            os << " : " << cell.entries.size() << " items" << std::endl;
+        }
+    }
+
+    if(!hash.oversized_.empty()) {
+        os << "oversized : " << hash.oversized_.size() << " items" << std::endl;
     }
 
     return os;
@@ -1,89 +1,50 @@
 #pragma once
 
-#include <cstring>
-#include <map>
-#include <unordered_set>
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <memory>
 #include <ostream>
-#include <unordered_set>
 #include "../../interfaces.h"
 
 /*
  * Hierarchical Grid Spatial Hash implementation
  *
- * Objects are inserted into (preferably) one bucket
+ * There are MAX_GRID_LEVELS grids, each with a cell size double that of
+ * the last. Objects are inserted into the level whose cell size fits their
+ * AABB, which means they overlap at most 2x2x2 cells of that level.
+ *
+ * Each level is a flat open-addressing hash table of packed 64-bit cell
+ * keys. Cells are stored contiguously per-level, and a small occupancy
+ * bitset lets queries skip empty cells without probing the table.
  */
 
 namespace smlt {
 
-
 const uint32_t MAX_GRID_LEVELS = 16;
-struct Hash {
-    Hash() = default;
-    Hash(int16_t x, int16_t y, int16_t z):
-        x(x), y(y), z(z) {}
-
-    int16_t x = 0;
-    int16_t y = 0;
-    int16_t z = 0;
-};
+
+/* The most cells an object can be inserted into */
+const uint32_t MAX_CELLS_PER_ENTRY = 8;
 
 /*
- * Heirarchical hash key. Each level in the key is a hash of cell_size, x, y, z
- * if a child key is visible then all parent and child keys are visible. Using a multimap
- * we can rapidly gather child key objects (by iterating until the key no longer starts with this one)
- * and we can gather parent ones by checking all levels of the hash_path
+ * A cell key packs the grid level into the top 4 bits, and the Morton
+ * (Z-order) interleaving of the cell's x, y and z coordinates into the
+ * remaining 60. Coordinates are biased by 2^19 so that each fits into
+ * 20 bits, cells outside that range are clamped to the edge.
  */
-struct Key {
-    Hash hash_path[MAX_GRID_LEVELS];
-    std::size_t ancestors = 0;
-    std::size_t hash_code = 0;
-
-    bool operator<(const Key& other) const {
-        auto len = std::min(other.ancestors, ancestors) + 1;
-        auto ret = memcmp(hash_path, other.hash_path, sizeof(Hash) * len);
-        return ret < 0 || (ret == 0 && ancestors < other.ancestors);
-    }
-
-    bool operator==(const Key& other) const {
-        return (
-            ancestors == other.ancestors &&
-            memcmp(hash_path, other.hash_path, sizeof(Hash) * (ancestors + 1)) == 0
-        );
-    }
-
-    bool is_root() const { return ancestors == 0; }
-    Key parent_key() const;
-
-    bool is_ancestor_of(const Key& other) const;
-
-    friend std::ostream& operator<<(std::ostream& os, const Key& key);
-};
-
-}
+typedef uint64_t CellKey;
 
-namespace std {
+const int32_t CELL_COORD_BIAS = (1 << 19);
+const int32_t CELL_COORD_MIN = -CELL_COORD_BIAS;
+const int32_t CELL_COORD_MAX = CELL_COORD_BIAS - 1;
 
-    template<>
-    struct hash<smlt::Key> {
-        typedef smlt::Key argument_type;
-        typedef std::size_t result_type;
+CellKey make_cell_key(uint32_t level, int32_t x, int32_t y, int32_t z);
 
-        result_type operator()(argument_type const& s) const
-        {
-            return s.hash_code;
-        }
-    };
-
-}
-
-namespace smlt {
-
-std::ostream& operator<<(std::ostream& os, const Key& key);
+/* Returns the key of the level's cell which contains the point */
+CellKey make_cell_key_for_point(uint32_t level, float x, float y, float z);
 
-Key make_key(int32_t cell_size, float x, float y, float z);
-Hash make_hash(int32_t cell_size, float x, float y, float z);
-
-typedef std::unordered_set<Key> KeyList;
+uint32_t cell_key_level(CellKey key);
+void cell_key_coords(CellKey key, int32_t& x, int32_t& y, int32_t& z);
 
 class SpatialHashEntry {
 public:
@@ -93,59 +54,130 @@ public:
         hash_aabb_ = aabb;
     }
 
-    void push_key(const Key& key) {
-        keys_.insert(key);
-    }
+    const AABB& hash_aabb() const { return hash_aabb_; }
 
-    void remove_key(const Key& key) {
-        keys_.erase(key);
+    std::size_t key_count() const {
+        return key_count_;
     }
 
-    void set_keys(const KeyList& keys) {
-        keys_ = std::move(keys);
+    CellKey key(std::size_t i) const {
+        return keys_[i];
     }
 
-    const KeyList& keys() const {
-        return keys_;
+    /* True if the entry is too large for the grid and is tested
+     * against every query instead */
+    bool is_oversized() const {
+        return oversized_;
     }
 
-    const AABB& hash_aabb() const { return hash_aabb_; }
 private:
-    KeyList keys_;
+    friend class SpatialHash;
+
+    std::array<CellKey, MAX_CELLS_PER_ENTRY> keys_;
+    uint8_t key_count_ = 0;
+    bool oversized_ = false;
+    bool inserted_ = false;
+
     AABB hash_aabb_;
 };
 
-typedef std::unordered_set<SpatialHashEntry*> HGSHEntryList;
+typedef std::vector<SpatialHashEntry*> HGSHEntryList;
 
 class SpatialHash {
 public:
     SpatialHash();
+    ~SpatialHash();
 
+    /* Inserting an object which is already in the hash moves it */
     void insert_object_for_box(const AABB& box, SpatialHashEntry* object);
     void remove_object(SpatialHashEntry* object);
 
     void update_object_for_box(const AABB& new_box, SpatialHashEntry* object);
 
-    HGSHEntryList find_objects_within_box(const AABB& box);
-    HGSHEntryList find_objects_within_frustum(const Frustum& frustum);
+    /* Moves several objects at once, each cell they leave or enter is
+     * rebuilt once however many of them touch it. Each object must only
+     * appear once. */
+    void update_objects_for_boxes(const AABB* new_boxes, SpatialHashEntry* const* objects, std::size_t count);
+
+    /* Returned lists contain no duplicates. These are const and safe to
+     * call from multiple threads as long as nothing is writing. */
+    HGSHEntryList find_objects_within_box(const AABB& box) const;
+    HGSHEntryList find_objects_within_frustum(const Frustum& frustum) const;
+
+    std::size_t cell_count() const;
 
     friend std::ostream &operator<<(std::ostream &os, const SpatialHash &hash);
 
 private:
-    void erase_object_from_key(Key key, SpatialHashEntry* object);
+    struct Cell {
+        CellKey key;
+        int32_t x, y, z;
+        std::vector<SpatialHashEntry*> entries;
+    };
 
-    int32_t find_cell_size_for_box(const AABB& box) const;
-    void insert_object_for_key(Key key, SpatialHashEntry* entry);
+    struct Slot {
+        CellKey key;
+        uint32_t cell;
+    };
 
-    typedef std::map<Key, std::unordered_set<SpatialHashEntry*>> Index;
-    Index index_;
-};
+    static const uint32_t EMPTY_SLOT = ~0u;
 
-std::ostream &operator<<(std::ostream &os, const SpatialHash &hash);
+    /* 16x16x16 cells wrapping over the level */
+    static const uint32_t OCCUPANCY_BITS = 4096;
 
-void generate_boxes_for_frustum(const Frustum& frustum, std::vector<AABB>& results);
+    struct Level {
+        std::vector<Cell> cells;
+        std::vector<Slot> slots;
 
-}
+        std::array<uint64_t, OCCUPANCY_BITS / 64> occupied;
 
+        /* How many cells share each occupancy bit, so that bits
+         * can be cleared when the last cell goes */
+        std::array<uint16_t, OCCUPANCY_BITS> occupancy_counts;
 
+        Level();
 
+        int32_t find_cell(CellKey key) const;
+        uint32_t insert_cell(CellKey key, int32_t x, int32_t y, int32_t z);
+        void erase_cell(uint32_t index);
+
+        bool is_occupied(int32_t x, int32_t y, int32_t z) const {
+            auto bit = occupancy_bit(x, y, z);
+            return occupied[bit >> 6] & (uint64_t(1) << (bit & 63));
+        }
+
+    private:
+        static uint32_t occupancy_bit(int32_t x, int32_t y, int32_t z) {
+            return ((x & 15) << 8) | ((y & 15) << 4) | (z & 15);
+        }
+
+        uint32_t find_slot(CellKey key) const;
+        void grow();
+    };
+
+    /* Calculates the level and cell keys for the box. Returns false if
+     * the box is too large (or not finite) to be stored in the grid */
+    bool calculate_keys(const AABB& box, std::array<CellKey, MAX_CELLS_PER_ENTRY>& keys, uint8_t& count) const;
+
+    void insert_object_for_key(CellKey key, SpatialHashEntry* object);
+    void erase_object_from_key(CellKey key, SpatialHashEntry* object);
+
+    /* An object leaving (or entering) a cell, staged by update_objects_for_boxes */
+    struct CellChange {
+        CellKey key;
+        bool insert;
+        SpatialHashEntry* object;
+    };
+
+    std::vector<CellChange> changes_;
+
+    template<typename Func>
+    void gather(const AABB& bounds, HGSHEntryList& results, Func&& cell_visible) const;
+
+    std::array<std::unique_ptr<Level>, MAX_GRID_LEVELS> levels_;
+    std::vector<SpatialHashEntry*> oversized_;
+};
+
+std::ostream &operator<<(std::ostream &os, const SpatialHash &hash);
+
+}
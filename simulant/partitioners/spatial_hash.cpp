@@ -21,8 +21,6 @@ SpatialHashPartitioner::~SpatialHashPartitioner() {
 }
 
 void SpatialHashPartitioner::stage_add_actor(ActorID obj) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
-
     auto actor = stage->actor(obj);
     if(!actor) {
         return;
@@ -35,8 +33,6 @@ void SpatialHashPartitioner::stage_add_actor(ActorID obj) {
 }
 
 void SpatialHashPartitioner::stage_remove_actor(ActorID obj) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
-
     auto it = actor_entries_.find(obj);
     if(it != actor_entries_.end()) {
         hash_->remove_object(it->second.get());
@@ -45,23 +41,18 @@ void SpatialHashPartitioner::stage_remove_actor(ActorID obj) {
 }
 
 void SpatialHashPartitioner::_update_actor(const AABB &bounds, ActorID actor) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
     hash_->update_object_for_box(bounds, actor_entries_.at(actor).get());
 }
 
 void SpatialHashPartitioner::_update_particle_system(const AABB& bounds, ParticleSystemID ps) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
     hash_->update_object_for_box(bounds, particle_system_entries_.at(ps).get());
 }
 
 void SpatialHashPartitioner::_update_light(const AABB& bounds, LightID light) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
     hash_->update_object_for_box(bounds, light_entries_.at(light).get());
 }
 
 void SpatialHashPartitioner::stage_add_geom(GeomID geom_id) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
-
     auto geom = stage->geom(geom_id);
 
     if(!geom) {
@@ -74,8 +65,6 @@ void SpatialHashPartitioner::stage_add_geom(GeomID geom_id) {
 }
 
 void SpatialHashPartitioner::stage_remove_geom(GeomID geom_id) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
-
     auto it = geom_entries_.find(geom_id);
     if(it != geom_entries_.end()) {
         hash_->remove_object(it->second.get());
@@ -84,8 +73,6 @@ void SpatialHashPartitioner::stage_remove_geom(GeomID geom_id) {
 }
 
 void SpatialHashPartitioner::stage_add_light(LightID obj) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
-
     auto light = stage->light(obj);
 
     if(!light) {
@@ -103,8 +90,6 @@ void SpatialHashPartitioner::stage_add_light(LightID obj) {
 }
 
 void SpatialHashPartitioner::stage_remove_light(LightID obj) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
-
     if(directional_lights_.find(obj) != directional_lights_.end()) {
         directional_lights_.erase(obj);
     } else {
@@ -117,8 +102,6 @@ void SpatialHashPartitioner::stage_remove_light(LightID obj) {
 }
 
 void SpatialHashPartitioner::stage_add_particle_system(ParticleSystemID ps) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
-
     auto particle_system = stage->particle_system(ps);
     auto partitioner_entry = std::make_shared<PartitionerEntry>(ps);
     hash_->insert_object_for_box(particle_system->transformed_aabb(), partitioner_entry.get());
@@ -126,8 +109,6 @@ void SpatialHashPartitioner::stage_add_particle_system(ParticleSystemID ps) {
 }
 
 void SpatialHashPartitioner::stage_remove_particle_system(ParticleSystemID ps) {
-    thread::WriteLock<thread::SharedMutex> lock(lock_);
-
     auto it = particle_system_entries_.find(ps);
     if(it != particle_system_entries_.end()) {
         hash_->remove_object(it->second.get());
@@ -136,8 +117,58 @@ void SpatialHashPartitioner::stage_remove_particle_system(ParticleSystemID ps) {
 }
 
 void SpatialHashPartitioner::apply_staged_write(const UniqueIDKey& key, const StagedWrite &write) {
-    _apply_writes();
+    thread::WriteLock<thread::SharedMutex> lock(lock_);
+    _apply_staged_write(key, write);
+}
+
+void SpatialHashPartitioner::apply_staged_writes(const std::vector<KeyedWrite>& writes) {
+    /* Take the lock once for the whole batch rather than per-write */
+    thread::WriteLock<thread::SharedMutex> lock(lock_);
+
+    /* Adds and removes create and destroy entries so they're applied
+     * in order, then the updates are handed to the hash together so that
+     * each cell they touch is only rebuilt once */
+    for(auto& write: writes) {
+        if(write.second.operation != WRITE_OPERATION_UPDATE) {
+            _apply_staged_write(write.first, write.second);
+        }
+    }
+
+    updated_bounds_.clear();
+    updated_entries_.clear();
+
+    for(auto& write: writes) {
+        if(write.second.operation != WRITE_OPERATION_UPDATE) {
+            continue;
+        }
+
+        auto entry = find_entry(write.first);
+        if(entry) {
+            updated_bounds_.push_back(write.second.new_bounds);
+            updated_entries_.push_back(entry);
+        }
+    }
+
+    hash_->update_objects_for_boxes(updated_bounds_.data(), updated_entries_.data(), updated_entries_.size());
+}
+
+PartitionerEntry* SpatialHashPartitioner::find_entry(const UniqueIDKey& key) const {
+    if(key.first == typeid(Actor)) {
+        auto it = actor_entries_.find(make_unique_id_from_key<ActorID>(key));
+        return (it == actor_entries_.end()) ? nullptr : it->second.get();
+    } else if(key.first == typeid(Light)) {
+        auto it = light_entries_.find(make_unique_id_from_key<LightID>(key));
+        return (it == light_entries_.end()) ? nullptr : it->second.get();
+    } else if(key.first == typeid(ParticleSystem)) {
+        auto it = particle_system_entries_.find(make_unique_id_from_key<ParticleSystemID>(key));
+        return (it == particle_system_entries_.end()) ? nullptr : it->second.get();
+    }
+
+    /* Geoms don't move, and directional lights aren't in the hash */
+    return nullptr;
+}
 
+void SpatialHashPartitioner::_apply_staged_write(const UniqueIDKey& key, const StagedWrite &write) {
     bool is_actor = key.first == typeid(Actor);
     bool is_geom = key.first == typeid(Geom);
     bool is_light = key.first == typeid(Light);
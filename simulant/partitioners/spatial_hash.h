@@ -71,6 +71,14 @@ private:
     void _update_light(const AABB& bounds, LightID light);
 
     void apply_staged_write(const UniqueIDKey& key, const StagedWrite& write) override;
+    void apply_staged_writes(const std::vector<KeyedWrite>& writes) override;
+
+    /* Callers must hold a write lock on lock_ */
+    void _apply_staged_write(const UniqueIDKey& key, const StagedWrite& write);
+
+    /* Returns the hash entry for an actor, light or particle system, or
+     * nullptr if it isn't in the hash */
+    PartitionerEntry* find_entry(const UniqueIDKey& key) const;
 
     SpatialHash* hash_ = nullptr;
 
@@ -83,6 +91,10 @@ private:
 
     std::unordered_set<LightID> directional_lights_;
 
+    /* Scratch space for apply_staged_writes */
+    std::vector<AABB> updated_bounds_;
+    std::vector<SpatialHashEntry*> updated_entries_;
+
     thread::SharedMutex lock_;
 };
 
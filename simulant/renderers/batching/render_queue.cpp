@@ -17,6 +17,13 @@
 //     along with Simulant.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 #include "../../stage.h"
 #include "../../assets/material.h"
@@ -25,22 +32,155 @@
 #include "../../nodes/geom.h"
 #include "../../nodes/geoms/geom_culler.h"
 #include "../../nodes/camera.h"
+#include "../../time_keeper.h"
+#include "../../application.h"
+#include "../../threads/job_system.h"
 
 #include "render_queue.h"
 #include "../../partitioner.h"
 
 namespace smlt {
+
+uint64_t next_renderables_version() {
+#if !defined(__PSP__) && !defined(__DREAMCAST__)
+    /* Called for every node moved by the stage's parallel transformation
+     * pass, so this needs to be cheap */
+    static std::atomic<uint64_t> version(0);
+    return version.fetch_add(1, std::memory_order_relaxed) + 1;
+#else
+    /* No 64-bit atomics here, but there's only one core to contend with */
+    static thread::Mutex lock;
+    static uint64_t version = 0;
+
+    thread::Lock<thread::Mutex> g(lock);
+    return ++version;
+#endif
+}
+
 namespace batcher {
 
 
-RenderGroupKey generate_render_group_key(const uint8_t pass, const bool is_blended, const float distance_to_camera) {
+RenderGroupKey generate_render_group_key(const uint8_t pass, const bool is_blended, const float distance_to_camera, const RenderPriority priority, const uint32_t material_id) {
     RenderGroupKey key;
     key.pass = pass;
     key.is_blended = is_blended;
     key.distance_to_camera = distance_to_camera;
+    key.priority = (int16_t) priority;
+    key.material_id = material_id;
     return key;
 }
 
+static const uint32_t PRIORITY_BITS = 9;
+static const uint32_t PASS_BITS = 3;
+static const uint32_t DEPTH_BITS = 24;
+static const uint32_t MATERIAL_BITS = 64 - PRIORITY_BITS - PASS_BITS - 1 - DEPTH_BITS;
+
+static_assert(
+    (RENDER_PRIORITY_MAX - RENDER_PRIORITY_MIN) <= (1 << PRIORITY_BITS),
+    "Render priorities don't fit in the sort key"
+);
+
+static_assert(MAX_MATERIAL_PASSES <= (1 << PASS_BITS), "Material passes don't fit in the sort key");
+
+static inline uint64_t quantize_depth(float distance) {
+    /* Positive IEEE floats sort the same as their bit patterns, so
+     * we just drop the lowest bits of the mantissa */
+    if(!(distance > 0.0f)) {
+        return 0;
+    }
+
+    uint32_t bits;
+    std::memcpy(&bits, &distance, sizeof(float));
+    return (bits >> (32 - 1 - DEPTH_BITS));
+}
+
+uint64_t pack_render_group_key(const RenderGroupKey& key) {
+    const uint64_t priority = uint64_t(key.priority - RENDER_PRIORITY_MIN) & ((1 << PRIORITY_BITS) - 1);
+    const uint64_t pass = key.pass & ((1 << PASS_BITS) - 1);
+    const uint64_t material = key.material_id & ((1u << MATERIAL_BITS) - 1);
+    const uint64_t depth = quantize_depth(key.distance_to_camera);
+
+    uint64_t ret = (priority << (64 - PRIORITY_BITS));
+    ret |= (pass << (64 - PRIORITY_BITS - PASS_BITS));
+
+    if(key.is_blended) {
+        const uint64_t inverted_depth = ((1 << DEPTH_BITS) - 1) - depth;
+
+        ret |= (uint64_t(1) << (MATERIAL_BITS + DEPTH_BITS));
+        ret |= (inverted_depth << MATERIAL_BITS);
+        ret |= material;
+    } else {
+        ret |= (material << DEPTH_BITS);
+        ret |= depth;
+    }
+
+    return ret;
+}
+
+/* Queues larger than this have their matrices calculated across the job system */
+static const std::size_t PARALLEL_MATRIX_THRESHOLD = 2048;
+static const std::size_t MATRIX_BATCH_SIZE = 512;
+
+/* out = lhs * rhs, out must not be either of the inputs */
+static inline void multiply(const Mat4& lhs, const Mat4& rhs, Mat4& out) {
+#if defined(__SSE__)
+    /* Each column of the result is the columns of lhs, weighted by
+     * the corresponding column of rhs */
+    const float* a = lhs.data();
+    const float* b = rhs.data();
+    float* o = &out[0];
+
+    const __m128 c0 = _mm_loadu_ps(a);
+    const __m128 c1 = _mm_loadu_ps(a + 4);
+    const __m128 c2 = _mm_loadu_ps(a + 8);
+    const __m128 c3 = _mm_loadu_ps(a + 12);
+
+    for(int i = 0; i < 16; i += 4) {
+        __m128 col = _mm_mul_ps(c0, _mm_set1_ps(b[i]));
+        col = _mm_add_ps(col, _mm_mul_ps(c1, _mm_set1_ps(b[i + 1])));
+        col = _mm_add_ps(col, _mm_mul_ps(c2, _mm_set1_ps(b[i + 2])));
+        col = _mm_add_ps(col, _mm_mul_ps(c3, _mm_set1_ps(b[i + 3])));
+        _mm_storeu_ps(o + i, col);
+    }
+#else
+    out = lhs * rhs;
+#endif
+}
+
+void calculate_renderable_matrices(const Mat4& view, const Mat4& projection, const Renderable* renderables, std::size_t count, RenderableMatrices* out, uint8_t flags) {
+    const bool modelview = flags & (RENDERABLE_MATRIX_MODELVIEW | RENDERABLE_MATRIX_INVERSE_TRANSPOSE_MODELVIEW);
+    const bool modelview_projection = flags & RENDERABLE_MATRIX_MODELVIEW_PROJECTION;
+    const bool inverse_transpose = flags & RENDERABLE_MATRIX_INVERSE_TRANSPOSE_MODELVIEW;
+
+    Mat4 view_projection;
+    if(modelview_projection) {
+        multiply(projection, view, view_projection);
+    }
+
+    for(std::size_t i = 0; i < count; ++i) {
+        auto& model = renderables[i].final_transformation;
+        auto& matrices = out[i];
+
+        if(modelview) {
+            multiply(view, model, matrices.modelview);
+        }
+
+        if(modelview_projection) {
+            multiply(view_projection, model, matrices.modelview_projection);
+        }
+
+        if(inverse_transpose) {
+            matrices.inverse_transpose_modelview = Mat3(matrices.modelview);
+            matrices.inverse_transpose_modelview.inverse();
+            matrices.inverse_transpose_modelview.transpose();
+        }
+    }
+}
+
+static inline uint32_t key_priority(uint64_t key) {
+    return uint32_t(key >> (64 - PRIORITY_BITS));
+}
+
 RenderQueue::RenderQueue() {
 
 }
@@ -51,6 +191,83 @@ void RenderQueue::reset(Stage* stage, RenderGroupFactory* factory, CameraPtr cam
     camera_ = camera;
 
     clear();
+
+    /* Drop cached renderables for nodes that haven't been
+     * visible for a few frames (or have been destroyed) */
+    const uint64_t max_unused_frames = 4;
+
+    ++frame_count_;
+    for(auto it = cache_.begin(); it != cache_.end();) {
+        if(frame_count_ - it->second.last_used_frame > max_unused_frames) {
+            it = cache_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool RenderQueue::insert_cached_renderables(const StageNode* node, uint64_t version) {
+    auto it = cache_.find(node);
+    if(it == cache_.end() || it->second.version != version) {
+        return false;
+    }
+
+    auto& cached = it->second;
+    cached.last_used_frame = frame_count_;
+
+    auto first_entry = entries_.size();
+    for(auto& renderable: cached.renderables) {
+        insert_renderable(Renderable(renderable));
+    }
+
+    cached_renderable_count_ += cached.renderables.size();
+    track_cached_entries(&cached, first_entry);
+    return true;
+}
+
+void RenderQueue::begin_caching(const StageNode* node, uint64_t version) {
+    assert(!caching_);
+
+    auto& cached = cache_[node];
+    cached.version = version;
+    cached.last_used_frame = frame_count_;
+    cached.renderables.clear();
+    cached.ranks.clear();
+
+    caching_ = &cached;
+    caching_first_renderable_ = renderables_.size();
+    caching_first_entry_ = entries_.size();
+}
+
+void RenderQueue::end_caching() {
+    assert(caching_);
+
+    caching_->renderables.assign(
+        renderables_.begin() + caching_first_renderable_,
+        renderables_.end()
+    );
+
+    track_cached_entries(caching_, caching_first_entry_);
+    caching_ = nullptr;
+}
+
+void RenderQueue::track_cached_entries(CachedRenderables* cached, std::size_t first_entry) {
+    const std::size_t count = entries_.size() - first_entry;
+
+    /* If the number of entries changed (e.g. a material gained a pass)
+     * then the previous ranks are meaningless */
+    if(cached->ranks.size() != count) {
+        cached->ranks.assign(count, ~0u);
+    }
+
+    for(std::size_t i = 0; i < count; ++i) {
+        hints_[first_entry + i] = cached->ranks[i];
+        ranks_[first_entry + i] = &cached->ranks[i];
+
+        if(cached->ranks[i] != ~0u) {
+            ++hinted_count_;
+        }
+    }
 }
 
 void RenderQueue::insert_renderable(Renderable&& src_renderable) {
@@ -75,6 +292,7 @@ void RenderQueue::insert_renderable(Renderable&& src_renderable) {
     auto idx = renderables_.size();
     renderables_.push_back(std::move(src_renderable));
     auto renderable = &renderables_[idx];
+    matrices_calculated_ = false;
 
     auto material = renderable->material;
     assert(material);
@@ -97,98 +315,334 @@ void RenderQueue::insert_renderable(Renderable&& src_renderable) {
             i, is_blended, renderable_dist_to_camera
         );
 
-        // Priorities run from -250 to +250, so we need to offset the index
-        auto queue_number = priority + std::abs(RENDER_PRIORITY_MIN);
-        assert(queue_number < (int) priority_queues_.size());
+        // Priorities run from -250 to +250, they're offset when
+        // the key is packed
+        assert(priority >= RENDER_PRIORITY_MIN && priority < RENDER_PRIORITY_MAX);
+        group.sort_key.priority = (int16_t) priority;
 
-        auto& priority_queue = priority_queues_[queue_number];
-        priority_queue.insert(std::move(group), std::move(idx));
+        SortEntry entry;
+        entry.key = pack_render_group_key(group.sort_key);
+        entry.group = (uint32_t) groups_.size();
+        entry.renderable = (uint32_t) idx;
+
+        groups_.push_back(group);
+        entries_.push_back(entry);
+        hints_.push_back(~0u);
+        ranks_.push_back(nullptr);
     }
+
+    sorted_ = false;
 }
 
+void RenderQueue::radix_sort(std::vector<SortEntry>& entries) {
+    /* LSD radix sort, one byte at a time. Entries which compare equal keep
+     * their order, and any byte that's the same across all keys
+     * (e.g. the priority is usually the same for everything) is skipped */
+    const std::size_t count = entries.size();
+    sort_buffer_.resize(count);
+
+    uint64_t all_and = ~uint64_t(0);
+    uint64_t all_or = 0;
+    for(auto& entry: entries) {
+        all_and &= entry.key;
+        all_or |= entry.key;
+    }
 
-void RenderQueue::clear() {
+    const uint64_t varying = all_and ^ all_or;
+
+    SortEntry* src = entries.data();
+    SortEntry* dst = sort_buffer_.data();
+
+    for(uint32_t shift = 0; shift < 64; shift += 8) {
+        if(!((varying >> shift) & 0xFF)) {
+            continue;
+        }
+
+        std::size_t offsets[256] = {0};
+        for(std::size_t i = 0; i < count; ++i) {
+            ++offsets[(src[i].key >> shift) & 0xFF];
+        }
+
+        std::size_t total = 0;
+        for(auto& offset: offsets) {
+            auto c = offset;
+            offset = total;
+            total += c;
+        }
+
+        for(std::size_t i = 0; i < count; ++i) {
+            dst[offsets[(src[i].key >> shift) & 0xFF]++] = src[i];
+        }
+
+        std::swap(src, dst);
+    }
+
+    if(src != entries.data()) {
+        std::swap(entries, sort_buffer_);
+    }
+}
+
+bool RenderQueue::insertion_sort(std::vector<SortEntry>& entries, std::size_t max_moves) {
+    /* Returns false if the entries were too far out of order to
+     * be worth finishing, the entries are left partially sorted */
+    std::size_t moves = 0;
+
+    for(std::size_t i = 1; i < entries.size(); ++i) {
+        auto entry = entries[i];
+
+        std::size_t j = i;
+        while(j > 0 && entries[j - 1].key > entry.key) {
+            entries[j] = entries[j - 1];
+            --j;
+        }
+
+        entries[j] = entry;
+
+        moves += (i - j);
+        if(moves > max_moves) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void RenderQueue::sort_with_hints() {
+    /* Put the entries which were sorted last frame back into the order
+     * they were in. Unless the camera turned around, they'll be nearly sorted */
+    const SortEntry empty = {0, ~0u, ~0u};
+    hinted_entries_.assign(previous_sort_count_, empty);
+    new_entries_.clear();
+
+    for(auto& entry: entries_) {
+        auto hint = hints_[entry.group];
+        if(hint < hinted_entries_.size() && hinted_entries_[hint].group == ~0u) {
+            hinted_entries_[hint] = entry;
+        } else {
+            new_entries_.push_back(entry);
+        }
+    }
+
+    hinted_entries_.erase(
+        std::remove_if(hinted_entries_.begin(), hinted_entries_.end(), [](const SortEntry& e) {
+            return e.group == ~0u;
+        }),
+        hinted_entries_.end()
+    );
+
+    if(!insertion_sort(hinted_entries_, hinted_entries_.size() * 4)) {
+        radix_sort(hinted_entries_);
+    }
+
+    radix_sort(new_entries_);
+
+    /* Both halves are sorted, so merge them back together. The new entries
+     * go second so the order is stable with respect to the previous frame */
+    std::merge(
+        hinted_entries_.begin(), hinted_entries_.end(),
+        new_entries_.begin(), new_entries_.end(),
+        entries_.begin(),
+        [](const SortEntry& lhs, const SortEntry& rhs) {
+            return lhs.key < rhs.key;
+        }
+    );
+}
+
+void RenderQueue::sort() {
     thread::Lock<thread::Mutex> lock(queue_lock_);
-    for(auto& queue: priority_queues_) {
-        queue.clear();
+
+    if(sorted_) {
+        return;
     }
 
+    auto start = TimeKeeper::now_in_us();
+
+    if(hinted_count_) {
+        sort_with_hints();
+    } else {
+        radix_sort(entries_);
+    }
+
+    /* Store where each cached entry ended up for next time */
+    for(std::size_t i = 0; i < entries_.size(); ++i) {
+        auto rank = ranks_[entries_[i].group];
+        if(rank) {
+            *rank = (uint32_t) i;
+        }
+    }
+
+    sorted_ = true;
+    previous_sort_count_ = entries_.size();
+    last_sort_count_ = entries_.size();
+    last_sort_time_us_ = TimeKeeper::now_in_us() - start;
+}
+
+void RenderQueue::clear() {
+    thread::Lock<thread::Mutex> lock(queue_lock_);
     renderables_.clear();
+    groups_.clear();
+    entries_.clear();
+    hints_.clear();
+    ranks_.clear();
+    sorted_ = true;
+    matrices_calculated_ = false;
+
+    hinted_count_ = 0;
+    cached_renderable_count_ = 0;
+
+    last_sort_time_us_ = 0;
+    last_sort_count_ = 0;
 }
 
-void RenderQueue::traverse(RenderQueueVisitor* visitor, uint64_t frame_id) const {
+void RenderQueue::calculate_matrices() {
+    thread::Lock<thread::Mutex> lock(queue_lock_);
+
+    if(matrices_calculated_) {
+        return;
+    }
+
+    const auto count = renderables_.size();
+    matrices_.resize(count);
+
+    if(count) {
+        const Mat4& view = camera_->view_matrix();
+        const Mat4& projection = camera_->projection_matrix();
+
+        /* e.g. the fixed function renderer only needs the modelview */
+        const uint8_t flags = (render_group_factory_) ?
+            render_group_factory_->renderable_matrices_used() : uint8_t(RENDERABLE_MATRIX_ALL);
+
+        auto app = get_app();
+        if(app && count >= PARALLEL_MATRIX_THRESHOLD) {
+            app->jobs->parallel_for_batches(count, [&](std::size_t begin, std::size_t end) {
+                calculate_renderable_matrices(
+                    view, projection, &renderables_[begin], end - begin, &matrices_[begin], flags
+                );
+            }, MATRIX_BATCH_SIZE);
+        } else {
+            calculate_renderable_matrices(
+                view, projection, renderables_.data(), count, matrices_.data(), flags
+            );
+        }
+    }
+
+    matrices_calculated_ = true;
+}
+
+const RenderableMatrices* RenderQueue::matrices(const Renderable* renderable) const {
+    if(!matrices_calculated_ || renderables_.empty()) {
+        return nullptr;
+    }
+
+    /* Anything outside of our storage is a copy (e.g. a batch
+     * made by the renderer) and has no matrices */
+    const Renderable* first = renderables_.data();
+    if(renderable < first || renderable >= first + renderables_.size()) {
+        return nullptr;
+    }
+
+    return &matrices_[renderable - first];
+}
+
+void RenderQueue::traverse(RenderQueueVisitor* visitor, uint64_t frame_id) {
+    sort();
+    calculate_matrices();
+
     thread::Lock<thread::Mutex> lock(queue_lock_);
 
     visitor->start_traversal(*this, frame_id, stage_);
 
-    for(auto& queue: priority_queues_) {
-        IterationType pass_iteration_type = ITERATION_TYPE_ONCE;
-        MaterialPass* material_pass = nullptr, *last_pass = nullptr;
+    IterationType pass_iteration_type = ITERATION_TYPE_ONCE;
+    MaterialPass* material_pass = nullptr, *last_pass = nullptr;
 
-        const RenderGroup* last_group = nullptr;
+    const RenderGroup* last_group = nullptr;
+    uint64_t last_key = 0;
+    uint32_t last_priority = 0;
 
-        for(auto& p: queue) {
-            const RenderGroup* current_group = &p.first;
-            const Renderable* renderable = &renderables_[p.second];
+    for(auto& entry: entries_) {
+        const RenderGroup* current_group = &groups_[entry.group];
+        const Renderable* renderable = &renderables_[entry.renderable];
 
-            /* We do this here so that we don't change render group unless something in the
-             * new group is visible */
-            if(!last_group || *current_group != *last_group) {
-                visitor->change_render_group(last_group, current_group);
-            }
+        /* Each priority is rendered as though it were a separate queue */
+        auto priority = key_priority(entry.key);
+        if(priority != last_priority) {
+            last_pass = nullptr;
+            last_group = nullptr;
+            last_priority = priority;
+        }
 
-            material_pass = renderable->material->pass(current_group->sort_key.pass);
+        /* We do this here so that we don't change render group unless something in the
+         * new group is visible */
+        if(!last_group || entry.key != last_key) {
+            visitor->change_render_group(last_group, current_group);
+        }
 
-            if(material_pass != last_pass) {
-                pass_iteration_type = material_pass->iteration_type();
-                visitor->change_material_pass(last_pass, material_pass);
-                last_pass = material_pass;
-            }
+        material_pass = renderable->material->pass(current_group->sort_key.pass);
 
-            uint32_t iterations = 1;
+        if(material_pass != last_pass) {
+            pass_iteration_type = material_pass->iteration_type();
+            visitor->change_material_pass(last_pass, material_pass);
+            last_pass = material_pass;
+        }
 
-            // Get any lights which are visible and affecting the renderable this frame
-            auto& lights = renderable->lights_affecting_this_frame;
+        uint32_t iterations = 1;
 
-            if(pass_iteration_type == ITERATION_TYPE_N) {
-                iterations = material_pass->max_iterations();
-            } else if(pass_iteration_type == ITERATION_TYPE_ONCE_PER_LIGHT) {
-                iterations = renderable->light_count;
-            }
+        // Get any lights which are visible and affecting the renderable this frame
+        auto& lights = renderable->lights_affecting_this_frame;
 
-            for(Iteration i = 0; i < iterations; ++i) {
-                LightPtr next = nullptr;
-
-                // Pass down the light if necessary, otherwise just pass nullptr
-                if(i < renderable->light_count) {
-                    next = lights[i];
-                } else {
-                    next = nullptr;
-                }
-
-                if(pass_iteration_type == ITERATION_TYPE_ONCE_PER_LIGHT) {
-                    visitor->apply_lights(&next, 1);
-                } else if(pass_iteration_type == ITERATION_TYPE_N || pass_iteration_type == ITERATION_TYPE_ONCE) {
-                    visitor->apply_lights(&lights[0], (uint8_t) renderable->light_count);
-                }
-                visitor->visit(renderable, material_pass, i);
+        if(pass_iteration_type == ITERATION_TYPE_N) {
+            iterations = material_pass->max_iterations();
+        } else if(pass_iteration_type == ITERATION_TYPE_ONCE_PER_LIGHT) {
+            iterations = renderable->light_count;
+        }
+
+        for(Iteration i = 0; i < iterations; ++i) {
+            LightPtr next = nullptr;
+
+            // Pass down the light if necessary, otherwise just pass nullptr
+            if(i < renderable->light_count) {
+                next = lights[i];
+            } else {
+                next = nullptr;
             }
 
-            last_group = current_group;
+            if(pass_iteration_type == ITERATION_TYPE_ONCE_PER_LIGHT) {
+                visitor->apply_lights(&next, 1);
+            } else if(pass_iteration_type == ITERATION_TYPE_N || pass_iteration_type == ITERATION_TYPE_ONCE) {
+                visitor->apply_lights(&lights[0], (uint8_t) renderable->light_count);
+            }
+            visitor->visit(renderable, material_pass, i);
         }
+
+        last_group = current_group;
+        last_key = entry.key;
     }
 
     visitor->end_traversal(*this, stage_);
 }
 
+std::size_t RenderQueue::queue_count() const {
+    thread::Lock<thread::Mutex> lock(queue_lock_);
+
+    std::set<uint32_t> priorities;
+    for(auto& entry: entries_) {
+        priorities.insert(key_priority(entry.key));
+    }
+
+    return priorities.size();
+}
+
 std::size_t RenderQueue::group_count(Pass pass_number) const {
-    uint32_t i = 0;
-    auto& queue = priority_queues_.at(pass_number);
-    for(auto it = queue.begin(); it != queue.end(); it = queue.upper_bound(it->first)) {
-        ++i;
+    thread::Lock<thread::Mutex> lock(queue_lock_);
+
+    std::set<uint64_t> groups;
+    for(auto& entry: entries_) {
+        if(groups_[entry.group].sort_key.pass == pass_number) {
+            groups.insert(entry.key);
+        }
     }
 
-    return i;
+    return groups.size();
 }
 
 }
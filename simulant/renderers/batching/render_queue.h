@@ -20,8 +20,7 @@
 
 #include <list>
 #include <set>
-
-#include "../../generic/containers/contiguous_map.h"
+#include <vector>
 
 #include "../../types.h"
 #include "../../threads/shared_mutex.h"
@@ -33,16 +32,31 @@ class MaterialPass;
 class Renderer;
 struct Renderable;
 class Light;
+class StageNode;
 
 namespace batcher {
 
 struct RenderGroupKey {
-    uint8_t pass; // 1 byte
-    bool is_blended; // 1 byte
-    float distance_to_camera; // 4 bytes
-    uint16_t padding; // 2-bytes to get 8-byte alignment
+    uint8_t pass = 0; // 1 byte
+    bool is_blended = false; // 1 byte
+    int16_t priority = RENDER_PRIORITY_MAIN; // 2 bytes
+    float distance_to_camera = 0.0f; // 4 bytes
+    uint32_t material_id = 0; // 4 bytes
 };
 
+/*
+ * Packs a RenderGroupKey into a single integer which sorts in render order.
+ * From the most significant bit:
+ *
+ * - 9 bits: priority (offset so that RENDER_PRIORITY_MIN is zero)
+ * - 3 bits: material pass
+ * - 1 bit:  is_blended
+ *
+ * The remaining 51 bits depend on blending. Opaque groups are sorted by material
+ * (to minimize state changes) and then front-to-back, blended groups must be
+ * drawn back-to-front so the (inverted) depth comes first.
+ */
+uint64_t pack_render_group_key(const RenderGroupKey& key);
 
 struct RenderGroup {
     /* A sort key, generated from priority and material properties, this
@@ -50,37 +64,11 @@ struct RenderGroup {
     RenderGroupKey sort_key;
 
     bool operator<(const RenderGroup& rhs) const {
-        if(sort_key.pass < rhs.sort_key.pass) {
-            return true;
-        }
-
-        if(sort_key.is_blended < rhs.sort_key.is_blended) {
-            return true;
-        }
-
-        if(!sort_key.is_blended) {
-            if(sort_key.distance_to_camera < rhs.sort_key.distance_to_camera) {
-                // If the object is opaque, we want to render
-                // front-to-back, so less distance is less
-                return true;
-            }
-        } else {
-            if(rhs.sort_key.distance_to_camera < sort_key.distance_to_camera) {
-                // If the object is translucent, we want to render
-                // back-to-front
-                return true;
-            }
-        }
-
-        return false;
+        return pack_render_group_key(sort_key) < pack_render_group_key(rhs.sort_key);
     }
 
     bool operator==(const RenderGroup& rhs) const  {
-        return (
-            sort_key.pass == rhs.sort_key.pass &&
-            sort_key.is_blended == rhs.sort_key.is_blended &&
-            sort_key.distance_to_camera == rhs.sort_key.distance_to_camera
-        );
+        return pack_render_group_key(sort_key) == pack_render_group_key(rhs.sort_key);
     }
 
     bool operator!=(const RenderGroup& rhs) const {
@@ -88,12 +76,32 @@ struct RenderGroup {
     }
 };
 
-RenderGroupKey generate_render_group_key(const uint8_t pass, const bool is_blended, const float distance_to_camera);
+RenderGroupKey generate_render_group_key(
+    const uint8_t pass,
+    const bool is_blended,
+    const float distance_to_camera,
+    const RenderPriority priority=RENDER_PRIORITY_MAIN,
+    const uint32_t material_id=0
+);
+
+/* Which of the RenderableMatrices a renderer reads */
+enum RenderableMatrixFlags {
+    RENDERABLE_MATRIX_MODELVIEW = 1 << 0,
+    RENDERABLE_MATRIX_MODELVIEW_PROJECTION = 1 << 1,
+    RENDERABLE_MATRIX_INVERSE_TRANSPOSE_MODELVIEW = 1 << 2,
+    RENDERABLE_MATRIX_ALL = 0x7
+};
 
 class RenderGroupFactory {
 public:
     virtual ~RenderGroupFactory() {}
 
+    /* The RenderableMatrixFlags of the matrices that the queue should
+     * calculate up-front, the others are left uninitialized */
+    virtual uint8_t renderable_matrices_used() const {
+        return RENDERABLE_MATRIX_ALL;
+    }
+
     /* Initialize a render group based on the provided arguments
      * Returns the group's sort_key */
     virtual RenderGroupKey prepare_render_group(
@@ -109,6 +117,26 @@ public:
 typedef uint32_t Pass;
 typedef uint32_t Iteration;
 
+/* Matrices derived from a renderable's transformation and the camera. These
+ * are calculated for everything in the queue before traversal so that
+ * multi-pass and per-light materials don't recalculate them per draw */
+struct RenderableMatrices {
+    Mat4 modelview;
+    Mat4 modelview_projection;
+    Mat3 inverse_transpose_modelview;
+};
+
+/* Calculates the RenderableMatrices selected by flags for count
+ * contiguous renderables */
+void calculate_renderable_matrices(
+    const Mat4& view,
+    const Mat4& projection,
+    const Renderable* renderables,
+    std::size_t count,
+    RenderableMatrices* out,
+    uint8_t flags=RENDERABLE_MATRIX_ALL
+);
+
 class RenderQueue;
 
 class RenderQueueVisitor {
@@ -164,30 +192,115 @@ public:
     void insert_renderable(Renderable&& renderable); // IMPORTANT, must update RenderGroups if they exist already
     void clear();
 
-    void traverse(RenderQueueVisitor* callback, uint64_t frame_id) const;
+    /*
+     * The queue keeps the renderables of nodes with static renderables between
+     * frames. If the node's renderables are cached, and the version hasn't
+     * changed, this reinserts them and returns true. Otherwise the node
+     * should generate its renderables between begin_caching() and
+     * end_caching() so they can be reused next frame.
+     */
+    bool insert_cached_renderables(const StageNode* node, uint64_t version);
+    void begin_caching(const StageNode* node, uint64_t version);
+    void end_caching();
+
+    /* The number of renderables reinserted from the cache since the last clear() */
+    std::size_t cached_renderable_count() const { return cached_renderable_count_; }
+
+    /* Sorts the queued render groups into render order. This is called
+     * by traverse() if necessary, but it can be called up-front (e.g. from
+     * a worker thread) to take it off the render thread */
+    void sort();
+
+    /* Calculates the derived matrices of the queued renderables. Like sort()
+     * this is called by traverse() if necessary. Transformations changed
+     * through renderable() after this has been called aren't picked up */
+    void calculate_matrices();
 
-    std::size_t queue_count() const { return priority_queues_.size(); }
+    /* Returns the derived matrices for a renderable in this queue. Returns
+     * nullptr if the renderable isn't one of ours (e.g. it's a copy) or the
+     * matrices haven't been calculated */
+    const RenderableMatrices* matrices(const Renderable* renderable) const;
+
+    void traverse(RenderQueueVisitor* callback, uint64_t frame_id);
+
+    /* The number of distinct priorities with something queued */
+    std::size_t queue_count() const;
     std::size_t group_count(Pass pass_number) const;
 
     std::size_t renderable_count() const { return renderables_.size(); }
     Renderable* renderable(const std::size_t i) {
         return &renderables_[i];
     }
+
+    /* Time taken by the last call to sort(), and the number of entries it sorted */
+    uint64_t last_sort_time_us() const { return last_sort_time_us_; }
+    std::size_t last_sort_count() const { return last_sort_count_; }
+
 private:
-    // std::map is ordered, so by using the RenderGroup as the key we
-    // minimize GL state changes (e.g. if a RenderGroupImpl orders by TextureID, then ShaderID
-    // then we'll see  (TexID(1), ShaderID(1)), (TexID(1), ShaderID(2)) for example meaning the
-    // texture doesn't change even if the shader does
-    typedef ContiguousMultiMap<RenderGroup, std::size_t> SortedRenderables;
+    /* Each material pass of each renderable adds an entry to the queue. Entries
+     * are appended unsorted and then radix sorted on their packed key
+     * once all renderables have been inserted. */
+    struct SortEntry {
+        uint64_t key;
+        uint32_t group;
+        uint32_t renderable;
+    };
 
     Stage* stage_ = nullptr;
     RenderGroupFactory* render_group_factory_ = nullptr;
     CameraPtr camera_;
 
     std::vector<Renderable> renderables_;
-    std::array<SortedRenderables, RENDER_PRIORITY_MAX - RENDER_PRIORITY_MIN> priority_queues_;
-
-    void clean_empty_batches();
+    std::vector<RenderGroup> groups_;
+    std::vector<SortEntry> entries_;
+
+    /* Scratch space for the radix sort, kept around to avoid
+     * reallocating each frame */
+    std::vector<SortEntry> sort_buffer_;
+
+    bool sorted_ = true;
+    uint64_t last_sort_time_us_ = 0;
+    std::size_t last_sort_count_ = 0;
+
+    /* Derived matrices, one per renderable */
+    std::vector<RenderableMatrices> matrices_;
+    bool matrices_calculated_ = false;
+
+    void radix_sort(std::vector<SortEntry>& entries);
+    bool insertion_sort(std::vector<SortEntry>& entries, std::size_t max_moves);
+    void sort_with_hints();
+
+    struct CachedRenderables {
+        uint64_t version = 0;
+        uint64_t last_used_frame = 0;
+        std::vector<Renderable> renderables;
+
+        /* Where each of the renderables' entries ended up in the last
+         * sort. As most things don't move much between frames, this
+         * gives an almost sorted starting point for the next sort */
+        std::vector<uint32_t> ranks;
+    };
+
+    std::unordered_map<const StageNode*, CachedRenderables> cache_;
+    uint64_t frame_count_ = 0;
+    std::size_t cached_renderable_count_ = 0;
+
+    CachedRenderables* caching_ = nullptr;
+    std::size_t caching_first_renderable_ = 0;
+    std::size_t caching_first_entry_ = 0;
+
+    void track_cached_entries(CachedRenderables* cached, std::size_t first_entry);
+
+    /* Per entry (in insertion order) the rank it had last frame, and
+     * where to store its rank once sorted. Only set for cached entries */
+    std::vector<uint32_t> hints_;
+    std::vector<uint32_t*> ranks_;
+    std::size_t hinted_count_ = 0;
+
+    /* Entries which were in the previous sort last time, and those which weren't */
+    std::vector<SortEntry> hinted_entries_;
+    std::vector<SortEntry> new_entries_;
+    std::size_t previous_sort_count_ = 0;
 
     mutable thread::Mutex queue_lock_;
 };
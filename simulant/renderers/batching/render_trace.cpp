@@ -0,0 +1,251 @@
+//
+//   Copyright (c) 2011-2017 Luke Benstead https://simulant-engine.appspot.com
+//
+//     This file is part of Simulant.
+//
+//     Simulant is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU Lesser General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Simulant is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU Lesser General Public License for more details.
+//
+//     You should have received a copy of the GNU Lesser General Public License
+//     along with Simulant.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "render_trace.h"
+#include "../../stage.h"
+#include "../../stage_manager.h"
+#include "../../nodes/light.h"
+#include "../../assets/material.h"
+#include "../../application.h"
+
+namespace smlt {
+namespace batcher {
+
+/* Zero is never a valid ID, so stands in for null */
+template<typename T>
+static uint32_t id_of(const T* obj) {
+    return (obj) ? obj->id().value() : 0;
+}
+
+static uint8_t pass_index(const MaterialPass* pass) {
+    auto material = pass->material();
+    for(uint8_t i = 0; i < material->pass_count(); ++i) {
+        if(material->pass(i) == pass) {
+            return i;
+        }
+    }
+
+    assert(0 && "Pass doesn't belong to its material");
+    return 0;
+}
+
+void RenderTrace::clear() {
+    stream_.clear();
+    renderables_.clear();
+    last_renderable_ = nullptr;
+
+    traversal_count_ = 0;
+    render_group_changes_ = 0;
+    material_pass_changes_ = 0;
+    light_changes_ = 0;
+    visit_count_ = 0;
+}
+
+std::size_t RenderTrace::size_in_bytes() const {
+    return stream_.size() + (renderables_.size() * sizeof(Renderable));
+}
+
+void RenderTrace::write_pass(const MaterialPass* pass) {
+    write(id_of(pass->material()));
+    write(pass_index(pass));
+}
+
+const MaterialPass* RenderTrace::read_pass(std::size_t& offset, Stage* stage) const {
+    auto material_id = MaterialID(read<uint32_t>(offset));
+    auto index = read<uint8_t>(offset);
+
+    /* Stage assets fall back to the shared assets */
+    auto material = (stage) ?
+        stage->assets->material(material_id) :
+        get_app()->shared_assets->material(material_id);
+
+    return (material && index < material->pass_count()) ? material->pass(index) : nullptr;
+}
+
+void RenderTrace::record_start_traversal(uint64_t frame_id, Stage* stage) {
+    /* Renderables from a previous traversal have been cleared by now */
+    last_renderable_ = nullptr;
+    ++traversal_count_;
+
+    write(OPCODE_START_TRAVERSAL);
+    write(frame_id);
+    write(id_of(stage));
+}
+
+void RenderTrace::record_change_render_group(const RenderGroup* prev, const RenderGroup* next) {
+    ++render_group_changes_;
+
+    write(OPCODE_CHANGE_RENDER_GROUP);
+    write(uint8_t(prev != nullptr));
+    if(prev) {
+        write(prev->sort_key);
+    }
+    write(next->sort_key);
+}
+
+void RenderTrace::record_change_material_pass(const MaterialPass* prev, const MaterialPass* next) {
+    ++material_pass_changes_;
+
+    write(OPCODE_CHANGE_MATERIAL_PASS);
+    write(uint8_t(prev != nullptr));
+    if(prev) {
+        write_pass(prev);
+    }
+    write_pass(next);
+}
+
+void RenderTrace::record_apply_lights(const LightPtr* lights, const uint8_t count) {
+    ++light_changes_;
+
+    write(OPCODE_APPLY_LIGHTS);
+    write(count);
+    for(uint8_t i = 0; i < count; ++i) {
+        write(id_of((Light*) lights[i]));
+    }
+}
+
+void RenderTrace::record_visit(const Renderable* renderable, const MaterialPass* pass, Iteration iteration) {
+    ++visit_count_;
+
+    if(renderable != last_renderable_) {
+        renderables_.push_back(*renderable);
+        last_renderable_ = renderable;
+    }
+
+    /* The pass always belongs to the renderable's material */
+    write(OPCODE_VISIT);
+    write(uint32_t(renderables_.size() - 1));
+    write(pass_index(pass));
+    write(iteration);
+}
+
+void RenderTrace::record_end_traversal(Stage* stage) {
+    write(OPCODE_END_TRAVERSAL);
+    write(id_of(stage));
+}
+
+void RenderTrace::replay(RenderQueueVisitor* visitor, StageManager* stages) const {
+    /* The visitors look up precalculated matrices in the queue, an
+     * empty one makes them fall back to calculating their own */
+    RenderQueue queue;
+
+    RenderGroup prev_group, next_group;
+    LightPtr lights[MAX_LIGHTS_PER_RENDERABLE];
+
+    /* The stage of the traversal being replayed */
+    Stage* stage = nullptr;
+    auto find_stage = [stages](uint32_t id) -> Stage* {
+        return (id) ? (Stage*) stages->stage(StageID(id)) : nullptr;
+    };
+
+    std::size_t offset = 0;
+    while(offset < stream_.size()) {
+        auto opcode = read<Opcode>(offset);
+
+        switch(opcode) {
+            case OPCODE_START_TRAVERSAL: {
+                auto frame_id = read<uint64_t>(offset);
+                stage = find_stage(read<uint32_t>(offset));
+                visitor->start_traversal(queue, frame_id, stage);
+            } break;
+            case OPCODE_CHANGE_RENDER_GROUP: {
+                bool has_prev = read<uint8_t>(offset);
+                if(has_prev) {
+                    prev_group.sort_key = read<RenderGroupKey>(offset);
+                }
+                next_group.sort_key = read<RenderGroupKey>(offset);
+                visitor->change_render_group((has_prev) ? &prev_group : nullptr, &next_group);
+            } break;
+            case OPCODE_CHANGE_MATERIAL_PASS: {
+                bool has_prev = read<uint8_t>(offset);
+                auto prev = (has_prev) ? read_pass(offset, stage) : nullptr;
+                auto next = read_pass(offset, stage);
+                visitor->change_material_pass(prev, next);
+            } break;
+            case OPCODE_APPLY_LIGHTS: {
+                auto count = read<uint8_t>(offset);
+                for(uint8_t i = 0; i < count; ++i) {
+                    auto light_id = read<uint32_t>(offset);
+                    lights[i] = (light_id && stage) ? stage->light(LightID(light_id)) : nullptr;
+                }
+                visitor->apply_lights(lights, count);
+            } break;
+            case OPCODE_VISIT: {
+                auto index = read<uint32_t>(offset);
+                auto pass_number = read<uint8_t>(offset);
+                auto iteration = read<Iteration>(offset);
+
+                auto renderable = &renderables_[index];
+                visitor->visit(renderable, renderable->material->pass(pass_number), iteration);
+            } break;
+            case OPCODE_END_TRAVERSAL: {
+                stage = find_stage(read<uint32_t>(offset));
+                visitor->end_traversal(queue, stage);
+            } break;
+        default:
+            assert(0 && "Invalid render trace opcode");
+            return;
+        }
+    }
+}
+
+void RecordingRenderQueueVisitor::start_traversal(const RenderQueue& queue, uint64_t frame_id, Stage* stage) {
+    trace_->record_start_traversal(frame_id, stage);
+    if(next_) {
+        next_->start_traversal(queue, frame_id, stage);
+    }
+}
+
+void RecordingRenderQueueVisitor::change_render_group(const RenderGroup* prev, const RenderGroup* next) {
+    trace_->record_change_render_group(prev, next);
+    if(next_) {
+        next_->change_render_group(prev, next);
+    }
+}
+
+void RecordingRenderQueueVisitor::change_material_pass(const MaterialPass* prev, const MaterialPass* next) {
+    trace_->record_change_material_pass(prev, next);
+    if(next_) {
+        next_->change_material_pass(prev, next);
+    }
+}
+
+void RecordingRenderQueueVisitor::apply_lights(const LightPtr* lights, const uint8_t count) {
+    trace_->record_apply_lights(lights, count);
+    if(next_) {
+        next_->apply_lights(lights, count);
+    }
+}
+
+void RecordingRenderQueueVisitor::visit(const Renderable* renderable, const MaterialPass* pass, Iteration iteration) {
+    trace_->record_visit(renderable, pass, iteration);
+    if(next_) {
+        next_->visit(renderable, pass, iteration);
+    }
+}
+
+void RecordingRenderQueueVisitor::end_traversal(const RenderQueue& queue, Stage* stage) {
+    trace_->record_end_traversal(stage);
+    if(next_) {
+        next_->end_traversal(queue, stage);
+    }
+}
+
+}
+}
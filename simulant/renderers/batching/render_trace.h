@@ -0,0 +1,150 @@
+/* *   Copyright (c) 2011-2017 Luke Benstead https://simulant-engine.appspot.com
+ *
+ *     This file is part of Simulant.
+ *
+ *     Simulant is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Simulant is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Lesser General Public License
+ *     along with Simulant.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "render_queue.h"
+#include "renderable.h"
+
+namespace smlt {
+
+class StageManager;
+
+namespace batcher {
+
+/*
+ * A recording of the calls made to a RenderQueueVisitor, so that what a
+ * frame asked of the renderer can be inspected, diffed or replayed without
+ * rebuilding the render queue.
+ *
+ * Calls are packed into a byte stream (an opcode followed by its arguments).
+ * The stream holds no addresses: stages, lights and material passes are
+ * recorded by ID (a pass by its material's ID and its index), so it can be
+ * saved and compared with the stream from another run.
+ *
+ * Renderables are copied into a separate table as the queue is cleared once
+ * it's been rendered. They still point at the vertex/index data they were
+ * drawn with, so replaying is only possible in the process that recorded the
+ * trace, and only while that data exists. IDs which no longer resolve are
+ * replayed as null.
+ */
+class RenderTrace {
+public:
+    void clear();
+    bool empty() const { return stream_.empty(); }
+
+    /* Calls the recorded methods on visitor, in the order they were made.
+     * Recorded IDs are looked up through stages */
+    void replay(RenderQueueVisitor* visitor, StageManager* stages) const;
+
+    /* The packed calls, without the renderable table */
+    const std::vector<uint8_t>& stream() const { return stream_; }
+
+    /* The size of the packed stream, plus the renderable table */
+    std::size_t size_in_bytes() const;
+
+    uint32_t traversal_count() const { return traversal_count_; }
+    uint32_t render_group_changes() const { return render_group_changes_; }
+    uint32_t material_pass_changes() const { return material_pass_changes_; }
+    uint32_t light_changes() const { return light_changes_; }
+
+    /* The number of calls to visit(), i.e. the number of draws requested */
+    uint32_t visit_count() const { return visit_count_; }
+    std::size_t renderable_count() const { return renderables_.size(); }
+
+private:
+    friend class RecordingRenderQueueVisitor;
+
+    enum Opcode : uint8_t {
+        OPCODE_START_TRAVERSAL,
+        OPCODE_CHANGE_RENDER_GROUP,
+        OPCODE_CHANGE_MATERIAL_PASS,
+        OPCODE_APPLY_LIGHTS,
+        OPCODE_VISIT,
+        OPCODE_END_TRAVERSAL
+    };
+
+    template<typename T>
+    void write(const T& value) {
+        auto offset = stream_.size();
+        stream_.resize(offset + sizeof(T));
+        std::memcpy(&stream_[offset], &value, sizeof(T));
+    }
+
+    template<typename T>
+    T read(std::size_t& offset) const {
+        T value;
+        std::memcpy(&value, &stream_[offset], sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    void write_pass(const MaterialPass* pass);
+    const MaterialPass* read_pass(std::size_t& offset, Stage* stage) const;
+
+    void record_start_traversal(uint64_t frame_id, Stage* stage);
+    void record_change_render_group(const RenderGroup* prev, const RenderGroup* next);
+    void record_change_material_pass(const MaterialPass* prev, const MaterialPass* next);
+    void record_apply_lights(const LightPtr* lights, const uint8_t count);
+    void record_visit(const Renderable* renderable, const MaterialPass* pass, Iteration iteration);
+    void record_end_traversal(Stage* stage);
+
+    std::vector<uint8_t> stream_;
+    std::vector<Renderable> renderables_;
+
+    /* Multi-pass materials visit the same renderable repeatedly, so
+     * consecutive visits share an entry in the table */
+    const Renderable* last_renderable_ = nullptr;
+
+    uint32_t traversal_count_ = 0;
+    uint32_t render_group_changes_ = 0;
+    uint32_t material_pass_changes_ = 0;
+    uint32_t light_changes_ = 0;
+    uint32_t visit_count_ = 0;
+};
+
+
+/*
+ * Records each call into a RenderTrace, and then passes it on to another
+ * visitor if one was given. Wrapping a renderer's visitor records what it
+ * was asked to render while still rendering it.
+ */
+class RecordingRenderQueueVisitor : public RenderQueueVisitor {
+public:
+    RecordingRenderQueueVisitor(RenderTrace* trace, std::shared_ptr<RenderQueueVisitor> next=nullptr):
+        trace_(trace),
+        next_(next) {}
+
+    void start_traversal(const RenderQueue& queue, uint64_t frame_id, Stage* stage) override;
+    void change_render_group(const RenderGroup* prev, const RenderGroup* next) override;
+    void change_material_pass(const MaterialPass* prev, const MaterialPass* next) override;
+    void apply_lights(const LightPtr* lights, const uint8_t count) override;
+    void visit(const Renderable* renderable, const MaterialPass* pass, Iteration iteration) override;
+    void end_traversal(const RenderQueue& queue, Stage* stage) override;
+
+private:
+    RenderTrace* trace_;
+    std::shared_ptr<RenderQueueVisitor> next_;
+};
+
+}
+}
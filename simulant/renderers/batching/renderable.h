@@ -34,6 +34,13 @@ struct VertexRange;
 
 typedef sig::signal<void (RenderPriority, RenderPriority)> RenderPriorityChangedSignal;
 
+/* Returns a new version number each time it's called. Anything which affects
+ * the renderables a node generates takes a new version when it changes, so
+ * the render queue can tell when cached renderables are stale. As the numbers
+ * are never reused, the largest version of several sources changes if any of
+ * them change. */
+uint64_t next_renderables_version();
+
 
 class HasMutableRenderPriority {
     DEFINE_SIGNAL(RenderPriorityChangedSignal, signal_render_priority_changed);
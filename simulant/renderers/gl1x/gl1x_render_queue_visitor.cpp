@@ -29,9 +29,10 @@ GL1RenderQueueVisitor::GL1RenderQueueVisitor(GL1XRenderer* renderer, CameraPtr c
 }
 
 void GL1RenderQueueVisitor::start_traversal(const batcher::RenderQueue& queue, uint64_t frame_id, Stage* stage) {
-    _S_UNUSED(queue);
     _S_UNUSED(frame_id);
 
+    queue_ = &queue;
+
     /* Set up default client state before the run. This is necessary
      * so that the boolean flags get correctly set */
     enable_vertex_arrays(true);
@@ -45,6 +46,9 @@ void GL1RenderQueueVisitor::start_traversal(const batcher::RenderQueue& queue, u
 
     global_ambient_ = stage->ambient_light();
     GLCheck(glLightModelfv, GL_LIGHT_MODEL_AMBIENT, &global_ambient_.r);
+
+    /* The viewport clear (among other things) has happened since the last traversal */
+    renderer_->state_cache()->invalidate();
 }
 
 void GL1RenderQueueVisitor::visit(const Renderable* renderable, const MaterialPass* pass, batcher::Iteration iteration) {
@@ -54,6 +58,12 @@ void GL1RenderQueueVisitor::visit(const Renderable* renderable, const MaterialPa
 void GL1RenderQueueVisitor::end_traversal(const batcher::RenderQueue &queue, Stage* stage) {
     _S_UNUSED(queue);
     _S_UNUSED(stage);
+
+    auto state = renderer_->state_cache();
+    get_app()->stats->increment_render_state_changes(
+        state->state_changes(), state->state_changes_avoided()
+    );
+    state->reset_counters();
 }
 
 void GL1RenderQueueVisitor::change_render_group(const batcher::RenderGroup *prev, const batcher::RenderGroup *next) {
@@ -61,22 +71,23 @@ void GL1RenderQueueVisitor::change_render_group(const batcher::RenderGroup *prev
     _S_UNUSED(next);
 }
 
-_S_FORCE_INLINE bool bind_texture(const GLubyte which, const TexturePtr& tex, const Mat4& mat) {
+_S_FORCE_INLINE bool bind_texture(GL1XRenderer* renderer, const GLubyte which, const TexturePtr& tex, const Mat4& mat) {
     if(!tex) {
         return false;
     }
 
-    auto id = tex->_renderer_specific_id();
-
     if(which >= _S_GL_MAX_TEXTURE_UNITS) {
         return false;
     }
 
-#if _S_GL_SUPPORTS_MULTITEXTURE
-    GLCheck(glActiveTexture, GL_TEXTURE0 + which);
-#endif
+    renderer->make_texture_resident(tex.get());
 
-    GLCheck(glBindTexture, GL_TEXTURE_2D, id);
+    auto state = renderer->state_cache();
+    state->bind_texture(which, tex->_renderer_specific_id());
+
+    /* The binding may have been skipped, but the texture matrix
+     * is per-unit so the unit must still be made active */
+    state->set_active_texture(which);
 
     GLCheck(glMatrixMode, GL_TEXTURE);
     GLCheck(glLoadMatrixf, mat.data());
@@ -111,137 +122,48 @@ void GL1RenderQueueVisitor::change_material_pass(const MaterialPass* prev, const
         GLCheck(glMaterialf, GL_FRONT_AND_BACK, GL_SHININESS, next->shininess());
     }
 
-    if(!prev || prev->is_depth_test_enabled() != next->is_depth_test_enabled()) {
-        if(next->is_depth_test_enabled()) {
-            GLCheck(glEnable, GL_DEPTH_TEST);
-        } else {
-            GLCheck(glDisable, GL_DEPTH_TEST);
-        }
-    }
+    /* Only the state which differs from what's bound reaches GL */
+    auto state = renderer_->state_cache();
 
-    if(!prev || prev->is_depth_write_enabled() != next->is_depth_write_enabled()) {
-        if(next->is_depth_write_enabled()) {
-            GLCheck(glDepthMask, GL_TRUE);
-        } else {
-            GLCheck(glDepthMask, GL_FALSE);
-        }
-    }
+    state->set_depth_test_enabled(next->is_depth_test_enabled());
+    state->set_depth_write_enabled(next->is_depth_write_enabled());
 
     /* Enable lighting on the pass appropriately */
-    if(!prev || prev->is_lighting_enabled() != next->is_lighting_enabled()) {
-        if(next->is_lighting_enabled()) {
-            GLCheck(glEnable, GL_LIGHTING);
-        } else {
-            GLCheck(glDisable, GL_LIGHTING);
-        }
-    }
+    state->set_lighting_enabled(next->is_lighting_enabled());
 
     auto enabled = next->textures_enabled();
 
     for(uint32_t i = 0; i < _S_GL_MAX_TEXTURE_UNITS; ++i) {
-#if _S_GL_SUPPORTS_MULTITEXTURE
-        GLCheck(glActiveTexture, GL_TEXTURE0 + i);
-#endif
         if(enabled & (1 << i)) {
-            GLCheck(glEnable, GL_TEXTURE_2D);
+            state->set_texture_enabled(i, true);
         } else {
-            GLCheck(glDisable, GL_TEXTURE_2D);
+            state->set_texture_enabled(i, false);
             continue;
         }
 
         switch(i) {
             case 0:
-                bind_texture(0, next->diffuse_map(), next->diffuse_map_matrix());
+                bind_texture(renderer_, 0, next->diffuse_map(), next->diffuse_map_matrix());
             break;
             case 1:
-                bind_texture(1, next->light_map(), next->light_map_matrix());
+                bind_texture(renderer_, 1, next->light_map(), next->light_map_matrix());
             break;
             case 2:
-                bind_texture(2, next->normal_map(), next->normal_map_matrix());
+                bind_texture(renderer_, 2, next->normal_map(), next->normal_map_matrix());
             break;
             case 3:
-                bind_texture(3, next->specular_map(), next->specular_map_matrix());
+                bind_texture(renderer_, 3, next->specular_map(), next->specular_map_matrix());
             break;
             default:
                 break;
         }
     }
 
-
-#if !defined(__DREAMCAST__) && !defined(__PSP__)
-    if(!prev || prev->point_size() != next->point_size()) {
-        glPointSize(next->point_size());
-    }
-
-    if(!prev || prev->polygon_mode() != next->polygon_mode()) {
-        switch((PolygonMode) next->polygon_mode()) {
-            case POLYGON_MODE_POINT:
-                glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
-            break;
-            case POLYGON_MODE_LINE:
-                glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            break;
-            default:
-                glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        }
-    }
-#endif
-
-    if(!prev || prev->cull_mode() != next->cull_mode()) {
-        if(next->cull_mode() != CULL_MODE_NONE) {
-            glEnable(GL_CULL_FACE);
-        }
-
-        switch(next->cull_mode()) {
-            case CULL_MODE_NONE:
-                glDisable(GL_CULL_FACE);
-            break;
-            case CULL_MODE_FRONT_FACE:
-                glCullFace(GL_FRONT);
-            break;
-            case CULL_MODE_BACK_FACE:
-                glCullFace(GL_BACK);
-            break;
-            case CULL_MODE_FRONT_AND_BACK_FACE:
-                glCullFace(GL_FRONT_AND_BACK);
-            break;
-        }
-    }
-
-    auto set_blending_mode = [](BlendType type) {
-        if(type == BLEND_NONE) {
-            GLCheck(glDisable, GL_BLEND);
-            return;
-        }
-
-        GLCheck(glEnable, GL_BLEND);
-        switch(type) {
-            case BLEND_ADD: GLCheck(glBlendFunc, GL_ONE, GL_ONE);
-            break;
-            case BLEND_ALPHA: GLCheck(glBlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            break;
-            case BLEND_COLOUR: GLCheck(glBlendFunc, GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
-            break;
-            case BLEND_MODULATE: GLCheck(glBlendFunc, GL_DST_COLOR, GL_ZERO);
-            break;
-            case BLEND_ONE_ONE_MINUS_ALPHA: GLCheck(glBlendFunc, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-            break;
-        default:
-            throw std::logic_error("Invalid blend type specified");
-        }
-    };
-
-    if(!prev || prev->blend_func() != next->blend_func()) {
-        set_blending_mode(next->blend_func());
-    }
-
-    if(!prev || prev->shade_model() != next->shade_model()) {
-        if(next->shade_model() == SHADE_MODEL_SMOOTH) {
-            GLCheck(glShadeModel, GL_SMOOTH);
-        } else {
-            GLCheck(glShadeModel, GL_FLAT);
-        }
-    }
+    state->set_point_size(next->point_size());
+    state->set_polygon_mode(next->polygon_mode());
+    state->set_cull_mode(next->cull_mode());
+    state->set_blend_type(next->blend_func());
+    state->set_shade_model(next->shade_model());
 
 #if _S_GL_SUPPORTS_COLOR_MATERIAL
     if(!prev || prev->colour_material() != next->colour_material()) {
@@ -455,11 +377,13 @@ void GL1RenderQueueVisitor::do_visit(const Renderable* renderable, const Materia
         return;
     }
 
-    const Mat4& model = renderable->final_transformation;
-    const Mat4& view = camera_->view_matrix();
     const Mat4& projection = camera_->projection_matrix();
 
-    Mat4 modelview = view * model;
+    /* The queue calculates the modelview up-front, so multi-pass
+     * materials don't recalculate it for each pass */
+    auto matrices = queue_->matrices(renderable);
+    const Mat4 modelview = (matrices) ?
+        matrices->modelview : camera_->view_matrix() * renderable->final_transformation;
 
     GLCheck(glMatrixMode, GL_MODELVIEW);
     GLCheck(glLoadMatrixf, modelview.data());
@@ -569,6 +493,7 @@ void GL1RenderQueueVisitor::do_visit(const Renderable* renderable, const Materia
         );
 
         get_app()->stats->increment_polygons_rendered(renderable->arrangement, element_count);
+        get_app()->stats->increment_draw_calls();
     } else {
         /* Range-based renderable */
         assert(renderable->vertex_ranges);
@@ -583,6 +508,7 @@ void GL1RenderQueueVisitor::do_visit(const Renderable* renderable, const Materia
             );
 
             total += range->count;
+            get_app()->stats->increment_draw_calls();
         }
 
         get_app()->stats->increment_polygons_rendered(renderable->arrangement, total);
@@ -33,6 +33,7 @@ public:
 private:
     GL1XRenderer* renderer_;
     CameraPtr camera_;
+    const batcher::RenderQueue* queue_ = nullptr;
     Colour global_ambient_;
 
     const MaterialPass* pass_ = nullptr;
@@ -43,14 +43,17 @@ batcher::RenderGroupKey GL1XRenderer::prepare_render_group(
     const bool is_blended,
     const float distance_to_camera) {
 
-    _S_UNUSED(renderable);
     _S_UNUSED(material_pass);
     _S_UNUSED(group);
 
+    /* Grouping by material keeps renderables which share textures and
+     * programs together */
     return batcher::generate_render_group_key(
         pass_number,
         is_blended,
-        distance_to_camera
+        distance_to_camera,
+        renderable->render_priority,
+        renderable->material->id().value()
     );
 }
 
@@ -20,6 +20,7 @@
 
 #include "../renderer.h"
 #include "../gl_renderer.h"
+#include "../gl_state_cache.h"
 
 namespace smlt {
 
@@ -51,6 +52,19 @@ public:
     void prepare_to_render(const Renderable *renderable) override {
         _S_UNUSED(renderable);
     }
+
+    /* Fixed function, so the projection is set once and the
+     * normals are transformed by GL */
+    uint8_t renderable_matrices_used() const override {
+        return batcher::RENDERABLE_MATRIX_MODELVIEW;
+    }
+
+    GLStateCache* state_cache() {
+        return &state_cache_;
+    }
+
+private:
+    GLStateCache state_cache_;
 };
 
 }
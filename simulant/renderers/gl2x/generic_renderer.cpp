@@ -17,6 +17,11 @@
 //     along with Simulant.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
 #include "generic_renderer.h"
 
 #include "../../nodes/actor.h"
@@ -33,6 +38,8 @@
 #include "../../window.h"
 #include "../../coroutines/coroutine.h"
 #include "../../application.h"
+#include "../../utils/kfs.h"
+#include "../../utils/hash/md5.h"
 
 namespace smlt {
 
@@ -41,8 +48,14 @@ namespace smlt {
 
 const std::string default_vertex_shader = R"(
 #version 120
+
+attribute vec3 s_position;
+attribute mat4 s_instance_transformation;
+
+uniform mat4 s_modelview_projection;
+
 void main(void) {
-    gl_Position = ftransform();
+    gl_Position = s_modelview_projection * s_instance_transformation * vec4(s_position, 1.0);
 }
 )";
 
@@ -80,95 +93,67 @@ batcher::RenderGroupKey GenericRenderer::prepare_render_group(
     const float distance_to_camera) {
 
     _S_UNUSED(group);
-    _S_UNUSED(renderable);
     _S_UNUSED(material_pass);
-    _S_UNUSED(pass_number);
-    _S_UNUSED(is_blended);
-    _S_UNUSED(distance_to_camera);
 
+    /* Grouping by material keeps renderables which share textures and
+     * programs together */
     return batcher::generate_render_group_key(
         pass_number,
         is_blended,
-        distance_to_camera
+        distance_to_camera,
+        renderable->render_priority,
+        renderable->material->id().value()
     );
 }
 
 void GenericRenderer::set_light_uniforms(const MaterialPass* pass, GPUProgram* program, const LightPtr light) {
     _S_UNUSED(pass);
 
-    auto pos_loc = program->locate_uniform(LIGHT_POSITION_PROPERTY, true);
-    if(pos_loc > -1) {
+    if(program->has_auto_uniform(SP_AUTO_LIGHT_POSITION)) {
         auto pos = (light) ? light->absolute_position() : Vec3();
         auto vec = (light) ? Vec4(pos, (light->type() == LIGHT_TYPE_DIRECTIONAL) ? 0.0 : 1.0) : Vec4();
-        program->set_uniform_vec4(pos_loc, vec);
+        program->set_auto_uniform_vec4(SP_AUTO_LIGHT_POSITION, vec);
     }
 
-    auto amb_loc = program->locate_uniform(LIGHT_AMBIENT_PROPERTY, true);
-    if(amb_loc > -1) {
-        program->set_uniform_colour(
-            amb_loc,
-            (light) ? light->ambient() : Colour::NONE
-        );
-    }
+    program->set_auto_uniform_colour(
+        SP_AUTO_LIGHT_AMBIENT,
+        (light) ? light->ambient() : Colour::NONE
+    );
 
-    auto diff_loc = program->locate_uniform(LIGHT_DIFFUSE_PROPERTY, true);
-    if(diff_loc > -1) {
-        auto diffuse = (light) ? light->diffuse() : smlt::Colour::NONE;
-        program->set_uniform_colour(diff_loc, diffuse);
-    }
+    program->set_auto_uniform_colour(
+        SP_AUTO_LIGHT_DIFFUSE,
+        (light) ? light->diffuse() : Colour::NONE
+    );
 
-    auto spec_loc = program->locate_uniform(LIGHT_SPECULAR_PROPERTY, true);
-    if(spec_loc > -1) {
-        auto specular = (light) ? light->specular() : smlt::Colour::NONE;
-        program->set_uniform_colour(spec_loc, specular);
-    }
+    program->set_auto_uniform_colour(
+        SP_AUTO_LIGHT_SPECULAR,
+        (light) ? light->specular() : Colour::NONE
+    );
 
-    auto ca_loc = program->locate_uniform(LIGHT_CONSTANT_ATTENUATION_PROPERTY, true);
-    if(ca_loc > -1) {
-        auto att = (light) ? light->constant_attenuation() : 0;
-        program->set_uniform_float(ca_loc, att);
-    }
+    program->set_auto_uniform_float(
+        SP_AUTO_LIGHT_CONSTANT_ATTENUATION,
+        (light) ? light->constant_attenuation() : 0
+    );
 
-    auto la_loc = program->locate_uniform(LIGHT_LINEAR_ATTENUATION_PROPERTY, true);
-    if(la_loc > -1) {
-        auto att = (light) ? light->linear_attenuation() : 0;
-        program->set_uniform_float(la_loc, att);
-    }
+    program->set_auto_uniform_float(
+        SP_AUTO_LIGHT_LINEAR_ATTENUATION,
+        (light) ? light->linear_attenuation() : 0
+    );
 
-    auto qa_loc = program->locate_uniform(LIGHT_QUADRATIC_ATTENUATION_PROPERTY, true);
-    if(qa_loc > -1) {
-        auto att = (light) ? light->quadratic_attenuation() : 0;
-        program->set_uniform_float(qa_loc, att);
-    }
+    program->set_auto_uniform_float(
+        SP_AUTO_LIGHT_QUADRATIC_ATTENUATION,
+        (light) ? light->quadratic_attenuation() : 0
+    );
 }
 
 void GenericRenderer::set_material_uniforms(const MaterialPass* pass, GPUProgram* program) {
     auto mat = pass->material();
 
-    auto amb_loc = program->locate_uniform(AMBIENT_PROPERTY_NAME, true);
-    if(amb_loc > -1) {
-        program->set_uniform_colour(AMBIENT_PROPERTY_NAME, pass->ambient());
-    }
-
-    auto diff_loc = program->locate_uniform(DIFFUSE_PROPERTY_NAME, true);
-    if(diff_loc > -1) {
-        program->set_uniform_colour(DIFFUSE_PROPERTY_NAME, pass->diffuse());
-    }
-
-    auto spec_loc = program->locate_uniform(SPECULAR_PROPERTY_NAME, true);
-    if(spec_loc > -1) {
-        program->set_uniform_colour(SPECULAR_PROPERTY_NAME, pass->specular());
-    }
-
-    auto shin_loc = program->locate_uniform(SHININESS_PROPERTY_NAME, true);
-    if(shin_loc > -1) {
-        program->set_uniform_float(SHININESS_PROPERTY_NAME, pass->shininess());
-    }
-
-    auto ps_loc = program->locate_uniform(POINT_SIZE_PROPERTY_NAME, true);
-    if(ps_loc > -1) {
-        program->set_uniform_float(POINT_SIZE_PROPERTY_NAME, pass->point_size());
-    }
+    program->set_auto_uniform_colour(SP_AUTO_MATERIAL_AMBIENT, pass->ambient());
+    program->set_auto_uniform_colour(SP_AUTO_MATERIAL_DIFFUSE, pass->diffuse());
+    program->set_auto_uniform_colour(SP_AUTO_MATERIAL_SPECULAR, pass->specular());
+    program->set_auto_uniform_float(SP_AUTO_MATERIAL_SHININESS, pass->shininess());
+    program->set_auto_uniform_float(SP_AUTO_MATERIAL_POINT_SIZE, pass->point_size());
 
     /* Each texture property has a counterpart matrix, this passes those down if they exist */
     const auto& texture_props = mat->texture_properties();
@@ -199,20 +184,15 @@ void GenericRenderer::set_material_uniforms(const MaterialPass* pass, GPUProgram
 void GenericRenderer::set_stage_uniforms(const MaterialPass *pass, GPUProgram *program, const Colour &global_ambient) {
     _S_UNUSED(pass);
 
-    auto varname = "s_global_ambient";
-    auto loc = program->locate_uniform(varname, true);
-
-    if(loc > -1) {
-        program->set_uniform_colour(loc, global_ambient);
-    }
+    program->set_auto_uniform_colour(SP_AUTO_LIGHT_GLOBAL_AMBIENT, global_ambient);
 }
 
 
 /* Shadows GL state to avoid unnecessary GL calls */
-static uint8_t enabled_vertex_attributes_ = 0;
+static uint32_t enabled_vertex_attributes_ = 0;
 
 void enable_vertex_attribute(uint8_t i) {
-    uint8_t v = 1 << i;
+    uint32_t v = 1u << i;
     if((enabled_vertex_attributes_ & v) == v) {
         return;
     }
@@ -223,7 +203,7 @@ void enable_vertex_attribute(uint8_t i) {
 }
 
 void disable_vertex_attribute(uint8_t i) {
-    uint8_t v = 1 << i;
+    uint32_t v = 1u << i;
 
     if((enabled_vertex_attributes_ & v) != v) {
         return;
@@ -319,49 +299,64 @@ void GenericRenderer::set_auto_attributes_on_shader(GPUProgram* program, const R
     send_attribute(program->locate_attribute("s_normal", true),
                    VERTEX_ATTRIBUTE_TYPE_NORMAL, vertex_spec,
                    &VertexSpecification::has_normals, &VertexSpecification::normal_offset, offset);
-}
 
-void GenericRenderer::set_blending_mode(BlendType type) {
-    if(type == BLEND_NONE) {
-        GLCheck(glDisable, GL_BLEND);
-        return;
+    /* Unless it's drawn instanced (which enables the attribute array) the
+     * model matrix is part of the matrix uniforms, so the instance
+     * transformation is the identity */
+    auto instance_loc = program->locate_attribute(INSTANCE_TRANSFORMATION_ATTRIBUTE, true);
+    if(instance_loc > -1) {
+        for(uint8_t i = 0; i < 4; ++i) {
+            GLCheck(
+                glVertexAttrib4f, instance_loc + i,
+                (i == 0) ? 1.0f : 0.0f, (i == 1) ? 1.0f : 0.0f,
+                (i == 2) ? 1.0f : 0.0f, (i == 3) ? 1.0f : 0.0f
+            );
+        }
     }
+}
 
-    GLCheck(glEnable, GL_BLEND);
-    switch(type) {
-        case BLEND_ADD: GLCheck(glBlendFunc, GL_ONE, GL_ONE);
-        break;
-        case BLEND_ALPHA: GLCheck(glBlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        break;
-        case BLEND_COLOUR: GLCheck(glBlendFunc, GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
-        break;
-        case BLEND_MODULATE: GLCheck(glBlendFunc, GL_DST_COLOR, GL_ZERO);
-        break;
-        case BLEND_ONE_ONE_MINUS_ALPHA: GLCheck(glBlendFunc, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-        break;
-    default:
-        throw std::logic_error("Invalid blend type specified");
+int32_t GenericRenderer::instance_transformation_location(GPUProgram* program) const {
+    if(!supports_instancing()) {
+        return -1;
     }
-}
 
+    return program->locate_attribute(INSTANCE_TRANSFORMATION_ATTRIBUTE, true);
+}
 
 std::shared_ptr<batcher::RenderQueueVisitor> GenericRenderer::get_render_queue_visitor(CameraPtr camera) {
     return std::make_shared<GL2RenderQueueVisitor>(this, camera);
 }
 
 smlt::GPUProgramID smlt::GenericRenderer::new_or_existing_gpu_program(const std::string &vertex_shader_source, const std::string &fragment_shader_source) {
-    /* FIXME: This doesn't do what the function implies... it should either be called new_gpu_program, or it should try to return an existing progra
-     * if the source matches */
+    auto hash = gpu_program_source_hash(vertex_shader_source, fragment_shader_source);
+
+    auto it = programs_by_hash_.find(hash);
+    if(it != programs_by_hash_.end()) {
+        if(program_manager_.contains(it->second)) {
+            return it->second;
+        }
+
+        /* Garbage collected since */
+        programs_by_hash_.erase(it);
+    }
 
     auto program = program_manager_.make(this, vertex_shader_source, fragment_shader_source);
 
     program_manager_.set_garbage_collection_method(program->id(), GARBAGE_COLLECT_PERIODIC);
 
+    /* The render queues only calculate the matrices that some program reads */
+    auto linked = program.get();
+    linked->signal_linked().connect([this, linked]() {
+        renderable_matrices_used_ = renderable_matrices_used_ | matrices_used_by(linked);
+    });
+
     /* Build the GPU program on the main thread */
     cr_run_main([&]() {
-        program->build();
+        build_program(program.get());
     });
 
+    programs_by_hash_.insert(std::make_pair(hash, program->id()));
+
     return program->id();
 }
 
@@ -376,24 +371,140 @@ GL2RenderQueueVisitor::GL2RenderQueueVisitor(GenericRenderer* renderer, CameraPt
 }
 
 void GL2RenderQueueVisitor::visit(const Renderable* renderable, const MaterialPass* material_pass, batcher::Iteration iteration) {
-    do_visit(renderable, material_pass, iteration);
+    if(can_batch(renderable, material_pass, iteration)) {
+        batch_.transformations.push_back(renderable->final_transformation);
+        batch_.matrices.push_back(queue_->matrices(renderable));
+        return;
+    }
+
+    flush_batch();
+
+    batch_.renderable = *renderable;
+    batch_.pass = material_pass;
+    batch_.iteration = iteration;
+    batch_.transformations.push_back(renderable->final_transformation);
+    batch_.matrices.push_back(queue_->matrices(renderable));
+}
+
+bool GL2RenderQueueVisitor::can_batch(const Renderable* renderable, const MaterialPass* pass, batcher::Iteration iteration) const {
+    if(batch_.transformations.empty()) {
+        return false;
+    }
+
+    auto& other = batch_.renderable;
+
+    if(pass != batch_.pass || iteration != batch_.iteration) {
+        return false;
+    }
+
+    if(renderable->vertex_data != other.vertex_data ||
+       renderable->index_data != other.index_data ||
+       renderable->index_element_count != other.index_element_count ||
+       renderable->vertex_ranges != other.vertex_ranges ||
+       renderable->vertex_range_count != other.vertex_range_count ||
+       renderable->arrangement != other.arrangement ||
+       renderable->material != other.material) {
+        return false;
+    }
+
+    if(renderable->light_count != other.light_count) {
+        return false;
+    }
+
+    for(uint8_t i = 0; i < renderable->light_count; ++i) {
+        if(renderable->lights_affecting_this_frame[i] != other.lights_affecting_this_frame[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void GL2RenderQueueVisitor::flush_batch() {
+    auto& transformations = batch_.transformations;
+    if(transformations.empty()) {
+        return;
+    }
+
+    auto renderable = &batch_.renderable;
+
+    if(transformations.size() == 1) {
+        do_visit(renderable, batch_.pass, batch_.iteration, batch_.matrices[0]);
+        transformations.clear();
+        batch_.matrices.clear();
+        return;
+    }
+
+    auto instance_loc = renderer_->instance_transformation_location(program_);
+
+    if(instance_loc > -1) {
+        /* The model matrices are passed as an attribute, so the uniforms
+         * are calculated without one */
+        renderable->final_transformation = Mat4();
+
+        renderer_->set_renderable_uniforms(batch_.pass, program_, renderable, camera_);
+        renderer_->prepare_to_render(renderable);
+        renderer_->set_auto_attributes_on_shader(program_, renderable, renderer_->buffer_stash_.get());
+        renderer_->send_geometry_instanced(
+            renderable, renderer_->buffer_stash_.get(), program_, instance_loc, transformations
+        );
+    } else {
+        std::size_t i = 0;
+        while(i < transformations.size()) {
+            Renderable batched;
+            GPUBuffer buffers;
+
+            auto count = renderer_->build_cpu_batch(renderable, transformations, i, &batched, &buffers);
+            if(count) {
+                renderer_->set_renderable_uniforms(batch_.pass, program_, &batched, camera_);
+                renderer_->set_auto_attributes_on_shader(program_, &batched, &buffers);
+                renderer_->send_geometry(&batched, &buffers, count);
+                i += count;
+            } else {
+                /* Can't be batched, draw them one at a time */
+                renderable->final_transformation = transformations[i];
+                do_visit(renderable, batch_.pass, batch_.iteration, batch_.matrices[i]);
+                ++i;
+            }
+        }
+    }
+
+    transformations.clear();
+    batch_.matrices.clear();
 }
 
 void GL2RenderQueueVisitor::start_traversal(const batcher::RenderQueue& queue, uint64_t frame_id, Stage* stage) {
-    _S_UNUSED(queue);
     _S_UNUSED(frame_id);
     _S_UNUSED(stage);
 
+    queue_ = &queue;
     global_ambient_ = stage->ambient_light();
+
+    /* The viewport clear (among other things) has happened since the last traversal */
+    renderer_->state_cache()->invalidate();
 }
 
 void GL2RenderQueueVisitor::end_traversal(const batcher::RenderQueue &queue, Stage* stage) {
     _S_UNUSED(queue);
     _S_UNUSED(stage);
+
+    flush_batch();
+
+    auto state = renderer_->state_cache();
+    get_app()->stats->increment_render_state_changes(
+        state->state_changes(), state->state_changes_avoided()
+    );
+    state->reset_counters();
 }
 
 void GL2RenderQueueVisitor::apply_lights(const LightPtr* lights, const uint8_t count) {
     if(count == 1) {
+        /* Anything batched must be drawn with the light it was queued with */
+        if(lights[0] != light_) {
+            flush_batch();
+            light_ = lights[0];
+        }
+
         renderer_->set_light_uniforms(pass_, program_, lights[0]);
     } else {
         // FIXME: This should fill out a light array in the shader. Needs a new property defined!
@@ -402,7 +513,10 @@ void GL2RenderQueueVisitor::apply_lights(const LightPtr* lights, const uint8_t c
 }
 
 void GL2RenderQueueVisitor::change_material_pass(const MaterialPass* prev, const MaterialPass* next) {
+    flush_batch();
+
     pass_ = next;
+    light_ = nullptr;
 
     // Active the new program, if this render group uses a different one
     if(!prev || prev->gpu_program_id() != next->gpu_program_id()) {
@@ -411,6 +525,9 @@ void GL2RenderQueueVisitor::change_material_pass(const MaterialPass* prev, const
         program_->activate();
     }
 
+    /* Only the state which differs from what's bound reaches GL */
+    auto state = renderer_->state_cache();
+
     /* First we bind any used texture properties to their associated variables */
     uint8_t texture_unit = 0;
     std::string name;
@@ -433,85 +550,27 @@ void GL2RenderQueueVisitor::change_material_pass(const MaterialPass* prev, const
         // If someone uses s_diffuse_map, but doesn't set a value, surely that should get the default texture?
         auto loc = program_->locate_uniform(name, true);
         if(loc > -1 && (texture_unit + 1u) < _S_GL_MAX_TEXTURE_UNITS) {
-            GLCheck(glActiveTexture, GL_TEXTURE0 + texture_unit);
-            GLCheck(glBindTexture, GL_TEXTURE_2D, (tex) ? tex->_renderer_specific_id() : 0);
+            if(tex) {
+                renderer_->make_texture_resident(tex.get());
+            }
+
+            state->bind_texture(texture_unit, (tex) ? tex->_renderer_specific_id() : 0);
             texture_unit++;
         }
     }
 
     /* Next, we wipe out any unused texture units */
     for(uint8_t i = texture_unit; i < _S_GL_MAX_TEXTURE_UNITS; ++i) {
-        GLCheck(glActiveTexture, GL_TEXTURE0 + texture_unit);
-        GLCheck(glBindTexture, GL_TEXTURE_2D, 0);
-    }
-
-    if(!prev || prev->is_depth_test_enabled() != next->is_depth_test_enabled()) {
-        if(next->is_depth_test_enabled()) {
-            GLCheck(glEnable, GL_DEPTH_TEST);
-        } else {
-            GLCheck(glDisable, GL_DEPTH_TEST);
-        }
-    }
-
-    if(!prev || prev->is_depth_write_enabled() != next->is_depth_write_enabled()) {
-        if(next->is_depth_write_enabled()) {
-            GLCheck(glDepthMask, GL_TRUE);
-        } else {
-            GLCheck(glDepthMask, GL_FALSE);
-        }
+        state->bind_texture(i, 0);
     }
 
-    if(!prev || prev->point_size() != next->point_size()) {
-        glPointSize(next->point_size());
-    }
-
-    if(!prev || prev->polygon_mode() != next->polygon_mode()) {
-        switch(next->polygon_mode()) {
-            case POLYGON_MODE_POINT:
-                glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
-            break;
-            case POLYGON_MODE_LINE:
-                glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            break;
-            default:
-                glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        }
-    }
-
-    if(!prev || prev->cull_mode() != next->cull_mode()) {
-        if(next->cull_mode() != CULL_MODE_NONE) {
-            glEnable(GL_CULL_FACE);
-        }
-
-        switch(next->cull_mode()) {
-            case CULL_MODE_NONE:
-                glDisable(GL_CULL_FACE);
-            break;
-            case CULL_MODE_FRONT_FACE:
-                glCullFace(GL_FRONT);
-            break;
-            case CULL_MODE_BACK_FACE:
-                glCullFace(GL_BACK);
-            break;
-            case CULL_MODE_FRONT_AND_BACK_FACE:
-                glCullFace(GL_FRONT_AND_BACK);
-            break;
-        default:
-            assert(0 && "Invalid cull mode");
-        }
-    }
-
-    if(!prev || prev->blend_func() != next->blend_func()) {
-        renderer_->set_blending_mode(next->blend_func());
-    }
-
-    if(!prev || prev->shade_model() != next->shade_model()) {
-        if(next->shade_model() == SHADE_MODEL_SMOOTH) {
-            GLCheck(glShadeModel, GL_SMOOTH);
-        } else {
-            GLCheck(glShadeModel, GL_FLAT);
-        }
-    }
+    state->set_depth_test_enabled(next->is_depth_test_enabled());
+    state->set_depth_write_enabled(next->is_depth_write_enabled());
+    state->set_point_size(next->point_size());
+    state->set_polygon_mode(next->polygon_mode());
+    state->set_cull_mode(next->cull_mode());
+    state->set_blend_type(next->blend_func());
+    state->set_shade_model(next->shade_model());
 
     renderer_->set_stage_uniforms(next, program_, global_ambient_);
     renderer_->set_material_uniforms(next, program_);
@@ -543,61 +602,46 @@ void GL2RenderQueueVisitor::change_material_pass(const MaterialPass* prev, const
    // rebind_attribute_locations_if_necessary(next, program_);
 }
 
-void GenericRenderer::set_renderable_uniforms(const MaterialPass* pass, GPUProgram* program, const Renderable* renderable, Camera* camera) {
-    _S_UNUSED(pass);
-
-    //Calculate the modelview-projection matrix
-    const Mat4 model = renderable->final_transformation;
-    const Mat4& view = camera->view_matrix();
-    const Mat4& projection = camera->projection_matrix();
-
-    Mat4 modelview = view * model;
-    Mat4 modelview_projection = projection * modelview;
+uint8_t GenericRenderer::matrices_used_by(const GPUProgram* program) {
+    uint8_t flags = 0;
 
-    auto v_loc = program->locate_uniform(VIEW_MATRIX_PROPERTY, true);
-    if(v_loc > -1) {
-        program->set_uniform_mat4x4(
-            VIEW_MATRIX_PROPERTY,
-            view
-        );
+    if(program->has_auto_uniform(SP_AUTO_MODELVIEW_MATRIX)) {
+        flags |= batcher::RENDERABLE_MATRIX_MODELVIEW;
     }
 
-    auto mvp_loc = program->locate_uniform(MODELVIEW_PROJECTION_MATRIX_PROPERTY, true);
-    if(mvp_loc > -1) {
-        program->set_uniform_mat4x4(
-            MODELVIEW_PROJECTION_MATRIX_PROPERTY,
-            modelview_projection
-        );
+    if(program->has_auto_uniform(SP_AUTO_MODELVIEW_PROJECTION_MATRIX)) {
+        flags |= batcher::RENDERABLE_MATRIX_MODELVIEW_PROJECTION;
     }
 
-    auto mv_loc = program->locate_uniform(MODELVIEW_MATRIX_PROPERTY, true);
-    if(mv_loc > -1) {
-        program->set_uniform_mat4x4(
-            MODELVIEW_MATRIX_PROPERTY,
-            modelview
-        );
+    if(program->has_auto_uniform(SP_AUTO_INVERSE_TRANSPOSE_MODELVIEW_MATRIX)) {
+        flags |= batcher::RENDERABLE_MATRIX_INVERSE_TRANSPOSE_MODELVIEW;
     }
 
-    auto p_loc = program->locate_uniform(PROJECTION_MATRIX_PROPERTY, true);
-    if(p_loc > -1) {
-        program->set_uniform_mat4x4(
-            PROJECTION_MATRIX_PROPERTY,
-            projection
-        );
-    }
+    return flags;
+}
 
-    auto itmv_loc = program->locate_uniform(INVERSE_TRANSPOSE_MODELVIEW_MATRIX_PROPERTY, true);
-    if(itmv_loc > -1) {
-        // PERF: Recalculating every frame will be costly!
-        Mat3 inverse_transpose_modelview(modelview);
-        inverse_transpose_modelview.inverse();
-        inverse_transpose_modelview.transpose();
+void GenericRenderer::set_renderable_uniforms(const MaterialPass* pass, GPUProgram* program, const Renderable* renderable, Camera* camera, const batcher::RenderableMatrices* matrices) {
+    _S_UNUSED(pass);
 
-        program->set_uniform_mat3x3(
-            INVERSE_TRANSPOSE_MODELVIEW_MATRIX_PROPERTY,
-            inverse_transpose_modelview
+    /* Renderables from the queue have their matrices calculated up-front, anything
+     * else (e.g. a CPU batch) needs the ones this program reads calculating now */
+    batcher::RenderableMatrices calculated;
+    if(!matrices) {
+        batcher::calculate_renderable_matrices(
+            camera->view_matrix(), camera->projection_matrix(), renderable, 1, &calculated,
+            matrices_used_by(program)
         );
+        matrices = &calculated;
     }
+
+    program->set_auto_uniform_mat4x4(SP_AUTO_VIEW_MATRIX, camera->view_matrix());
+    program->set_auto_uniform_mat4x4(SP_AUTO_MODELVIEW_PROJECTION_MATRIX, matrices->modelview_projection);
+    program->set_auto_uniform_mat4x4(SP_AUTO_MODELVIEW_MATRIX, matrices->modelview);
+    program->set_auto_uniform_mat4x4(SP_AUTO_PROJECTION_MATRIX, camera->projection_matrix());
+    program->set_auto_uniform_mat3x3(
+        SP_AUTO_INVERSE_TRANSPOSE_MODELVIEW_MATRIX,
+        matrices->inverse_transpose_modelview
+    );
 }
 
 /*
@@ -627,10 +671,10 @@ void GL2RenderQueueVisitor::change_render_group(const batcher::RenderGroup *prev
     _S_UNUSED(next);
 }
 
-void GL2RenderQueueVisitor::do_visit(const Renderable* renderable, const MaterialPass* material_pass, batcher::Iteration iteration) {
+void GL2RenderQueueVisitor::do_visit(const Renderable* renderable, const MaterialPass* material_pass, batcher::Iteration iteration, const batcher::RenderableMatrices* matrices) {
     _S_UNUSED(iteration);
 
-    renderer_->set_renderable_uniforms(material_pass, program_, renderable, camera_);
+    renderer_->set_renderable_uniforms(material_pass, program_, renderable, camera_, matrices);
     renderer_->prepare_to_render(renderable);
     renderer_->set_auto_attributes_on_shader(program_, renderable, renderer_->buffer_stash_.get());
     renderer_->send_geometry(renderable, renderer_->buffer_stash_.get());
@@ -681,7 +725,7 @@ GPUProgramID GenericRenderer::current_gpu_program_id() const {
     return ret;
 }
 
-void GenericRenderer::send_geometry(const Renderable *renderable, GPUBuffer *buffers) {
+void GenericRenderer::send_geometry(const Renderable *renderable, GPUBuffer *buffers, uint32_t instance_count) {
     auto element_count = renderable->index_element_count;
     auto arrangement = convert_arrangement(renderable->arrangement);
     if(element_count) {
@@ -689,6 +733,7 @@ void GenericRenderer::send_geometry(const Renderable *renderable, GPUBuffer *buf
         auto offset = buffers->index_vbo->byte_offset(buffers->index_vbo_slot);
         GLCheck(glDrawElements, arrangement, element_count, index_type, BUFFER_OFFSET(offset));
         get_app()->stats->increment_polygons_rendered(renderable->arrangement, element_count);
+        get_app()->stats->increment_draw_calls(instance_count);
     } else {
         assert(renderable->vertex_ranges);
         assert(renderable->vertex_range_count);
@@ -702,12 +747,218 @@ void GenericRenderer::send_geometry(const Renderable *renderable, GPUBuffer *buf
             );
 
             total += range->count;
+            get_app()->stats->increment_draw_calls(instance_count);
         }
 
         get_app()->stats->increment_polygons_rendered(renderable->arrangement, total);
     }
 }
 
+static_assert(sizeof(Mat4) == sizeof(float) * 16, "Mat4 can't be used as an attribute");
+
+void GenericRenderer::send_geometry_instanced(
+        const Renderable* renderable,
+        GPUBuffer* buffers,
+        GPUProgram* program,
+        int32_t instance_loc,
+        const std::vector<Mat4>& transformations) {
+
+    _S_UNUSED(program);
+
+    assert(supports_instancing());
+
+    if(!instance_vbo_) {
+        GLCheck(glGenBuffers, 1, &instance_vbo_);
+    }
+
+    /* Orphan the previous contents each time, so we don't wait
+     * for the last draw to finish with them */
+    const GLsizei instance_count = transformations.size();
+    GLCheck(glBindBuffer, GL_ARRAY_BUFFER, instance_vbo_);
+    GLCheck(glBufferData, GL_ARRAY_BUFFER, sizeof(Mat4) * instance_count, nullptr, GL_STREAM_DRAW);
+    GLCheck(glBufferData, GL_ARRAY_BUFFER, sizeof(Mat4) * instance_count, transformations.data(), GL_STREAM_DRAW);
+
+    /* A mat4 attribute takes up 4 locations, one per column */
+    for(uint8_t i = 0; i < 4; ++i) {
+        enable_vertex_attribute(instance_loc + i);
+        GLCheck(
+            glVertexAttribPointer,
+            instance_loc + i, 4, GL_FLOAT, GL_FALSE, sizeof(Mat4), BUFFER_OFFSET(sizeof(float) * 4 * i)
+        );
+        GLCheck(vertex_attrib_divisor_, instance_loc + i, 1);
+    }
+
+    auto element_count = renderable->index_element_count;
+    auto arrangement = convert_arrangement(renderable->arrangement);
+    if(element_count) {
+        auto index_type = convert_id_type(renderable->index_data->index_type());
+        auto offset = buffers->index_vbo->byte_offset(buffers->index_vbo_slot);
+        GLCheck(
+            draw_elements_instanced_,
+            arrangement, element_count, index_type, BUFFER_OFFSET(offset), instance_count
+        );
+
+        get_app()->stats->increment_polygons_rendered(renderable->arrangement, element_count * instance_count);
+        get_app()->stats->increment_draw_calls(instance_count);
+    } else {
+        auto range = renderable->vertex_ranges;
+        auto total = 0;
+        for(std::size_t i = 0; i < renderable->vertex_range_count; ++i, ++range) {
+            GLCheck(
+                draw_arrays_instanced_,
+                arrangement, range->start, range->count, instance_count
+            );
+
+            total += range->count;
+            get_app()->stats->increment_draw_calls(instance_count);
+        }
+
+        get_app()->stats->increment_polygons_rendered(renderable->arrangement, total * instance_count);
+    }
+
+    /* Leave the locations as normal attributes for whatever comes next */
+    for(uint8_t i = 0; i < 4; ++i) {
+        GLCheck(vertex_attrib_divisor_, instance_loc + i, 0);
+        disable_vertex_attribute(instance_loc + i);
+    }
+
+    /* Rebind the vertex buffer, so the VBOs are as prepare_to_render left them */
+    buffers->bind_vbos();
+}
+
+/* Only meshes this small are worth transforming on the CPU, bigger
+ * ones are drawn one instance at a time */
+static const uint32_t MAX_CPU_BATCH_SOURCE_VERTICES = 512;
+static const uint32_t MAX_CPU_BATCH_VERTICES = 65535;
+
+std::size_t GenericRenderer::build_cpu_batch(
+        const Renderable* renderable,
+        const std::vector<Mat4>& transformations,
+        std::size_t first,
+        Renderable* batch,
+        GPUBuffer* buffers) {
+
+    auto vertex_data = renderable->vertex_data;
+    auto index_data = renderable->index_data;
+    const auto& spec = vertex_data->vertex_specification();
+
+    /* Only lists can be joined into a single draw */
+    if(!index_data || !renderable->index_element_count) {
+        return 0;
+    }
+
+    if(renderable->arrangement != MESH_ARRANGEMENT_TRIANGLES &&
+       renderable->arrangement != MESH_ARRANGEMENT_LINES) {
+        return 0;
+    }
+
+    if(spec.position_attribute != VERTEX_ATTRIBUTE_3F &&
+       spec.position_attribute != VERTEX_ATTRIBUTE_4F) {
+        return 0;
+    }
+
+    if(spec.has_normals() && spec.normal_attribute != VERTEX_ATTRIBUTE_3F) {
+        return 0;
+    }
+
+    /* We only copy the vertices that the indexes use */
+    auto min_index = index_data->min_index();
+    auto max_index = index_data->max_index();
+    if(min_index > max_index || max_index >= vertex_data->count()) {
+        return 0;
+    }
+
+    const uint32_t range = max_index - min_index + 1;
+    if(range > MAX_CPU_BATCH_SOURCE_VERTICES) {
+        return 0;
+    }
+
+    const std::size_t count = std::min<std::size_t>(
+        transformations.size() - first, MAX_CPU_BATCH_VERTICES / range
+    );
+
+    if(count < 2) {
+        return 0;
+    }
+
+    if(!batch_vertex_data_ || batch_vertex_data_->vertex_specification() != spec) {
+        batch_vertex_data_ = VertexData::create(spec);
+        batch_vertex_vbo_ = DedicatedVBO::create(0, spec);
+    }
+
+    if(!batch_index_data_) {
+        batch_index_data_ = IndexData::create(INDEX_TYPE_16_BIT);
+        batch_index_vbo_ = DedicatedVBO::create(0, INDEX_TYPE_16_BIT);
+    }
+
+    const uint32_t stride = spec.stride();
+    const uint32_t element_count = renderable->index_element_count;
+
+    batch_vertex_data_->resize(range * count);
+    batch_index_data_->clear();
+    batch_indexes_.resize(element_count);
+
+    const uint8_t* source = vertex_data->data() + (min_index * stride);
+
+    for(std::size_t i = 0; i < count; ++i) {
+        const Mat4& transformation = transformations[first + i];
+        const uint32_t base = i * range;
+
+        /* Anything with the same vertex data can be batched (not just mesh
+         * instances), so the scaling may not be uniform */
+        Mat3 normal_matrix;
+        if(spec.has_normals()) {
+            normal_matrix = Mat3(transformation).inversed().transposed();
+        }
+
+        std::memcpy(batch_vertex_data_->data() + (base * stride), source, range * stride);
+
+        for(uint32_t v = base; v < base + range; ++v) {
+            batch_vertex_data_->move_to(v);
+
+            auto pos = transformation * batch_vertex_data_->position_nd_at(v);
+            batch_vertex_data_->position(pos.x, pos.y, pos.z);
+
+            if(spec.has_normals()) {
+                auto n = batch_vertex_data_->normal_at<Vec3>(v);
+                batch_vertex_data_->normal(n->rotated_by(normal_matrix).normalized());
+            }
+        }
+
+        for(uint32_t j = 0; j < element_count; ++j) {
+            batch_indexes_[j] = (index_data->at(j) - min_index) + base;
+        }
+
+        batch_index_data_->index(batch_indexes_.data(), element_count);
+    }
+
+    batch_vertex_data_->done();
+    batch_index_data_->done();
+
+    /* The batch is rebuilt and uploaded for every draw. That's at most
+     * MAX_CPU_BATCH_VERTICES vertices from meshes of no more than
+     * MAX_CPU_BATCH_SOURCE_VERTICES, which is cheaper on the GL2 targets
+     * without instancing than the draw calls it replaces. glBufferData
+     * gives the buffer new storage each time, so the upload doesn't wait
+     * for the previous batch's draw to finish */
+    batch_vertex_vbo_->upload(0, batch_vertex_data_.get());
+    batch_index_vbo_->upload(0, batch_index_data_.get());
+
+    buffers->vertex_vbo = batch_vertex_vbo_.get();
+    buffers->vertex_vbo_slot = 0;
+    buffers->index_vbo = batch_index_vbo_.get();
+    buffers->index_vbo_slot = 0;
+    buffers->bind_vbos();
+
+    *batch = *renderable;
+    batch->vertex_data = batch_vertex_data_.get();
+    batch->index_data = batch_index_data_.get();
+    batch->index_element_count = batch_index_data_->count();
+    batch->final_transformation = Mat4();
+
+    return count;
+}
+
 void GenericRenderer::init_context() {
     if(!gladLoadGL()) {
         throw std::runtime_error("Unable to intialize OpenGL 2.1");
@@ -731,11 +982,219 @@ void GenericRenderer::init_context() {
     GLCheck(glDepthFunc, GL_LEQUAL);
     GLCheck(glEnable, GL_CULL_FACE);
 
+    load_instancing_functions();
+    load_streaming_functions();
+    load_program_binary_functions();
+
+    driver_hash_ = hashlib::MD5(
+        _F("{0} {1} {2}").format(GL_vendor, GL_renderer, GL_version)
+    ).hex_digest();
+
     if(!default_gpu_program_id_) {
         default_gpu_program_id_ = new_or_existing_gpu_program(default_vertex_shader, default_fragment_shader);
     }
 }
 
+static bool has_extension(const char* extensions, const char* name) {
+    if(!extensions) {
+        return false;
+    }
+
+    /* Make sure we don't match the start of a longer name */
+    auto length = std::strlen(name);
+    auto found = std::strstr(extensions, name);
+    while(found) {
+        bool starts = (found == extensions || found[-1] == ' ');
+        bool ends = (found[length] == ' ' || found[length] == '\0');
+        if(starts && ends) {
+            return true;
+        }
+
+        found = std::strstr(found + length, name);
+    }
+
+    return false;
+}
+
+void GenericRenderer::load_instancing_functions() {
+    vertex_attrib_divisor_ = nullptr;
+    draw_elements_instanced_ = nullptr;
+    draw_arrays_instanced_ = nullptr;
+
+    auto extensions = (const char*) glGetString(GL_EXTENSIONS);
+
+    if(has_extension(extensions, "GL_ARB_instanced_arrays") && has_extension(extensions, "GL_ARB_draw_instanced")) {
+        vertex_attrib_divisor_ = (PFNGLVERTEXATTRIBDIVISORPROC) window->gl_proc_address("glVertexAttribDivisorARB");
+        draw_elements_instanced_ = (PFNGLDRAWELEMENTSINSTANCEDPROC) window->gl_proc_address("glDrawElementsInstancedARB");
+        draw_arrays_instanced_ = (PFNGLDRAWARRAYSINSTANCEDPROC) window->gl_proc_address("glDrawArraysInstancedARB");
+    }
+
+    if(supports_instancing()) {
+        S_INFO("Instanced drawing is available");
+    } else {
+        S_INFO("Instanced drawing is unavailable, instances will be batched on the CPU");
+    }
+}
+
+void GenericRenderer::load_streaming_functions() {
+    PFNGLMAPBUFFERRANGEPROC map_buffer_range = nullptr;
+
+    auto extensions = (const char*) glGetString(GL_EXTENSIONS);
+    if(has_extension(extensions, "GL_ARB_map_buffer_range")) {
+        map_buffer_range = (PFNGLMAPBUFFERRANGEPROC) window->gl_proc_address("glMapBufferRange");
+    }
+
+    buffer_manager_->set_map_buffer_range_function(map_buffer_range);
+
+    if(map_buffer_range) {
+        S_INFO("Dynamic geometry will be streamed through mapped buffers");
+    } else {
+        S_INFO("Dynamic geometry will be streamed with glBufferSubData");
+    }
+}
+
+void GenericRenderer::load_program_binary_functions() {
+    get_program_binary_ = nullptr;
+    program_binary_ = nullptr;
+    program_parameteri_ = nullptr;
+    program_binary_formats_.clear();
+
+    program_cache_directory_ = get_app()->config->general.gpu_program_cache_directory;
+    if(program_cache_directory_.empty()) {
+        return;
+    }
+
+    auto extensions = (const char*) glGetString(GL_EXTENSIONS);
+    if(has_extension(extensions, "GL_ARB_get_program_binary")) {
+        get_program_binary_ = (PFNGLGETPROGRAMBINARYPROC) window->gl_proc_address("glGetProgramBinary");
+        program_binary_ = (PFNGLPROGRAMBINARYPROC) window->gl_proc_address("glProgramBinary");
+        program_parameteri_ = (PFNGLPROGRAMPARAMETERIPROC) window->gl_proc_address("glProgramParameteri");
+    } else if(has_extension(extensions, "GL_OES_get_program_binary")) {
+        /* GLES has no retrievable hint, binaries are always available */
+        get_program_binary_ = (PFNGLGETPROGRAMBINARYPROC) window->gl_proc_address("glGetProgramBinaryOES");
+        program_binary_ = (PFNGLPROGRAMBINARYPROC) window->gl_proc_address("glProgramBinaryOES");
+    }
+
+    GLint count = 0;
+    if(get_program_binary_ && program_binary_) {
+        GLCheck(glGetIntegerv, GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    }
+
+    /* Some drivers have the extension but can't produce any binaries */
+    if(count <= 0) {
+        get_program_binary_ = nullptr;
+        program_binary_ = nullptr;
+        program_parameteri_ = nullptr;
+        S_INFO("GPU programs will not be cached, the driver doesn't support program binaries");
+        return;
+    }
+
+    program_binary_formats_.resize(count);
+    GLCheck(glGetIntegerv, GL_PROGRAM_BINARY_FORMATS, &program_binary_formats_[0]);
+
+    try {
+        kfs::make_dirs(program_cache_directory_);
+    } catch(kfs::IOError& e) {
+        S_WARN("Unable to create the GPU program cache directory: {0}", e.what());
+    }
+
+    S_INFO("GPU programs will be cached in {0}", program_cache_directory_);
+}
+
+std::string GenericRenderer::program_binary_path(GPUProgram* program) const {
+    return kfs::path::join(
+        program_cache_directory_,
+        _F("{0}-{1}.bin").format(program->md5(), driver_hash_)
+    );
+}
+
+bool GenericRenderer::load_program_binary(GPUProgram* program) {
+    std::ifstream file(program_binary_path(program), std::ios::binary);
+    if(!file) {
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    auto size = (std::streamoff) file.tellg() - (std::streamoff) sizeof(GLenum);
+    file.seekg(0, std::ios::beg);
+
+    if(size <= 0) {
+        return false;
+    }
+
+    GLenum format = 0;
+    file.read((char*) &format, sizeof(format));
+
+    std::vector<char> binary((std::size_t) size);
+    file.read(&binary[0], size);
+
+    /* A truncated file (e.g. we were killed while writing it) */
+    if(!file || file.gcount() != size) {
+        return false;
+    }
+
+    /* Passing an unknown format is an error, rather than a failed link */
+    auto known = std::find(
+        program_binary_formats_.begin(), program_binary_formats_.end(), (GLint) format
+    ) != program_binary_formats_.end();
+
+    if(!known) {
+        return false;
+    }
+
+    program->prepare_program();
+    GLCheck(program_binary_, program->program_object(), format, &binary[0], (GLsizei) binary.size());
+    return program->_link_from_binary();
+}
+
+void GenericRenderer::save_program_binary(GPUProgram* program) {
+    GLint length = 0;
+    GLCheck(glGetProgramiv, program->program_object(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) {
+        return;
+    }
+
+    GLenum format = 0;
+    std::vector<char> binary(length);
+    GLCheck(get_program_binary_, program->program_object(), length, &length, &format, &binary[0]);
+
+    std::ofstream file(program_binary_path(program), std::ios::binary);
+    file.write((const char*) &format, sizeof(format));
+    file.write(&binary[0], length);
+
+    if(!file) {
+        S_WARN("Unable to write GPU program {0} to the cache", program->md5());
+    }
+}
+
+void GenericRenderer::build_program(GPUProgram* program) {
+    if(program->is_complete()) {
+        return;
+    }
+
+    if(!program_binary_) {
+        program->build();
+        return;
+    }
+
+    if(load_program_binary(program)) {
+        return;
+    }
+
+    /* A stale binary (e.g. the driver was updated), or nothing cached yet */
+    program->prepare_program();
+    if(program_parameteri_) {
+        GLCheck(program_parameteri_, program->program_object(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    program->build();
+    save_program_binary(program);
+}
+
+void GenericRenderer::on_pre_render() {
+    buffer_manager_->begin_frame();
+}
+
 void GenericRenderer::prepare_to_render(const Renderable *renderable) {
     /* Here we allocate VBOs for the renderable if necessary, and then upload
      * any new data */
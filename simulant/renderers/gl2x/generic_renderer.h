@@ -20,12 +20,17 @@
 #define GENERIC_RENDERER_H
 
 #include <vector>
+#include <string>
+#include <unordered_map>
 #include <memory>
 #include <cstdint>
 #include "../renderer.h"
 #include "../gl_renderer.h"
+#include "../gl_state_cache.h"
 #include "../../assets/material.h"
 #include "../batching/render_queue.h"
+#include "../batching/renderable.h"
+#include "../glad/glad/glad.h"
 
 namespace smlt {
 
@@ -33,6 +38,7 @@ struct GL2RenderGroupImpl;
 class GenericRenderer;
 class VBOManager;
 class GPUBuffer;
+class DedicatedVBO;
 
 struct RenderState {
     Renderable* renderable;
@@ -59,13 +65,38 @@ private:
     CameraPtr camera_;
     Colour global_ambient_;
 
+    const batcher::RenderQueue* queue_ = nullptr;
+
     GPUProgram* program_ = nullptr;
     const MaterialPass* pass_ = nullptr;
     const Light* light_ = nullptr;
 
     GL2RenderGroupImpl* current_group_ = nullptr;
 
-    void do_visit(const Renderable* renderable, const MaterialPass* material_pass, batcher::Iteration iteration);
+    /* Consecutive renderables which only differ by their transformation
+     * (e.g. the instances of a MeshInstancer) are collected here and
+     * drawn together when something different comes along */
+    struct InstanceBatch {
+        Renderable renderable;
+        const MaterialPass* pass = nullptr;
+        batcher::Iteration iteration = 0;
+        std::vector<Mat4> transformations;
+
+        /* The queue's derived matrices for each transformation */
+        std::vector<const batcher::RenderableMatrices*> matrices;
+    };
+
+    InstanceBatch batch_;
+
+    bool can_batch(const Renderable* renderable, const MaterialPass* pass, batcher::Iteration iteration) const;
+    void flush_batch();
+
+    void do_visit(
+        const Renderable* renderable,
+        const MaterialPass* material_pass,
+        batcher::Iteration iteration,
+        const batcher::RenderableMatrices* matrices
+    );
 
     void rebind_attribute_locations_if_necessary(const MaterialPass* pass, GPUProgram* program);
 };
@@ -96,6 +127,10 @@ public:
     GPUProgramPtr gpu_program(const GPUProgramID& program_id) const override;
     GPUProgramID current_gpu_program_id() const override;
     bool supports_gpu_programs() const override { return true; }
+
+    uint8_t renderable_matrices_used() const override {
+        return renderable_matrices_used_;
+    }
     GPUProgramID default_gpu_program_id() const override;
 
     std::string name() const override {
@@ -103,20 +138,122 @@ public:
     }
 
     void prepare_to_render(const Renderable* renderable) override;
+    void on_pre_render() override;
+
+    /* True if the context supports instanced arrays. Programs which have an
+     * s_instance_transformation (mat4) attribute are then sent the model
+     * matrix of each instance through it, and s_modelview_projection etc.
+     * will not include the model matrix. */
+    bool supports_instancing() const {
+        return vertex_attrib_divisor_ && draw_elements_instanced_ && draw_arrays_instanced_;
+    }
+
+    /* The location of the program's s_instance_transformation attribute if
+     * runs of renderables can be drawn instanced with it, otherwise -1. When
+     * drawn without instancing the attribute is left as the identity. */
+    int32_t instance_transformation_location(GPUProgram* program) const;
+
+    GLStateCache* state_cache() {
+        return &state_cache_;
+    }
+
 private:
+    GLStateCache state_cache_;
+
     GPUProgramManager program_manager_;
     GPUProgramID default_gpu_program_id_ = 0;
 
+    /* Programs are shared by everything using the same source, this
+     * maps gpu_program_source_hash() to the program */
+    std::unordered_map<std::string, GPUProgramID> programs_by_hash_;
+
+    /* Linked programs are cached on disk (see AppConfig::general) if
+     * GL_ARB_get_program_binary or GL_OES_get_program_binary is available.
+     * Binaries are only valid for the driver that made them, so the
+     * file names include a hash of the GL vendor, renderer and version */
+    PFNGLGETPROGRAMBINARYPROC get_program_binary_ = nullptr;
+    PFNGLPROGRAMBINARYPROC program_binary_ = nullptr;
+    PFNGLPROGRAMPARAMETERIPROC program_parameteri_ = nullptr;
+    std::vector<GLint> program_binary_formats_;
+    std::string program_cache_directory_;
+    std::string driver_hash_;
+
+    void load_program_binary_functions();
+    std::string program_binary_path(GPUProgram* program) const;
+    bool load_program_binary(GPUProgram* program);
+    void save_program_binary(GPUProgram* program);
+
+    /* Builds the program, from the on-disk cache if possible */
+    void build_program(GPUProgram* program);
+
     std::shared_ptr<VBOManager> buffer_manager_;
 
     void set_light_uniforms(const MaterialPass* pass, GPUProgram* program, const LightPtr light);
     void set_material_uniforms(const MaterialPass *pass, GPUProgram* program);
-    void set_renderable_uniforms(const MaterialPass* pass, GPUProgram* program, const Renderable* renderable, Camera* camera);
+    /* The batcher::RenderableMatrixFlags of every linked program's auto
+     * uniforms. Only written on the main thread, but read by the workers
+     * calculating each queue's matrices */
+    thread::Atomic<uint8_t> renderable_matrices_used_ = {0};
+
+    static uint8_t matrices_used_by(const GPUProgram* program);
+
+    /* If matrices is null, the derived matrices are calculated from
+     * the renderable's transformation */
+    void set_renderable_uniforms(
+        const MaterialPass* pass,
+        GPUProgram* program,
+        const Renderable* renderable,
+        Camera* camera,
+        const batcher::RenderableMatrices* matrices=nullptr
+    );
     void set_stage_uniforms(const MaterialPass* pass, GPUProgram* program, const Colour& global_ambient);
 
     void set_auto_attributes_on_shader(GPUProgram *program, const Renderable* buffer, GPUBuffer* buffers);
-    void set_blending_mode(BlendType type);
-    void send_geometry(const Renderable* renderable, GPUBuffer* buffers);
+    /* instance_count is the number of instances in the geometry, for the
+     * stats (e.g. a batch built on the CPU) */
+    void send_geometry(const Renderable* renderable, GPUBuffer* buffers, uint32_t instance_count=1);
+
+    /* Instanced drawing, loaded from GL_ARB_instanced_arrays and
+     * GL_ARB_draw_instanced if available */
+    PFNGLVERTEXATTRIBDIVISORPROC vertex_attrib_divisor_ = nullptr;
+    PFNGLDRAWELEMENTSINSTANCEDPROC draw_elements_instanced_ = nullptr;
+    PFNGLDRAWARRAYSINSTANCEDPROC draw_arrays_instanced_ = nullptr;
+
+    void load_instancing_functions();
+
+    /* Dynamic data is streamed through glMapBufferRange if
+     * GL_ARB_map_buffer_range is available */
+    void load_streaming_functions();
+
+    GLuint instance_vbo_ = 0;
+
+    void send_geometry_instanced(
+        const Renderable* renderable,
+        GPUBuffer* buffers,
+        GPUProgram* program,
+        int32_t instance_loc,
+        const std::vector<Mat4>& transformations
+    );
+
+    /* When instancing isn't available, small meshes are transformed
+     * on the CPU and drawn in batches from these */
+    std::shared_ptr<VertexData> batch_vertex_data_;
+    std::shared_ptr<IndexData> batch_index_data_;
+    std::shared_ptr<DedicatedVBO> batch_vertex_vbo_;
+    std::shared_ptr<DedicatedVBO> batch_index_vbo_;
+
+    std::vector<uint32_t> batch_indexes_;
+
+    /* Fills batch (and binds buffers) with copies of the renderable transformed
+     * by the transformations from first onwards. Returns how many were batched,
+     * or zero if the renderable can't be batched on the CPU */
+    std::size_t build_cpu_batch(
+        const Renderable* renderable,
+        const std::vector<Mat4>& transformations,
+        std::size_t first,
+        Renderable* batch,
+        GPUBuffer* buffers
+    );
 
     /* Stashed here in prepare_to_render and used later for that renderable */
     std::shared_ptr<GPUBuffer> buffer_stash_;
@@ -18,14 +18,42 @@
 //
 
 
+#include <cstring>
+
 #include "../../utils/gl_error.h"
 #include "../../utils/hash/md5.h"
 #include "gpu_program.h"
-#include "../renderer.h"
+#include "../gl_renderer.h"
+#include "../../assets/materials/constants.h"
 #include "../../generic/raii.h"
 
 namespace smlt {
 
+const char* auto_uniform_name(ShaderAvailableAuto uniform) {
+    switch(uniform) {
+        case SP_AUTO_MODELVIEW_PROJECTION_MATRIX: return MODELVIEW_PROJECTION_MATRIX_PROPERTY;
+        case SP_AUTO_VIEW_MATRIX: return VIEW_MATRIX_PROPERTY;
+        case SP_AUTO_MODELVIEW_MATRIX: return MODELVIEW_MATRIX_PROPERTY;
+        case SP_AUTO_PROJECTION_MATRIX: return PROJECTION_MATRIX_PROPERTY;
+        case SP_AUTO_INVERSE_TRANSPOSE_MODELVIEW_MATRIX: return INVERSE_TRANSPOSE_MODELVIEW_MATRIX_PROPERTY;
+        case SP_AUTO_MATERIAL_DIFFUSE: return DIFFUSE_PROPERTY_NAME;
+        case SP_AUTO_MATERIAL_SPECULAR: return SPECULAR_PROPERTY_NAME;
+        case SP_AUTO_MATERIAL_AMBIENT: return AMBIENT_PROPERTY_NAME;
+        case SP_AUTO_MATERIAL_SHININESS: return SHININESS_PROPERTY_NAME;
+        case SP_AUTO_MATERIAL_POINT_SIZE: return POINT_SIZE_PROPERTY_NAME;
+        case SP_AUTO_LIGHT_GLOBAL_AMBIENT: return GLOBAL_AMBIENT_PROPERTY;
+        case SP_AUTO_LIGHT_POSITION: return LIGHT_POSITION_PROPERTY;
+        case SP_AUTO_LIGHT_DIFFUSE: return LIGHT_DIFFUSE_PROPERTY;
+        case SP_AUTO_LIGHT_SPECULAR: return LIGHT_SPECULAR_PROPERTY;
+        case SP_AUTO_LIGHT_AMBIENT: return LIGHT_AMBIENT_PROPERTY;
+        case SP_AUTO_LIGHT_CONSTANT_ATTENUATION: return LIGHT_CONSTANT_ATTENUATION_PROPERTY;
+        case SP_AUTO_LIGHT_LINEAR_ATTENUATION: return LIGHT_LINEAR_ATTENUATION_PROPERTY;
+        case SP_AUTO_LIGHT_QUADRATIC_ATTENUATION: return LIGHT_QUADRATIC_ATTENUATION_PROPERTY;
+    default:
+        return nullptr;
+    }
+}
+
 
 UniformInfo GPUProgram::uniform_info(const std::string& uniform_name) {
     /*
@@ -90,36 +118,42 @@ GLint GPUProgram::locate_uniform(const std::string& uniform_name, bool fail_sile
 
 void GPUProgram::set_uniform_int(const int32_t loc, const int32_t value) {
     assert(loc >= 0);
+    forget_auto_uniform_value(loc);
     GLCheck(glUniform1i, loc, value);
 }
 
 void GPUProgram::set_uniform_int(const std::string& uniform_name, const int32_t value, bool fail_silently) {
     GLint loc = locate_uniform(uniform_name, fail_silently);
     if(loc > -1) {
+        forget_auto_uniform_value(loc);
         GLCheck(glUniform1i, loc, value);
     }
 }
 
 void GPUProgram::set_uniform_float(const int32_t loc, const float value) {
     assert(loc >= 0);
+    forget_auto_uniform_value(loc);
     GLCheck(glUniform1f, loc, value);
 }
 
 void GPUProgram::set_uniform_float(const std::string& uniform_name, const float value, bool fail_silently) {
     int32_t loc = locate_uniform(uniform_name, fail_silently);
     if(loc > -1) {
+        forget_auto_uniform_value(loc);
         GLCheck(glUniform1f, loc, value);
     }
 }
 
 void GPUProgram::set_uniform_mat4x4(const int32_t loc, const Mat4& matrix) {
     assert(loc >= 0);
+    forget_auto_uniform_value(loc);
     GLCheck(glUniformMatrix4fv, loc, 1, false, (GLfloat*)matrix.data());
 }
 
 void GPUProgram::set_uniform_mat4x4(const std::string& uniform_name, const Mat4& matrix) {
     int32_t loc = locate_uniform(uniform_name);
     if(loc > -1) {
+        forget_auto_uniform_value(loc);
         GLCheck(glUniformMatrix4fv, loc, 1, false, (GLfloat*)matrix.data());
     }
 }
@@ -127,6 +161,7 @@ void GPUProgram::set_uniform_mat4x4(const std::string& uniform_name, const Mat4&
 void GPUProgram::set_uniform_mat3x3(const std::string& uniform_name, const Mat3& matrix) {
     int32_t loc = locate_uniform(uniform_name);
     if(loc > -1) {
+        forget_auto_uniform_value(loc);
         GLCheck(glUniformMatrix3fv, loc, 1, false, (GLfloat*)matrix.data());
     }
 }
@@ -134,18 +169,21 @@ void GPUProgram::set_uniform_mat3x3(const std::string& uniform_name, const Mat3&
 void GPUProgram::set_uniform_vec3(const std::string& uniform_name, const Vec3& values) {
     int32_t loc = locate_uniform(uniform_name);
     if(loc > -1) {
+        forget_auto_uniform_value(loc);
         GLCheck(glUniform3fv, loc, 1, (GLfloat*) &values);
     }
 }
 
 void GPUProgram::set_uniform_vec4(const int32_t loc, const Vec4& values) {
     assert(loc >= 0);
+    forget_auto_uniform_value(loc);
     GLCheck(glUniform4fv, loc, 1, (GLfloat*) &values);
 }
 
 void GPUProgram::set_uniform_vec4(const std::string& uniform_name, const Vec4& values) {
     int32_t loc = locate_uniform(uniform_name);
     if(loc > -1) {
+        forget_auto_uniform_value(loc);
         GLCheck(glUniform4fv, loc, 1, (GLfloat*) &values);
     }
 }
@@ -164,6 +202,79 @@ void GPUProgram::set_uniform_mat4x4_array(const std::string& uniform_name, const
     GLCheck(glUniformMatrix4fv, loc, matrices.size(), false, (GLfloat*) &matrices[0]);
 }
 
+bool GPUProgram::update_auto_uniform(ShaderAvailableAuto uniform, const void* value, std::size_t size) {
+    assert(size <= sizeof(AutoUniform::value));
+
+    auto& slot = auto_uniforms_[uniform];
+    if(slot.location < 0) {
+        return false;
+    }
+
+    if(slot.has_value && std::memcmp(slot.value, value, size) == 0) {
+        return false;
+    }
+
+    std::memcpy(slot.value, value, size);
+    slot.has_value = true;
+    return true;
+}
+
+void GPUProgram::forget_auto_uniform_value(GLint location) {
+    /* Something set an auto uniform by name or location, so we
+     * no longer know what value it holds */
+    for(auto& slot: auto_uniforms_) {
+        if(slot.location == location) {
+            slot.has_value = false;
+        }
+    }
+}
+
+void GPUProgram::set_auto_uniform_int(ShaderAvailableAuto uniform, const int32_t value) {
+    if(update_auto_uniform(uniform, &value, sizeof(value))) {
+        GLCheck(glUniform1i, auto_uniforms_[uniform].location, value);
+    }
+}
+
+void GPUProgram::set_auto_uniform_float(ShaderAvailableAuto uniform, const float value) {
+    if(update_auto_uniform(uniform, &value, sizeof(value))) {
+        GLCheck(glUniform1f, auto_uniforms_[uniform].location, value);
+    }
+}
+
+void GPUProgram::set_auto_uniform_vec4(ShaderAvailableAuto uniform, const Vec4& values) {
+    if(update_auto_uniform(uniform, &values, sizeof(float) * 4)) {
+        GLCheck(glUniform4fv, auto_uniforms_[uniform].location, 1, (GLfloat*) &values);
+    }
+}
+
+void GPUProgram::set_auto_uniform_colour(ShaderAvailableAuto uniform, const Colour& values) {
+    set_auto_uniform_vec4(uniform, Vec4(values.r, values.g, values.b, values.a));
+}
+
+void GPUProgram::set_auto_uniform_mat3x3(ShaderAvailableAuto uniform, const Mat3& values) {
+    if(update_auto_uniform(uniform, values.data(), sizeof(float) * 9)) {
+        GLCheck(glUniformMatrix3fv, auto_uniforms_[uniform].location, 1, false, (GLfloat*) values.data());
+    }
+}
+
+void GPUProgram::set_auto_uniform_mat4x4(ShaderAvailableAuto uniform, const Mat4& values) {
+    if(update_auto_uniform(uniform, values.data(), sizeof(float) * 16)) {
+        GLCheck(glUniformMatrix4fv, auto_uniforms_[uniform].location, 1, false, (GLfloat*) values.data());
+    }
+}
+
+void GPUProgram::rebuild_auto_uniforms() {
+    for(int i = 0; i < SP_AUTO_MAX; ++i) {
+        auto& slot = auto_uniforms_[i];
+        auto name = auto_uniform_name((ShaderAvailableAuto) i);
+
+        /* Uniform values are reset when a program links */
+        slot.has_value = false;
+        slot.location = (name) ?
+            _GLCheck<GLint>(__func__, glGetUniformLocation, program_object_, name) : -1;
+    }
+}
+
 void GPUProgram::rebuild_uniform_info() {
     //FIXME: Make this only happen when debugging
     //DEBUG info!
@@ -400,13 +511,50 @@ bool GPUProgram::is_compiled(ShaderType type) const {
 void GPUProgram::rebuild_hash() {
     hashlib::MD5 combined_hash;
 
-    for(auto p: shader_hashes_) {
-        combined_hash.update(p.second);
+    /* In a fixed order, so the same sources always give the same hash */
+    for(int type = 0; type < SHADER_TYPE_MAX; ++type) {
+        auto it = shader_hashes_.find((ShaderType) type);
+        if(it != shader_hashes_.end()) {
+            combined_hash.update(it->second);
+        }
     }
 
     md5_shader_hash_ = combined_hash.hex_digest();
 }
 
+std::string gpu_program_source_hash(const std::string& vertex_source, const std::string& fragment_source) {
+    hashlib::MD5 combined_hash;
+    combined_hash.update(hashlib::MD5(vertex_source).hex_digest());
+    combined_hash.update(hashlib::MD5(fragment_source).hex_digest());
+    return combined_hash.hex_digest();
+}
+
+bool GPUProgram::_link_from_binary() {
+    GLint linked = 0;
+    GLCheck(glGetProgramiv, program_object_, GL_LINK_STATUS, &linked);
+
+    if(!linked) {
+        return false;
+    }
+
+    /* There are no shader objects, but everything they'd provide is there */
+    for(auto& p: shaders_) {
+        p.second.is_compiled = true;
+    }
+
+    S_DEBUG("Loaded program {0} from a binary", program_object_);
+
+    rebuild_uniform_info();
+    rebuild_auto_uniforms();
+    uniform_cache_.clear();
+
+    is_linked_ = true;
+    needs_relink_ = false;
+    signal_linked_();
+
+    return true;
+}
+
 
 void GPUProgram::link(bool force) {
     if(!force && !needs_relink_) {
@@ -444,6 +592,7 @@ void GPUProgram::link(bool force) {
 
     // Rebuild the uniform information for debugging
     rebuild_uniform_info();
+    rebuild_auto_uniforms();
     uniform_cache_.clear();
 
     is_linked_ = true;
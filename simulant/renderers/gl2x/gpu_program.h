@@ -21,6 +21,7 @@
 
 #include <set>
 #include <map>
+#include <array>
 #include <unordered_map>
 
 #include "../../signals/signal.h"
@@ -30,6 +31,7 @@
 #include "../../utils/gl_thread_check.h"
 #include "../../generic/identifiable.h"
 #include "../../vertex_data.h"
+#include "../../materials/uniform_manager.h"
 
 #include "../glad/glad/glad.h"
 
@@ -63,6 +65,23 @@ struct UniformInfo {
     GLsizei size;
 };
 
+/* The uniforms the renderer sets on every program are located once when
+ * the program links, after that they're set by slot rather than by name.
+ * Each slot keeps the last value sent so unchanged values don't hit GL. */
+struct AutoUniform {
+    GLint location = -1;
+    bool has_value = false;
+    uint8_t value[sizeof(float) * 16];
+};
+
+/* Returns the GLSL variable name for an auto uniform, or nullptr if the
+ * renderer doesn't (yet) set that uniform */
+const char* auto_uniform_name(ShaderAvailableAuto uniform);
+
+/* The hash which identifies a program built from these sources, the
+ * same as GPUProgram::md5() */
+std::string gpu_program_source_hash(const std::string& vertex_source, const std::string& fragment_source);
+
 
 class GPUProgram:
     public RefCounted<GPUProgram>,
@@ -87,6 +106,11 @@ public:
     void compile(ShaderType type);
     void build();
 
+    /* Called in place of build() once the renderer has passed a binary
+     * from an earlier run to glProgramBinary. Returns false if the driver
+     * rejected it, in which case the program should be built as normal */
+    bool _link_from_binary();
+
     ProgramLinkedSignal& signal_linked() { return signal_linked_; }
     ShaderCompiledSignal& signal_shader_compiled() { return signal_shader_compiled_; }
 
@@ -126,6 +150,23 @@ public:
     void set_uniform_colour(const std::string& uniform_name, const Colour& values);
     void set_uniform_mat4x4_array(const std::string& uniform_name, const std::vector<Mat4>& matrices);
 
+    bool has_auto_uniform(ShaderAvailableAuto uniform) const {
+        return auto_uniforms_[uniform].location > -1;
+    }
+
+    GLint auto_uniform_location(ShaderAvailableAuto uniform) const {
+        return auto_uniforms_[uniform].location;
+    }
+
+    /* These do nothing if the program doesn't use the uniform, or if it
+     * was last set to the same value */
+    void set_auto_uniform_int(ShaderAvailableAuto uniform, const int32_t value);
+    void set_auto_uniform_float(ShaderAvailableAuto uniform, const float value);
+    void set_auto_uniform_vec4(ShaderAvailableAuto uniform, const Vec4& values);
+    void set_auto_uniform_colour(ShaderAvailableAuto uniform, const Colour& values);
+    void set_auto_uniform_mat3x3(ShaderAvailableAuto uniform, const Mat3& values);
+    void set_auto_uniform_mat4x4(ShaderAvailableAuto uniform, const Mat4& values);
+
     void relink() {
         if(needs_relink_) {
             link();
@@ -171,6 +212,11 @@ private:
     std::unordered_map<std::string, GLint> uniform_cache_;
     std::unordered_map<std::string, int32_t> attribute_cache_;
 
+    std::array<AutoUniform, SP_AUTO_MAX> auto_uniforms_;
+    void rebuild_auto_uniforms();
+    void forget_auto_uniform_value(GLint location);
+    bool update_auto_uniform(ShaderAvailableAuto uniform, const void* value, std::size_t size);
+
     void link(bool force=false);
 
     uint32_t renderer_id_ = 0;
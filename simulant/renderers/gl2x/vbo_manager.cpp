@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
 #include "vbo_manager.h"
+#include "../../application.h"
+#include "../../stats_recorder.h"
 
 namespace smlt {
 
@@ -10,17 +16,87 @@ void GPUBuffer::bind_vbos() {
 }
 
 void VBOManager::on_index_data_destroyed(IndexData* index_data) {
+    index_streams_.erase(index_data->uuid());
     release_slot(index_data);
 }
 
 void VBOManager::on_vertex_data_destroyed(VertexData* vertex_data) {
+    vertex_streams_.erase(vertex_data->uuid());
     release_slot(vertex_data);
 }
 
+StreamingVBO* VBOManager::streaming_vbo(GLenum target) {
+    auto& vbo = (target == GL_ARRAY_BUFFER) ? streaming_vertex_vbo_ : streaming_index_vbo_;
+    if(!vbo) {
+        vbo = StreamingVBO::create(target, STREAMING_VBO_SIZE, map_buffer_range_);
+    }
+
+    return vbo.get();
+}
+
+template<typename Data>
+bool VBOManager::should_stream(const Data* data, StreamState& state) {
+    /* Only data that would otherwise go in a SharedVBO is streamed */
+    if(data->data_size() >= VBO_MAX_SHARED_SIZE) {
+        return false;
+    }
+
+    if(state.last_changed_frame + 1 == frame_) {
+        ++state.changed_frames;
+    } else if(state.last_changed_frame != frame_ || !state.changed_frames) {
+        state.changed_frames = 1;
+    }
+
+    state.last_changed_frame = frame_;
+    return state.changed_frames >= STREAMING_THRESHOLD_FRAMES;
+}
+
+template<typename Data>
+std::pair<VBO*, VBOSlot> VBOManager::stream(const Data* data, StreamState& state, StreamingVBO* vbo) {
+    /* Data has to be written again if it changed, or if the
+     * buffer has wrapped since it was last written */
+    bool changed = data->last_updated() != state.last_updated;
+    if(changed || state.generation != vbo->generation()) {
+        auto size = data->data_size();
+
+        state.offset = vbo->write(data->data(), size);
+        state.generation = vbo->generation();
+        state.last_updated = data->last_updated();
+
+        auto app = get_app();
+        if(app) {
+            app->stats->increment_bytes_streamed(size);
+
+            if(changed) {
+                app->stats->increment_streamed_updates();
+            }
+        }
+    }
+
+    vbo->bind(state.offset);
+    return std::make_pair((VBO*) vbo, state.offset);
+}
+
 template<typename Data>
-std::pair<VBO*, VBOSlot> VBOManager::perform_fetch_or_upload(const Data* vdata, VBOManager::DedicatedMap& dedicated_vbos, VBOManager::SlotMap& data_slots) {
+std::pair<VBO*, VBOSlot> VBOManager::perform_fetch_or_upload(const Data* vdata, VBOManager::DedicatedMap& dedicated_vbos, VBOManager::SlotMap& data_slots, VBOManager::StreamMap& streams, GLenum target) {
     uuid64 vid = vdata->uuid();
 
+    /* Data which is rewritten every frame lives in the streaming VBO until it settles down */
+    auto sit = streams.find(vid);
+    if(sit != streams.end() && sit->second.is_streamed) {
+        auto& state = sit->second;
+        if(vdata->last_updated() != state.last_updated) {
+            state.last_changed_frame = frame_;
+        }
+
+        if(frame_ - state.last_changed_frame < STREAMING_IDLE_FRAMES &&
+           vdata->data_size() < VBO_MAX_SHARED_SIZE) {
+            return stream(vdata, state, streaming_vbo(target));
+        }
+
+        streams.erase(sit);
+    }
+
     auto vit = data_slots.find(vid);
 
     VBO* vvbo = nullptr;
@@ -48,8 +124,7 @@ std::pair<VBO*, VBOSlot> VBOManager::perform_fetch_or_upload(const Data* vdata,
         vslot = vit->second.second;
     }
 
-    if(vdata->data_size() > vvbo->slot_size_in_bytes()) {
-        /* Data size increased past the slot size, we need to free and reallocate */
+    if(vdata->data_size() > vvbo->slot_size_in_bytes(vslot)) {
         /* Data size increased past the slot size, we need to free and reallocate */
         release_slot(vdata);
         auto vpair = allocate_slot(vdata);
@@ -61,8 +136,20 @@ std::pair<VBO*, VBOSlot> VBOManager::perform_fetch_or_upload(const Data* vdata,
     // FIXME: What if the vertex buffer reduces in size to below the next slot, do we
     // bother reallocating?
 
-    if(vdata->last_updated() > vvbo->slot_last_updated(vslot)) {
+    if(!upload_vdata && vdata->last_updated() > vvbo->slot_last_updated(vslot)) {
         upload_vdata = true;
+
+        /* It's changed since it was uploaded, if that keeps happening
+         * then stop rewriting the slot and stream it instead. The destruction
+         * signal stays connected so the stream is released with the data */
+        auto& state = streams[vid];
+        if(should_stream(vdata, state)) {
+            vvbo->release_slot(vslot);
+            data_slots.erase(vid);
+
+            state.is_streamed = true;
+            return stream(vdata, state, streaming_vbo(target));
+        }
     }
 
     assert(vvbo);
@@ -78,7 +165,9 @@ std::pair<VBO*, VBOSlot> VBOManager::perform_fetch_or_upload(const Data* vdata,
 
 GPUBuffer VBOManager::update_and_fetch_buffers(const Renderable *renderable) {
     const auto& vdata = renderable->vertex_data;
-    auto vpair = perform_fetch_or_upload(vdata, dedicated_vertex_vbos_, vertex_data_slots_);
+    auto vpair = perform_fetch_or_upload(
+        vdata, dedicated_vertex_vbos_, vertex_data_slots_, vertex_streams_, GL_ARRAY_BUFFER
+    );
 
     assert(vpair.first->target() == GL_ARRAY_BUFFER);
 
@@ -88,7 +177,9 @@ GPUBuffer VBOManager::update_and_fetch_buffers(const Renderable *renderable) {
 
     if(renderable->index_data) {
         const auto& idata = renderable->index_data;
-        auto ipair = perform_fetch_or_upload(idata, dedicated_index_vbos_, index_data_slots_);
+        auto ipair = perform_fetch_or_upload(
+            idata, dedicated_index_vbos_, index_data_slots_, index_streams_, GL_ELEMENT_ARRAY_BUFFER
+        );
         assert(ipair.first->target() == GL_ELEMENT_ARRAY_BUFFER);
 
         buffer.index_vbo = ipair.first;
@@ -98,75 +189,112 @@ GPUBuffer VBOManager::update_and_fetch_buffers(const Renderable *renderable) {
     return buffer;
 }
 
-uint32_t VBOManager::dedicated_buffer_count() const {
-    return dedicated_index_vbos_.size() + dedicated_vertex_vbos_.size();
+void VBOManager::begin_frame() {
+    ++frame_;
+
+    for(auto& pair: shared_vertex_vbos_) {
+        compact(pair.second.get(), vertex_data_slots_);
+    }
+
+    for(auto& pair: shared_index_vbos_) {
+        compact(pair.second.get(), index_data_slots_);
+    }
 }
 
-VBOManager::~VBOManager() {
-    for(auto& pair: vdata_destruction_connections_) {
-        pair.second.disconnect();
+void VBOManager::compact(SharedVBO* vbo, SlotMap& data_slots) {
+    auto released = vbo->compact(VBO_COMPACTION_BYTES_PER_FRAME);
+    if(released.empty()) {
+        return;
     }
 
-    for(auto& pair: idata_destruction_connections_) {
-        pair.second.disconnect();
+    /* Forget where the data was, so it's allocated and uploaded again when
+     * it's next used. The destruction signals stay connected and are
+     * cleaned up as normal */
+    std::unordered_set<VBOSlot> slots(released.begin(), released.end());
+    for(auto it = data_slots.begin(); it != data_slots.end();) {
+        if(it->second.first == vbo && slots.count(it->second.second)) {
+            it = data_slots.erase(it);
+        } else {
+            ++it;
+        }
     }
 }
 
-VBOSlotSize VBOManager::calc_vbo_slot_size(uint32_t required_size_in_bytes) {
-    auto next_pow2 = [](uint32_t x) -> uint32_t {
-        uint32_t power = 1;
-        while(power < x)
-            power *= 2;
-        return power;
+VBOAllocationStats VBOManager::shared_buffer_stats() const {
+    VBOAllocationStats total;
+
+    auto accumulate = [&total](const SharedVBO* vbo) {
+        auto stats = vbo->stats();
+        total.buffer_count += stats.buffer_count;
+        total.buffer_bytes += stats.buffer_bytes;
+        total.used_block_count += stats.used_block_count;
+        total.used_bytes += stats.used_bytes;
+        total.free_block_count += stats.free_block_count;
+        total.free_bytes += stats.free_bytes;
+        total.largest_free_block = std::max(total.largest_free_block, stats.largest_free_block);
     };
 
-    VBOSlotSize size = VBO_SLOT_SIZE_1K;
+    for(auto& pair: shared_vertex_vbos_) {
+        accumulate(pair.second.get());
+    }
+
+    for(auto& pair: shared_index_vbos_) {
+        accumulate(pair.second.get());
+    }
 
-    auto check = next_pow2(required_size_in_bytes);
+    return total;
+}
 
-    assert(check <= (int) smlt::VBO_SLOT_SIZE_512K);
+uint32_t VBOManager::dedicated_buffer_count() const {
+    return dedicated_index_vbos_.size() + dedicated_vertex_vbos_.size();
+}
 
-    if(check <= (int) VBO_SLOT_SIZE_1K) {
-        size = VBO_SLOT_SIZE_1K;
-    } else {
-        size = (VBOSlotSize) check;
+bool VBOManager::is_streamed(const VertexData* vertex_data) const {
+    auto it = vertex_streams_.find(vertex_data->uuid());
+    return it != vertex_streams_.end() && it->second.is_streamed;
+}
+
+bool VBOManager::is_streamed(const IndexData* index_data) const {
+    auto it = index_streams_.find(index_data->uuid());
+    return it != index_streams_.end() && it->second.is_streamed;
+}
+
+VBOManager::~VBOManager() {
+    for(auto& pair: vdata_destruction_connections_) {
+        pair.second.disconnect();
     }
 
-    return size;
+    for(auto& pair: idata_destruction_connections_) {
+        pair.second.disconnect();
+    }
 }
 
 std::pair<VBO *, VBOSlot> VBOManager::allocate_slot(const VertexData *vertex_data) {
     auto required_size = vertex_data->data_size();
     auto spec = vertex_data->vertex_specification();
 
-    if(required_size >= int(VBO_SLOT_SIZE_512K)) {
+    if(required_size >= VBO_MAX_SHARED_SIZE) {
         /* Use a dedicated VBO */
         auto pair = std::make_pair(vertex_data->uuid(), DedicatedVBO::create(required_size, spec));
         dedicated_vertex_vbos_.insert(pair);
 
         connect_destruction_signal(vertex_data);
 
-        auto vpair = std::make_pair(pair.second.get(), pair.second->allocate_slot());
+        auto vpair = std::make_pair(pair.second.get(), pair.second->allocate_slot(required_size));
         vertex_data_slots_.insert(std::make_pair(vertex_data->uuid(), vpair));
         return vpair;
     } else {
-        /* Use one of the shared VBOs */
-        auto size = calc_vbo_slot_size(required_size);
-
-        auto idx = log2(int(size)) - 10; // Convert enum value to index
-        auto& entry = shared_vertex_vbos_[idx];
-        auto it = entry.find(spec);
-        if(it == entry.end()) {
+        /* Use the shared VBO for this vertex specification */
+        auto it = shared_vertex_vbos_.find(spec);
+        if(it == shared_vertex_vbos_.end()) {
             // Create new VBO
-            auto new_vbo = SharedVBO::create(size, spec);
-            entry.insert(std::make_pair(spec, new_vbo));
-            it = entry.find(spec);
+            it = shared_vertex_vbos_.insert(std::make_pair(spec, SharedVBO::create(spec))).first;
         }
 
         connect_destruction_signal(vertex_data);
 
         VBO* vbo = it->second.get();
-        auto vpair = std::make_pair(vbo, vbo->allocate_slot());
+        auto vpair = std::make_pair(vbo, vbo->allocate_slot(required_size));
         vertex_data_slots_.insert(std::make_pair(vertex_data->uuid(), vpair));
         return vpair;
     }
@@ -210,34 +338,28 @@ std::pair<VBO *, VBOSlot> VBOManager::allocate_slot(const IndexData *index_data)
     auto required_size = index_data->data_size();
     auto index_type = index_data->index_type();
 
-    if(required_size >= int(VBO_SLOT_SIZE_512K)) {
+    if(required_size >= VBO_MAX_SHARED_SIZE) {
         /* Use a dedicated VBO */
         auto pair = std::make_pair(index_data->uuid(), DedicatedVBO::create(required_size, index_type));
         dedicated_index_vbos_.insert(pair);
 
         connect_destruction_signal(index_data);
 
-        auto ipair = std::make_pair(pair.second.get(), pair.second->allocate_slot());
+        auto ipair = std::make_pair(pair.second.get(), pair.second->allocate_slot(required_size));
         index_data_slots_.insert(std::make_pair(index_data->uuid(), ipair));
         return ipair;
     } else {
-        /* Use one of the shared VBOs */
-        auto size = calc_vbo_slot_size(required_size);
-
-        auto idx = log2(int(size)) - 10; // Convert enum value to index
-        auto& entry = shared_index_vbos_[idx];
-        auto it = entry.find(index_type);
-        if(it == entry.end()) {
+        /* Use the shared VBO for this index type */
+        auto it = shared_index_vbos_.find(index_type);
+        if(it == shared_index_vbos_.end()) {
             // Create new VBO
-            auto new_vbo = SharedVBO::create(size, index_type);
-            entry.insert(std::make_pair(index_type, new_vbo));
-            it = entry.find(index_type);
+            it = shared_index_vbos_.insert(std::make_pair(index_type, SharedVBO::create(index_type))).first;
         }
 
         connect_destruction_signal(index_data);
 
         VBO* vbo = it->second.get();
-        auto ipair = std::make_pair(vbo, vbo->allocate_slot());
+        auto ipair = std::make_pair(vbo, vbo->allocate_slot(required_size));
         index_data_slots_.insert(std::make_pair(index_data->uuid(), ipair));
         return ipair;
     }
@@ -291,52 +413,384 @@ void VBOManager::connect_destruction_signal(const IndexData* vdata) {
     ));
 }
 
-VBOSlot SharedVBO::allocate_slot() {
-    if(!free_slots_.empty()) {
-        VBOSlot slot = free_slots_.front();
-        free_slots_.pop();
+const uint32_t SharedVBO::NO_BLOCK;
+const uint32_t SharedVBO::NO_BUFFER;
 
-        L_DEBUG_VBO(_F("Grabbed existing free slot {0}").format(slot));
-        return slot;
-    } else {
-        // Allocate a new GL buffer
-        // which creates new free slots
+SharedVBO::SharedVBO(VertexSpecification spec):
+    spec_(spec),
+    type_(GL_ARRAY_BUFFER) {
+
+    for(auto& lists: free_lists_) {
+        lists.fill(NO_BLOCK);
+    }
+}
+
+SharedVBO::SharedVBO(IndexType type):
+    index_type_(type),
+    type_(GL_ELEMENT_ARRAY_BUFFER) {
+
+    for(auto& lists: free_lists_) {
+        lists.fill(NO_BLOCK);
+    }
+}
+
+SharedVBO::~SharedVBO() {
+    try {
+        for(auto& buffer: buffers_) {
+            if(buffer.gl_id) glDeleteBuffers(1, &buffer.gl_id);
+        }
+    } catch(...) {
+        S_WARN("Exception while deleting GL VBO");
+    }
+}
+
+void SharedVBO::mapping(uint32_t size, uint32_t& fl, uint32_t& sl) {
+    assert(size >= SL_COUNT);
+
+    fl = 31 - __builtin_clz(size);
+    sl = (size >> (fl - SL_LOG2)) ^ SL_COUNT;
+}
+
+uint32_t SharedVBO::new_block() {
+    if(!unused_blocks_.empty()) {
+        auto block = unused_blocks_.back();
+        unused_blocks_.pop_back();
+        blocks_[block] = Block();
+        return block;
+    }
+
+    blocks_.push_back(Block());
+    return blocks_.size() - 1;
+}
+
+void SharedVBO::insert_free_block(uint32_t b) {
+    auto& block = blocks_[b];
+    assert(!block.is_free);
+
+    block.is_free = true;
+    ++free_block_count_;
+
+    /* Nothing new is allocated from a buffer which is being emptied */
+    if(block.buffer == draining_buffer_) {
+        return;
+    }
+
+    uint32_t fl, sl;
+    mapping(block.size, fl, sl);
+
+    block.prev_free = NO_BLOCK;
+    block.next_free = free_lists_[fl][sl];
+    block.in_free_list = true;
+
+    if(block.next_free != NO_BLOCK) {
+        blocks_[block.next_free].prev_free = b;
+    }
+
+    free_lists_[fl][sl] = b;
+    fl_bitmap_ |= (1u << fl);
+    sl_bitmaps_[fl] |= (1u << sl);
+}
+
+void SharedVBO::remove_free_block(uint32_t b) {
+    auto& block = blocks_[b];
+    assert(block.is_free);
+
+    if(block.in_free_list) {
+        uint32_t fl, sl;
+        mapping(block.size, fl, sl);
+
+        if(block.prev_free != NO_BLOCK) {
+            blocks_[block.prev_free].next_free = block.next_free;
+        } else {
+            free_lists_[fl][sl] = block.next_free;
+            if(block.next_free == NO_BLOCK) {
+                sl_bitmaps_[fl] &= ~(1u << sl);
+                if(!sl_bitmaps_[fl]) {
+                    fl_bitmap_ &= ~(1u << fl);
+                }
+            }
+        }
+
+        if(block.next_free != NO_BLOCK) {
+            blocks_[block.next_free].prev_free = block.prev_free;
+        }
+
+        block.prev_free = block.next_free = NO_BLOCK;
+        block.in_free_list = false;
+    }
+
+    block.is_free = false;
+    --free_block_count_;
+}
+
+uint32_t SharedVBO::find_free_block(uint32_t size) {
+    /* Round up to the start of the next list, so that any block
+     * in the list we pick is big enough */
+    uint32_t top = 31 - __builtin_clz(size);
+    size += (1u << (top - SL_LOG2)) - 1;
+
+    uint32_t fl, sl;
+    mapping(size, fl, sl);
+
+    uint32_t sl_map = sl_bitmaps_[fl] & (~0u << sl);
+    if(!sl_map) {
+        /* Nothing in this size range, so use the smallest larger one */
+        uint32_t fl_map = (fl + 1 < FL_COUNT) ? fl_bitmap_ & (~0u << (fl + 1)) : 0;
+        if(!fl_map) {
+            return NO_BLOCK;
+        }
+
+        fl = __builtin_ctz(fl_map);
+        sl_map = sl_bitmaps_[fl];
+    }
+
+    sl = __builtin_ctz(sl_map);
+    return free_lists_[fl][sl];
+}
+
+void SharedVBO::merge_free_block(uint32_t b) {
+    /* Absorb the following block if it's free */
+    auto next = blocks_[b].next_physical;
+    if(next != NO_BLOCK && blocks_[next].is_free) {
+        remove_free_block(next);
+
+        blocks_[b].size += blocks_[next].size;
+        blocks_[b].next_physical = blocks_[next].next_physical;
+        if(blocks_[b].next_physical != NO_BLOCK) {
+            blocks_[blocks_[b].next_physical].prev_physical = b;
+        }
+
+        unused_blocks_.push_back(next);
+    }
+
+    /* Then be absorbed by the preceding block if that's free */
+    auto prev = blocks_[b].prev_physical;
+    if(prev != NO_BLOCK && blocks_[prev].is_free) {
+        remove_free_block(prev);
+
+        blocks_[prev].size += blocks_[b].size;
+        blocks_[prev].next_physical = blocks_[b].next_physical;
+        if(blocks_[prev].next_physical != NO_BLOCK) {
+            blocks_[blocks_[prev].next_physical].prev_physical = prev;
+        }
+
+        unused_blocks_.push_back(b);
+        b = prev;
+    }
+
+    insert_free_block(b);
+}
+
+VBOSlot SharedVBO::allocate_slot(uint32_t size) {
+    assert(size <= VBO_SIZE);
+
+    size = std::max(size, 1u);
+    size = (size + VBO_ALIGNMENT - 1) & ~(VBO_ALIGNMENT - 1);
+
+    auto b = find_free_block(size);
+    if(b == NO_BLOCK) {
+        // Allocate a new GL buffer, which
+        // creates a new free block
         allocate_new_gl_buffer();
 
-        // Recurse
-        return allocate_slot();
+        b = find_free_block(size);
+        assert(b != NO_BLOCK);
+    }
+
+    remove_free_block(b);
+
+    /* Split off the space we don't need, if it's worth keeping */
+    if(blocks_[b].size - size >= VBO_MIN_BLOCK_SIZE) {
+        auto r = new_block();
+
+        auto& block = blocks_[b];
+        auto& rest = blocks_[r];
+
+        rest.buffer = block.buffer;
+        rest.offset = block.offset + size;
+        rest.size = block.size - size;
+        rest.prev_physical = b;
+        rest.next_physical = block.next_physical;
+
+        if(rest.next_physical != NO_BLOCK) {
+            blocks_[rest.next_physical].prev_physical = r;
+        }
+
+        block.next_physical = r;
+        block.size = size;
+
+        insert_free_block(r);
     }
+
+    auto& block = blocks_[b];
+    block.last_updated = 0;
+
+    auto& buffer = buffers_[block.buffer];
+    buffer.used_bytes += block.size;
+    ++buffer.used_blocks;
+    ++used_block_count_;
+
+    L_DEBUG_VBO(_F("Allocated slot {0} ({1} bytes)").format(b, block.size));
+    return b;
 }
 
 void SharedVBO::release_slot(VBOSlot slot) {
     L_DEBUG_VBO(_F("Releasing slot {0}").format(slot));
-    free_slots_.push(slot);
+
+    assert(slot < blocks_.size());
+    assert(!blocks_[slot].is_free);
+
+    auto& buffer = buffers_[blocks_[slot].buffer];
+    buffer.used_bytes -= blocks_[slot].size;
+    --buffer.used_blocks;
+    --used_block_count_;
+
+    merge_free_block(slot);
+}
+
+VBOAllocationStats SharedVBO::stats() const {
+    VBOAllocationStats stats;
+    stats.used_block_count = used_block_count_;
+    stats.free_block_count = free_block_count_;
+
+    for(auto& buffer: buffers_) {
+        if(!buffer.gl_id) {
+            continue;
+        }
+
+        ++stats.buffer_count;
+        stats.buffer_bytes += VBO_SIZE;
+        stats.used_bytes += buffer.used_bytes;
+
+        for(auto b = buffer.first_block; b != NO_BLOCK; b = blocks_[b].next_physical) {
+            auto& block = blocks_[b];
+            if(block.is_free) {
+                stats.free_bytes += block.size;
+                stats.largest_free_block = std::max<uint64_t>(stats.largest_free_block, block.size);
+            }
+        }
+    }
+
+    return stats;
+}
+
+void SharedVBO::set_draining_buffer(uint32_t buffer) {
+    auto previous = draining_buffer_;
+    draining_buffer_ = buffer;
+
+    /* Reinserting a free block puts it into, or takes it out of, the free lists */
+    auto refresh = [this](uint32_t buffer) {
+        for(auto b = buffers_[buffer].first_block; b != NO_BLOCK; b = blocks_[b].next_physical) {
+            if(blocks_[b].is_free) {
+                remove_free_block(b);
+                insert_free_block(b);
+            }
+        }
+    };
+
+    if(previous != NO_BUFFER && buffers_[previous].gl_id) {
+        refresh(previous);
+    }
+
+    if(buffer != NO_BUFFER) {
+        refresh(buffer);
+    }
+}
+
+std::vector<VBOSlot> SharedVBO::compact(uint32_t max_bytes) {
+    std::vector<VBOSlot> released;
+
+    /* Delete any empty buffers, as long as there's one left to allocate from */
+    uint32_t live = 0;
+    for(auto& buffer: buffers_) {
+        live += (buffer.gl_id) ? 1 : 0;
+    }
+
+    for(uint32_t i = 0; i < buffers_.size() && live > 1; ++i) {
+        if(buffers_[i].gl_id && !buffers_[i].used_blocks) {
+            release_gl_buffer(i);
+            --live;
+        }
+    }
+
+    if(live < 2) {
+        if(is_compacting()) {
+            set_draining_buffer(NO_BUFFER);
+        }
+
+        return released;
+    }
+
+    if(!is_compacting()) {
+        /* Empty the least used buffer, if it's at most half full and everything
+         * in it would comfortably fit in the free space of the others */
+        uint32_t candidate = NO_BUFFER;
+        uint64_t free_bytes = 0;
+
+        for(uint32_t i = 0; i < buffers_.size(); ++i) {
+            if(!buffers_[i].gl_id) {
+                continue;
+            }
+
+            free_bytes += VBO_SIZE - buffers_[i].used_bytes;
+            if(candidate == NO_BUFFER || buffers_[i].used_bytes < buffers_[candidate].used_bytes) {
+                candidate = i;
+            }
+        }
+
+        uint64_t used = buffers_[candidate].used_bytes;
+        uint64_t free_elsewhere = free_bytes - (VBO_SIZE - used);
+        if(used > VBO_SIZE / 2 || free_elsewhere < used * 2) {
+            return released;
+        }
+
+        L_DEBUG_VBO(_F("Compacting buffer {0} ({1} bytes used)").format(candidate, used));
+        set_draining_buffer(candidate);
+    }
+
+    /* Releasing a block only ever merges it with free neighbours, so the
+     * allocated blocks we collect here stay valid while we release them */
+    uint32_t moved = 0;
+    auto& buffer = buffers_[draining_buffer_];
+    for(auto b = buffer.first_block; b != NO_BLOCK && moved < max_bytes; b = blocks_[b].next_physical) {
+        if(!blocks_[b].is_free) {
+            moved += blocks_[b].size;
+            released.push_back(b);
+        }
+    }
+
+    for(auto slot: released) {
+        release_slot(slot);
+    }
+
+    if(!buffers_[draining_buffer_].used_blocks) {
+        release_gl_buffer(draining_buffer_);
+    }
+
+    return released;
 }
 
 void SharedVBO::upload(VBOSlot slot, const VertexData *vertex_data) {
-    const int SLOTS_PER_BUFFER = (VBO_SIZE / slot_size_in_bytes_);
-    uint32_t offset = (slot % SLOTS_PER_BUFFER) * slot_size_in_bytes_;
+    assert(vertex_data->data_size() <= blocks_[slot].size);
 
     bind(slot);
-    GLCheck(glBufferSubData, type_, offset, vertex_data->data_size(), vertex_data->data());
+    GLCheck(glBufferSubData, type_, blocks_[slot].offset, vertex_data->data_size(), vertex_data->data());
 
-    metas_[slot].last_updated = TimeKeeper::now_in_us();
+    blocks_[slot].last_updated = vertex_data->last_updated();
 }
 
 void SharedVBO::upload(VBOSlot slot, const IndexData *index_data) {
-    const int SLOTS_PER_BUFFER = (VBO_SIZE / slot_size_in_bytes_);
-    uint32_t offset = (slot % SLOTS_PER_BUFFER) * slot_size_in_bytes_;
+    assert(index_data->data_size() <= blocks_[slot].size);
 
     bind(slot);
 
-    GLCheck(glBufferSubData, type_, offset, index_data->data_size(), index_data->data());
+    GLCheck(glBufferSubData, type_, blocks_[slot].offset, index_data->data_size(), index_data->data());
 
-    metas_[slot].last_updated = TimeKeeper::now_in_us();
+    blocks_[slot].last_updated = index_data->last_updated();
 }
 
 void SharedVBO::bind(VBOSlot slot) {
-    const int SLOTS_PER_BUFFER = (VBO_SIZE / slot_size_in_bytes_);
-    GLuint vbo_id = gl_ids_[slot / SLOTS_PER_BUFFER];
+    GLuint vbo_id = buffers_[blocks_[slot].buffer].gl_id;
 
     GLCheck(glBindBuffer, type_, vbo_id);
 }
@@ -344,13 +798,13 @@ void SharedVBO::bind(VBOSlot slot) {
 void DedicatedVBO::upload(VBOSlot, const VertexData* vertex_data) {
     bind(0);
     GLCheck(glBufferData, type_, vertex_data->data_size(), vertex_data->data(), GL_STATIC_DRAW);
-    last_updated_ = TimeKeeper::now_in_us();
+    last_updated_ = vertex_data->last_updated();
 }
 
 void DedicatedVBO::upload(VBOSlot, const IndexData* index_data) {
     bind(0);
     GLCheck(glBufferData, type_, index_data->data_size(), index_data->data(), GL_STATIC_DRAW);
-    last_updated_ = TimeKeeper::now_in_us();
+    last_updated_ = index_data->last_updated();
 }
 
 void DedicatedVBO::bind(VBOSlot) {
@@ -361,7 +815,7 @@ void DedicatedVBO::bind(VBOSlot) {
     GLCheck(glBindBuffer, type_, gl_id_);
 }
 
-VBOSlot DedicatedVBO::allocate_slot() {
+VBOSlot DedicatedVBO::allocate_slot(uint32_t) {
     assert(!allocated_);
     allocated_ = true;
     return 0;
@@ -375,16 +829,91 @@ void DedicatedVBO::release_slot(VBOSlot slot) {
     // FIXME? Should we delete the GL buffer here?
 }
 
+VBOSlot StreamingVBO::write(const uint8_t* data, uint32_t size) {
+    assert(size <= size_in_bytes_);
+
+    /* Keep everything aligned for whatever attribute or index type is read from it */
+    const uint32_t alignment = 16;
+    uint32_t offset = (head_ + alignment - 1) & ~(alignment - 1);
+
+    if(!gl_id_ || offset + size > size_in_bytes_) {
+        orphan();
+        offset = 0;
+    }
+
+    if(size) {
+        write_at(offset, data, size);
+    }
+
+    head_ = offset + size;
+    ++write_count_;
+    return offset;
+}
+
+void StreamingVBO::write_at(VBOSlot offset, const uint8_t* data, uint32_t size) {
+    bind(offset);
+
+    if(map_buffer_range_) {
+        void* dest = map_buffer_range_(
+            type_, offset, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+        );
+
+        if(dest) {
+            std::memcpy(dest, data, size);
+            if(glUnmapBuffer(type_)) {
+                return;
+            }
+
+            /* The contents were lost (e.g. a mode switch), fall
+             * back to a normal write */
+        }
+    }
+
+    GLCheck(glBufferSubData, type_, offset, size, data);
+}
+
+void StreamingVBO::orphan() {
+    /* Allocating new storage leaves the old storage with the driver until
+     * any draws using it have finished, so this doesn't wait on the GPU */
+    bind(0);
+    GLCheck(glBufferData, type_, size_in_bytes_, nullptr, GL_STREAM_DRAW);
+
+    head_ = 0;
+    write_count_ = 0;
+    ++generation_;
+}
+
+void StreamingVBO::upload(VBOSlot slot, const VertexData* vertex_data) {
+    write_at(slot, vertex_data->data(), vertex_data->data_size());
+}
+
+void StreamingVBO::upload(VBOSlot slot, const IndexData* index_data) {
+    write_at(slot, index_data->data(), index_data->data_size());
+}
+
+void StreamingVBO::bind(VBOSlot) {
+    if(!gl_id_) {
+        GLCheck(glGenBuffers, 1, &gl_id_);
+    }
+
+    GLCheck(glBindBuffer, type_, gl_id_);
+}
+
+VBOSlot StreamingVBO::allocate_slot(uint32_t) {
+    throw std::logic_error("Streaming VBOs don't have slots, use write() instead");
+}
+
 void SharedVBO::allocate_new_gl_buffer() {
-    /* Create a new GL VBO, then push back the
-         * free slot IDS */
+    /* Create a new GL VBO, then add a
+     * free block covering all of it */
 
     L_DEBUG_VBO(_F("Allocating new GL buffer for target {0}").format(type_));
 
-    GLuint buffer;
+    GLuint gl_id;
 
-    GLCheck(glGenBuffers, 1, &buffer);
-    GLCheck(glBindBuffer, type_, buffer);
+    GLCheck(glGenBuffers, 1, &gl_id);
+    GLCheck(glBindBuffer, type_, gl_id);
 
     // Upload VBO_SIZE of zeros so we an use buffersubdata afterwards
     std::vector<uint8_t> init_data(VBO_SIZE, 0);
@@ -392,19 +921,46 @@ void SharedVBO::allocate_new_gl_buffer() {
     /* FIXME: usage needs to change based on, well usage */
     GLCheck(glBufferData, type_, VBO_SIZE, &init_data[0], GL_DYNAMIC_DRAW);
 
-    const auto slots_per_buffer = VBO_SIZE / slot_size_;
-
-    /* Push new meta data for each slot */
-    metas_.resize((gl_ids_.size() + 1) * slots_per_buffer);
+    /* Reuse the entry of a buffer that was deleted by compaction */
+    uint32_t index = 0;
+    while(index < buffers_.size() && buffers_[index].gl_id) {
+        ++index;
+    }
 
-    /* Push new free slots */
-    auto offset = gl_ids_.size() * slots_per_buffer;
-    for(VBOSlot i = 0; i < slots_per_buffer; ++i) {
-        free_slots_.push(offset + i);
+    if(index == buffers_.size()) {
+        buffers_.push_back(Buffer());
     }
 
-    /* Store the new VBO ID */
-    gl_ids_.push_back(buffer);
+    auto b = new_block();
+    blocks_[b].buffer = index;
+    blocks_[b].offset = 0;
+    blocks_[b].size = VBO_SIZE;
+
+    buffers_[index] = Buffer();
+    buffers_[index].gl_id = gl_id;
+    buffers_[index].first_block = b;
+
+    insert_free_block(b);
+}
+
+void SharedVBO::release_gl_buffer(uint32_t index) {
+    auto& buffer = buffers_[index];
+    assert(!buffer.used_blocks);
+
+    L_DEBUG_VBO(_F("Releasing GL buffer {0} for target {1}").format(index, type_));
+
+    auto b = buffer.first_block;
+    assert(blocks_[b].is_free && blocks_[b].size == VBO_SIZE);
+
+    remove_free_block(b);
+    unused_blocks_.push_back(b);
+
+    GLCheck(glDeleteBuffers, 1, &buffer.gl_id);
+    buffer = Buffer();
+
+    if(draining_buffer_ == index) {
+        draining_buffer_ = NO_BUFFER;
+    }
 }
 
 }
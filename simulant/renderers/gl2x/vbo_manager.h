@@ -3,7 +3,7 @@
 #include <cstdint>
 #include <array>
 #include <unordered_map>
-#include <queue>
+#include <vector>
 
 #include "../../meshes/mesh.h"
 #include "../../generic/managed.h"
@@ -23,8 +23,33 @@
 
 namespace smlt {
 
-/* The size of VBO to allocate */
-const uint32_t VBO_SIZE = 1024 * 512;
+/* The size of each GL buffer that SharedVBO allocations are carved out of */
+const uint32_t VBO_SIZE = 1024 * 1024;
+
+/* Data this size or larger gets a DedicatedVBO of its own */
+const uint32_t VBO_MAX_SHARED_SIZE = 1024 * 512;
+
+/* Allocations within a SharedVBO start on this alignment, and leftover space
+ * smaller than VBO_MIN_BLOCK_SIZE stays with the allocation rather than being
+ * split off into a free block too small to be useful */
+const uint32_t VBO_ALIGNMENT = 16;
+const uint32_t VBO_MIN_BLOCK_SIZE = 256;
+
+/* The most data that's moved out of a sparsely used SharedVBO buffer each
+ * frame while compacting. Moved data is uploaded again when it's next drawn */
+const uint32_t VBO_COMPACTION_BYTES_PER_FRAME = 1024 * 256;
+
+/* The size of the ring buffers that dynamic data is streamed into. This
+ * needs to hold a few frames worth of particles, sprites, text etc. */
+const uint32_t STREAMING_VBO_SIZE = 1024 * 1024 * 4;
+
+/* Data which changes this many frames in a row is streamed rather
+ * than being rewritten into its slot */
+const uint32_t STREAMING_THRESHOLD_FRAMES = 3;
+
+/* Streamed data which hasn't changed for this many frames goes back
+ * into a SharedVBO slot */
+const uint32_t STREAMING_IDLE_FRAMES = 60;
 
 typedef uint32_t VBOSlot;
 
@@ -42,20 +67,23 @@ struct GPUBuffer {
     void bind_vbos();
 };
 
-enum VBOSlotSize {
-    VBO_SLOT_SIZE_1K = (1 << 10),
-    VBO_SLOT_SIZE_2K = (1 << 11),
-    VBO_SLOT_SIZE_4K = (1 << 12),
-    VBO_SLOT_SIZE_8K = (1 << 13),
-    VBO_SLOT_SIZE_16K = (1 << 14),
-    VBO_SLOT_SIZE_32K = (1 << 15),
-    VBO_SLOT_SIZE_64K = (1 << 16),
-    VBO_SLOT_SIZE_128K = (1 << 17),
-    VBO_SLOT_SIZE_256K = (1 << 18),
-    VBO_SLOT_SIZE_512K = (1 << 19)
-};
+struct VBOAllocationStats {
+    uint32_t buffer_count = 0;
+    uint64_t buffer_bytes = 0;
+
+    uint32_t used_block_count = 0;
+    uint64_t used_bytes = 0;
+
+    uint32_t free_block_count = 0;
+    uint64_t free_bytes = 0;
+    uint64_t largest_free_block = 0;
 
-const int VBO_SLOT_SIZE_COUNT = 11;
+    /* 0 when all the free space is in a single block, approaching 1 as
+     * it's split into more (and smaller) pieces */
+    float fragmentation() const {
+        return (free_bytes) ? 1.0f - (float(largest_free_block) / float(free_bytes)) : 0.0f;
+    }
+};
 
 class VBO {
 public:
@@ -67,9 +95,9 @@ public:
     virtual void bind(VBOSlot) = 0;
     virtual uint64_t slot_last_updated(VBOSlot slot) = 0;
     virtual uint32_t byte_offset(VBOSlot slot) = 0;
-    virtual uint32_t slot_size_in_bytes() const = 0;
+    virtual uint32_t slot_size_in_bytes(VBOSlot slot) const = 0;
 
-    virtual VBOSlot allocate_slot() = 0;
+    virtual VBOSlot allocate_slot(uint32_t size) = 0;
     virtual void release_slot(VBOSlot slot) = 0;
 
     virtual uint32_t used_slot_count() const = 0;
@@ -111,11 +139,11 @@ public:
         return 0;
     }
 
-    uint32_t slot_size_in_bytes() const {
+    uint32_t slot_size_in_bytes(VBOSlot) const {
         return size_in_bytes_;
     }
 
-    VBOSlot allocate_slot();
+    VBOSlot allocate_slot(uint32_t size);
     void release_slot(VBOSlot slot);
 
     uint32_t used_slot_count() const {
@@ -136,31 +164,31 @@ private:
     GLuint gl_id_ = 0;
 };
 
+/*
+ * Sub-allocates data for a single vertex specification (or index type) out of
+ * VBO_SIZE GL buffers, using a two-level segregated fit (TLSF) allocator. Sizes
+ * are only rounded up to VBO_ALIGNMENT, freed blocks are merged with their free
+ * neighbours, and a good fit is found in constant time.
+ *
+ * Slots are block indexes, and stay valid until they're released.
+ */
 class SharedVBO:
     public RefCounted<SharedVBO>,
     public VBO {
 
 public:
-    SharedVBO(VBOSlotSize slot_size, VertexSpecification spec):
-        slot_size_(slot_size),
-        slot_size_in_bytes_(int(slot_size)),
-        spec_(spec),
-        type_(GL_ARRAY_BUFFER) {}
-
-    SharedVBO(VBOSlotSize slot_size, IndexType type):
-        slot_size_(slot_size),
-        slot_size_in_bytes_(int(slot_size)),
-        index_type_(type),
-        type_(GL_ELEMENT_ARRAY_BUFFER) {}
+    SharedVBO(VertexSpecification spec);
+    SharedVBO(IndexType type);
+    ~SharedVBO();
 
     uint64_t slot_last_updated(VBOSlot slot) {
-        assert(slot < metas_.size());
-        return metas_[slot].last_updated;
+        assert(slot < blocks_.size());
+        return blocks_[slot].last_updated;
     }
 
     GLenum target() const { return type_; }
 
-    VBOSlot allocate_slot();
+    VBOSlot allocate_slot(uint32_t size);
 
     void release_slot(VBOSlot slot);
 
@@ -168,40 +196,170 @@ public:
     void upload(VBOSlot slot, const IndexData* index_data);
     void bind(VBOSlot slot);
 
-    VBOSlotSize slot_size() const { return slot_size_; }
-    uint32_t slot_size_in_bytes() const { return int(slot_size_); }
+    uint32_t slot_size_in_bytes(VBOSlot slot) const {
+        assert(slot < blocks_.size());
+        return blocks_[slot].size;
+    }
 
     uint32_t byte_offset(VBOSlot slot) {
-        const int SLOTS_PER_BUFFER = (VBO_SIZE / slot_size_in_bytes_);
-        return (slot % SLOTS_PER_BUFFER) * slot_size_in_bytes_;
+        assert(slot < blocks_.size());
+        return blocks_[slot].offset;
+    }
+
+    /* The GL buffer that the slot is in */
+    uint32_t buffer_index(VBOSlot slot) const {
+        assert(slot < blocks_.size());
+        return blocks_[slot].buffer;
     }
 
     uint32_t used_slot_count() const {
-        return metas_.size() - free_slots_.size();
+        return used_block_count_;
     }
 
     uint32_t free_slot_count() const {
-        return free_slots_.size();
+        return free_block_count_;
     }
 
+    VBOAllocationStats stats() const;
+
+    /* Empties sparsely used GL buffers a little at a time, so that the
+     * allocations in them can be packed into the others. Releases up to
+     * max_bytes of allocations and returns their slots, the data in them
+     * needs uploading again. GL buffers are deleted once they're empty. */
+    std::vector<VBOSlot> compact(uint32_t max_bytes);
+
+    bool is_compacting() const { return draining_buffer_ != NO_BUFFER; }
+
 private:
-    void allocate_new_gl_buffer();
+    static const uint32_t NO_BLOCK = ~0u;
+    static const uint32_t NO_BUFFER = ~0u;
+
+    /* Each first level list covers a power of two range of sizes,
+     * which is split linearly into SL_COUNT second level lists */
+    static const uint32_t SL_LOG2 = 3;
+    static const uint32_t SL_COUNT = 1 << SL_LOG2;
+    static const uint32_t FL_COUNT = 32;
+
+    struct Block {
+        uint32_t buffer = 0;
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        bool is_free = false;
+
+        /* Neighbours in the same GL buffer, by offset */
+        uint32_t prev_physical = NO_BLOCK;
+        uint32_t next_physical = NO_BLOCK;
+
+        /* Links in the free list for the block's size */
+        uint32_t prev_free = NO_BLOCK;
+        uint32_t next_free = NO_BLOCK;
+        bool in_free_list = false;
 
-    VBOSlotSize slot_size_;
-    uint32_t slot_size_in_bytes_;
+        uint64_t last_updated = 0;
+    };
+
+    struct Buffer {
+        GLuint gl_id = 0;
+        uint32_t used_bytes = 0;
+        uint32_t used_blocks = 0;
+
+        /* The block at offset zero, this is never merged into another */
+        uint32_t first_block = NO_BLOCK;
+    };
 
     VertexSpecification spec_;
     IndexType index_type_;
     GLenum type_;
-    std::queue<VBOSlot> free_slots_;
-    std::vector<GLuint> gl_ids_;
 
-    struct SlotMeta {
-        uint64_t last_updated = 0;
-        uint32_t uploaded_size = 0;
-    };
+    std::vector<Block> blocks_;
+    std::vector<uint32_t> unused_blocks_;
+
+    /* Deleted GL buffers leave an entry with a zero id, which is reused */
+    std::vector<Buffer> buffers_;
+    uint32_t draining_buffer_ = NO_BUFFER;
+
+    uint32_t fl_bitmap_ = 0;
+    std::array<uint32_t, FL_COUNT> sl_bitmaps_ = {{}};
+    std::array<std::array<uint32_t, SL_COUNT>, FL_COUNT> free_lists_;
+
+    uint32_t used_block_count_ = 0;
+    uint32_t free_block_count_ = 0;
+
+    static void mapping(uint32_t size, uint32_t& fl, uint32_t& sl);
+
+    uint32_t new_block();
+    void insert_free_block(uint32_t block);
+    void remove_free_block(uint32_t block);
+    uint32_t find_free_block(uint32_t size);
+    void merge_free_block(uint32_t block);
+    void set_draining_buffer(uint32_t buffer);
+    void allocate_new_gl_buffer();
+    void release_gl_buffer(uint32_t buffer);
+};
+
+/*
+ * A ring buffer for data which is rewritten every frame. Writes are appended
+ * linearly, and when the buffer fills up it's orphaned so that the driver can
+ * give us fresh storage while the GPU finishes with the old contents, rather
+ * than stalling. Where glMapBufferRange is available the data is written
+ * through an unsynchronized mapping, which is safe as nothing past the write
+ * position has been used since the buffer was last orphaned.
+ *
+ * The slot returned by write() is the byte offset of the data, and it's
+ * only valid until generation() changes.
+ */
+class StreamingVBO:
+    public RefCounted<StreamingVBO>,
+    public VBO {
+
+public:
+    StreamingVBO(GLenum target, uint32_t size, PFNGLMAPBUFFERRANGEPROC map_buffer_range=nullptr):
+        size_in_bytes_(size),
+        type_(target),
+        map_buffer_range_(map_buffer_range) {}
+
+    ~StreamingVBO() {
+        try {
+            if(gl_id_) glDeleteBuffers(1, &gl_id_);
+        } catch(...) {
+            S_WARN("Exception while deleting GL VBO");
+        }
+    }
+
+    GLenum target() const { return type_; }
+
+    VBOSlot write(const uint8_t* data, uint32_t size);
+
+    void upload(VBOSlot slot, const VertexData* vertex_data);
+    void upload(VBOSlot slot, const IndexData* index_data);
+    void bind(VBOSlot);
+
+    uint64_t slot_last_updated(VBOSlot) { return 0; }
+    uint32_t byte_offset(VBOSlot slot) { return slot; }
+    uint32_t slot_size_in_bytes(VBOSlot) const { return size_in_bytes_; }
+
+    /* Space is reclaimed when the buffer wraps, there are no slots as such */
+    VBOSlot allocate_slot(uint32_t size);
+    void release_slot(VBOSlot) {}
+
+    uint32_t used_slot_count() const { return write_count_; }
+    uint32_t free_slot_count() const { return 0; }
+
+    /* Incremented each time the buffer is orphaned */
+    uint32_t generation() const { return generation_; }
+
+private:
+    uint32_t size_in_bytes_;
+    GLenum type_;
+    PFNGLMAPBUFFERRANGEPROC map_buffer_range_ = nullptr;
+
+    GLuint gl_id_ = 0;
+    uint32_t head_ = 0;
+    uint32_t generation_ = 0;
+    uint32_t write_count_ = 0;
 
-    std::vector<SlotMeta> metas_;
+    void orphan();
+    void write_at(VBOSlot offset, const uint8_t* data, uint32_t size);
 };
 
 class VBOManager : public RefCounted<VBOManager> {
@@ -211,8 +369,23 @@ public:
 
     uint32_t dedicated_buffer_count() const;
 
+    /* Called by the renderer at the start of each frame, this is how we
+     * tell which data is being rewritten every frame. Shared buffers are
+     * compacted a little each frame too */
+    void begin_frame();
+
+    /* If set, streamed data is written through glMapBufferRange */
+    void set_map_buffer_range_function(PFNGLMAPBUFFERRANGEPROC func) {
+        map_buffer_range_ = func;
+    }
+
+    bool is_streamed(const VertexData* vertex_data) const;
+    bool is_streamed(const IndexData* index_data) const;
+
+    /* Totals across all the shared vertex and index buffers */
+    VBOAllocationStats shared_buffer_stats() const;
+
 private:
-    VBOSlotSize calc_vbo_slot_size(uint32_t required_size_in_bytes);
 
     std::pair<VBO*, VBOSlot> allocate_slot(const VertexData* vertex_data);
     std::pair<VBO*, VBOSlot> allocate_slot(const IndexData* index_data);
@@ -220,16 +393,9 @@ private:
     void release_slot(const VertexData* vertex_data);
     void release_slot(const IndexData* index_data);
 
-    /* Buffers for renderables which aren't dynamic and are less than 512k */
-    std::array<
-        std::unordered_map<VertexSpecification, SharedVBO::ptr>,
-        VBO_SLOT_SIZE_COUNT
-    > shared_vertex_vbos_;
-
-    std::array<
-        std::unordered_map<IndexType, SharedVBO::ptr>,
-        VBO_SLOT_SIZE_COUNT
-    > shared_index_vbos_;
+    /* Buffers for data which is smaller than VBO_MAX_SHARED_SIZE */
+    std::unordered_map<VertexSpecification, SharedVBO::ptr> shared_vertex_vbos_;
+    std::unordered_map<IndexType, SharedVBO::ptr> shared_index_vbos_;
 
     typedef std::unordered_map<uuid64, DedicatedVBO::ptr> DedicatedMap;
     typedef std::unordered_map<uuid64, std::pair<VBO*, VBOSlot>> SlotMap;
@@ -251,8 +417,45 @@ private:
     void on_vertex_data_destroyed(VertexData* vertex_data);
     void on_index_data_destroyed(IndexData* vertex_data);
 
+    /* Data in released slots is uploaded again wherever it's allocated
+     * next time it's drawn */
+    void compact(SharedVBO* vbo, SlotMap& data_slots);
+
+    struct StreamState {
+        /* Consecutive frames the data has changed in */
+        uint64_t last_changed_frame = 0;
+        uint32_t changed_frames = 0;
+
+        bool is_streamed = false;
+
+        /* Where the data was last written in the streaming VBO */
+        uint64_t last_updated = 0;
+        VBOSlot offset = 0;
+        uint32_t generation = ~0u;
+    };
+
+    typedef std::unordered_map<uuid64, StreamState> StreamMap;
+
+    /* Only data which has changed after its first upload is tracked here */
+    StreamMap vertex_streams_;
+    StreamMap index_streams_;
+
+    StreamingVBO::ptr streaming_vertex_vbo_;
+    StreamingVBO::ptr streaming_index_vbo_;
+
+    PFNGLMAPBUFFERRANGEPROC map_buffer_range_ = nullptr;
+    uint64_t frame_ = 0;
+
+    StreamingVBO* streaming_vbo(GLenum target);
+
+    template<typename Data>
+    bool should_stream(const Data* data, StreamState& state);
+
+    template<typename Data>
+    std::pair<VBO*, VBOSlot> stream(const Data* data, StreamState& state, StreamingVBO* vbo);
+
     template<typename Data>
-    std::pair<VBO*, VBOSlot> perform_fetch_or_upload(const Data*, VBOManager::DedicatedMap&, VBOManager::SlotMap&);
+    std::pair<VBO*, VBOSlot> perform_fetch_or_upload(const Data*, VBOManager::DedicatedMap&, VBOManager::SlotMap&, VBOManager::StreamMap&, GLenum target);
 
 };
 
@@ -63,6 +63,17 @@ void GLRenderer::on_texture_unregister(TextureID tex_id, Texture* texture) {
     texture->_set_renderer_specific_id(0);
 }
 
+void GLRenderer::on_texture_evict(Texture* texture) {
+    /* Deleting the texture object is the only portable way to release
+     * its storage, so it's swapped for a new (empty) one */
+    GLuint gl_tex = texture->_renderer_specific_id();
+    GLCheck(glDeleteTextures, 1, &gl_tex);
+    GLCheck(glGenTextures, 1, &gl_tex);
+
+    texture->_set_renderer_specific_id(gl_tex);
+    texture->_set_has_mipmaps(false);
+}
+
 uint32_t GLRenderer::convert_format(TextureFormat format) {
     switch(format) {
         case TEXTURE_FORMAT_R_1UB_8:
@@ -257,6 +268,31 @@ void GLRenderer::on_texture_prepare(Texture *texture) {
                     type, data
                 );
 
+                /* Any existing levels were for the old data (e.g. a placeholder
+                 * which has been replaced) so they need uploading or generating again */
+                texture->_set_has_mipmaps(false);
+
+                auto& mipmaps = texture->_mipmap_data();
+                if(!mipmaps.empty() && !paletted) {
+                    /* Smaller levels soon stop being a multiple of 4 bytes wide */
+                    GLCheck(glPixelStorei, GL_UNPACK_ALIGNMENT, 1);
+
+                    for(std::size_t i = 0; i < mipmaps.size(); ++i) {
+                        GLCheck(glTexImage2D,
+                            GL_TEXTURE_2D,
+                            i + 1, internal_format,
+                            std::max(texture->width() >> (i + 1), 1),
+                            std::max(texture->height() >> (i + 1), 1), 0,
+                            format,
+                            type, &mipmaps[i][0]
+                        );
+                    }
+
+                    GLCheck(glPixelStorei, GL_UNPACK_ALIGNMENT, 4);
+                    texture->_set_has_mipmaps(true);
+                    texture->_set_mipmap_data(std::vector<Texture::Data>());
+                }
+
                 if(texture_format_contains_mipmaps(f)) {
                     S_WARN(
                         "Upload of provided mipmap texture data is not"
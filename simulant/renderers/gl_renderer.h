@@ -21,6 +21,8 @@ constexpr const char* const MODELVIEW_PROJECTION_MATRIX_PROPERTY = "s_modelview_
 constexpr const char* const PROJECTION_MATRIX_PROPERTY = "s_projection";
 constexpr const char* const MODELVIEW_MATRIX_PROPERTY = "s_modelview";
 constexpr const char* const INVERSE_TRANSPOSE_MODELVIEW_MATRIX_PROPERTY = "s_inverse_transpose_modelview";
+constexpr const char* const GLOBAL_AMBIENT_PROPERTY = "s_global_ambient";
+constexpr const char* const INSTANCE_TRANSFORMATION_ATTRIBUTE = "s_instance_transformation";
 
 #ifdef __DREAMCAST__
 // The Dreamcast only supports 2 multitexture units
@@ -55,6 +57,7 @@ protected:
     void on_texture_register(TextureID tex_id, Texture *texture) override;
     void on_texture_unregister(TextureID tex_id, Texture* texture) override;
     void on_texture_prepare(Texture* texture) override;
+    void on_texture_evict(Texture* texture) override;
     bool texture_format_is_native(TextureFormat fmt) override;
 
     uint32_t convert_format(TextureFormat format);
@@ -0,0 +1,207 @@
+#ifdef __DREAMCAST__
+    #include "../../../deps/libgl/include/GL/gl.h"
+    #include "../../../deps/libgl/include/GL/glext.h"
+#elif defined(__PSP__)
+    #include <GL/gl.h>
+#else
+    #include "./glad/glad/glad.h"
+#endif
+
+#include <stdexcept>
+
+#include "gl_state_cache.h"
+#include "../utils/gl_error.h"
+
+namespace smlt {
+
+GLStateCache::GLStateCache() {
+    invalidate();
+}
+
+void GLStateCache::invalidate() {
+    depth_test_ = UNKNOWN;
+    depth_write_ = UNKNOWN;
+    cull_enabled_ = UNKNOWN;
+    cull_face_ = UNKNOWN;
+    blend_enabled_ = UNKNOWN;
+    blend_type_ = UNKNOWN;
+    shade_model_ = UNKNOWN;
+    polygon_mode_ = UNKNOWN;
+    lighting_ = UNKNOWN;
+
+    point_size_known_ = false;
+    point_size_ = 0.0f;
+
+    active_texture_ = UNKNOWN;
+
+    for(uint8_t i = 0; i < _S_GL_MAX_TEXTURE_UNITS; ++i) {
+        textures_enabled_[i] = UNKNOWN;
+        texture_known_[i] = false;
+        textures_[i] = 0;
+    }
+}
+
+static void set_capability(GLenum cap, bool enabled) {
+    if(enabled) {
+        GLCheck(glEnable, cap);
+    } else {
+        GLCheck(glDisable, cap);
+    }
+}
+
+void GLStateCache::set_depth_test_enabled(bool enabled) {
+    if(changed(depth_test_, enabled)) {
+        set_capability(GL_DEPTH_TEST, enabled);
+    }
+}
+
+void GLStateCache::set_depth_write_enabled(bool enabled) {
+    if(changed(depth_write_, enabled)) {
+        GLCheck(glDepthMask, (enabled) ? GL_TRUE : GL_FALSE);
+    }
+}
+
+void GLStateCache::set_cull_mode(CullMode mode) {
+    bool enabled = mode != CULL_MODE_NONE;
+    if(changed(cull_enabled_, enabled)) {
+        set_capability(GL_CULL_FACE, enabled);
+    }
+
+    /* The face is left as it was while culling is disabled */
+    if(!enabled || !changed(cull_face_, mode)) {
+        return;
+    }
+
+    switch(mode) {
+        case CULL_MODE_FRONT_FACE:
+            GLCheck(glCullFace, GL_FRONT);
+        break;
+        case CULL_MODE_BACK_FACE:
+            GLCheck(glCullFace, GL_BACK);
+        break;
+        case CULL_MODE_FRONT_AND_BACK_FACE:
+            GLCheck(glCullFace, GL_FRONT_AND_BACK);
+        break;
+    default:
+        assert(0 && "Invalid cull mode");
+    }
+}
+
+void GLStateCache::set_blend_type(BlendType type) {
+    bool enabled = type != BLEND_NONE;
+    if(changed(blend_enabled_, enabled)) {
+        set_capability(GL_BLEND, enabled);
+    }
+
+    /* As with culling, the function is left alone while blending is disabled */
+    if(!enabled || !changed(blend_type_, type)) {
+        return;
+    }
+
+    switch(type) {
+        case BLEND_ADD: GLCheck(glBlendFunc, GL_ONE, GL_ONE);
+        break;
+        case BLEND_ALPHA: GLCheck(glBlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        break;
+        case BLEND_COLOUR: GLCheck(glBlendFunc, GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
+        break;
+        case BLEND_MODULATE: GLCheck(glBlendFunc, GL_DST_COLOR, GL_ZERO);
+        break;
+        case BLEND_ONE_ONE_MINUS_ALPHA: GLCheck(glBlendFunc, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        break;
+    default:
+        throw std::logic_error("Invalid blend type specified");
+    }
+}
+
+void GLStateCache::set_shade_model(ShadeModel model) {
+    if(changed(shade_model_, model)) {
+        GLCheck(glShadeModel, (model == SHADE_MODEL_SMOOTH) ? GL_SMOOTH : GL_FLAT);
+    }
+}
+
+void GLStateCache::set_polygon_mode(PolygonMode mode) {
+#if !defined(__DREAMCAST__) && !defined(__PSP__)
+    if(!changed(polygon_mode_, mode)) {
+        return;
+    }
+
+    switch(mode) {
+        case POLYGON_MODE_POINT:
+            GLCheck(glPolygonMode, GL_FRONT_AND_BACK, GL_POINT);
+        break;
+        case POLYGON_MODE_LINE:
+            GLCheck(glPolygonMode, GL_FRONT_AND_BACK, GL_LINE);
+        break;
+        default:
+            GLCheck(glPolygonMode, GL_FRONT_AND_BACK, GL_FILL);
+    }
+#else
+    _S_UNUSED(mode);
+#endif
+}
+
+void GLStateCache::set_point_size(float size) {
+#if !defined(__DREAMCAST__) && !defined(__PSP__)
+    if(point_size_known_ && point_size_ == size) {
+        ++state_changes_avoided_;
+        return;
+    }
+
+    point_size_known_ = true;
+    point_size_ = size;
+    ++state_changes_;
+
+    GLCheck(glPointSize, size);
+#else
+    _S_UNUSED(size);
+#endif
+}
+
+void GLStateCache::set_lighting_enabled(bool enabled) {
+    if(changed(lighting_, enabled)) {
+        set_capability(GL_LIGHTING, enabled);
+    }
+}
+
+void GLStateCache::set_texture_enabled(uint8_t unit, bool enabled) {
+    assert(unit < _S_GL_MAX_TEXTURE_UNITS);
+
+    if(textures_enabled_[unit] == (int8_t) enabled) {
+        ++state_changes_avoided_;
+        return;
+    }
+
+    set_active_texture(unit);
+    changed(textures_enabled_[unit], enabled);
+    set_capability(GL_TEXTURE_2D, enabled);
+}
+
+void GLStateCache::set_active_texture(uint8_t unit) {
+#if _S_GL_SUPPORTS_MULTITEXTURE
+    if(changed(active_texture_, unit)) {
+        GLCheck(glActiveTexture, GL_TEXTURE0 + unit);
+    }
+#else
+    _S_UNUSED(unit);
+#endif
+}
+
+void GLStateCache::bind_texture(uint8_t unit, uint32_t texture) {
+    assert(unit < _S_GL_MAX_TEXTURE_UNITS);
+
+    if(texture_known_[unit] && textures_[unit] == texture) {
+        ++state_changes_avoided_;
+        return;
+    }
+
+    set_active_texture(unit);
+
+    texture_known_[unit] = true;
+    textures_[unit] = texture;
+    ++state_changes_;
+
+    GLCheck(glBindTexture, GL_TEXTURE_2D, texture);
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../assets/materials/constants.h"
+#include "gl_renderer.h"
+
+namespace smlt {
+
+/*
+ * Shadows the GL state which the render queue visitors change, so only the
+ * calls which actually change something reach the driver. Shared between
+ * the GL1.x and GL2.x renderers.
+ *
+ * Everything starts out unknown, which lets the first call of each kind
+ * through. Anything that changes this state behind the cache's back (e.g.
+ * clearing a viewport) must be followed by invalidate() before the cache is
+ * used again. The visitors do that at the start of each traversal.
+ */
+class GLStateCache {
+public:
+    GLStateCache();
+
+    /* Forget everything, the next call of each kind reaches GL */
+    void invalidate();
+
+    void set_depth_test_enabled(bool enabled);
+    void set_depth_write_enabled(bool enabled);
+    void set_cull_mode(CullMode mode);
+    void set_blend_type(BlendType type);
+    void set_shade_model(ShadeModel model);
+    void set_polygon_mode(PolygonMode mode);
+    void set_point_size(float size);
+
+    /* Fixed function only */
+    void set_lighting_enabled(bool enabled);
+    void set_texture_enabled(uint8_t unit, bool enabled);
+
+    void set_active_texture(uint8_t unit);
+    void bind_texture(uint8_t unit, uint32_t texture);
+
+    /* The number of calls made, and skipped because the state
+     * already matched, since reset_counters() */
+    uint32_t state_changes() const {
+        return state_changes_;
+    }
+
+    uint32_t state_changes_avoided() const {
+        return state_changes_avoided_;
+    }
+
+    void reset_counters() {
+        state_changes_ = 0;
+        state_changes_avoided_ = 0;
+    }
+
+private:
+    static const int8_t UNKNOWN = -1;
+
+    bool changed(int8_t& current, int8_t value) {
+        if(current == value) {
+            ++state_changes_avoided_;
+            return false;
+        }
+
+        current = value;
+        ++state_changes_;
+        return true;
+    }
+
+    int8_t depth_test_;
+    int8_t depth_write_;
+    int8_t cull_enabled_;
+    int8_t cull_face_;
+    int8_t blend_enabled_;
+    int8_t blend_type_;
+    int8_t shade_model_;
+    int8_t polygon_mode_;
+    int8_t lighting_;
+
+    bool point_size_known_;
+    float point_size_;
+
+    int8_t active_texture_;
+    int8_t textures_enabled_[_S_GL_MAX_TEXTURE_UNITS];
+
+    /* 0 is a valid binding, so these have a separate flag */
+    bool texture_known_[_S_GL_MAX_TEXTURE_UNITS];
+    uint32_t textures_[_S_GL_MAX_TEXTURE_UNITS];
+
+    uint32_t state_changes_ = 0;
+    uint32_t state_changes_avoided_ = 0;
+};
+
+}
@@ -0,0 +1,83 @@
+/* *   Copyright (c) 2011-2017 Luke Benstead https://simulant-engine.appspot.com
+ *
+ *     This file is part of Simulant.
+ *
+ *     Simulant is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Simulant is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Lesser General Public License
+ *     along with Simulant.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "renderer.h"
+#include "batching/render_trace.h"
+
+namespace smlt {
+
+/*
+ * A renderer which doesn't draw anything. Textures and buffers are never
+ * uploaded, and instead of drawing, each frame's render queue traversals are
+ * recorded into trace(). This makes it possible to measure culling, queue
+ * building and traversal on machines without a GPU, and to compare the
+ * number of draws and state changes a scene generates.
+ *
+ * No GL context is created for it. The SDL window uses SDL's "dummy" video
+ * driver unless SDL_VIDEODRIVER says otherwise, so no display is needed.
+ *
+ * The trace is cleared at the start of each frame. Selected by passing
+ * "null" as the renderer name (or SIMULANT_RENDERER=null).
+ */
+class NullRenderer:
+    public Renderer {
+
+public:
+    NullRenderer(Window* window):
+        Renderer(window) {}
+
+    batcher::RenderGroupKey prepare_render_group(
+        batcher::RenderGroup* group,
+        const Renderable *renderable,
+        const MaterialPass *material_pass,
+        const uint8_t pass_number,
+        const bool is_blended,
+        const float distance_to_camera
+    ) override;
+
+    std::shared_ptr<batcher::RenderQueueVisitor> get_render_queue_visitor(CameraPtr camera) override;
+
+    void init_context() override {}
+
+    bool requires_gl_context() const override {
+        return false;
+    }
+
+    std::string name() const override {
+        return "null";
+    }
+
+    void prepare_to_render(const Renderable *renderable) override {
+        _S_UNUSED(renderable);
+    }
+
+    const batcher::RenderTrace& trace() const {
+        return trace_;
+    }
+
+private:
+    batcher::RenderTrace trace_;
+
+    void on_pre_render() override {
+        trace_.clear();
+    }
+};
+
+}
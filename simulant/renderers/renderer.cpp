@@ -17,8 +17,13 @@
 //     along with Simulant.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <algorithm>
+
 #include "renderer.h"
 #include "../texture.h"
+#include "../application.h"
+#include "../stats_recorder.h"
+#include "../loader.h"
 
 namespace smlt {
 
@@ -29,6 +34,7 @@ void Renderer::register_texture(TextureID tex_id, Texture* texture) {
 
 void Renderer::unregister_texture(TextureID texture_id, Texture* texture) {
     texture_registry_.erase(texture_id);
+    forget_texture(texture_id);
     on_texture_unregister(texture_id, texture);
 }
 
@@ -83,10 +89,223 @@ bool Renderer::is_texture_registered(TextureID texture_id) const {
     return texture_registry_.count(texture_id);
 }
 
+static uint32_t texture_system_memory(const Texture* texture) {
+    uint32_t bytes = texture->data_size();
+    for(auto& level: texture->_mipmap_data()) {
+        bytes += level.size();
+    }
+
+    return bytes;
+}
+
+/* Textures which can free their data, as it can be loaded again */
+static bool texture_can_reload(const Texture* texture) {
+    return texture->_data_from_source() && !texture->source().str().empty();
+}
+
 void Renderer::pre_render() {
+    ++frame_;
+
+    auto app = get_app();
+    if(app) {
+        app->stats->set_texture_evictions(textures_evicted_, textures_restored_);
+    }
+
+    textures_evicted_ = 0;
+    textures_restored_ = 0;
+
+    texture_cpu_bytes_ = 0;
     for(auto& wptr: texture_registry_){
-        prepare_texture(wptr.second);
+        /* Evicted textures are left alone until they're bound again */
+        if(!evicted_textures_.count(wptr.first)) {
+            prepare_texture(wptr.second);
+        }
+
+        texture_cpu_bytes_ += texture_system_memory(wptr.second);
+    }
+
+    evict_textures();
+    free_texture_data();
+
+    if(app) {
+        app->stats->set_texture_residency(resident_textures_.size(), resident_texture_bytes_);
+        app->stats->set_texture_cpu_bytes(texture_cpu_bytes_);
+    }
+
+    on_pre_render();
+}
+
+static uint32_t texture_video_memory(const Texture* texture) {
+    uint32_t bytes = Texture::required_data_size(
+        texture->format(), texture->width(), texture->height()
+    );
+
+    /* A full mipmap chain adds a third */
+    if(texture->has_mipmaps() && !texture_format_contains_mipmaps(texture->format())) {
+        bytes += bytes / 3;
+    }
+
+    return bytes;
+}
+
+void Renderer::mark_texture_resident(Texture* texture) {
+    auto bytes = texture_video_memory(texture);
+
+    auto entry = resident_textures_.touch(texture->id());
+    if(entry) {
+        resident_texture_bytes_ -= entry->bytes;
+        entry->bytes = bytes;
+        entry->last_used_frame = frame_;
+    } else {
+        resident_textures_.insert(texture->id(), ResidentTexture{texture, bytes, frame_});
+    }
+
+    resident_texture_bytes_ += bytes;
+}
+
+void Renderer::forget_texture(TextureID texture_id) {
+    auto entry = resident_textures_.peek(texture_id);
+    if(entry) {
+        resident_texture_bytes_ -= entry.value().bytes;
+        resident_textures_.erase(texture_id);
     }
+
+    evicted_textures_.erase(texture_id);
+}
+
+void Renderer::evict_textures() {
+    if(!texture_budget_ && !texture_eviction_age_) {
+        return;
+    }
+
+    while(auto texture_id = resident_textures_.oldest_key()) {
+        auto entry = resident_textures_.peek(texture_id.value()).value();
+        auto age = frame_ - entry.last_used_frame;
+
+        /* Anything used last frame will most likely be used this
+         * frame, evicting it would just mean uploading it again */
+        if(age <= 1) {
+            break;
+        }
+
+        bool over_budget = texture_budget_ && resident_texture_bytes_ > texture_budget_;
+        bool expired = texture_eviction_age_ && age > texture_eviction_age_;
+        if(!over_budget && !expired) {
+            break;
+        }
+
+        auto texture = entry.texture;
+        forget_texture(texture_id.value());
+
+        /* If there's nothing to restore the texture from, or reloading
+         * would lose changes made since it was loaded, it stays on the
+         * GPU but is no longer tracked */
+        if(!texture->has_data() && !texture_can_reload(texture)) {
+            continue;
+        }
+
+        on_texture_evict(texture);
+        evicted_textures_.insert(texture_id.value());
+        ++textures_evicted_;
+    }
+}
+
+void Renderer::free_texture_data() {
+    if(!texture_cpu_budget_ || texture_cpu_bytes_ <= texture_cpu_budget_) {
+        return;
+    }
+
+    /* Least recently bound first, evicted textures aren't in
+     * resident_textures_ and so go before everything else */
+    std::vector<std::pair<uint64_t, Texture*>> candidates;
+    for(auto& wptr: texture_registry_) {
+        auto texture = wptr.second;
+
+        /* Data which hasn't been uploaded yet is still needed */
+        if(!texture->has_data() || texture->_data_dirty() || !texture_can_reload(texture)) {
+            continue;
+        }
+
+        auto entry = resident_textures_.peek(wptr.first);
+        candidates.push_back(
+            std::make_pair((entry) ? entry.value().last_used_frame : 0, texture)
+        );
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](
+        const std::pair<uint64_t, Texture*>& lhs, const std::pair<uint64_t, Texture*>& rhs) {
+            return lhs.first < rhs.first;
+        }
+    );
+
+    for(auto& candidate: candidates) {
+        if(texture_cpu_bytes_ <= texture_cpu_budget_) {
+            break;
+        }
+
+        texture_cpu_bytes_ -= texture_system_memory(candidate.second);
+        candidate.second->free();
+    }
+}
+
+bool Renderer::restore_texture(Texture* texture) {
+    if(!texture->has_data()) {
+        auto loader = std::dynamic_pointer_cast<loaders::BaseTextureLoader>(
+            get_app()->loader_for(texture->source(), LOADER_HINT_TEXTURE)
+        );
+
+        if(!loader) {
+            S_ERROR("Unable to reload evicted texture {0}", texture->source());
+            return false;
+        }
+
+        TextureLoadResult result;
+        try {
+            result = loader->load_data();
+        } catch(std::exception& e) {
+            S_ERROR("Unable to reload evicted texture {0}: {1}", texture->source(), e.what());
+            return false;
+        }
+
+        if(texture->_source_flipped()) {
+            flip_texture_data_vertically(&result.data[0], result.width, result.height, result.format);
+        }
+
+        texture->set_format(result.format);
+        texture->resize(result.width, result.height);
+        texture->set_data(result.data);
+        texture->_set_data_from_source(true);
+    }
+
+    texture->_set_dirty();
+    prepare_texture(texture);
+    return true;
+}
+
+void Renderer::make_texture_resident(Texture* texture) {
+    auto entry = resident_textures_.touch(texture->id());
+    if(entry) {
+        entry->last_used_frame = frame_;
+        return;
+    }
+
+    if(!evicted_textures_.count(texture->id())) {
+        /* Not uploaded yet, or not tracked */
+        return;
+    }
+
+    evicted_textures_.erase(texture->id());
+    if(restore_texture(texture)) {
+        ++textures_restored_;
+    }
+}
+
+bool Renderer::is_texture_resident(TextureID texture_id) const {
+    return is_texture_registered(texture_id) && !evicted_textures_.count(texture_id);
+}
+
+std::size_t Renderer::resident_texture_count() const {
+    return resident_textures_.size();
 }
 
 static bool format_in_list(TextureFormat fmt, const TextureFormat* values) {
@@ -209,8 +428,8 @@ static TextureFormat untwiddle_format(TextureFormat fmt) {
 }
 
 
-bool Renderer::convert_if_necessary(Texture* tex) {
-    auto fmt = tex->format();
+bool Renderer::convert_texture_data(TextureFormat& format, std::vector<uint8_t>& data, uint16_t width, uint16_t height) {
+    auto fmt = format;
     if(natively_supports_texture_format(fmt)) {
         return true;
     }
@@ -239,31 +458,52 @@ bool Renderer::convert_if_necessary(Texture* tex) {
     bool decompress = format_in_list(fmt, can_decompress);
 
     if(decompress) {
-        std::vector<uint8_t> tmp(tex->width() * tex->height() * 2);
-        decompress_16bpp(&tex->data()[0], &tmp[0], tex->width(), tex->height());
+        std::vector<uint8_t> tmp(width * height * 2);
+        decompress_16bpp(&data[0], &tmp[0], width, height);
 
         fmt = uncompress_format(fmt);
-        tex->set_data(&tmp[0], tmp.size());
+        data.swap(tmp);
     }
 
     bool untwiddle = format_in_list(fmt, can_untwiddle);
 
     if(untwiddle) {
-        std::vector<uint8_t> tmp(tex->data_size());
+        std::vector<uint8_t> tmp(data.size());
 
-        untwiddle_16bpp(&tex->data()[0], &tmp[0], tex->width(), tex->height());
+        untwiddle_16bpp(&data[0], &tmp[0], width, height);
         fmt = untwiddle_format(fmt);
-        tex->set_data(&tmp[0], tmp.size());
+        data.swap(tmp);
     }
 
-    tex->set_format(fmt);
+    format = fmt;
 
     /* Shouldn't happen, but just in case something goes wrong */
-    assert(natively_supports_texture_format(tex->format()));
-    if(!natively_supports_texture_format(tex->format())) {
+    assert(natively_supports_texture_format(format));
+    if(!natively_supports_texture_format(format)) {
+        return false;
+    }
+
+    return true;
+}
+
+bool Renderer::convert_if_necessary(Texture* tex) {
+    auto fmt = tex->format();
+    if(natively_supports_texture_format(fmt)) {
+        return true;
+    }
+
+    auto data = tex->data_copy();
+    if(!convert_texture_data(fmt, data, tex->width(), tex->height())) {
         return false;
     }
 
+    /* Converting is repeated whenever the data is reloaded, so
+     * doesn't count as a change */
+    bool from_source = tex->_data_from_source();
+
+    tex->set_data(data);
+    tex->set_format(fmt);
+    tex->_set_data_from_source(from_source);
     return true;
 }
 
@@ -275,7 +515,13 @@ void Renderer::prepare_texture(Texture* tex) {
         return;
     }
 
+    bool uploading = tex->_data_dirty() && tex->auto_upload();
+
     on_texture_prepare(tex);
+
+    if(uploading && !tex->_data_dirty()) {
+        mark_texture_resident(tex);
+    }
 }
 
 void Renderer::prepare_material(Material* material) {
@@ -22,11 +22,13 @@
 #include <set>
 #include <vector>
 #include <memory>
+#include <limits>
 
 #include "../types.h"
 #include "../threads/shared_mutex.h"
 #include "../macros.h"
 #include "../texture.h"
+#include "../generic/lru_cache.h"
 
 #include "batching/renderable.h"
 #include "batching/render_queue.h"
@@ -43,7 +45,11 @@ public:
     typedef std::shared_ptr<Renderer> ptr;
 
     Renderer(Window* window):
-        window_(window) {}
+        window_(window) {
+
+        /* Textures are only dropped by evict_textures() */
+        resident_textures_.set_max_size(std::numeric_limits<std::size_t>::max());
+    }
 
     virtual std::shared_ptr<batcher::RenderQueueVisitor> get_render_queue_visitor(CameraPtr camera) = 0;
 
@@ -64,6 +70,10 @@ public:
 
     virtual std::string name() const = 0;
 
+    /* If false, the window doesn't create a GL context (or need a display)
+     * and nothing outside the renderer touches GL */
+    virtual bool requires_gl_context() const { return true; }
+
     /* This function is called just before drawing the renderable, it can be
      * used to upload any data to VRAM if necessary */
     virtual void prepare_to_render(const Renderable* renderable) = 0;
@@ -85,6 +95,12 @@ public:
         return texture_format_is_usable(fmt);
     }
 
+    /** Converts texture data to a format that the GPU natively supports, if
+     * it isn't in one already. Returns false if the format can't be used.
+     * This doesn't touch any renderer state, so can be called from
+     * any thread */
+    bool convert_texture_data(TextureFormat& format, std::vector<uint8_t>& data, uint16_t width, uint16_t height);
+
 public:
     /** To be overridden by subclasses. Default supported textures
      *  are those that are supported by glTexImage2D without any
@@ -106,6 +122,66 @@ public:
     void prepare_texture(Texture *texture);
     void prepare_material(Material* material);
 
+    /*
+     * Texture residency. Uploaded textures are tracked in least-recently-bound
+     * order, and at the start of each frame the oldest are evicted from video
+     * memory while the total is over the budget, or once they haven't been
+     * bound for texture_eviction_age() frames. Textures bound in the last frame
+     * are never evicted.
+     *
+     * Only textures which can be restored are evicted, that is textures which
+     * kept their data (TEXTURE_FREE_DATA_NEVER) or whose data is unchanged
+     * since it was loaded from source(). Textures which were changed at
+     * runtime and then freed their data are never evicted, as reloading
+     * them would lose the changes. Evicted textures are restored by
+     * make_texture_resident() the next time they are bound.
+     *
+     * The CPU budget limits the data kept in RAM by uploaded textures. While
+     * over it, the least recently bound textures with unchanged data from
+     * source() free their data, it's loaded again if they're ever restored.
+     * data() is empty for a texture whose data has been freed.
+     *
+     * A budget or age of zero (the default) disables that limit.
+     */
+    void set_texture_budget(uint32_t bytes) {
+        texture_budget_ = bytes;
+    }
+
+    uint32_t texture_budget() const {
+        return texture_budget_;
+    }
+
+    void set_texture_cpu_budget(uint32_t bytes) {
+        texture_cpu_budget_ = bytes;
+    }
+
+    uint32_t texture_cpu_budget() const {
+        return texture_cpu_budget_;
+    }
+
+    void set_texture_eviction_age(uint32_t frames) {
+        texture_eviction_age_ = frames;
+    }
+
+    uint32_t texture_eviction_age() const {
+        return texture_eviction_age_;
+    }
+
+    /* Called by render queue visitors before binding a texture. Restores
+     * the texture if it was evicted, and marks it as used this frame */
+    void make_texture_resident(Texture* texture);
+
+    bool is_texture_resident(TextureID texture_id) const;
+    std::size_t resident_texture_count() const;
+    uint32_t resident_texture_bytes() const {
+        return resident_texture_bytes_;
+    }
+
+    /* The texture data held in RAM, as of the start of the frame */
+    uint32_t texture_cpu_bytes() const {
+        return texture_cpu_bytes_;
+    }
+
 private:
     friend class Texture;
 
@@ -114,6 +190,31 @@ private:
 
     bool convert_if_necessary(Texture* tex);
 
+    struct ResidentTexture {
+        Texture* texture;
+        uint32_t bytes;
+        uint64_t last_used_frame;
+    };
+
+    LRUCache<TextureID, ResidentTexture> resident_textures_;
+    std::set<TextureID> evicted_textures_;
+    uint32_t resident_texture_bytes_ = 0;
+
+    uint32_t texture_budget_ = 0;
+    uint32_t texture_cpu_budget_ = 0;
+    uint32_t texture_cpu_bytes_ = 0;
+    uint32_t texture_eviction_age_ = 0;
+    uint64_t frame_ = 0;
+
+    uint32_t textures_evicted_ = 0;
+    uint32_t textures_restored_ = 0;
+
+    void mark_texture_resident(Texture* texture);
+    void forget_texture(TextureID texture_id);
+    void evict_textures();
+    void free_texture_data();
+    bool restore_texture(Texture* texture);
+
     Window* window_ = nullptr;
 
     /*
@@ -156,6 +257,21 @@ private:
         _S_UNUSED(texture);
     }
 
+    /*
+     * Should release the video memory used by the texture, while leaving it
+     * registered. The texture is marked dirty and prepared again when
+     * it's restored.
+     *
+     * Guaranteed to be called from the main (render) thread
+     */
+    virtual void on_texture_evict(Texture* texture) {
+        _S_UNUSED(texture);
+    }
+
+    /* Called at the start of each frame, before anything is rendered.
+     * Guaranteed to be called from the main (render) thread */
+    virtual void on_pre_render() {}
+
     /* Called when a Material is created, or when it is changed via
      * an assignment. FIXME: This seems like we'd miss occasions where
      * we should call this. Might be better being called on first update? */
@@ -1,6 +1,7 @@
 
 
 #include "renderer_config.h"
+#include "null_renderer.h"
 
 #ifdef __DREAMCAST__
     #include "gl1x/gl1x_renderer.h"
@@ -20,6 +21,7 @@ Renderer::ptr new_renderer(Window* window, const std::string& name) {
      *
      * - "gl2x"
      * - "gl1x"
+     * - "null" (draws nothing, see NullRenderer)
      *
      * If a renderer is unsupported a message will be logged and a null pointer returned
      */
@@ -52,6 +54,8 @@ Renderer::ptr new_renderer(Window* window, const std::string& name) {
 #else
         return std::make_shared<GenericRenderer>(window);
 #endif
+    } else if(chosen == "null") {
+        return std::make_shared<NullRenderer>(window);
     }
 
     return NOT_SUPPORTED;
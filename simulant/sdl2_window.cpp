@@ -43,7 +43,8 @@ static const std::string SDL_CONTROLLER_DB =
 namespace smlt {
 
 SDL2Window::SDL2Window() {
-    auto default_flags = SDL_INIT_EVERYTHING & (~SDL_INIT_HAPTIC) & (~SDL_INIT_SENSOR);
+    /* Video is initialized by _init_window(), once we know which renderer is in use */
+    auto default_flags = SDL_INIT_EVERYTHING & (~SDL_INIT_HAPTIC) & (~SDL_INIT_SENSOR) & (~SDL_INIT_VIDEO);
 
     if(SDL_Init(default_flags) != 0) {
         S_ERROR("Unable to initialize SDL {0}", SDL_GetError());
@@ -332,6 +333,19 @@ std::shared_ptr<SoundDriver> SDL2Window::create_sound_driver(const std::string&
 }
 
 bool SDL2Window::_init_window() {
+    bool requires_gl = !renderer_ || renderer_->requires_gl_context();
+
+    if(!requires_gl) {
+        /* Nothing will be drawn, so don't insist on a display. This
+         * doesn't override a driver that was chosen explicitly */
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    }
+
+    if(SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+        S_ERROR("Unable to initialize SDL video {0}", SDL_GetError());
+        FATAL_ERROR(ERROR_CODE_SDL_INIT_FAILED, "Failed to initialize SDL");
+    }
+
     /* Load the game controller mappings */
     auto rw_ops = SDL_RWFromConstMem(SDL_CONTROLLER_DB.c_str(), SDL_CONTROLLER_DB.size());
     int ret = SDL_GameControllerAddMappingsFromRW(rw_ops, 1);
@@ -341,7 +355,7 @@ bool SDL2Window::_init_window() {
         S_DEBUG("Successfully loaded {0} SDL controller mappings", ret);
     }
 
-    int32_t flags = SDL_WINDOW_OPENGL;
+    int32_t flags = (requires_gl) ? SDL_WINDOW_OPENGL : SDL_WINDOW_HIDDEN;
 
     if(is_fullscreen()) {
         flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
@@ -386,6 +400,12 @@ bool SDL2Window::_init_window() {
 }
 
 bool SDL2Window::_init_renderer(Renderer* renderer) {
+    if(!renderer->requires_gl_context()) {
+        /* There's no context to lose, so rendering can always go ahead */
+        set_has_context(true);
+        return true;
+    }
+
     if(renderer->name() == "gl1x") {
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 1);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
@@ -477,7 +497,13 @@ void SDL2Window::destroy_window() {
 }
 
 void SDL2Window::swap_buffers() {
-    SDL_GL_SwapWindow(screen_);
+    if(context_) {
+        SDL_GL_SwapWindow(screen_);
+    }
+}
+
+void* SDL2Window::gl_proc_address(const char* name) const {
+    return SDL_GL_GetProcAddress(name);
 }
 
 bool SDL2Window::initialize_screen(Screen *screen) {
@@ -59,6 +59,7 @@ private:
 
     void check_events() override;
     void swap_buffers() override;
+    void* gl_proc_address(const char* name) const override;
 
     friend int event_filter(void* user_data, SDL_Event* event);
 
@@ -17,12 +17,15 @@
 //     along with Simulant.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <algorithm>
+
 #include "stage.h"
 #include "window.h"
 #include "partitioner.h"
 #include "debug.h"
 #include "viewport.h"
 #include "application.h"
+#include "threads/job_system.h"
 
 #include "nodes/actor.h"
 #include "nodes/light.h"
@@ -121,7 +124,7 @@ ActorPtr Stage::new_actor() {
 
     /* Whenever the actor moves, we need to tell the stage's partitioner */
     a->signal_bounds_updated().connect([this, a](const AABB& new_bounds) {
-        this->partitioner->update_stage_node(a, new_bounds);
+        on_bounds_updated(a, new_bounds);
     });
 
     //Tell everyone about the new actor
@@ -148,7 +151,7 @@ ActorPtr Stage::new_actor_with_mesh(MeshID mid) {
 
     /* Whenever the actor moves, we need to tell the stage's partitioner */
     a->signal_bounds_updated().connect([this, a](const AABB& new_bounds) {
-        this->partitioner->update_stage_node(a, new_bounds);
+        on_bounds_updated(a, new_bounds);
     });
 
     // Tell everyone about the new actor
@@ -226,7 +229,7 @@ MeshInstancerPtr Stage::new_mesh_instancer(MeshID mid) {
     instance->set_parent(this);
 
     instance->signal_bounds_updated().connect([this, instance](const AABB& new_bounds) {
-        this->partitioner->update_stage_node(instance, new_bounds);
+        on_bounds_updated(instance, new_bounds);
     });
 
     signal_stage_node_created_(instance, STAGE_NODE_TYPE_MESH_INSTANCER);
@@ -336,6 +339,36 @@ GeomPtr Stage::new_geom_with_mesh(MeshID mid, const GeomCullerOptions& culler_op
     return new_geom_with_mesh_at_position(mid, smlt::Vec3(), smlt::Quaternion(), smlt::Vec3(1, 1, 1), culler_options);
 }
 
+GeomPtr Stage::new_geom_from_actors(const std::vector<ActorPtr>& actors, const GeomCullerOptions& culler_options) {
+    MeshPtr merged;
+
+    for(auto& actor: actors) {
+        auto& mesh = actor->base_mesh();
+        if(!mesh) {
+            continue;
+        }
+
+        if(mesh->is_animated()) {
+            S_WARN("Not merging animated actor {0} into a geom", actor->id());
+            continue;
+        }
+
+        if(!merged) {
+            merged = assets->new_mesh(mesh->vertex_data->vertex_specification());
+        }
+
+        if(!merged->append(mesh, actor->absolute_transformation(), actor->active_material_slot())) {
+            S_WARN("Not merging actor {0} into a geom, its vertex specification differs", actor->id());
+        }
+    }
+
+    if(!merged || !merged->vertex_data->count()) {
+        return GeomPtr();
+    }
+
+    return new_geom_with_mesh(merged->id(), culler_options);
+}
+
 GeomPtr Stage::geom(const GeomID gid) const {
     return geom_manager_->get(gid);
 }
@@ -382,7 +415,7 @@ ParticleSystemPtr Stage::new_particle_system(ParticleScriptID particle_script) {
 
     /* Whenever the particle system moves, we need to tell the stage's partitioner */
     p->signal_bounds_updated().connect([this, p](const AABB& new_bounds) {
-        this->partitioner->update_stage_node(p, new_bounds);
+        on_bounds_updated(p, new_bounds);
     });
 
     p->set_parent(this);
@@ -429,7 +462,7 @@ LightPtr Stage::new_light_as_directional(const Vec3& direction, const smlt::Colo
 
     /* Whenever the light moves, we need to tell the stage's partitioner */
     light->signal_bounds_updated().connect([this, light](const AABB& new_bounds) {
-        this->partitioner->update_stage_node(light, new_bounds);
+        on_bounds_updated(light, new_bounds);
     });
 
     signal_stage_node_created_(light, STAGE_NODE_TYPE_LIGHT);
@@ -450,7 +483,7 @@ LightPtr Stage::new_light_as_point(const Vec3& position, const smlt::Colour& col
 
     /* Whenever the light moves, we need to tell the stage's partitioner */
     light->signal_bounds_updated().connect([this, light](const AABB& new_bounds) {
-        this->partitioner->update_stage_node(light, new_bounds);
+        on_bounds_updated(light, new_bounds);
     });
 
     signal_stage_node_created_(light, STAGE_NODE_TYPE_LIGHT);
@@ -519,6 +552,142 @@ void Stage::update(float dt) {
     node_pool_->shrink_to_fit();
 }
 
+/* Below this many subtrees to update, it's quicker to do them all
+ * on this thread than to hand them out to the workers */
+static const std::size_t PARALLEL_TRANSFORMATION_ROOTS = 64;
+
+void Stage::queue_transformation_update(StageNode* node) {
+    node->transformation_queue_index_ = transformation_updates_.size();
+    transformation_updates_.push_back(node);
+}
+
+void Stage::dequeue_transformation_update(StageNode* node) {
+    /* Left as a gap, the pass skips it */
+    assert(transformation_updates_[node->transformation_queue_index_] == node);
+    transformation_updates_[node->transformation_queue_index_] = nullptr;
+}
+
+void Stage::update_transformations() {
+    transformation_roots_.clear();
+
+    /* Find the top-most dirty node above each moved node, those are the
+     * roots of the subtrees that need updating. A dirty node's descendents
+     * are always dirty, so the roots can't overlap */
+    for(auto node: transformation_updates_) {
+        if(!node) {
+            /* Destroyed since it moved */
+            continue;
+        }
+
+        node->transformation_queued_ = false;
+
+        if(!node->transformation_dirty_) {
+            /* Something read the node since it moved, which updated it (and
+             * its parents) but not its children. Its ancestors are clean, so
+             * the first dirty nodes below it are roots */
+            clean_transformation_nodes_.clear();
+            clean_transformation_nodes_.push_back(node);
+
+            for(std::size_t i = 0; i < clean_transformation_nodes_.size(); ++i) {
+                for(auto& child: clean_transformation_nodes_[i]->each_child()) {
+                    if(child.transformation_dirty_) {
+                        transformation_roots_.push_back(&child);
+                    } else {
+                        clean_transformation_nodes_.push_back(&child);
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        auto root = node;
+        while(!root->parent_is_stage() && root->parent_stage_node_ && root->parent_stage_node_->transformation_dirty_) {
+            root = root->parent_stage_node_;
+        }
+
+        transformation_roots_.push_back(root);
+    }
+
+    transformation_updates_.clear();
+
+    std::sort(transformation_roots_.begin(), transformation_roots_.end());
+    transformation_roots_.erase(
+        std::unique(transformation_roots_.begin(), transformation_roots_.end()),
+        transformation_roots_.end()
+    );
+
+    const std::size_t root_count = transformation_roots_.size();
+    if(root_count < PARALLEL_TRANSFORMATION_ROOTS) {
+        transformation_batches_.resize(std::max<std::size_t>(transformation_batches_.size(), 1));
+        update_transformation_batch(transformation_batches_[0], 0, root_count);
+        notify_bounds_updated(1);
+        return;
+    }
+
+    /* Split the roots into a batch per thread */
+    auto& jobs = get_app()->jobs;
+    const std::size_t batches = std::min<std::size_t>(
+        jobs->worker_count() + 1, root_count / PARALLEL_TRANSFORMATION_ROOTS
+    );
+
+    transformation_batches_.resize(std::max(transformation_batches_.size(), batches));
+
+    jobs->parallel_for(batches, [this, root_count, batches](std::size_t b) {
+        update_transformation_batch(
+            transformation_batches_[b],
+            (root_count * b) / batches,
+            (root_count * (b + 1)) / batches
+        );
+    });
+
+    notify_bounds_updated(batches);
+}
+
+void Stage::update_transformation_batch(TransformationBatch& batch, std::size_t begin, std::size_t end) {
+    batch.bounds_updated.clear();
+
+    for(std::size_t i = begin; i < end; ++i) {
+        transformation_roots_[i]->update_transformation_subtree(batch.subtree);
+
+        /* Every node in the subtree has moved, so this is the best place
+         * to recalculate their bounds. The signals are fired afterwards
+         * on this thread. */
+        for(auto node: batch.subtree) {
+            if(node->refresh_transformed_aabb()) {
+                batch.bounds_updated.push_back(node);
+            }
+        }
+    }
+}
+
+void Stage::notify_bounds_updated(std::size_t batch_count) {
+    collecting_bounds_updates_ = true;
+
+    for(std::size_t b = 0; b < batch_count; ++b) {
+        for(auto node: transformation_batches_[b].bounds_updated) {
+            node->signal_bounds_updated_(node->transformed_aabb_);
+        }
+    }
+
+    collecting_bounds_updates_ = false;
+
+    if(!bounds_updated_nodes_.empty()) {
+        partitioner->update_stage_nodes(bounds_updated_nodes_, bounds_updated_);
+        bounds_updated_nodes_.clear();
+        bounds_updated_.clear();
+    }
+}
+
+void Stage::on_bounds_updated(StageNode* node, const AABB& new_bounds) {
+    if(collecting_bounds_updates_) {
+        bounds_updated_nodes_.push_back(node);
+        bounds_updated_.push_back(new_bounds);
+    } else {
+        partitioner->update_stage_node(node, new_bounds);
+    }
+}
+
 Debug* Stage::enable_debug(bool v) {
     if(debug_ && !v) {
         debug_.reset();
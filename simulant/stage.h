@@ -164,6 +164,21 @@ public:
         const Vec3& scale=Vec3(1, 1, 1),
         const GeomCullerOptions& culler_options=GeomCullerOptions()
     );
+
+    /* Merges the meshes of static actors, as currently positioned, into a single
+     * Geom. Triangles sharing a material end up in the same index buffer for
+     * each cell of the Geom's culler, so a level built from many small actors
+     * costs a draw call per material per visible cell rather than one per actor.
+     *
+     * All the meshes must share a vertex specification, actors which don't
+     * match the first (or which are animated) are skipped with a warning. The
+     * actors themselves are left alone, usually you'll destroy them afterwards.
+     * Returns a null pointer if nothing could be merged. */
+    GeomPtr new_geom_from_actors(
+        const std::vector<ActorPtr>& actors,
+        const GeomCullerOptions& culler_options=GeomCullerOptions()
+    );
+
     GeomPtr geom(const GeomID gid) const;
     bool has_geom(GeomID geom_id) const;
     void destroy_geom(GeomID geom_id);
@@ -225,6 +240,12 @@ public:
         return active_pipeline_count_ > 0;
     }
 
+    /* Brings the absolute transformation of every node moved since the
+     * last call up to date. Independent subtrees are updated in parallel.
+     * Called by the compositor before rendering, everything else is
+     * updated when it's read */
+    void update_transformations();
+
 private:
     UniqueIDKey make_key() const override {
         return make_unique_id_key(id());
@@ -271,6 +292,43 @@ private:
 
     void clean_up_dead_objects();
 
+    /* Nodes whose transformation has changed since the last
+     * update_transformations() */
+    friend class StageNode;
+    std::vector<StageNode*> transformation_updates_;
+    std::vector<StageNode*> transformation_roots_;
+    std::vector<StageNode*> clean_transformation_nodes_;
+
+    /* Scratch space for a batch of roots, one per batch so that the
+     * workers don't share them */
+    struct TransformationBatch {
+        /* Passed to StageNode::update_transformation_subtree */
+        std::vector<StageNode*> subtree;
+
+        /* Nodes whose bounds changed while updating the batch */
+        std::vector<StageNode*> bounds_updated;
+    };
+
+    std::vector<TransformationBatch> transformation_batches_;
+
+    void queue_transformation_update(StageNode* node);
+    void dequeue_transformation_update(StageNode* node);
+
+    void update_transformation_batch(TransformationBatch& batch, std::size_t begin, std::size_t end);
+
+    /* Fires signal_bounds_updated for the nodes in the first batch_count
+     * batches, and stages their new bounds with the partitioner together */
+    void notify_bounds_updated(std::size_t batch_count);
+
+    /* Called whenever a partitioned node's bounds change */
+    void on_bounds_updated(StageNode* node, const AABB& new_bounds);
+
+    /* While true, on_bounds_updated collects the bounds instead of
+     * staging them one at a time */
+    bool collecting_bounds_updates_ = false;
+    std::vector<StageNode*> bounds_updated_nodes_;
+    std::vector<AABB> bounds_updated_;
+
 public:
     Property<decltype(&Stage::debug_)> debug = {this, &Stage::debug_};
     Property<decltype(&Stage::partitioner_)> partitioner = {this, &Stage::partitioner_};
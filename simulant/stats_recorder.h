@@ -40,6 +40,16 @@ public:
     void increment_fixed_steps() { fixed_steps_run_++; }
     void increment_frames() { frames_run_++; }
 
+    uint64_t render_queue_sort_time_us() const { return render_queue_sort_time_us_; }
+    void set_render_queue_sort_time_us(uint64_t value) {
+        render_queue_sort_time_us_ = value;
+    }
+
+    uint32_t render_queue_entries_sorted() const { return render_queue_entries_sorted_; }
+    void set_render_queue_entries_sorted(uint32_t value) {
+        render_queue_entries_sorted_ = value;
+    }
+
     void reset_polygons_rendered() {
         polygons_rendered_ = 0;
     }
@@ -49,16 +59,135 @@ public:
         return polygons_rendered_;
     }
 
+    void reset_draw_calls() {
+        draw_calls_ = 0;
+        instances_rendered_ = 0;
+    }
+
+    /* Instanced draws count as a single draw call, the instances they
+     * drew are counted separately */
+    void increment_draw_calls(uint32_t instance_count=1) {
+        draw_calls_++;
+        instances_rendered_ += instance_count;
+    }
+
+    uint32_t draw_calls() const {
+        return draw_calls_;
+    }
+
+    uint32_t instances_rendered() const {
+        return instances_rendered_;
+    }
+
+    void reset_streaming() {
+        bytes_streamed_ = 0;
+        streamed_updates_ = 0;
+    }
+
+    /* Dynamic vertex and index data written to the renderer's streaming
+     * buffers, and the number of those writes made because the data had
+     * changed (rather than because the streaming buffer wrapped) */
+    void increment_bytes_streamed(uint32_t bytes) {
+        bytes_streamed_ += bytes;
+    }
+
+    void increment_streamed_updates() {
+        streamed_updates_++;
+    }
+
+    uint32_t bytes_streamed() const {
+        return bytes_streamed_;
+    }
+
+    uint32_t streamed_updates() const {
+        return streamed_updates_;
+    }
+
+    void reset_render_state_changes() {
+        render_state_changes_ = 0;
+        render_state_changes_avoided_ = 0;
+    }
+
+    /* GL state changes made by the render queue visitors, and the
+     * ones skipped because the state was already set. The better the
+     * render queue groups draws, the higher the proportion avoided */
+    void increment_render_state_changes(uint32_t changes, uint32_t avoided) {
+        render_state_changes_ += changes;
+        render_state_changes_avoided_ += avoided;
+    }
+
+    uint32_t render_state_changes() const {
+        return render_state_changes_;
+    }
+
+    uint32_t render_state_changes_avoided() const {
+        return render_state_changes_avoided_;
+    }
+
+    /* Textures which the renderer is holding in video memory, and
+     * the number evicted or restored during the last frame */
+    void set_texture_residency(uint32_t count, uint32_t bytes) {
+        textures_resident_ = count;
+        texture_bytes_resident_ = bytes;
+    }
+
+    void set_texture_cpu_bytes(uint32_t bytes) {
+        texture_cpu_bytes_ = bytes;
+    }
+
+    void set_texture_evictions(uint32_t evicted, uint32_t restored) {
+        textures_evicted_ = evicted;
+        textures_restored_ = restored;
+    }
+
+    uint32_t textures_resident() const {
+        return textures_resident_;
+    }
+
+    uint32_t texture_bytes_resident() const {
+        return texture_bytes_resident_;
+    }
+
+    /* Texture data held in RAM */
+    uint32_t texture_cpu_bytes() const {
+        return texture_cpu_bytes_;
+    }
+
+    uint32_t textures_evicted() const {
+        return textures_evicted_;
+    }
+
+    uint32_t textures_restored() const {
+        return textures_restored_;
+    }
+
 private:
     float frame_time_ = 0;
     uint32_t subactors_renderered_ = 0;
     uint32_t frames_per_second_ = 0;
     uint32_t geometry_visible_ = 0;
 
+    uint64_t render_queue_sort_time_us_ = 0;
+    uint32_t render_queue_entries_sorted_ = 0;
+
     uint64_t fixed_steps_run_ = 0;
     uint64_t frames_run_ = 0;
 
     uint32_t polygons_rendered_ = 0;
+    uint32_t draw_calls_ = 0;
+    uint32_t instances_rendered_ = 0;
+
+    uint32_t bytes_streamed_ = 0;
+    uint32_t streamed_updates_ = 0;
+
+    uint32_t render_state_changes_ = 0;
+    uint32_t render_state_changes_avoided_ = 0;
+
+    uint32_t textures_resident_ = 0;
+    uint32_t texture_bytes_resident_ = 0;
+    uint32_t texture_cpu_bytes_ = 0;
+    uint32_t textures_evicted_ = 0;
+    uint32_t textures_restored_ = 0;
 };
 
 
@@ -514,7 +514,7 @@ bool Texture::convert(TextureFormat new_format, const TextureChannelSet &channel
 }
 
 
-static void do_flip_vertically(uint8_t* data, uint16_t width, uint16_t height, TextureFormat format) {
+void flip_texture_data_vertically(uint8_t* data, uint16_t width, uint16_t height, TextureFormat format) {
     /**
      *  Flips the texture data vertically
      */
@@ -541,7 +541,7 @@ static void do_flip_vertically(uint8_t* data, uint16_t width, uint16_t height, T
 }
 
 void Texture::flip_vertically() {
-    mutate_data(&do_flip_vertically);
+    mutate_data(&flip_texture_data_vertically);
 }
 
 void Texture::set_source(const Path& source) {
@@ -556,6 +556,9 @@ void Texture::free() {
     delete [] data_;
     data_ = nullptr;
     data_size_ = 0;
+
+    mipmap_data_.clear();
+    mipmap_data_.shrink_to_fit();
 }
 
 bool Texture::has_data() const {
@@ -574,6 +577,8 @@ void Texture::mutate_data(Texture::MutationFunc func) {
 
     /* A mutation by definition updates the data */
     data_dirty_ = true;
+    data_from_source_ = false;
+    mipmap_data_.clear();
 }
 
 bool Texture::is_compressed() const {
@@ -605,6 +610,10 @@ uint32_t Texture::data_size() const {
 void Texture::set_data(const uint8_t* data, std::size_t size) {
     resize_data(size);
     std::copy(data, data + size, data_);
+
+    data_dirty_ = true;
+    data_from_source_ = false;
+    mipmap_data_.clear();
 }
 
 uint8_t* Texture::_stash_paletted_data() {
@@ -678,6 +687,27 @@ void Texture::_set_data_clean() {
     data_dirty_ = false;
 }
 
+void Texture::_set_dirty() {
+    data_dirty_ = true;
+    params_dirty_ = true;
+}
+
+void Texture::_set_source_flipped(bool v) {
+    source_flipped_ = v;
+}
+
+bool Texture::_source_flipped() const {
+    return source_flipped_;
+}
+
+void Texture::_set_data_from_source(bool v) {
+    data_from_source_ = v;
+}
+
+bool Texture::_data_from_source() const {
+    return data_from_source_;
+}
+
 void Texture::set_texture_wrap(TextureWrap wrap_u, TextureWrap wrap_v, TextureWrap wrap_w) {
     set_texture_wrap_u(wrap_u);
     set_texture_wrap_v(wrap_v);
@@ -729,6 +759,14 @@ void Texture::_set_has_mipmaps(bool v) {
     has_mipmaps_ = v;
 }
 
+void Texture::_set_mipmap_data(std::vector<Data> levels) {
+    mipmap_data_ = std::move(levels);
+}
+
+const std::vector<Texture::Data>& Texture::_mipmap_data() const {
+    return mipmap_data_;
+}
+
 void Texture::resize_data(uint32_t byte_size) {
     if(byte_size == data_size_) {
         return;
@@ -746,6 +784,8 @@ void Texture::resize_data(uint32_t byte_size) {
     std::memset(data_, 0, byte_size);
     data_size_ = byte_size;
     data_dirty_ = true;
+    data_from_source_ = false;
+    mipmap_data_.clear();
 }
 
 bool Texture::init() {
@@ -780,6 +820,60 @@ uint32_t Texture::_renderer_specific_id() const {
     return renderer_id_;
 }
 
+std::vector<std::vector<uint8_t>> generate_mipmap_data(const uint8_t* data, uint16_t width, uint16_t height, TextureFormat format) {
+    std::vector<std::vector<uint8_t>> levels;
+
+    if(format != TEXTURE_FORMAT_R_1UB_8 &&
+       format != TEXTURE_FORMAT_RGB_3UB_888 &&
+       format != TEXTURE_FORMAT_RGBA_4UB_8888) {
+        return levels;
+    }
+
+    if(!width || !height || (width & (width - 1)) || (height & (height - 1))) {
+        return levels;
+    }
+
+    const uint32_t channels = texture_format_stride(format);
+
+    const uint8_t* src = data;
+    uint32_t w = width;
+    uint32_t h = height;
+
+    while(w > 1 || h > 1) {
+        /* Once one side reaches 1, the other keeps halving
+         * on its own so we only average two texels */
+        uint32_t nw = std::max(w / 2, 1u);
+        uint32_t nh = std::max(h / 2, 1u);
+        uint32_t dx = (w > 1) ? 1 : 0;
+        uint32_t dy = (h > 1) ? 1 : 0;
+
+        std::vector<uint8_t> level(nw * nh * channels);
+        uint8_t* dst = &level[0];
+
+        for(uint32_t y = 0; y < nh; ++y) {
+            const uint8_t* row0 = src + ((y * 2) * w * channels);
+            const uint8_t* row1 = row0 + (dy * w * channels);
+
+            for(uint32_t x = 0; x < nw; ++x) {
+                uint32_t x0 = (x * 2) * channels;
+                uint32_t x1 = x0 + (dx * channels);
+
+                for(uint32_t c = 0; c < channels; ++c) {
+                    uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                    *dst++ = uint8_t((sum + 2) / 4);
+                }
+            }
+        }
+
+        levels.push_back(std::move(level));
+        src = &levels.back()[0];
+        w = nw;
+        h = nh;
+    }
+
+    return levels;
+}
+
 std::size_t texture_format_stride(TextureFormat format) {
     switch(format) {
         case TEXTURE_FORMAT_R_1UB_8: return 1;
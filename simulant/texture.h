@@ -116,6 +116,17 @@ std::size_t texture_format_channels(TextureFormat format);
  * data following the main texture data */
 bool texture_format_contains_mipmaps(TextureFormat format);
 
+/** Flips the rows of texture data in-place, the data must be uncompressed */
+void flip_texture_data_vertically(uint8_t* data, uint16_t width, uint16_t height, TextureFormat format);
+
+/** Box filters the data down to 1x1 and returns each mipmap level after
+ * the first. Returns nothing unless the format is one of the standard byte
+ * formats and the dimensions are powers of two. This doesn't touch the
+ * renderer, so it's safe to call from a worker thread. */
+std::vector<std::vector<uint8_t>> generate_mipmap_data(
+    const uint8_t* data, uint16_t width, uint16_t height, TextureFormat format
+);
+
 enum TextureFreeData {
     TEXTURE_FREE_DATA_NEVER,
     TEXTURE_FREE_DATA_AFTER_UPLOAD
@@ -343,10 +354,31 @@ public:
 
     /** INTERNAL: returns true if the filters are dirty */
     bool _params_dirty() const;
+
+    /** INTERNAL: marks the data and params as needing upload again, used
+     * when the renderer has released the texture's video memory */
+    void _set_dirty();
+
+    /** INTERNAL: set when the data from source() was flipped vertically
+     * after loading, so that it can be reloaded the same way */
+    void _set_source_flipped(bool v);
+    bool _source_flipped() const;
+
+    /** INTERNAL: true while the data is what loading source() produced,
+     * so it can be freed and loaded again. Any change to the data clears
+     * this */
+    void _set_data_from_source(bool v);
+    bool _data_from_source() const;
     void _set_has_mipmaps(bool v);
 
     /** INTERNAL: copy the current data to the paletted data array */
     uint8_t* _stash_paletted_data();
+
+    /** INTERNAL: mipmap levels (after the first) that were generated on the
+     * CPU. These are uploaded along with the data, and are cleared
+     * whenever the data changes */
+    void _set_mipmap_data(std::vector<Data> levels);
+    const std::vector<Data>& _mipmap_data() const;
 private:
     Renderer* renderer_ = nullptr;
 
@@ -356,6 +388,8 @@ private:
     TextureFormat format_ = TEXTURE_FORMAT_RGBA_4UB_8888;
 
     Path source_;
+    bool source_flipped_ = false;
+    bool data_from_source_ = false;
 
     bool auto_upload_ = true; /* If true, the texture is uploaded by the renderer asap */
 
@@ -379,6 +413,7 @@ private:
 
     MipmapGenerate mipmap_generation_ = MIPMAP_GENERATE_COMPLETE;
     bool has_mipmaps_ = false;
+    std::vector<Data> mipmap_data_;
 
     bool params_dirty_ = true;
     TextureFilter filter_ = TEXTURE_FILTER_POINT;
@@ -5,6 +5,7 @@
 #include <type_traits>
 #include "thread.h"
 #include "mutex.h"
+#include "job_system.h"
 #include "../logging.h"
 
 namespace smlt {
@@ -30,6 +31,8 @@ public:
         T result_;
         bool is_ready_ = false;
         bool is_failed_ = false;
+
+        JobHandle job_;
     };
 
     Future(std::shared_ptr<FutureState> state):
@@ -87,6 +90,12 @@ public:
     }
 
     void wait() {
+        /* Run other jobs while we wait, rather than spinning */
+        auto& job = state_->job_;
+        if(job) {
+            job->system()->wait(job);
+        }
+
         while(wait_for(std::chrono::microseconds(0)) != FutureStatus::ready) {}
     }
 
@@ -118,6 +127,8 @@ public:
         Mutex lock_;
         bool is_ready_ = false;
         bool is_failed_ = false;
+
+        JobHandle job_;
     };
 
     /* FIXME: Should be private */
@@ -154,6 +165,12 @@ public:
     }
 
     void wait() {
+        /* Run other jobs while we wait, rather than spinning */
+        auto& job = state_->job_;
+        if(job) {
+            job->system()->wait(job);
+        }
+
         while(wait_for(std::chrono::microseconds(0)) != FutureStatus::ready) {}
     }
 
@@ -239,11 +256,15 @@ Future<result_of_t<Function(Args...)>> async(Function&& f, Args&&... args) {
 
     WrapperType callback = WrapperType(&processor<ResultType, Function, Args...>);
 
-    Thread(
-        callback,
-        state,
-        std::forward<Function>(f), std::forward<Args>(args)...
-    ).detach();
+    /* Runs on the engine's worker pool rather than spawning
+     * a thread per call */
+    state->job_ = default_job_system()->schedule(
+        std::bind<void>(
+            callback,
+            state,
+            std::forward<Function>(f), std::forward<Args>(args)...
+        )
+    );
 
     Future<ResultType> ret(state);
     return ret;
@@ -251,4 +272,3 @@ Future<result_of_t<Function(Args...)>> async(Function&& f, Args&&... args) {
 
 }
 }
-
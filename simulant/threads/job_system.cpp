@@ -0,0 +1,381 @@
+#include <algorithm>
+
+#include "job_system.h"
+#include "../logging.h"
+
+namespace smlt {
+namespace thread {
+
+bool Job::is_complete() const {
+    Lock<Mutex> lock(lock_);
+    return complete_;
+}
+
+void JobQueue::push_back(const JobHandle& job) {
+    Lock<Mutex> lock(lock_);
+
+    if(count_ == jobs_.size()) {
+        /* Grow and unwrap the ring so head_ is at zero */
+        std::vector<JobHandle> jobs(jobs_.size() * 2);
+        for(std::size_t i = 0; i < count_; ++i) {
+            jobs[i] = std::move(jobs_[(head_ + i) % jobs_.size()]);
+        }
+
+        jobs_ = std::move(jobs);
+        head_ = 0;
+    }
+
+    jobs_[(head_ + count_) % jobs_.size()] = job;
+    ++count_;
+}
+
+JobHandle JobQueue::pop_back() {
+    Lock<Mutex> lock(lock_);
+    if(!count_) {
+        return JobHandle();
+    }
+
+    --count_;
+    auto& slot = jobs_[(head_ + count_) % jobs_.size()];
+    JobHandle ret = std::move(slot);
+    slot.reset();
+    return ret;
+}
+
+JobHandle JobQueue::pop_front() {
+    Lock<Mutex> lock(lock_);
+    if(!count_) {
+        return JobHandle();
+    }
+
+    auto& slot = jobs_[head_];
+    JobHandle ret = std::move(slot);
+    slot.reset();
+
+    head_ = (head_ + 1) % jobs_.size();
+    --count_;
+    return ret;
+}
+
+bool JobQueue::empty() const {
+    Lock<Mutex> lock(lock_);
+    return count_ == 0;
+}
+
+static JobSystem* global_job_system = nullptr;
+static Mutex global_job_system_lock;
+
+JobSystem::JobSystem(std::size_t worker_count) {
+    if(!worker_count) {
+        auto cores = hardware_concurrency();
+        worker_count = (cores > 1) ? cores - 1 : 1;
+    }
+
+    S_DEBUG("Starting job system with {0} workers", worker_count);
+
+    for(std::size_t i = 0; i < worker_count; ++i) {
+        queues_.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+    }
+
+    /* Workers can't receive jobs until the constructor returns, so
+     * filling worker_ids_ as we go is safe */
+    for(std::size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::unique_ptr<Thread>(
+            new Thread(&JobSystem::worker_main, this, i)
+        ));
+
+        worker_ids_.push_back(workers_.back()->id());
+    }
+}
+
+JobSystem::~JobSystem() {
+    shutdown();
+
+    Lock<Mutex> lock(global_job_system_lock);
+    if(global_job_system == this) {
+        global_job_system = nullptr;
+    }
+}
+
+void JobSystem::shutdown() {
+    {
+        Lock<Mutex> lock(signal_lock_);
+        if(!running_) {
+            return;
+        }
+
+        running_ = false;
+        signal_.notify_all();
+    }
+
+    for(auto& worker: workers_) {
+        worker->join();
+    }
+
+    S_DEBUG("Job system stopped after running {0} jobs ({1} stolen)", jobs_run_, jobs_stolen_);
+}
+
+bool JobSystem::is_worker_thread() const {
+    return worker_index() >= 0;
+}
+
+int32_t JobSystem::worker_index() const {
+    auto id = this_thread_id();
+    for(std::size_t i = 0; i < worker_ids_.size(); ++i) {
+        if(worker_ids_[i] == id) {
+            return (int32_t) i;
+        }
+    }
+
+    return -1;
+}
+
+uint64_t JobSystem::jobs_run() const {
+    Lock<Mutex> lock(signal_lock_);
+    return jobs_run_;
+}
+
+uint64_t JobSystem::jobs_stolen() const {
+    Lock<Mutex> lock(signal_lock_);
+    return jobs_stolen_;
+}
+
+JobHandle JobSystem::schedule(std::function<void ()> func) {
+    JobHandle job(new Job(this, func));
+    enqueue(job);
+    return job;
+}
+
+JobHandle JobSystem::schedule(std::function<void ()> func, const std::vector<JobHandle>& dependencies) {
+    JobHandle job(new Job(this, func));
+
+    /* The extra count stops the job being queued by a dependency
+     * completing while we're still registering the others */
+    job->dependencies_remaining_ = dependencies.size() + 1;
+
+    std::size_t already_complete = 1;
+    for(auto& dep: dependencies) {
+        Lock<Mutex> lock(dep->lock_);
+        if(dep->complete_) {
+            ++already_complete;
+        } else {
+            dep->continuations_.push_back(job);
+        }
+    }
+
+    bool ready = false;
+    {
+        Lock<Mutex> lock(job->lock_);
+        job->dependencies_remaining_ -= already_complete;
+        ready = (job->dependencies_remaining_ == 0);
+    }
+
+    if(ready) {
+        enqueue(job);
+    }
+
+    return job;
+}
+
+void JobSystem::enqueue(const JobHandle& job) {
+    auto index = worker_index();
+
+    {
+        Lock<Mutex> lock(signal_lock_);
+        if(running_) {
+            if(index < 0) {
+                /* Not a worker, spread external work across the queues */
+                index = next_queue_++ % queues_.size();
+            }
+
+            queues_[index]->push_back(job);
+            ++queued_;
+            signal_.notify_one();
+            return;
+        }
+    }
+
+    /* We've shut down, so there's nobody left to run it */
+    execute(job);
+}
+
+JobHandle JobSystem::take(int32_t index) {
+    JobHandle job;
+    bool stolen = false;
+
+    if(index >= 0) {
+        job = queues_[index]->pop_back();
+    }
+
+    const std::size_t count = queues_.size();
+    const std::size_t start = (index >= 0) ? index + 1 : 0;
+    for(std::size_t i = 0; !job && i < count; ++i) {
+        job = queues_[(start + i) % count]->pop_front();
+        stolen = bool(job) && index >= 0;
+    }
+
+    if(job) {
+        Lock<Mutex> lock(signal_lock_);
+        --queued_;
+        if(stolen) {
+            ++jobs_stolen_;
+        }
+    }
+
+    return job;
+}
+
+void JobSystem::execute(const JobHandle& job) {
+    try {
+        job->func_();
+    } catch(std::exception& e) {
+        S_ERROR("Unhandled exception in job: {0}", e.what());
+    }
+
+    /* Release anything the job captured */
+    job->func_ = std::function<void ()>();
+
+    std::vector<JobHandle> continuations;
+    {
+        Lock<Mutex> lock(job->lock_);
+        job->complete_ = true;
+        std::swap(continuations, job->continuations_);
+    }
+
+    for(auto& next: continuations) {
+        bool ready = false;
+        {
+            Lock<Mutex> lock(next->lock_);
+            ready = (--next->dependencies_remaining_ == 0);
+        }
+
+        if(ready) {
+            enqueue(next);
+        }
+    }
+
+    Lock<Mutex> lock(signal_lock_);
+    ++jobs_run_;
+    signal_.notify_all();
+}
+
+bool JobSystem::run_pending_job() {
+    auto job = take(worker_index());
+    if(!job) {
+        return false;
+    }
+
+    execute(job);
+    return true;
+}
+
+void JobSystem::worker_main(std::size_t index) {
+    while(true) {
+        auto job = take((int32_t) index);
+        if(job) {
+            execute(job);
+            continue;
+        }
+
+        Lock<Mutex> lock(signal_lock_);
+        while(running_ && !queued_) {
+            signal_.wait(signal_lock_);
+        }
+
+        if(!running_ && !queued_) {
+            break;
+        }
+    }
+}
+
+void JobSystem::wait(const JobHandle& job) {
+    if(!job) {
+        return;
+    }
+
+    while(!job->is_complete()) {
+        if(run_pending_job()) {
+            continue;
+        }
+
+        /* Nothing to help with, sleep until something completes
+         * or is queued */
+        Lock<Mutex> lock(signal_lock_);
+        if(!queued_ && !job->is_complete()) {
+            signal_.wait(signal_lock_);
+        }
+    }
+}
+
+void JobSystem::wait_all(const std::vector<JobHandle>& jobs) {
+    for(auto& job: jobs) {
+        wait(job);
+    }
+}
+
+void JobSystem::parallel_for_batches(std::size_t count, std::function<void (std::size_t, std::size_t)> func, std::size_t min_batch_size) {
+    if(!count) {
+        return;
+    }
+
+    min_batch_size = std::max<std::size_t>(min_batch_size, 1);
+
+    /* One batch per worker, plus one for the calling thread */
+    std::size_t batches = std::min(
+        (count + min_batch_size - 1) / min_batch_size,
+        worker_count() + 1
+    );
+
+    if(batches < 2) {
+        func(0, count);
+        return;
+    }
+
+    const std::size_t batch_size = (count + batches - 1) / batches;
+
+    std::vector<JobHandle> jobs;
+    jobs.reserve(batches - 1);
+
+    std::size_t begin = batch_size;
+    while(begin < count) {
+        auto end = std::min(begin + batch_size, count);
+        jobs.push_back(schedule([&func, begin, end]() {
+            func(begin, end);
+        }));
+        begin = end;
+    }
+
+    try {
+        func(0, batch_size);
+    } catch(...) {
+        /* The jobs reference func, so they must finish first */
+        wait_all(jobs);
+        throw;
+    }
+
+    wait_all(jobs);
+}
+
+JobSystem* default_job_system() {
+    /* Only used if the application didn't install a job system */
+    static std::unique_ptr<JobSystem> fallback;
+
+    Lock<Mutex> lock(global_job_system_lock);
+    if(!global_job_system) {
+        if(!fallback) {
+            fallback.reset(new JobSystem());
+        }
+
+        global_job_system = fallback.get();
+    }
+
+    return global_job_system;
+}
+
+void set_default_job_system(JobSystem* system) {
+    Lock<Mutex> lock(global_job_system_lock);
+    global_job_system = system;
+}
+
+}
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "thread.h"
+#include "mutex.h"
+#include "condition.h"
+
+/*
+ * A persistent pool of worker threads which run small jobs.
+ *
+ * Each worker owns a queue of jobs. A worker pushes and pops from the back
+ * of its own queue (so recently spawned, cache-warm work runs first) and
+ * when its queue is empty it steals from the front of the other workers'
+ * queues. Threads which are waiting on a job (including the main thread)
+ * help out by running queued jobs rather than sleeping.
+ *
+ * Usage:
+ *
+ * auto jobs = thread::default_job_system();
+ *
+ * auto a = jobs->schedule([]() { ... });
+ * auto b = jobs->schedule([]() { ... });
+ *
+ * // Runs once both a and b have completed
+ * auto c = jobs->schedule([]() { ... }, {a, b});
+ *
+ * jobs->wait(c);
+ *
+ * jobs->parallel_for(particles.size(), [&](std::size_t i) {
+ *      update_particle(particles[i]);
+ * });
+ */
+
+namespace smlt {
+namespace thread {
+
+class JobSystem;
+
+class Job {
+public:
+    bool is_complete() const;
+
+    JobSystem* system() const {
+        return system_;
+    }
+
+private:
+    friend class JobSystem;
+
+    Job(JobSystem* system, std::function<void ()> func):
+        system_(system),
+        func_(func) {}
+
+    JobSystem* system_ = nullptr;
+    std::function<void ()> func_;
+
+    mutable Mutex lock_;
+
+    /* Number of dependencies that must complete before
+     * this job is queued. */
+    std::size_t dependencies_remaining_ = 0;
+    bool complete_ = false;
+
+    /* Jobs waiting on this one */
+    std::vector<std::shared_ptr<Job>> continuations_;
+};
+
+typedef std::shared_ptr<Job> JobHandle;
+
+/* A queue of jobs. The owning worker pushes and pops at the back,
+ * other workers steal from the front. This is a growable ring buffer
+ * rather than a std::deque to avoid excessive allocations. */
+class JobQueue {
+public:
+    JobQueue():
+        jobs_(16) {}
+
+    void push_back(const JobHandle& job);
+    JobHandle pop_back();
+    JobHandle pop_front();
+
+    bool empty() const;
+
+private:
+    mutable Mutex lock_;
+
+    std::vector<JobHandle> jobs_;
+    std::size_t head_ = 0;
+    std::size_t count_ = 0;
+};
+
+class JobSystem {
+public:
+    /* If worker_count is zero, one worker is started for each
+     * available core except the calling thread's, with a minimum
+     * of one */
+    JobSystem(std::size_t worker_count=0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /* Queues a job to run on a worker thread */
+    JobHandle schedule(std::function<void ()> func);
+
+    /* Queues a job that will run once all of the dependencies
+     * have completed */
+    JobHandle schedule(std::function<void ()> func, const std::vector<JobHandle>& dependencies);
+
+    /* Queues a job to run once the job has completed */
+    JobHandle then(const JobHandle& job, std::function<void ()> func) {
+        return schedule(func, {job});
+    }
+
+    /* Blocks until the job has completed. The calling thread will
+     * run other queued jobs while it waits. */
+    void wait(const JobHandle& job);
+    void wait_all(const std::vector<JobHandle>& jobs);
+
+    /* Calls func(i) for each i in [0, count), splitting the range
+     * into batches across the workers and the calling thread.
+     * Returns when every batch has completed. */
+    template<typename Func>
+    void parallel_for(std::size_t count, Func&& func, std::size_t min_batch_size=1) {
+        parallel_for_batches(count, [&func](std::size_t begin, std::size_t end) {
+            for(auto i = begin; i < end; ++i) {
+                func(i);
+            }
+        }, min_batch_size);
+    }
+
+    /* Like parallel_for, but func(begin, end) is called once per
+     * batch. Useful for kernels that process contiguous arrays. */
+    void parallel_for_batches(
+        std::size_t count,
+        std::function<void (std::size_t, std::size_t)> func,
+        std::size_t min_batch_size=1
+    );
+
+    /* Runs a single queued job on the calling thread. Returns
+     * false if there was nothing to run */
+    bool run_pending_job();
+
+    /* Stops the workers once all queued jobs have run. Jobs scheduled
+     * after shutdown run immediately on the calling thread. */
+    void shutdown();
+
+    std::size_t worker_count() const {
+        return workers_.size();
+    }
+
+    /* Returns true if called from one of this system's workers */
+    bool is_worker_thread() const;
+
+    uint64_t jobs_run() const;
+    uint64_t jobs_stolen() const;
+
+private:
+    void worker_main(std::size_t index);
+    int32_t worker_index() const;
+
+    void enqueue(const JobHandle& job);
+    JobHandle take(int32_t index);
+    void execute(const JobHandle& job);
+
+    std::vector<std::unique_ptr<Thread>> workers_;
+    std::vector<ThreadID> worker_ids_;
+    std::vector<std::unique_ptr<JobQueue>> queues_;
+
+    /* Protects the members below, signal_ is notified when a job is
+     * queued or a job completes */
+    mutable Mutex signal_lock_;
+    Condition signal_;
+
+    bool running_ = true;
+    std::size_t queued_ = 0;
+    std::size_t next_queue_ = 0;
+
+    uint64_t jobs_run_ = 0;
+    uint64_t jobs_stolen_ = 0;
+};
+
+/* Returns the job system used by thread::async and the engine. The
+ * Application installs its own pool when it's constructed, otherwise
+ * one is created on first use. */
+JobSystem* default_job_system();
+void set_default_job_system(JobSystem* system);
+
+}
+}
@@ -8,6 +8,7 @@
 #include <pspthreadman.h>
 #else
 #include <time.h>
+#include <unistd.h>
 #endif
 
 #include "../logging.h"
@@ -153,6 +154,21 @@ void yield() {
 #endif
 }
 
+std::size_t hardware_concurrency() {
+#ifdef __WIN32__
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+#elif defined(__PSP__) || defined(__DREAMCAST__)
+    return 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (std::size_t) count : 1;
+#else
+    return 1;
+#endif
+}
+
 ThreadID this_thread_id() {
 #ifdef __PSP__
     return (ThreadID) sceKernelGetThreadId();
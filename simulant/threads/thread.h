@@ -159,6 +159,10 @@ private:
 void yield();
 void sleep(size_t ms);
 
+/* Returns the number of cores available to the process, or 1 if
+ * that can't be determined */
+std::size_t hardware_concurrency();
+
 ThreadID this_thread_id();
 
 }
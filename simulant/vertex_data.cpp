@@ -18,13 +18,32 @@
 //
 
 #include <stdexcept>
+#include <atomic>
+
 #include "vertex_data.h"
 #include "window.h"
-#include "time_keeper.h"
+#include "threads/mutex.h"
 #include "utils/gl_thread_check.h"
 
 namespace smlt {
 
+/* Vertex and index data take a new number each time they're updated, these
+ * increase across all data so they can be compared with the number of
+ * whatever was uploaded last. Unlike a timestamp, two updates in quick
+ * succession never get the same number */
+static uint64_t next_update_version() {
+#if !defined(__PSP__) && !defined(__DREAMCAST__)
+    static std::atomic<uint64_t> version(0);
+    return version.fetch_add(1, std::memory_order_relaxed) + 1;
+#else
+    static thread::Mutex lock;
+    static uint64_t version = 0;
+
+    thread::Lock<thread::Mutex> g(lock);
+    return ++version;
+#endif
+}
+
 // Adapted from here: https://github.com/mesa3d/mesa/blob/a5f618a291e67e74c56df235d45c3eb967ebb41f/src/mesa/main/image.c
 _S_FORCE_INLINE uint32_t pack_vertex_attribute_vec3_1i(float x, float y, float z) {
     const float w = 0.0f;
@@ -584,7 +603,7 @@ void VertexData::resize(uint32_t size) {
 
 void VertexData::done() {
     signal_update_complete_();
-    last_updated_ = TimeKeeper::now_in_us();
+    last_updated_ = next_update_version();
 }
 
 uint64_t VertexData::last_updated() const {
@@ -644,7 +663,7 @@ std::vector<uint32_t> IndexData::all() {
 
 void IndexData::done() {
     signal_update_complete_();
-    last_updated_ = TimeKeeper::now_in_us();
+    last_updated_ = next_update_version();
 }
 
 uint64_t IndexData::last_updated() const {
@@ -77,6 +77,9 @@ public:
     uint32_t move_next();
 
     void done();
+
+    /* Increases each time done() is called. Comparable between all vertex
+     * and index data, but not a time */
     uint64_t last_updated() const;
 
     void position(float x, float y, float z, float w);
@@ -395,6 +398,9 @@ public:
     }
 
     void done();
+
+    /* Increases each time done() is called. Comparable between all vertex
+     * and index data, but not a time */
     uint64_t last_updated() const;
 
     uint32_t at(const uint32_t i) const {
@@ -64,13 +64,14 @@ bool Window::create_window(uint16_t width, uint16_t height, uint8_t bpp, bool fu
 
     GLThreadCheck::init();
 
-    _init_window();
-
+    /* Created first so that the window knows whether it needs GL */
     renderer_ = new_renderer(
         this,
         application_->config_.development.force_renderer
     );
 
+    _init_window();
+
     _init_renderer(renderer_.get());
 
     renderer_->init_context();
@@ -97,6 +97,13 @@ public:
     virtual void check_events() = 0;
     virtual void swap_buffers() = 0;
 
+    /* Looks up an OpenGL function by name (e.g. one from an extension).
+     * Returns nullptr if the function isn't available. */
+    virtual void* gl_proc_address(const char* name) const {
+        _S_UNUSED(name);
+        return nullptr;
+    }
+
     uint16_t width() const override { return width_; }
     uint16_t height() const override { return height_; }
     bool is_fullscreen() const { return fullscreen_; }
@@ -33,7 +33,7 @@ public:
         auto ret1 = vbo_manager_->allocate_slot(mesh_->vertex_data);
         VBO* vbo = ret1.first;
         assert_equal(vbo->used_slot_count(), 1u);
-        assert_equal(vbo->free_slot_count(), (VBO_SIZE / vbo->slot_size_in_bytes()) - 1);
+        assert_equal(vbo->free_slot_count(), 1u); // The rest of the buffer
 
         auto mesh2 = stage_->assets->new_mesh(smlt::VertexSpecification::DEFAULT);
         mesh2->new_submesh_as_cube("cube", stage_->assets->new_material(), 1.0f);
@@ -43,22 +43,22 @@ public:
         assert_not_equal(ret1.second, ret3.second); // New slot, same VBO
 
         assert_equal(vbo->used_slot_count(), 2u);
-        assert_equal(vbo->free_slot_count(), (VBO_SIZE / vbo->slot_size_in_bytes()) - 2);
+        assert_equal(vbo->free_slot_count(), 1u);
 
         stage_->assets->destroy_mesh(mesh2->id());
         mesh2.reset(); // Remove refcount
         stage_->assets->run_garbage_collection();
 
-        // Slot should've been freed
+        // Slot should've been freed, and merged with the free space after it
         assert_equal(vbo->used_slot_count(), 1u);
-        assert_equal(vbo->free_slot_count(), (VBO_SIZE / vbo->slot_size_in_bytes()) - 1);
+        assert_equal(vbo->free_slot_count(), 1u);
     }
 
     void test_shared_index_vbo() {
         auto ret1 = vbo_manager_->allocate_slot(mesh_->first_submesh()->index_data);
         VBO* vbo = ret1.first;
         assert_equal(vbo->used_slot_count(), 1u);
-        assert_equal(vbo->free_slot_count(), (VBO_SIZE / vbo->slot_size_in_bytes()) - 1);
+        assert_equal(vbo->free_slot_count(), 1u); // The rest of the buffer
 
         auto mesh2 = stage_->assets->new_mesh(smlt::VertexSpecification::DEFAULT);
         mesh2->new_submesh_as_cube("cube", stage_->assets->new_material(), 1.0f);
@@ -68,22 +68,22 @@ public:
         assert_not_equal(ret1.second, ret3.second); // New slot, same VBO
 
         assert_equal(vbo->used_slot_count(), 2u);
-        assert_equal(vbo->free_slot_count(), (VBO_SIZE / vbo->slot_size_in_bytes()) - 2);
+        assert_equal(vbo->free_slot_count(), 1u);
 
         stage_->assets->destroy_mesh(mesh2->id());
         mesh2.reset(); // Remove refcount
         stage_->assets->run_garbage_collection();
 
-        // Slot should've been freed
+        // Slot should've been freed, and merged with the free space after it
         assert_equal(vbo->used_slot_count(), 1u);
-        assert_equal(vbo->free_slot_count(), (VBO_SIZE / vbo->slot_size_in_bytes()) - 1);
+        assert_equal(vbo->free_slot_count(), 1u);
     }
 
     void test_dedicated_vbo() {
         auto ret1 = vbo_manager_->allocate_slot(mesh_->vertex_data);
         VBO* vbo = ret1.first;
         assert_equal(vbo->used_slot_count(), 1u);
-        assert_equal(vbo->free_slot_count(), (VBO_SIZE / vbo->slot_size_in_bytes()) - 1);
+        assert_equal(vbo->free_slot_count(), 1u); // The rest of the buffer
 
         auto mesh2 = stage_->assets->new_mesh(VertexSpecification::DEFAULT);
 
@@ -112,7 +112,7 @@ public:
         auto ret1 = vbo_manager_->allocate_slot(mesh_->vertex_data);
         VBO* vbo = ret1.first;
         assert_equal(vbo->used_slot_count(), 1u);
-        assert_equal(vbo->free_slot_count(), (VBO_SIZE / vbo->slot_size_in_bytes()) - 1);
+        assert_equal(vbo->free_slot_count(), 1u); // The rest of the buffer
 
         /* 50000 verts should tip over 512k always */
         for(auto i = 0; i < 50000; ++i) {
@@ -144,6 +144,184 @@ public:
         assert_equal(vbo->used_slot_count(), 0u);
     }
 
+    void test_shared_allocations_are_not_rounded_to_powers_of_two() {
+        SharedVBO::ptr vbo = SharedVBO::create(INDEX_TYPE_16_BIT);
+
+        auto first = vbo->allocate_slot(33 * 1024);
+        assert_equal(vbo->slot_size_in_bytes(first), 33u * 1024u);
+
+        /* Sizes are only rounded up to the alignment */
+        auto second = vbo->allocate_slot(1000);
+        assert_equal(vbo->slot_size_in_bytes(second), 1008u);
+        assert_equal(vbo->byte_offset(second), 33u * 1024u);
+
+        auto stats = vbo->stats();
+        assert_equal(stats.buffer_count, 1u);
+        assert_equal(stats.used_bytes, uint64_t(33 * 1024 + 1008));
+        assert_equal(stats.free_bytes, uint64_t(VBO_SIZE) - stats.used_bytes);
+        assert_equal(stats.fragmentation(), 0.0f);
+    }
+
+    void test_freed_shared_blocks_are_merged() {
+        SharedVBO::ptr vbo = SharedVBO::create(INDEX_TYPE_16_BIT);
+
+        auto a = vbo->allocate_slot(4096);
+        auto b = vbo->allocate_slot(4096);
+        auto c = vbo->allocate_slot(4096);
+
+        vbo->release_slot(a);
+        vbo->release_slot(c);
+
+        /* The hole at the start, and the rest of the buffer */
+        auto stats = vbo->stats();
+        assert_equal(stats.free_block_count, 2u);
+        assert_equal(stats.largest_free_block, uint64_t(VBO_SIZE - 8192));
+        assert_true(stats.fragmentation() > 0.0f);
+
+        /* A hole that's big enough is reused */
+        auto d = vbo->allocate_slot(4000);
+        assert_equal(vbo->byte_offset(d), 0u);
+        vbo->release_slot(d);
+
+        vbo->release_slot(b);
+
+        stats = vbo->stats();
+        assert_equal(stats.free_block_count, 1u);
+        assert_equal(stats.free_bytes, uint64_t(VBO_SIZE));
+        assert_equal(stats.fragmentation(), 0.0f);
+    }
+
+    void test_sparse_shared_buffers_are_compacted() {
+        SharedVBO::ptr vbo = SharedVBO::create(INDEX_TYPE_16_BIT);
+
+        /* Fill two buffers, then free half of the first and most of the second */
+        std::vector<VBOSlot> slots;
+        for(auto i = 0u; i < (VBO_SIZE / (64 * 1024)) * 2; ++i) {
+            slots.push_back(vbo->allocate_slot(64 * 1024));
+        }
+
+        assert_equal(vbo->stats().buffer_count, 2u);
+
+        auto first_buffer = vbo->buffer_index(slots[0]);
+        uint32_t first_count = 0, second_count = 0;
+        for(auto slot: slots) {
+            if(vbo->buffer_index(slot) == first_buffer) {
+                if(first_count++ % 2) vbo->release_slot(slot);
+            } else if(second_count++ >= 2) {
+                vbo->release_slot(slot);
+            }
+        }
+
+        /* The emptier buffer is emptied a step at a time */
+        auto released = vbo->compact(64 * 1024);
+        assert_equal(released.size(), 1u);
+        assert_true(vbo->is_compacting());
+
+        released = vbo->compact(64 * 1024);
+        assert_equal(released.size(), 1u);
+
+        assert_false(vbo->is_compacting());
+        assert_equal(vbo->stats().buffer_count, 1u);
+    }
+
+    void test_shared_buffer_stats() {
+        vbo_manager_->allocate_slot(mesh_->vertex_data);
+        vbo_manager_->allocate_slot(mesh_->first_submesh()->index_data);
+
+        auto stats = vbo_manager_->shared_buffer_stats();
+        assert_equal(stats.buffer_count, 2u);
+        assert_equal(stats.used_block_count, 2u);
+        assert_true(stats.used_bytes >= mesh_->vertex_data->data_size() + mesh_->first_submesh()->index_data->data_size());
+        assert_equal(stats.used_bytes + stats.free_bytes, stats.buffer_bytes);
+    }
+
+    void test_data_changing_every_frame_is_streamed() {
+        auto actor = stage_->new_actor_with_mesh(mesh_->id());
+
+        batcher::RenderQueue queue;
+        queue.reset(stage_, window->renderer.get(), camera_);
+        actor->_get_renderables(&queue, camera_, DETAIL_LEVEL_NEAREST);
+
+        auto renderable = queue.renderable(0);
+        auto vertex_data = mesh_->vertex_data.get();
+
+        auto buffers = vbo_manager_->update_and_fetch_buffers(renderable);
+        auto shared = buffers.vertex_vbo;
+        assert_false(vbo_manager_->is_streamed(vertex_data));
+        assert_equal(shared->used_slot_count(), 1u);
+
+        auto rewrite = [&]() {
+            vertex_data->move_to_start();
+            vertex_data->position(Vec3(1, 2, 3));
+            vertex_data->done();
+        };
+
+        /* Changing once isn't enough */
+        vbo_manager_->begin_frame();
+        rewrite();
+        vbo_manager_->update_and_fetch_buffers(renderable);
+        assert_false(vbo_manager_->is_streamed(vertex_data));
+
+        for(auto i = 1u; i < STREAMING_THRESHOLD_FRAMES; ++i) {
+            vbo_manager_->begin_frame();
+            rewrite();
+            buffers = vbo_manager_->update_and_fetch_buffers(renderable);
+        }
+
+        assert_true(vbo_manager_->is_streamed(vertex_data));
+        assert_not_equal(buffers.vertex_vbo, shared);
+        assert_equal(shared->used_slot_count(), 0u);
+
+        auto first_offset = buffers.vertex_vbo->byte_offset(buffers.vertex_vbo_slot);
+        auto streamed = application->stats->bytes_streamed();
+        auto updates = application->stats->streamed_updates();
+        assert_true(streamed >= vertex_data->data_size());
+
+        /* Unchanged data isn't written again */
+        buffers = vbo_manager_->update_and_fetch_buffers(renderable);
+        assert_equal(application->stats->bytes_streamed(), streamed);
+        assert_equal(application->stats->streamed_updates(), updates);
+        assert_equal(buffers.vertex_vbo->byte_offset(buffers.vertex_vbo_slot), first_offset);
+
+        /* Changed data is appended, however soon after the last change */
+        vbo_manager_->begin_frame();
+        rewrite();
+        buffers = vbo_manager_->update_and_fetch_buffers(renderable);
+        assert_true(buffers.vertex_vbo->byte_offset(buffers.vertex_vbo_slot) > first_offset);
+        assert_equal(application->stats->streamed_updates(), updates + 1);
+
+        /* Once it settles down, it goes back to a shared slot */
+        for(auto i = 0u; i < STREAMING_IDLE_FRAMES; ++i) {
+            vbo_manager_->begin_frame();
+        }
+
+        buffers = vbo_manager_->update_and_fetch_buffers(renderable);
+        assert_false(vbo_manager_->is_streamed(vertex_data));
+        assert_equal(buffers.vertex_vbo, shared);
+    }
+
+    void test_streaming_vbo_wraps() {
+        StreamingVBO::ptr vbo = StreamingVBO::create(GL_ARRAY_BUFFER, 1024);
+
+        std::vector<uint8_t> data(300, 0);
+
+        auto first = vbo->write(&data[0], 300);
+        auto generation = vbo->generation();
+        assert_equal(first, 0u);
+
+        /* Writes are aligned */
+        auto second = vbo->write(&data[0], 300);
+        assert_equal(second, 304u);
+
+        vbo->write(&data[0], 300);
+        assert_equal(vbo->generation(), generation);
+
+        /* Not enough room, so the buffer is orphaned and we start again */
+        auto fourth = vbo->write(&data[0], 300);
+        assert_equal(fourth, 0u);
+        assert_equal(vbo->generation(), generation + 1);
+    }
+
     void test_demotion_to_shared() {
         throw test::SkippedTestError("Demotion from dedicated to shared VBOs when data reduces in size is not yet implemented. See #192");
     }
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <random>
+
+#include "simulant/simulant.h"
+#include "simulant/test.h"
+#include "simulant/frustum_culling.h"
+
+namespace {
+
+using namespace smlt;
+
+class FrustumCullingTest : public smlt::test::TestCase {
+public:
+    void set_up() {
+        Mat4 projection = Mat4::as_projection(Degrees(45.0f), 1.0f, 1.0f, 100.0f);
+        Mat4 view = Mat4::as_rotation_y(Degrees(30.0f));
+        Mat4 mvp = projection * view;
+
+        frustum_.build(&mvp);
+    }
+
+    void test_aabb_list() {
+        AABBList list;
+        assert_true(list.empty());
+
+        list.push_back(AABB(Vec3(1, 2, 3), 2.0f));
+        list.push_back(AABB(Vec3(-1, -2, -3), 4.0f));
+
+        assert_equal(list.size(), 2u);
+        assert_equal(list.at(0), AABB(Vec3(1, 2, 3), 2.0f));
+        assert_equal(list.at(1), AABB(Vec3(-1, -2, -3), 4.0f));
+        assert_close(list.mins(0)[1], -3.0f, 0.0001f);
+        assert_close(list.maxs(2)[0], 4.0f, 0.0001f);
+
+        list.set(0, AABB(Vec3(), 1.0f));
+        assert_equal(list.at(0), AABB(Vec3(), 1.0f));
+
+        list.clear();
+        assert_true(list.empty());
+    }
+
+    void test_visibility_mask() {
+        VisibilityMask mask;
+        mask.reset(40);
+
+        assert_equal(mask.size(), 40u);
+        assert_equal(mask.word_count(), 2u);
+        assert_equal(mask.count(), 0u);
+
+        mask.set(3);
+        mask.set(33);
+
+        assert_true(mask.test(3));
+        assert_true(mask.test(33));
+        assert_false(mask.test(4));
+        assert_equal(mask.count(), 2u);
+
+        std::vector<std::size_t> set;
+        mask.each_set([&](std::size_t i) {
+            set.push_back(i);
+        });
+
+        assert_equal(set.size(), 2u);
+        assert_equal(set[0], 3u);
+        assert_equal(set[1], 33u);
+
+        mask.reset(40);
+        assert_equal(mask.count(), 0u);
+    }
+
+    void test_empty_list() {
+        AABBList list;
+        VisibilityMask mask;
+
+        assert_equal(cull_aabbs(frustum_, list, mask), 0u);
+        assert_equal(mask.size(), 0u);
+    }
+
+    void test_matches_intersects_aabb() {
+        /* An odd number of boxes so the remainder after the SIMD
+         * loop is tested too */
+        std::mt19937 rng(4321);
+        std::uniform_real_distribution<float> position(-120.0f, 120.0f);
+        std::uniform_real_distribution<float> size(0.1f, 10.0f);
+
+        AABBList list;
+        std::vector<AABB> boxes;
+        for(int i = 0; i < 1001; ++i) {
+            boxes.push_back(AABB(Vec3(position(rng), position(rng), position(rng)), size(rng)));
+            list.push_back(boxes.back());
+        }
+
+        VisibilityMask mask;
+        auto visible = cull_aabbs(frustum_, list, mask);
+
+        std::size_t expected = 0;
+        for(std::size_t i = 0; i < boxes.size(); ++i) {
+            bool inside = frustum_.intersects_aabb(boxes[i]);
+            assert_equal(mask.test(i), inside);
+            expected += (inside) ? 1 : 0;
+        }
+
+        assert_true(expected > 0);
+        assert_equal(visible, expected);
+        assert_equal(mask.count(), expected);
+    }
+
+private:
+    Frustum frustum_;
+};
+
+}
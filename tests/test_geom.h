@@ -19,6 +19,27 @@ public:
         geom->set_render_priority(smlt::RENDER_PRIORITY_NEAR);
         assert_equal(geom->render_priority(), smlt::RENDER_PRIORITY_NEAR);
     }
+
+    void test_new_geom_from_actors() {
+        auto stage = scene->new_stage();
+        auto mesh = stage->assets->new_mesh(VertexSpecification::DEFAULT);
+        mesh->new_submesh_as_cube("cube", stage->assets->new_material(), 1.0f);
+
+        auto a = stage->new_actor_with_mesh(mesh);
+        a->move_to(-5, 0, 0);
+
+        auto b = stage->new_actor_with_mesh(mesh);
+        b->move_to(5, 0, 0);
+
+        auto geom = stage->new_geom_from_actors({a, b});
+        assert_true(geom);
+
+        assert_close(geom->aabb().min().x, -5.5f, 0.0001f);
+        assert_close(geom->aabb().max().x, 5.5f, 0.0001f);
+
+        /* Nothing to merge */
+        assert_false(stage->new_geom_from_actors({}));
+    }
 };
 
 }
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "simulant/simulant.h"
+#include "simulant/test.h"
+#include "../simulant/renderers/gl_state_cache.h"
+
+namespace {
+
+using namespace smlt;
+
+class GLStateCacheTests : public smlt::test::SimulantTestCase {
+public:
+    void test_redundant_changes_are_skipped() {
+        GLStateCache cache;
+
+        cache.set_depth_test_enabled(true);
+        cache.set_depth_test_enabled(true);
+        cache.set_blend_type(BLEND_ALPHA);
+        cache.set_blend_type(BLEND_ALPHA);
+
+        /* Depth test, blend enable and blend func */
+        assert_equal(cache.state_changes(), 3u);
+        assert_equal(cache.state_changes_avoided(), 3u);
+
+        cache.set_depth_test_enabled(false);
+        assert_equal(cache.state_changes(), 4u);
+    }
+
+    void test_blend_func_kept_while_disabled() {
+        GLStateCache cache;
+
+        cache.set_blend_type(BLEND_ADD);
+        cache.set_blend_type(BLEND_NONE);
+        cache.reset_counters();
+
+        /* Only re-enabling is necessary */
+        cache.set_blend_type(BLEND_ADD);
+        assert_equal(cache.state_changes(), 1u);
+        assert_equal(cache.state_changes_avoided(), 1u);
+    }
+
+    void test_texture_bindings() {
+        GLStateCache cache;
+
+        cache.bind_texture(0, 0);
+        cache.reset_counters();
+
+        cache.bind_texture(0, 0);
+        assert_equal(cache.state_changes(), 0u);
+        assert_equal(cache.state_changes_avoided(), 1u);
+    }
+
+    void test_invalidate_forces_calls_through() {
+        GLStateCache cache;
+
+        cache.set_cull_mode(CULL_MODE_BACK_FACE);
+        cache.invalidate();
+        cache.reset_counters();
+
+        cache.set_cull_mode(CULL_MODE_BACK_FACE);
+        assert_equal(cache.state_changes(), 2u);
+        assert_equal(cache.state_changes_avoided(), 0u);
+    }
+};
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <numeric>
+
+#include "simulant/simulant.h"
+#include "simulant/test.h"
+
+#include "simulant/threads/job_system.h"
+#include "simulant/threads/atomic.h"
+
+namespace {
+
+using namespace smlt;
+using namespace smlt::thread;
+
+class JobSystemTests : public smlt::test::SimulantTestCase {
+public:
+    void test_schedule_and_wait() {
+        JobSystem jobs(2);
+        assert_equal(jobs.worker_count(), 2u);
+
+        Atomic<int> counter(0);
+
+        std::vector<JobHandle> handles;
+        for(int i = 0; i < 100; ++i) {
+            handles.push_back(jobs.schedule([&counter]() { ++counter; }));
+        }
+
+        jobs.wait_all(handles);
+
+        assert_equal((int) counter, 100);
+        for(auto& handle: handles) {
+            assert_true(handle->is_complete());
+        }
+    }
+
+    void test_dependencies_run_first() {
+        JobSystem jobs(2);
+
+        Mutex lock;
+        std::vector<int> order;
+
+        auto record = [&lock, &order](int i) {
+            Lock<Mutex> g(lock);
+            order.push_back(i);
+        };
+
+        auto a = jobs.schedule([&]() { thread::sleep(10); record(1); });
+        auto b = jobs.schedule([&]() { record(2); });
+        auto c = jobs.schedule([&]() { record(3); }, {a, b});
+        auto d = jobs.then(c, [&]() { record(4); });
+
+        jobs.wait(d);
+
+        assert_equal(order.size(), 4u);
+        assert_equal(order[2], 3);
+        assert_equal(order[3], 4);
+    }
+
+    void test_dependency_already_complete() {
+        JobSystem jobs(1);
+
+        auto a = jobs.schedule([]() {});
+        jobs.wait(a);
+
+        bool ran = false;
+        auto b = jobs.then(a, [&ran]() { ran = true; });
+        jobs.wait(b);
+
+        assert_true(ran);
+    }
+
+    void test_parallel_for() {
+        JobSystem jobs(3);
+
+        std::vector<int> values(1000, 0);
+        jobs.parallel_for(values.size(), [&values](std::size_t i) {
+            values[i] = (int) i;
+        });
+
+        for(std::size_t i = 0; i < values.size(); ++i) {
+            assert_equal(values[i], (int) i);
+        }
+
+        Atomic<int> batches(0);
+        jobs.parallel_for_batches(10, [this, &batches](std::size_t begin, std::size_t end) {
+            assert_true(begin < end);
+            ++batches;
+        }, 5);
+
+        assert_equal((int) batches, 2);
+    }
+
+    void test_nested_wait_on_single_worker() {
+        JobSystem jobs(1);
+
+        bool inner_ran = false;
+        auto outer = jobs.schedule([&]() {
+            /* Waiting from inside a job must not deadlock the only worker */
+            auto inner = jobs.schedule([&inner_ran]() { inner_ran = true; });
+            jobs.wait(inner);
+        });
+
+        jobs.wait(outer);
+        assert_true(inner_ran);
+    }
+
+    void test_schedule_after_shutdown_runs_inline() {
+        JobSystem jobs(1);
+        jobs.shutdown();
+
+        bool ran = false;
+        auto job = jobs.schedule([&ran]() { ran = true; });
+        assert_true(ran);
+        assert_true(job->is_complete());
+    }
+};
+
+}
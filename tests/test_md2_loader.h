@@ -0,0 +1,60 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "simulant/loaders/md2_loader.h"
+
+namespace {
+
+using namespace smlt;
+
+class MD2LoaderTests : public test::SimulantTestCase {
+public:
+    void set_up() {
+        test::SimulantTestCase::set_up();
+        max_resident_frames_ = loaders::MD2Loader::MAX_RESIDENT_FRAMES;
+    }
+
+    void tear_down() {
+        loaders::MD2Loader::MAX_RESIDENT_FRAMES = max_resident_frames_;
+        test::SimulantTestCase::tear_down();
+    }
+
+    void test_frames_evicted_least_recently_used() {
+        loaders::MD2Loader::MAX_RESIDENT_FRAMES = 2;
+
+        auto mesh = application->shared_assets->new_mesh_from_file("ogro.md2");
+        assert_true(mesh->is_animated());
+
+        auto stats = mesh->animation_stats();
+        assert_true(stats.compressed_bytes > 0);
+        assert_equal(stats.frames_decoded, 0u);
+
+        auto unpacker = mesh->animated_frame_data_;
+        VertexData out(mesh->vertex_data->vertex_specification());
+
+        unpacker->unpack_frame(0, 1, 0.5f, nullptr, &out);
+        assert_equal(mesh->animation_stats().frames_decoded, 2u);
+
+        Vec3 expected = *out.position_at<Vec3>(0);
+
+        /* Frame 1 is still resident, frame 2 replaces frame 0 */
+        unpacker->unpack_frame(1, 2, 0.0f, nullptr, &out);
+        assert_equal(mesh->animation_stats().frames_decoded, 3u);
+
+        /* Frame 0 replaces frame 1 (the least recently used) so then frame 1
+         * has to be decoded again too. Re-decoded frames give the same result */
+        unpacker->unpack_frame(0, 1, 0.5f, nullptr, &out);
+        assert_equal(mesh->animation_stats().frames_decoded, 5u);
+        assert_equal(mesh->animation_stats().frames_unpacked, 3u);
+
+        Vec3 result = *out.position_at<Vec3>(0);
+        assert_close(result.x, expected.x, 0.0001f);
+        assert_close(result.y, expected.y, 0.0001f);
+        assert_close(result.z, expected.z, 0.0001f);
+    }
+
+private:
+    uint16_t max_resident_frames_ = 0;
+};
+
+}
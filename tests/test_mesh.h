@@ -4,11 +4,24 @@
 #include "simulant/simulant.h"
 #include "simulant/test.h"
 #include "simulant/macros.h"
+#include "simulant/meshes/pose_cache.h"
 
 namespace {
 
 using namespace smlt;
 
+/* Counts the frames it's asked to unpack */
+class CountingFrameUnpacker : public FrameUnpacker {
+public:
+    void prepare_unpack(uint32_t, uint32_t, float, Rig* const, Debug* const) override {}
+
+    void unpack_frame(uint32_t, uint32_t, float, Rig* const, VertexData* const, Debug* const) override {
+        ++unpack_count;
+    }
+
+    uint32_t unpack_count = 0;
+};
+
 class MeshTest : public smlt::test::SimulantTestCase {
 public:
     void set_up() {
@@ -406,6 +419,106 @@ public:
         assert_not_equal(mesh->id(), stage_->assets->find_mesh("Mesh 2")->id());
     }
 
+    void test_append() {
+        auto source = stage_->assets->mesh(generate_test_mesh(stage_));
+        auto mesh = stage_->assets->new_mesh(smlt::VertexSpecification::POSITION_ONLY);
+
+        assert_true(mesh->append(source, Mat4::as_translation(Vec3(10, 0, 0))));
+        assert_true(mesh->append(source, Mat4()));
+
+        assert_equal(mesh->vertex_data->count(), 8u);
+        assert_close(mesh->vertex_data->position_at<Vec3>(0)->x, 9.0f, EPSILON);
+        assert_close(mesh->vertex_data->position_at<Vec3>(4)->x, -1.0f, EPSILON);
+
+        /* The line submesh is dropped, the triangles share one submesh */
+        assert_equal(mesh->submesh_count(), 1u);
+
+        auto indexes = mesh->first_submesh()->index_data.get();
+        assert_equal(indexes->count(), 12u);
+        assert_equal(indexes->at(6), 4u);
+        assert_equal(indexes->at(11), 7u);
+
+        auto other = stage_->assets->new_mesh(smlt::VertexSpecification::DEFAULT);
+        assert_false(mesh->append(other, Mat4()));
+    }
+
+    void test_append_keeps_normals_perpendicular() {
+        auto source = stage_->assets->new_mesh(smlt::VertexSpecification::DEFAULT);
+        source->vertex_data->position(0, 0, 0);
+        source->vertex_data->normal(Vec3(1, 1, 0).normalized());
+        source->vertex_data->move_next();
+        source->vertex_data->done();
+
+        /* Stretched along X, so the surface tilts towards Y */
+        auto mesh = stage_->assets->new_mesh(smlt::VertexSpecification::DEFAULT);
+        assert_true(mesh->append(source, Mat4::from_pos_rot_scale(Vec3(), Quaternion(), Vec3(2, 1, 1))));
+
+        auto expected = Vec3(0.5f, 1, 0).normalized();
+        auto n = mesh->vertex_data->normal_at<Vec3>(0);
+        assert_close(n->x, expected.x, EPSILON);
+        assert_close(n->y, expected.y, EPSILON);
+        assert_close(n->z, 0.0f, EPSILON);
+
+        /* transform_vertices does the same */
+        source->transform_vertices(Mat4::from_pos_rot_scale(Vec3(), Quaternion(), Vec3(2, 1, 1)));
+        n = source->vertex_data->normal_at<Vec3>(0);
+        assert_close(n->x, expected.x, EPSILON);
+        assert_close(n->y, expected.y, EPSILON);
+    }
+
+    void test_animated_actor_unpacked_once_per_frame() {
+        auto unpacker = std::make_shared<CountingFrameUnpacker>();
+
+        /* Skeletal, so the poses aren't shared */
+        auto mesh = stage_->assets->new_mesh(smlt::VertexSpecification::DEFAULT);
+        mesh->add_skeleton(1);
+        mesh->enable_animation(MESH_ANIMATION_TYPE_SKELETAL, 2, unpacker);
+
+        auto actor = stage_->new_actor_with_mesh(mesh->id());
+
+        /* As when the actor is visible to two pipelines */
+        actor->_update_animated_vertices(1);
+        actor->_update_animated_vertices(1);
+        assert_equal(unpacker->unpack_count, 1u);
+
+        actor->_update_animated_vertices(2);
+        assert_equal(unpacker->unpack_count, 2u);
+        assert_equal(actor->interpolated_frame_, 2u);
+    }
+
+    void test_actors_share_poses() {
+        auto unpacker = std::make_shared<CountingFrameUnpacker>();
+
+        auto mesh = stage_->assets->new_mesh(smlt::VertexSpecification::DEFAULT);
+        mesh->enable_animation(MESH_ANIMATION_TYPE_VERTEX_MORPH, 2, unpacker);
+        assert_is_not_null(mesh->pose_cache());
+
+        auto a1 = stage_->new_actor_with_mesh(mesh->id());
+        auto a2 = stage_->new_actor_with_mesh(mesh->id());
+
+        a1->_update_animated_vertices(1);
+        a2->_update_animated_vertices(1);
+
+        assert_equal(unpacker->unpack_count, 1u);
+        assert_equal(mesh->pose_cache()->pose_count(), 1u);
+        assert_true(a1->interpolated_vertex_data_ == a2->interpolated_vertex_data_);
+
+        /* Still the same pose, so there's nothing to do */
+        a1->_update_animated_vertices(2);
+        assert_equal(unpacker->unpack_count, 1u);
+
+        /* Close enough to share a quantised pose */
+        auto shared = mesh->pose_cache()->fetch(0, 1, 0.5f, 2);
+        auto close = mesh->pose_cache()->fetch(0, 1, 0.501f, 2);
+        assert_true(shared == close);
+        assert_equal(unpacker->unpack_count, 2u);
+
+        /* Poses unused for a frame are recycled */
+        mesh->pose_cache()->fetch(0, 1, 0.5f, 3);
+        mesh->pose_cache()->fetch(0, 1, 0.5f, 4);
+        assert_equal(mesh->pose_cache()->pose_count(), 1u);
+    }
+
 private:
     smlt::CameraPtr camera_;
     smlt::StagePtr stage_;
@@ -3,6 +3,13 @@
 #include <simulant/test.h>
 #include <simulant/simulant.h>
 
+#ifndef _arch_dreamcast
+#ifndef PSP
+#include "simulant/renderers/gl2x/generic_renderer.h"
+#include "simulant/renderers/gl2x/gpu_program.h"
+#endif
+#endif
+
 namespace {
 
 using namespace smlt;
@@ -75,7 +82,10 @@ public:
     void test_spawn_instances_updates_renderables() {
         auto instancer = stage_->new_mesh_instancer(mesh_);
 
+        /* Back the camera off so it can see instances at the origin */
         auto camera = stage_->new_camera();
+        camera->move_to(0, 0, 10);
+
         batcher::RenderQueue queue;
         queue.reset(stage_, window->renderer.get(), camera);
 
@@ -90,16 +100,147 @@ public:
         assert_equal(queue.renderable_count(), mesh_->submesh_count());
         queue.clear();
 
-        instancer->new_mesh_instance(smlt::Vec3(100));
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, -100));
         instancer->_get_renderables(&queue, camera, DETAIL_LEVEL_NEAREST);
 
         assert_equal(queue.renderable_count(), mesh_->submesh_count() * 2);
     }
 
+    void test_instances_outside_frustum_are_culled() {
+        auto instancer = stage_->new_mesh_instancer(mesh_);
+
+        auto camera = stage_->new_camera();
+        batcher::RenderQueue queue;
+        queue.reset(stage_, window->renderer.get(), camera);
+
+        /* The camera looks down -Z, so only the first is visible */
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, -10));
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, 10));
+
+        instancer->_get_renderables(&queue, camera, DETAIL_LEVEL_NEAREST);
+        assert_equal(queue.renderable_count(), mesh_->submesh_count());
+        assert_close(queue.renderable(0)->final_transformation[14], -10.0f, 0.0001f);
+        queue.clear();
+
+        /* Moving the instancer moves the instances with it */
+        instancer->move_to(0, 0, -20);
+        instancer->_get_renderables(&queue, camera, DETAIL_LEVEL_NEAREST);
+        assert_equal(queue.renderable_count(), mesh_->submesh_count() * 2);
+    }
+
+    void test_opaque_instances_are_queued_together() {
+        auto instancer = stage_->new_mesh_instancer(mesh_);
+
+        auto camera = stage_->new_camera();
+        batcher::RenderQueue queue;
+        queue.reset(stage_, window->renderer.get(), camera);
+
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, -10));
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, -50));
+
+        /* They share a centre, so the sort keeps each submesh's
+         * instances next to each other for the renderer to batch */
+        instancer->_get_renderables(&queue, camera, DETAIL_LEVEL_NEAREST);
+        assert_equal(queue.renderable_count(), mesh_->submesh_count() * 2);
+        assert_equal(queue.renderable(0)->centre, queue.renderable(1)->centre);
+        assert_equal(queue.renderable(0)->vertex_data, queue.renderable(1)->vertex_data);
+        assert_equal(queue.renderable(0)->index_data, queue.renderable(1)->index_data);
+    }
+
+    void test_default_material_is_drawn_instanced() {
+#ifndef _arch_dreamcast
+#ifndef PSP
+        auto renderer = dynamic_cast<GenericRenderer*>(window->renderer.get());
+        if(!renderer) {
+            return;
+        }
+
+        /* A new material's pass uses the renderer's default program */
+        auto material = stage_->assets->new_material();
+        for(auto& submesh: mesh_->each_submesh()) {
+            submesh->set_material(material);
+        }
+
+        auto instancer = stage_->new_mesh_instancer(mesh_);
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, -10));
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, -50));
+
+        auto camera = stage_->new_camera();
+        batcher::RenderQueue queue;
+        queue.reset(stage_, window->renderer.get(), camera);
+        instancer->_get_renderables(&queue, camera, DETAIL_LEVEL_NEAREST);
+
+        auto pass = queue.renderable(0)->material->pass(0);
+        auto program = renderer->gpu_program(pass->gpu_program_id());
+
+        assert_true(program->locate_attribute(INSTANCE_TRANSFORMATION_ATTRIBUTE, true) > -1);
+        if(renderer->supports_instancing()) {
+            assert_true(renderer->instance_transformation_location(program.get()) > -1);
+        } else {
+            assert_equal(renderer->instance_transformation_location(program.get()), -1);
+        }
+#endif
+#endif
+    }
+
+    void test_culling_changes_renderables_version() {
+        auto instancer = stage_->new_mesh_instancer(mesh_);
+        auto camera = stage_->new_camera();
+
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, -10));
+
+        auto version = instancer->renderables_version(camera, DETAIL_LEVEL_NEAREST);
+        assert_equal(version, instancer->renderables_version(camera, DETAIL_LEVEL_NEAREST));
+
+        /* Turn the camera around, the instance is no longer visible */
+        camera->rotate_global_y_by(smlt::Degrees(180));
+        auto culled_version = instancer->renderables_version(camera, DETAIL_LEVEL_NEAREST);
+        assert_not_equal(version, culled_version);
+        assert_equal(culled_version, instancer->renderables_version(camera, DETAIL_LEVEL_NEAREST));
+
+        /* Versions are never reused, even if the same instances are visible again */
+        camera->rotate_global_y_by(smlt::Degrees(180));
+        auto visible_version = instancer->renderables_version(camera, DETAIL_LEVEL_NEAREST);
+        assert_not_equal(version, visible_version);
+        assert_not_equal(culled_version, visible_version);
+
+        batcher::RenderQueue queue;
+        queue.reset(stage_, window->renderer.get(), camera);
+        instancer->_get_renderables(&queue, camera, DETAIL_LEVEL_NEAREST);
+        assert_equal(queue.renderable_count(), mesh_->submesh_count());
+    }
+
+    void test_cameras_have_their_own_renderables_version() {
+        auto instancer = stage_->new_mesh_instancer(mesh_);
+        auto camera1 = stage_->new_camera();
+        auto camera2 = stage_->new_camera();
+
+        instancer->new_mesh_instance(smlt::Vec3(0, 0, -10));
+
+        auto version1 = instancer->renderables_version(camera1, DETAIL_LEVEL_NEAREST);
+        auto version2 = instancer->renderables_version(camera2, DETAIL_LEVEL_NEAREST);
+
+        /* Culling changes for one camera don't affect the other */
+        camera1->rotate_global_y_by(smlt::Degrees(180));
+        assert_not_equal(version1, instancer->renderables_version(camera1, DETAIL_LEVEL_NEAREST));
+        assert_equal(version2, instancer->renderables_version(camera2, DETAIL_LEVEL_NEAREST));
+
+        /* Destroyed cameras are dropped when the next one is seen */
+        stage_->destroy_camera(camera1->id());
+        application->run_frame();
+
+        auto camera3 = stage_->new_camera();
+        instancer->renderables_version(camera3, DETAIL_LEVEL_NEAREST);
+        assert_equal(instancer->camera_visibility_.size(), 2u);
+    }
+
     void test_hidden_instances_arent_in_renderables() {
         auto instancer = stage_->new_mesh_instancer(mesh_);
 
+        /* Back the camera off so it can see instances at the origin */
         auto camera = stage_->new_camera();
+        camera->move_to(0, 0, 10);
+
         batcher::RenderQueue queue;
         queue.reset(stage_, window->renderer.get(), camera);
 
@@ -173,7 +314,9 @@ public:
         instancer->move_to(10, 0, 0);
         assert_equal(instancer->transformed_aabb().centre(), smlt::Vec3(10, 0, 0));
 
+        /* Put the camera where it can see the instance */
         auto camera = stage_->new_camera();
+        camera->move_to(10, 0, 20);
         batcher::RenderQueue queue;
         queue.reset(stage_, window->renderer.get(), camera);
 
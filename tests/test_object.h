@@ -219,6 +219,100 @@ public:
         assert_equal(10.0f, actor2->absolute_position().z);
     }
 
+    void test_transformations_updated_once_per_frame() {
+        auto actor1 = stage_->new_actor();
+        auto actor2 = stage_->new_actor_with_parent(actor1->id());
+        auto actor3 = stage_->new_actor_with_parent(actor2->id());
+        auto other = stage_->new_actor();
+
+        stage_->update_transformations();
+
+        actor3->move_to(0, 0, 1);
+        actor1->move_to(1, 0, 0);
+        actor1->move_to(2, 0, 0);
+        other->move_to(0, 5, 0);
+
+        /* Nothing is recalculated until it's needed */
+        assert_true(actor1->transformation_dirty_);
+        assert_true(actor3->transformation_dirty_);
+        assert_equal(stage_->transformation_updates_.size(), 3u);
+
+        stage_->update_transformations();
+
+        assert_false(actor1->transformation_dirty_);
+        assert_false(actor2->transformation_dirty_);
+        assert_false(actor3->transformation_dirty_);
+        assert_false(other->transformation_dirty_);
+        assert_true(stage_->transformation_updates_.empty());
+
+        /* actor3 was covered by updating actor1 */
+        assert_equal(stage_->transformation_roots_.size(), 2u);
+
+        assert_equal(smlt::Vec3(2, 0, 1), actor3->absolute_position());
+        assert_equal(smlt::Vec3(0, 5, 0), other->absolute_position());
+    }
+
+    void test_reading_updates_parents_first() {
+        auto actor1 = stage_->new_actor();
+        auto actor2 = stage_->new_actor_with_parent(actor1->id());
+
+        actor2->move_to(0, 1, 0);
+        actor1->move_to(1, 0, 0);
+
+        assert_equal(smlt::Vec3(1, 1, 0), actor2->absolute_position());
+        assert_false(actor1->transformation_dirty_);
+
+        /* Destroyed nodes are forgotten */
+        actor1->destroy_immediately();
+        for(auto node: stage_->transformation_updates_) {
+            assert_is_null(node);
+        }
+
+        stage_->update_transformations();
+        assert_true(stage_->transformation_updates_.empty());
+    }
+
+    void test_many_moved_nodes_are_updated() {
+        /* Enough to be split across the workers */
+        std::vector<smlt::ActorPtr> actors;
+        for(auto i = 0; i < 500; ++i) {
+            actors.push_back(stage_->new_actor());
+            stage_->new_actor_with_parent(actors.back()->id());
+        }
+
+        stage_->update_transformations();
+
+        for(auto i = 0u; i < actors.size(); ++i) {
+            actors[i]->move_to(float(i), 0, 0);
+        }
+
+        stage_->update_transformations();
+
+        for(auto i = 0u; i < actors.size(); ++i) {
+            auto child = static_cast<smlt::StageNode*>(actors[i]->first_child());
+            assert_false(actors[i]->transformation_dirty_);
+            assert_false(child->transformation_dirty_);
+            assert_equal(smlt::Vec3(float(i), 0, 0), child->absolute_position());
+        }
+    }
+
+    void test_reading_parent_leaves_children_for_update() {
+        auto actor1 = stage_->new_actor();
+        auto actor2 = stage_->new_actor_with_parent(actor1->id());
+        auto actor3 = stage_->new_actor_with_parent(actor2->id());
+        stage_->update_transformations();
+
+        actor1->move_to(1, 0, 0);
+        assert_equal(smlt::Vec3(1, 0, 0), actor1->absolute_position());
+        assert_false(actor1->transformation_dirty_);
+        assert_true(actor2->transformation_dirty_);
+
+        stage_->update_transformations();
+        assert_false(actor2->transformation_dirty_);
+        assert_false(actor3->transformation_dirty_);
+        assert_equal(smlt::Vec3(1, 0, 0), actor3->absolute_position());
+    }
+
     void test_set_parent_to_self_does_nothing() {
         auto actor1 = stage_->new_actor();
 
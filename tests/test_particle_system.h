@@ -72,6 +72,151 @@ public:
 
         assert_true(p1.position.y < p0.position.y);
     }
+
+    void test_large_systems_update_in_chunks() {
+        auto stage = scene->new_stage();
+        ParticleScriptPtr script = stage->assets->new_particle_script_from_file(
+            ParticleScript::BuiltIns::FIRE
+        );
+
+        script->set_quota(10000);
+        script->clear_manipulators();
+        script->add_manipulator(
+            std::make_shared<DirectionManipulator>(script.get(), smlt::Vec3::NEGATIVE_Y)
+        );
+
+        auto emitter = script->mutable_emitter(0);
+        emitter->emission_rate = 100000.0f;
+        emitter->ttl_range = std::make_pair(10.0f, 10.0f);
+        emitter->velocity_range = std::make_pair(0.0f, 0.0f);
+
+        ParticleSystemPtr system = stage->new_particle_system(script);
+        system->update(0.1f);
+        assert_equal(system->particle_count(), 10000u);
+
+        std::vector<Particle> before;
+        for(auto i = 0u; i < system->particle_count(); ++i) {
+            before.push_back(system->particle(i));
+        }
+
+        system->update(0.1f);
+        assert_equal(system->particle_count(), 10000u);
+
+        /* Every particle was moved by the manipulator, not just
+         * the first chunk */
+        for(auto i = 0u; i < system->particle_count(); ++i) {
+            auto p = system->particle(i);
+            assert_close(p.position.y, before[i].position.y - 0.1f, 0.0001f);
+            assert_close(p.ttl, before[i].ttl - 0.1f, 0.0001f);
+        }
+    }
+
+    void test_dead_particles_are_removed() {
+        auto stage = scene->new_stage();
+        ParticleScriptPtr script = stage->assets->new_particle_script_from_file(
+            ParticleScript::BuiltIns::FIRE
+        );
+
+        for(auto i = 0u; i < script->emitter_count(); ++i) {
+            script->mutable_emitter(i)->ttl_range = std::make_pair(0.5f, 0.5f);
+        }
+
+        ParticleSystemPtr system = stage->new_particle_system(script);
+        system->update(0.1f);
+        assert_true(system->particle_count() > 0);
+
+        system->set_emitters_active(false);
+        system->update(0.6f);
+        assert_equal(system->particle_count(), 0u);
+    }
+};
+
+class ParticleStreamsTests : public test::TestCase {
+public:
+    void set_up() {
+        streams_.resize(13);
+
+        for(auto i = 0u; i < streams_.capacity(); ++i) {
+            Particle p;
+            p.position = Vec3(i, i * 2, i * 3);
+            p.velocity = Vec3(1, -1, 0.5f);
+            p.dimensions = p.initial_dimensions = Vec2(2, 4);
+            p.ttl = p.lifetime = 1.0f + i;
+            p.colour = Colour(0.1f * i, 0.5f, 1.0f, 1.0f);
+            streams_.set(i, p);
+        }
+    }
+
+    void test_get_and_set() {
+        auto p = streams_.get(5);
+        assert_equal(p.position, Vec3(5, 10, 15));
+        assert_equal(p.velocity, Vec3(1, -1, 0.5f));
+        assert_equal(p.dimensions, Vec2(2, 4));
+        assert_close(p.ttl, 6.0f, 0.0001f);
+        assert_close(p.colour.r, 0.5f, 0.0001f);
+
+        streams_.move(12, 5);
+        p = streams_.get(5);
+        assert_equal(p.position, Vec3(12, 24, 36));
+        assert_close(p.lifetime, 13.0f, 0.0001f);
+    }
+
+    void test_integrate_particles() {
+        /* 13 particles so the remainder after the SIMD loop
+         * is integrated too */
+        particles::integrate_particles(streams_.range(0, streams_.capacity()), 0.5f);
+
+        for(auto i = 0u; i < streams_.capacity(); ++i) {
+            auto p = streams_.get(i);
+            assert_close(p.position.x, i + 0.5f, 0.0001f);
+            assert_close(p.position.y, i * 2 - 0.5f, 0.0001f);
+            assert_close(p.position.z, i * 3 + 0.25f, 0.0001f);
+            assert_close(p.ttl, i + 0.5f, 0.0001f);
+        }
+    }
+
+    void test_integrate_range() {
+        particles::integrate_particles(streams_.range(4, 2), 1.0f);
+
+        assert_close(streams_.get(3).ttl, 4.0f, 0.0001f);
+        assert_close(streams_.get(4).ttl, 4.0f, 0.0001f);
+        assert_close(streams_.get(5).ttl, 5.0f, 0.0001f);
+        assert_close(streams_.get(6).ttl, 7.0f, 0.0001f);
+    }
+
+    void test_expand_billboards() {
+        VertexSpecification spec(
+            VERTEX_ATTRIBUTE_3F, VERTEX_ATTRIBUTE_NONE, VERTEX_ATTRIBUTE_2F,
+            VERTEX_ATTRIBUTE_NONE, VERTEX_ATTRIBUTE_NONE, VERTEX_ATTRIBUTE_NONE,
+            VERTEX_ATTRIBUTE_NONE, VERTEX_ATTRIBUTE_NONE, VERTEX_ATTRIBUTE_NONE,
+            VERTEX_ATTRIBUTE_NONE, VERTEX_ATTRIBUTE_4F
+        );
+
+        VertexData vertices(spec);
+        vertices.resize(8);
+
+        particles::expand_billboards(
+            streams_.range(1, 2), Vec3::POSITIVE_Y, Vec3::POSITIVE_X,
+            vertices.data(), vertices.stride(),
+            spec.position_offset(), spec.texcoord0_offset(), spec.diffuse_offset()
+        );
+
+        /* Second particle, at (2, 4, 6) and 2x4 in size */
+        assert_equal(*vertices.position_at<Vec3>(4), Vec3(1, 2, 6));
+        assert_equal(*vertices.position_at<Vec3>(5), Vec3(3, 2, 6));
+        assert_equal(*vertices.position_at<Vec3>(6), Vec3(3, 6, 6));
+        assert_equal(*vertices.position_at<Vec3>(7), Vec3(1, 6, 6));
+
+        assert_equal(*vertices.texcoord0_at<Vec2>(4), Vec2(0, 0));
+        assert_equal(*vertices.texcoord0_at<Vec2>(6), Vec2(1, 1));
+
+        auto colour = vertices.diffuse_at<Colour>(7);
+        assert_close(colour->r, 0.2f, 0.0001f);
+        assert_close(colour->a, 1.0f, 0.0001f);
+    }
+
+private:
+    particles::ParticleStreams streams_;
 };
 
 }
@@ -7,6 +7,7 @@
 #include "simulant/stage.h"
 #include "simulant/nodes/actor.h"
 #include "simulant/nodes/particle_system.h"
+#include "simulant/threads/thread.h"
 
 
 namespace {
@@ -25,6 +26,13 @@ public:
         cb_(write);
     }
 
+    void apply_staged_writes(const std::vector<KeyedWrite>& writes) {
+        ++batch_count;
+        Partitioner::apply_staged_writes(writes);
+    }
+
+    uint32_t batch_count = 0;
+
     void lights_and_geometry_visible_from(CameraID camera_id, std::vector<LightID> &lights_out, std::vector<StageNode*> &geom_out) {
         _S_UNUSED(camera_id);
         _S_UNUSED(lights_out);
@@ -72,6 +80,134 @@ public:
         assert_false(exists);
     }
 
+    void test_batched_updates_are_coalesced() {
+        uint32_t updates = 0;
+        auto test = [&updates](const StagedWrite& write) {
+            if(write.operation == WRITE_OPERATION_UPDATE) {
+                ++updates;
+            }
+        };
+
+        StagePtr stage = scene->new_stage();
+        ActorPtr actor1 = stage->new_actor();
+        ActorPtr actor2 = stage->new_actor();
+
+        MockPartitioner partitioner(stage, test);
+
+        std::vector<StageNode*> nodes = {actor1, actor2, actor1};
+        std::vector<AABB> bounds(nodes.size(), AABB(Vec3(), 1.0f));
+        partitioner.update_stage_nodes(nodes, bounds);
+        partitioner._apply_writes();
+
+        /* actor1 was updated twice, but only needs applying once */
+        assert_equal(updates, 2u);
+        assert_equal(partitioner.batch_count, 1u);
+
+        /* Nothing staged, nothing to apply */
+        partitioner._apply_writes();
+        assert_equal(partitioner.batch_count, 1u);
+
+        scene->destroy_stage(stage->id());
+    }
+
+    void test_updates_staged_from_other_threads() {
+        uint32_t updates = 0;
+        auto test = [&updates](const StagedWrite& write) {
+            if(write.operation == WRITE_OPERATION_UPDATE) {
+                ++updates;
+            }
+        };
+
+        StagePtr stage = scene->new_stage();
+        ActorPtr actor1 = stage->new_actor();
+        ActorPtr actor2 = stage->new_actor();
+
+        MockPartitioner partitioner(stage, test);
+
+        thread::Thread thread([&]() {
+            partitioner.update_stage_node(actor1, AABB(Vec3(), 1.0f));
+        });
+
+        partitioner.update_stage_node(actor2, AABB(Vec3(), 1.0f));
+        thread.join();
+
+        partitioner._apply_writes();
+        assert_equal(updates, 2u);
+
+        scene->destroy_stage(stage->id());
+    }
+
+    void test_update_after_remove_is_ignored() {
+        bool updated = false;
+        auto test = [&updated](const StagedWrite& write) {
+            if(write.operation == WRITE_OPERATION_UPDATE) {
+                updated = true;
+            }
+        };
+
+        StagePtr stage = scene->new_stage();
+        ActorPtr actor = stage->new_actor();
+
+        MockPartitioner partitioner(stage, test);
+        partitioner.update_stage_node(actor, AABB(Vec3(), 1.0f));
+        partitioner.remove_stage_node(actor);
+        partitioner._apply_writes();
+
+        assert_false(updated);
+
+        scene->destroy_stage(stage->id());
+    }
+
+    void test_staged_bounds_are_applied() {
+        AABB applied;
+        auto test = [&applied](const StagedWrite& write) {
+            if(write.operation == WRITE_OPERATION_UPDATE) {
+                applied = write.new_bounds;
+            }
+        };
+
+        StagePtr stage = scene->new_stage();
+        ActorPtr actor = stage->new_actor();
+
+        MockPartitioner partitioner(stage, test);
+        partitioner.update_stage_node(actor, AABB(Vec3(10, 0, 0), 1.0f));
+        partitioner._apply_writes();
+
+        /* The actor itself hasn't moved, the staged bounds are used */
+        assert_close(applied.centre().x, 10.0f, 0.0001f);
+
+        scene->destroy_stage(stage->id());
+    }
+
+    void test_moved_nodes_are_staged_together() {
+        StagePtr stage = scene->new_stage();
+        ActorPtr actor1 = stage->new_actor();
+        ActorPtr actor2 = stage->new_actor();
+
+        Partitioner* partitioner = stage->partitioner;
+        partitioner->_apply_writes();
+
+        actor1->move_to(10, 0, 0);
+        actor2->move_to(20, 0, 0);
+
+        /* The bounds are calculated by the transformation pass rather
+         * than when something next reads them */
+        stage->update_transformations();
+
+        std::vector<StagedWrite> writes;
+        for(auto& buffer: partitioner->update_buffers_) {
+            writes.insert(writes.end(), buffer->writes.begin(), buffer->writes.end());
+        }
+
+        assert_equal(writes.size(), 2u);
+        for(auto& write: writes) {
+            auto expected = (write.node == (StageNode*) actor1) ? 10.0f : 20.0f;
+            assert_close(write.new_bounds.centre().x, expected, 0.0001f);
+        }
+
+        scene->destroy_stage(stage->id());
+    }
+
     void test_add_actor_stages_write() {
         auto test = [=](const StagedWrite& write) {
             assert_equal(write.operation, WRITE_OPERATION_ADD);
@@ -3,12 +3,60 @@
 
 #include "simulant/simulant.h"
 #include "simulant/test.h"
+#include "simulant/renderers/null_renderer.h"
 
 
 namespace {
 
 using namespace smlt;
 
+/* Flattens a traversal into something comparable. Frame IDs are left out
+ * as they differ between frames */
+class FlatteningVisitor : public batcher::RenderQueueVisitor {
+public:
+    struct Visit {
+        Stage* stage;
+        const MaterialPass* pass;
+        const VertexData* vertex_data;
+        const IndexData* index_data;
+        std::size_t index_element_count;
+        Vec3 centre;
+        uint8_t light_count;
+        batcher::Iteration iteration;
+
+        bool operator==(const Visit& rhs) const {
+            return stage == rhs.stage && pass == rhs.pass &&
+                vertex_data == rhs.vertex_data && index_data == rhs.index_data &&
+                index_element_count == rhs.index_element_count &&
+                centre == rhs.centre && light_count == rhs.light_count &&
+                iteration == rhs.iteration;
+        }
+    };
+
+    void start_traversal(const batcher::RenderQueue&, uint64_t, Stage* stage) override {
+        stage_ = stage;
+    }
+
+    void change_render_group(const batcher::RenderGroup*, const batcher::RenderGroup*) override {}
+    void change_material_pass(const MaterialPass*, const MaterialPass*) override {}
+    void apply_lights(const LightPtr*, const uint8_t) override {}
+
+    void visit(const Renderable* renderable, const MaterialPass* pass, batcher::Iteration iteration) override {
+        visits.push_back(Visit{
+            stage_, pass, renderable->vertex_data, renderable->index_data,
+            renderable->index_element_count, renderable->centre,
+            renderable->light_count, iteration
+        });
+    }
+
+    void end_traversal(const batcher::RenderQueue&, Stage*) override {}
+
+    std::vector<Visit> visits;
+
+private:
+    Stage* stage_ = nullptr;
+};
+
 class RenderChainTests : public smlt::test::SimulantTestCase {
 public:
     void test_basic_usage() {
@@ -55,6 +103,81 @@ public:
         pipeline1->activate();
         assert_true(pipeline1->is_active());
     }
+
+    void test_parallel_frame_building() {
+        auto stage = scene->new_stage();
+        auto cam1 = stage->new_camera();
+        auto cam2 = stage->new_camera();
+
+        auto ui_stage = scene->new_stage();
+        auto ui_cam = ui_stage->new_camera();
+
+        auto mesh = stage->assets->new_mesh_as_cube_with_submesh_per_face(1.0f);
+        stage->new_actor_with_mesh(mesh)->move_to(0, 0, -5);
+
+        auto script = stage->assets->new_particle_script_from_file(
+            ParticleScript::BuiltIns::FIRE
+        );
+        stage->new_particle_system(script)->move_to(0, 0, -5);
+        stage->new_light_as_point(Vec3(0, 0, -3));
+
+        auto p1 = window->compositor->render(stage, cam1);
+        auto p2 = window->compositor->render(stage, cam2);
+        auto p3 = window->compositor->render(ui_stage, ui_cam);
+
+        p1->activate();
+        p2->activate();
+        p3->activate();
+
+        int started = 0;
+        int finished = 0;
+        auto c1 = window->compositor->signal_pipeline_started().connect([&](Pipeline&) { ++started; });
+        auto c2 = window->compositor->signal_pipeline_finished().connect([&](Pipeline&) { ++finished; });
+
+        window->compositor->set_parallel_frame_building(true);
+        assert_true(window->compositor->parallel_frame_building());
+
+        application->run_frame();
+        application->run_frame();
+
+        window->compositor->set_parallel_frame_building(false);
+
+        c1.disconnect();
+        c2.disconnect();
+
+        /* Every pipeline should have been run, including any created by the test scene */
+        assert_true(started >= 6);
+        assert_equal(started, finished);
+
+        /* Render the same scene state both ways (nothing is updated between
+         * the runs) and check that the renderer was asked for the same
+         * things in the same order */
+        NullRenderer renderer(window);
+        window->compositor->set_renderer(&renderer);
+
+        window->compositor->run();
+        batcher::RenderTrace serial = renderer.trace();
+
+        window->compositor->set_parallel_frame_building(true);
+        window->compositor->run();
+        batcher::RenderTrace parallel = renderer.trace();
+
+        window->compositor->set_parallel_frame_building(false);
+        window->compositor->set_renderer(window->renderer.get());
+
+        assert_true(serial.visit_count() > 0);
+        assert_equal(serial.traversal_count(), parallel.traversal_count());
+        assert_equal(serial.visit_count(), parallel.visit_count());
+        assert_equal(serial.render_group_changes(), parallel.render_group_changes());
+        assert_equal(serial.material_pass_changes(), parallel.material_pass_changes());
+        assert_equal(serial.light_changes(), parallel.light_changes());
+
+        FlatteningVisitor serial_visits, parallel_visits;
+        serial.replay(&serial_visits, scene);
+        parallel.replay(&parallel_visits, scene);
+
+        assert_true(serial_visits.visits == parallel_visits.visits);
+    }
 };
 
 
@@ -9,6 +9,27 @@ namespace {
 
 using namespace smlt;
 
+/* Records the order that renderables are visited in */
+class RecordingVisitor : public batcher::RenderQueueVisitor {
+public:
+    void start_traversal(const batcher::RenderQueue&, uint64_t, Stage*) override {}
+    void change_render_group(const batcher::RenderGroup*, const batcher::RenderGroup*) override {
+        ++group_changes;
+    }
+
+    void change_material_pass(const MaterialPass*, const MaterialPass*) override {}
+    void apply_lights(const LightPtr*, const uint8_t) override {}
+
+    void visit(const Renderable* renderable, const MaterialPass*, batcher::Iteration) override {
+        visited.push_back(renderable->centre.z);
+    }
+
+    void end_traversal(const batcher::RenderQueue&, Stage*) override {}
+
+    std::vector<float> visited;
+    uint32_t group_changes = 0;
+};
+
 class RenderQueueTests : public smlt::test::SimulantTestCase {
 public:
     void set_up() {
@@ -97,9 +118,248 @@ public:
         assert_true(pass0_blended_100_tex1 < pass1_blended_10_tex1);
     }
 
+    void test_render_group_key_priority_and_material() {
+        batcher::RenderGroup background = {batcher::generate_render_group_key(
+            1, true, 100.0f, RENDER_PRIORITY_BACKGROUND, 2
+        )};
+
+        batcher::RenderGroup main_mat1_far = {batcher::generate_render_group_key(
+            0, false, 100.0f, RENDER_PRIORITY_MAIN, 1
+        )};
+
+        batcher::RenderGroup main_mat2_near = {batcher::generate_render_group_key(
+            0, false, 10.0f, RENDER_PRIORITY_MAIN, 2
+        )};
+
+        // Priority takes precedence over everything
+        assert_true(background < main_mat1_far);
+        assert_true(background < main_mat2_near);
+
+        // Opaque groups are grouped by material before depth
+        assert_true(main_mat1_far < main_mat2_near);
+
+        // Negative distances (e.g. straddling the near plane) sort first
+        batcher::RenderGroup main_mat1_behind = {batcher::generate_render_group_key(
+            0, false, -5.0f, RENDER_PRIORITY_MAIN, 1
+        )};
+
+        assert_true(main_mat1_behind < main_mat1_far);
+    }
+
+    void test_traversal_is_sorted() {
+        auto camera = stage_->new_camera();
+
+        auto mat1 = stage_->assets->new_material();
+        auto mat2 = stage_->assets->new_material();
+        auto blended = stage_->assets->new_material();
+        blended->pass(0)->set_blend_func(BLEND_ALPHA);
+
+        batcher::RenderQueue queue;
+        queue.reset(stage_, window->renderer.get(), camera);
+
+        auto insert = [&](MaterialPtr mat, float z, RenderPriority priority) {
+            Renderable renderable;
+            renderable.material = mat.get();
+            renderable.vertex_range_count = 1;
+            renderable.render_priority = priority;
+            renderable.centre = Vec3(0, 0, z);
+            queue.insert_renderable(std::move(renderable));
+        };
+
+        insert(blended, -10.0f, RENDER_PRIORITY_MAIN);
+        insert(mat2, -5.0f, RENDER_PRIORITY_MAIN);
+        insert(mat1, -50.0f, RENDER_PRIORITY_MAIN);
+        insert(blended, -50.0f, RENDER_PRIORITY_MAIN);
+        insert(mat1, -10.0f, RENDER_PRIORITY_MAIN);
+        insert(mat2, -100.0f, RENDER_PRIORITY_BACKGROUND);
+
+        RecordingVisitor visitor;
+        queue.traverse(&visitor, 0);
+
+        assert_equal(queue.last_sort_count(), 6u);
+        assert_equal(visitor.visited.size(), 6u);
+
+        // Background first
+        assert_close(visitor.visited[0], -100.0f, 0.0001f);
+
+        // Then opaque, by material and then front-to-back
+        assert_close(visitor.visited[1], -10.0f, 0.0001f);
+        assert_close(visitor.visited[2], -50.0f, 0.0001f);
+        assert_close(visitor.visited[3], -5.0f, 0.0001f);
+
+        // Then blended, back-to-front
+        assert_close(visitor.visited[4], -50.0f, 0.0001f);
+        assert_close(visitor.visited[5], -10.0f, 0.0001f);
+    }
+
+    void test_static_renderables_are_cached() {
+        auto camera = stage_->new_camera();
+        auto mesh = stage_->assets->new_mesh_as_cube_with_submesh_per_face(1.0f);
+        auto actor = stage_->new_actor_with_mesh(mesh);
+        actor->move_to(0, 0, -10);
+
+        assert_true(actor->has_static_renderables());
+
+        batcher::RenderQueue queue;
+        build_queue(queue, camera, {actor});
+
+        assert_equal(queue.cached_renderable_count(), 0u);
+        assert_equal(queue.renderable_count(), mesh->submesh_count());
+
+        build_queue(queue, camera, {actor});
+        assert_equal(queue.cached_renderable_count(), mesh->submesh_count());
+        assert_equal(queue.renderable_count(), mesh->submesh_count());
+
+        // Moving the actor invalidates the cache
+        actor->move_to(0, 0, -20);
+        build_queue(queue, camera, {actor});
+        assert_equal(queue.cached_renderable_count(), 0u);
+
+        build_queue(queue, camera, {actor});
+        assert_equal(queue.cached_renderable_count(), mesh->submesh_count());
+
+        // So does changing the mesh
+        mesh->first_submesh()->set_material(stage_->assets->new_material());
+        build_queue(queue, camera, {actor});
+        assert_equal(queue.cached_renderable_count(), 0u);
+    }
+
+    void test_cached_renderables_resorted_when_camera_moves() {
+        auto camera = stage_->new_camera();
+        auto mesh = stage_->assets->new_mesh_as_cube_with_submesh_per_face(1.0f);
+        auto material = stage_->assets->new_material();
+        for(auto submesh: mesh->each_submesh()) {
+            submesh->set_material(material);
+        }
+
+        auto a = stage_->new_actor_with_mesh(mesh);
+        auto b = stage_->new_actor_with_mesh(mesh);
+        auto c = stage_->new_actor_with_mesh(mesh);
+
+        a->move_to(0, 0, -20);
+        b->move_to(0, 0, -10);
+        c->move_to(0, 0, -30);
+
+        batcher::RenderQueue queue;
+        build_queue(queue, camera, {a, b, c});
+
+        RecordingVisitor visitor;
+        queue.traverse(&visitor, 0);
+        assert_equal(visitor.visited.size(), mesh->submesh_count() * 3);
+        assert_close(visitor.visited.front(), -10.0f, 0.0001f);
+        assert_close(visitor.visited.back(), -30.0f, 0.0001f);
+
+        // Look back the other way, nothing but the camera has moved
+        camera->move_to(0, 0, -40);
+        camera->rotate_to(Quaternion(Vec3(0, 1, 0), Degrees(180)));
+
+        build_queue(queue, camera, {a, b, c});
+        assert_equal(queue.cached_renderable_count(), mesh->submesh_count() * 3);
+
+        visitor.visited.clear();
+        queue.traverse(&visitor, 0);
+        assert_equal(visitor.visited.size(), mesh->submesh_count() * 3);
+        assert_close(visitor.visited.front(), -30.0f, 0.0001f);
+        assert_close(visitor.visited.back(), -10.0f, 0.0001f);
+    }
+
+    void test_renderable_matrices_are_calculated_before_traversal() {
+        auto camera = stage_->new_camera();
+        camera->set_perspective_projection(Degrees(45.0f), 1.5f, 0.1f, 100.0f);
+        camera->move_to(1, 2, 3);
+        camera->rotate_global_y_by(Degrees(30));
+
+        auto mat = stage_->assets->new_material();
+
+        batcher::RenderQueue queue;
+        queue.reset(stage_, window->renderer.get(), camera);
+
+        Renderable renderable;
+        renderable.material = mat.get();
+        renderable.vertex_range_count = 1;
+        renderable.final_transformation = Mat4::from_pos_rot_scale(
+            Vec3(5, -2, -10), Quaternion(Degrees(10), Degrees(20), Degrees(30)), Vec3(1, 2, 3)
+        );
+
+        Renderable copy = renderable;
+        queue.insert_renderable(std::move(renderable));
+
+        /* Nothing is calculated until the queue is traversed */
+        assert_is_null(queue.matrices(queue.renderable(0)));
+
+        RecordingVisitor visitor;
+        queue.traverse(&visitor, 0);
+
+        auto matrices = queue.matrices(queue.renderable(0));
+        assert_is_not_null(matrices);
+
+        /* Copies of renderables don't have any */
+        assert_is_null(queue.matrices(&copy));
+
+        Mat4 modelview = camera->view_matrix() * copy.final_transformation;
+        Mat4 modelview_projection = camera->projection_matrix() * modelview;
+
+        Mat3 inverse_transpose_modelview(modelview);
+        inverse_transpose_modelview.inverse();
+        inverse_transpose_modelview.transpose();
+
+        /* Only the matrices the renderer reads are calculated */
+        auto flags = window->renderer->renderable_matrices_used();
+        assert_true(flags & batcher::RENDERABLE_MATRIX_MODELVIEW);
+
+        for(int i = 0; i < 16; ++i) {
+            assert_close(matrices->modelview[i], modelview[i], 0.0001f);
+            if(flags & batcher::RENDERABLE_MATRIX_MODELVIEW_PROJECTION) {
+                assert_close(matrices->modelview_projection[i], modelview_projection[i], 0.0001f);
+            }
+        }
+
+        if(flags & batcher::RENDERABLE_MATRIX_INVERSE_TRANSPOSE_MODELVIEW) {
+            for(int i = 0; i < 9; ++i) {
+                assert_close(matrices->inverse_transpose_modelview[i], inverse_transpose_modelview[i], 0.0001f);
+            }
+        }
+    }
+
+    void test_only_flagged_matrices_are_calculated() {
+        Renderable renderable;
+        renderable.final_transformation = Mat4::as_translation(Vec3(0, 0, -10));
+
+        batcher::RenderableMatrices matrices;
+        matrices.modelview_projection = Mat4::as_scaling(2.0f);
+        matrices.inverse_transpose_modelview = Mat3(Mat4::as_scaling(2.0f));
+
+        batcher::calculate_renderable_matrices(
+            Mat4(), Mat4::as_scaling(3.0f), &renderable, 1, &matrices,
+            batcher::RENDERABLE_MATRIX_MODELVIEW
+        );
+
+        assert_close(matrices.modelview[14], -10.0f, 0.0001f);
+
+        /* Left untouched */
+        assert_close(matrices.modelview_projection[0], 2.0f, 0.0001f);
+        assert_close(matrices.inverse_transpose_modelview[0], 2.0f, 0.0001f);
+    }
+
 private:
     StagePtr stage_;
 
+    /* Builds the queue in the same way as the compositor */
+    void build_queue(batcher::RenderQueue& queue, CameraPtr camera, std::vector<StageNode*> nodes) {
+        queue.reset(stage_, window->renderer.get(), camera);
+
+        for(auto node: nodes) {
+            auto version = node->renderables_version(camera, DETAIL_LEVEL_NEAREST);
+            if(!queue.insert_cached_renderables(node, version)) {
+                queue.begin_caching(node, version);
+                node->_get_renderables(&queue, camera, DETAIL_LEVEL_NEAREST);
+                queue.end_caching();
+            }
+        }
+
+        queue.sort();
+    }
+
 };
 
 }
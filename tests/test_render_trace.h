@@ -0,0 +1,188 @@
+#pragma once
+
+#include "simulant/simulant.h"
+#include "simulant/test.h"
+#include "simulant/renderers/batching/render_trace.h"
+#include "simulant/renderers/null_renderer.h"
+
+namespace {
+
+using namespace smlt;
+
+/* Counts the calls made to it, and the order renderables were visited in */
+class CountingVisitor : public batcher::RenderQueueVisitor {
+public:
+    void start_traversal(const batcher::RenderQueue&, uint64_t frame, Stage* stage) override {
+        frame_id = frame;
+        started_stage = stage;
+    }
+
+    void change_render_group(const batcher::RenderGroup*, const batcher::RenderGroup*) override {
+        ++group_changes;
+    }
+
+    void change_material_pass(const MaterialPass*, const MaterialPass* next) override {
+        passes.push_back(next);
+    }
+
+    void apply_lights(const LightPtr*, const uint8_t) override {
+        ++light_changes;
+    }
+
+    void visit(const Renderable* renderable, const MaterialPass*, batcher::Iteration) override {
+        visited.push_back(renderable->centre.z);
+    }
+
+    void end_traversal(const batcher::RenderQueue&, Stage*) override {
+        ++ended;
+    }
+
+    uint64_t frame_id = 0;
+    Stage* started_stage = nullptr;
+    std::vector<const MaterialPass*> passes;
+    std::vector<float> visited;
+    uint32_t group_changes = 0;
+    uint32_t light_changes = 0;
+    uint32_t ended = 0;
+};
+
+class RenderTraceTests : public smlt::test::SimulantTestCase {
+public:
+    void set_up() {
+        SimulantTestCase::set_up();
+        stage_ = scene->new_stage();
+    }
+
+    void tear_down() {
+        scene->destroy_stage(stage_->id());
+        SimulantTestCase::tear_down();
+    }
+
+    void test_replay_matches_recording() {
+        auto camera = stage_->new_camera();
+        auto mat1 = stage_->assets->new_material();
+        auto mat2 = stage_->assets->new_material();
+
+        NullRenderer renderer(window);
+
+        batcher::RenderQueue queue;
+        queue.reset(stage_, &renderer, camera);
+
+        auto insert = [&](MaterialPtr mat, float z) {
+            Renderable renderable;
+            renderable.material = mat.get();
+            renderable.vertex_range_count = 1;
+            renderable.centre = Vec3(0, 0, z);
+            queue.insert_renderable(std::move(renderable));
+        };
+
+        insert(mat1, -10.0f);
+        insert(mat2, -5.0f);
+        insert(mat1, -20.0f);
+
+        CountingVisitor original;
+        batcher::RenderTrace trace;
+        auto recorder = std::make_shared<batcher::RecordingRenderQueueVisitor>(
+            &trace, std::shared_ptr<CountingVisitor>(&original, [](CountingVisitor*) {})
+        );
+
+        queue.traverse(recorder.get(), 7);
+
+        assert_equal(trace.traversal_count(), 1u);
+        assert_equal(trace.visit_count(), 3u);
+        assert_equal(trace.renderable_count(), 3u);
+        assert_equal(trace.render_group_changes(), original.group_changes);
+        assert_equal(trace.material_pass_changes(), (uint32_t) original.passes.size());
+
+        /* The queue is gone, but the trace still has everything */
+        queue.clear();
+
+        CountingVisitor replayed;
+        trace.replay(&replayed, scene);
+
+        assert_equal(replayed.frame_id, 7u);
+        assert_equal(replayed.started_stage, (Stage*) stage_);
+        assert_equal(replayed.group_changes, original.group_changes);
+        assert_equal(replayed.light_changes, original.light_changes);
+        assert_equal(replayed.ended, 1u);
+        assert_true(replayed.passes == original.passes);
+        assert_true(replayed.visited == original.visited);
+
+        trace.clear();
+        assert_true(trace.empty());
+        assert_equal(trace.visit_count(), 0u);
+    }
+
+    void test_stream_is_comparable_between_queues() {
+        auto camera = stage_->new_camera();
+        auto mat = stage_->assets->new_material();
+        auto light = stage_->new_light_as_point();
+
+        NullRenderer renderer(window);
+
+        auto record = [&](batcher::RenderTrace* trace) {
+            /* Each queue stores its renderables somewhere different */
+            batcher::RenderQueue queue;
+            queue.reset(stage_, &renderer, camera);
+
+            Renderable renderable;
+            renderable.material = mat.get();
+            renderable.vertex_range_count = 1;
+            renderable.lights_affecting_this_frame[0] = light;
+            renderable.light_count = 1;
+            queue.insert_renderable(std::move(renderable));
+
+            batcher::RecordingRenderQueueVisitor recorder(trace);
+            queue.traverse(&recorder, 1);
+        };
+
+        batcher::RenderTrace first, second;
+        record(&first);
+        record(&second);
+
+        assert_false(first.empty());
+        assert_true(first.stream() == second.stream());
+
+        /* Lights are found again by ID */
+        struct LightVisitor : public CountingVisitor {
+            void apply_lights(const LightPtr* lights, const uint8_t count) override {
+                applied = (count) ? lights[0] : nullptr;
+            }
+
+            LightPtr applied;
+        } replayed;
+
+        first.replay(&replayed, scene);
+        assert_equal((Light*) replayed.applied, (Light*) light);
+    }
+
+    void test_null_renderer_records_frames() {
+        auto renderer = std::make_shared<NullRenderer>(window);
+
+        /* So the window doesn't create a GL context for it */
+        assert_false(renderer->requires_gl_context());
+
+        auto camera = stage_->new_camera();
+        auto visitor = renderer->get_render_queue_visitor(camera);
+
+        batcher::RenderQueue queue;
+        queue.reset(stage_, renderer.get(), camera);
+
+        Renderable renderable;
+        renderable.material = stage_->assets->new_material().get();
+        renderable.vertex_range_count = 1;
+        queue.insert_renderable(std::move(renderable));
+
+        queue.traverse(visitor.get(), 0);
+        assert_equal(renderer->trace().visit_count(), 1u);
+
+        /* Each frame starts a new trace */
+        renderer->pre_render();
+        assert_true(renderer->trace().empty());
+    }
+
+private:
+    StagePtr stage_;
+};
+
+}
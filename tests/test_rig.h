@@ -49,6 +49,46 @@ public:
         assert_equal(a1->rig->joint_count(), 5u);
     }
 
+    void test_skinning_blends_joints_by_weight() {
+        auto m = stage_->assets->new_mesh(VertexSpecification::DEFAULT);
+        m->vertex_data->position(1, 0, 0);
+        m->vertex_data->normal(1, 0, 0);
+        m->vertex_data->move_next();
+        m->vertex_data->position(2, 0, 0);
+        m->vertex_data->normal(1, 0, 0);
+        m->vertex_data->move_next();
+        m->vertex_data->done();
+
+        m->add_skeleton(2);
+
+        auto unpacker = std::make_shared<SkeletalFrameUnpacker>(m.get(), 1, 2);
+        unpacker->link_vertex_to_joint(0, 0, 1.0f);
+        unpacker->link_vertex_to_joint(1, 0, 0.5f);
+        unpacker->link_vertex_to_joint(1, 1, 0.5f);
+
+        Rig rig(m->skeleton);
+        rig.joint(0)->rotate_to(Quaternion(Vec3::POSITIVE_Z, Degrees(90)));
+        rig.joint(1)->move_to(Vec3(0, 0, 1));
+
+        VertexData out(m->vertex_data->vertex_specification());
+        unpacker->unpack_frame(0, 0, 0.0f, &rig, &out);
+
+        auto p0 = out.position_at<Vec3>(0);
+        assert_close(p0->x, 0.0f, 0.0001f);
+        assert_close(p0->y, 1.0f, 0.0001f);
+        assert_close(p0->z, 0.0f, 0.0001f);
+
+        auto n0 = out.normal_at<Vec3>(0);
+        assert_close(n0->x, 0.0f, 0.0001f);
+        assert_close(n0->y, 1.0f, 0.0001f);
+
+        /* Halfway between rotated by the first joint, and moved by the second */
+        auto p1 = out.position_at<Vec3>(1);
+        assert_close(p1->x, 1.0f, 0.0001f);
+        assert_close(p1->y, 1.0f, 0.0001f);
+        assert_close(p1->z, 0.5f, 0.0001f);
+    }
+
 private:
     StagePtr stage_;
 };
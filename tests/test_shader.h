@@ -6,6 +6,9 @@
 #ifndef _arch_dreamcast
 #ifndef PSP
 #include "simulant/renderers/gl2x/gpu_program.h"
+#include "simulant/renderers/gl2x/generic_renderer.h"
+#include "simulant/utils/kfs.h"
+#include "simulant/generic/raii.h"
 #endif
 #endif
 
@@ -47,4 +50,137 @@ public:
 #endif
     }
 
+    void test_auto_uniforms_are_located_on_link() {
+#ifndef _arch_dreamcast
+#ifndef PSP
+        smlt::GPUProgram::ptr program = smlt::GPUProgram::create(
+            smlt::GPUProgramID(2),
+            window->renderer,
+            "uniform mat4 s_modelview_projection; attribute vec3 s_position; void main(){ gl_Position = s_modelview_projection * vec4(s_position, 1.0); }",
+            "uniform vec4 s_material_diffuse; void main(){ gl_FragColor = s_material_diffuse; }"
+        );
+
+        program->build();
+        program->activate();
+
+        assert_true(program->has_auto_uniform(smlt::SP_AUTO_MODELVIEW_PROJECTION_MATRIX));
+        assert_true(program->has_auto_uniform(smlt::SP_AUTO_MATERIAL_DIFFUSE));
+        assert_false(program->has_auto_uniform(smlt::SP_AUTO_VIEW_MATRIX));
+        assert_false(program->has_auto_uniform(smlt::SP_AUTO_LIGHT_POSITION));
+
+        assert_equal(
+            program->auto_uniform_location(smlt::SP_AUTO_MATERIAL_DIFFUSE),
+            program->locate_uniform("s_material_diffuse")
+        );
+#endif
+#endif
+    }
+
+    void test_auto_uniform_values_are_cached() {
+#ifndef _arch_dreamcast
+#ifndef PSP
+        smlt::GPUProgram::ptr program = smlt::GPUProgram::create(
+            smlt::GPUProgramID(3),
+            window->renderer,
+            "attribute vec3 s_position; void main(){ gl_Position = vec4(s_position, 1.0); }",
+            "uniform vec4 s_material_diffuse; void main(){ gl_FragColor = s_material_diffuse; }"
+        );
+
+        program->build();
+        program->activate();
+
+        auto& slot = program->auto_uniforms_[smlt::SP_AUTO_MATERIAL_DIFFUSE];
+        assert_false(slot.has_value);
+
+        program->set_auto_uniform_colour(smlt::SP_AUTO_MATERIAL_DIFFUSE, smlt::Colour::RED);
+        assert_true(slot.has_value);
+
+        /* Setting by name means we can't trust the cached value anymore */
+        program->set_uniform_colour("s_material_diffuse", smlt::Colour::BLUE);
+        assert_false(slot.has_value);
+
+        /* Nor after relinking */
+        program->set_auto_uniform_colour(smlt::SP_AUTO_MATERIAL_DIFFUSE, smlt::Colour::RED);
+        program->link(true);
+        assert_false(slot.has_value);
+
+        /* Unused auto uniforms are ignored */
+        program->set_auto_uniform_mat4x4(smlt::SP_AUTO_VIEW_MATRIX, smlt::Mat4());
+        assert_false(program->auto_uniforms_[smlt::SP_AUTO_VIEW_MATRIX].has_value);
+#endif
+#endif
+    }
+
+    void test_programs_are_shared_by_source() {
+#ifndef _arch_dreamcast
+#ifndef PSP
+        auto renderer = window->renderer.get();
+        if(!renderer->supports_gpu_programs()) {
+            return;
+        }
+
+        const std::string vertex = "attribute vec3 s_position; void main(){ gl_Position = vec4(s_position, 1.0); }";
+        const std::string fragment = "void main(){ gl_FragColor = vec4(0.5); }";
+
+        auto first = renderer->new_or_existing_gpu_program(vertex, fragment);
+        auto second = renderer->new_or_existing_gpu_program(vertex, fragment);
+        assert_equal(first, second);
+        assert_true(renderer->gpu_program(first)->is_complete());
+
+        auto other = renderer->new_or_existing_gpu_program(vertex, "void main(){ gl_FragColor = vec4(1.0); }");
+        assert_not_equal(first, other);
+
+        assert_equal(renderer->gpu_program(first)->md5(), smlt::gpu_program_source_hash(vertex, fragment));
+#endif
+#endif
+    }
+
+    void test_programs_are_loaded_from_the_cache() {
+#ifndef _arch_dreamcast
+#ifndef PSP
+        auto renderer = dynamic_cast<smlt::GenericRenderer*>(window->renderer.get());
+        if(!renderer) {
+            return;
+        }
+
+        auto cache_dir = kfs::path::join(kfs::temp_dir(), "simulant-program-cache");
+        auto old_cache_dir = application->config_.general.gpu_program_cache_directory;
+        application->config_.general.gpu_program_cache_directory = cache_dir;
+        renderer->load_program_binary_functions();
+
+        /* Put things back as they were, whatever happens */
+        smlt::raii::Finally then([&]() {
+            application->config_.general.gpu_program_cache_directory = old_cache_dir;
+            renderer->load_program_binary_functions();
+            if(kfs::path::exists(cache_dir)) {
+                kfs::remove_dirs(cache_dir);
+            }
+        });
+
+        if(!renderer->program_binary_) {
+            return;
+        }
+
+        const std::string vertex = "attribute vec3 s_position; void main(){ gl_Position = vec4(s_position, 0.5); }";
+        const std::string fragment = "void main(){ gl_FragColor = vec4(0.25); }";
+
+        /* Nothing is cached yet, so this compiles the program and saves it */
+        smlt::GPUProgram::ptr compiled = smlt::GPUProgram::create(
+            smlt::GPUProgramID(100), window->renderer, vertex, fragment
+        );
+
+        assert_false(renderer->load_program_binary(compiled.get()));
+        renderer->build_program(compiled.get());
+        assert_true(compiled->is_complete());
+        assert_true(kfs::path::exists(renderer->program_binary_path(compiled.get())));
+
+        smlt::GPUProgram::ptr cached = smlt::GPUProgram::create(
+            smlt::GPUProgramID(101), window->renderer, vertex, fragment
+        );
+
+        assert_true(renderer->load_program_binary(cached.get()));
+        assert_true(cached->is_complete());
+#endif
+#endif
+    }
 };
@@ -21,72 +21,111 @@ public:
     }
 
     void test_key_construction() {
-        Key test1 = make_key(1, 0, 0, 0);
-        Key test2 = make_key(2, 0.5, 0, 0);
-
-        assert_equal(15u, test1.ancestors);
-        assert_equal(14u, test2.ancestors);
-
-        assert_true(test2.is_ancestor_of(test1));
-        assert_false(test1.is_ancestor_of(test2));
-        assert_true(test1.is_ancestor_of(test1)); // Keys are ancestors of themselves
+        CellKey test1 = make_cell_key_for_point(0, 0.5, 0, 0);
+        CellKey test2 = make_cell_key_for_point(1, 0.5, 0, 0);
+        CellKey test3 = make_cell_key_for_point(0, -0.5, 0, 0);
+
+        assert_equal(0u, cell_key_level(test1));
+        assert_equal(1u, cell_key_level(test2));
+        assert_not_equal(test1, test2);
+        assert_not_equal(test1, test3);
+
+        int32_t x, y, z;
+        cell_key_coords(test3, x, y, z);
+        assert_equal(-1, x);
+        assert_equal(0, y);
+        assert_equal(0, z);
+
+        cell_key_coords(make_cell_key(15, -7, 12, 3000), x, y, z);
+        assert_equal(-7, x);
+        assert_equal(12, y);
+        assert_equal(3000, z);
     }
 
-    void test_key_comparison() {
-        Key key1, key2, key3, key4, key5;
+    void test_key_clamping() {
+        /* Cells outside the grid are clamped to the edge */
+        int32_t x, y, z;
+        cell_key_coords(make_cell_key_for_point(0, 1e9, -1e9, 0), x, y, z);
 
-        key1.hash_path[0] = Hash(1, 1, 1); key1.hash_path[1] = Hash(2, 2, 2);
-        key1.ancestors = 1;
+        assert_equal(CELL_COORD_MAX, x);
+        assert_equal(CELL_COORD_MIN, y);
+        assert_equal(0, z);
+    }
 
-        key2.hash_path[0] = Hash(1, 1, 1); key2.hash_path[1] = Hash(3, 3, 3);
-        key2.ancestors = 1;
+    void test_adding_objects_to_the_hash() {
+        AABB box1(Vec3(0.5, 0.5, 0.5), 0.5);
+        AABB box2(Vec3(0, 0, 0), 5.0);
 
-        key3.hash_path[0] = Hash(1, 1, 1); key3.hash_path[1] = Hash(1, 1, 1); key3.hash_path[2] = Hash(2, 2, 2);
-        key3.ancestors = 2;
+        hash_->insert_object_for_box(box1, new_entry_);
 
-        key4.hash_path[0] = Hash(3, 3, 3);
-        key4.ancestors = 0;
+        assert_equal(new_entry_->key_count(), 1u);
 
-        key5.hash_path[0] = Hash(1, 1, 1);
-        key5.ancestors = 0;
+        /* Inserting again moves the entry */
+        hash_->insert_object_for_box(box2, new_entry_);
 
-        assert_true(key3 < key1);
-        assert_false(key1 < key3);
+        assert_equal(new_entry_->key_count(), 8u);
+    }
 
-        assert_true(key3 < key2);
-        assert_false(key2 < key3);
+    void test_updating_objects_in_the_hash() {
+        SpatialHashEntry entry;
 
-        assert_true(key1 < key2);
-        assert_false(key2 < key1);
+        hash_->insert_object_for_box(AABB(Vec3(0.5, 0.5, 0.5), 0.5), &entry);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(), 2.0)).size(), 1u);
 
-        assert_true(key3 < key4);
-        assert_true(key2 < key4);
-        assert_true(key1 < key4);
+        hash_->update_object_for_box(AABB(Vec3(100.5, 0.5, 0.5), 0.5), &entry);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(), 2.0)).size(), 0u);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(100, 0, 0), 2.0)).size(), 1u);
+        assert_equal(hash_->cell_count(), 1u);
 
-        assert_false(key4 < key3);
-        assert_false(key4 < key2);
-        assert_false(key4 < key1);
+        hash_->remove_object(&entry);
+        assert_equal(hash_->cell_count(), 0u);
+    }
 
-        assert_true(key5 < key3);
-        assert_true(key5 < key2);
-        assert_true(key5 < key1);
+    void test_updating_several_objects_at_once() {
+        SpatialHashEntry entry1, entry2, entry3, entry4;
 
-        assert_false(key3 < key5);
-        assert_false(key2 < key5);
-        assert_false(key1 < key5);
+        AABB origin(Vec3(0.5, 0.5, 0.5), 0.5);
+        hash_->insert_object_for_box(origin, &entry1);
+        hash_->insert_object_for_box(origin, &entry2);
+        hash_->insert_object_for_box(origin, &entry3);
+        assert_equal(hash_->cell_count(), 1u);
+
+        /* Two leave the same cell, one stays put and one wasn't
+         * inserted yet */
+        std::vector<AABB> boxes = {
+            AABB(Vec3(100.5, 0.5, 0.5), 0.5),
+            AABB(Vec3(200.5, 0.5, 0.5), 0.5),
+            origin,
+            AABB(Vec3(100.5, 0.5, 0.5), 0.5)
+        };
+
+        std::vector<SpatialHashEntry*> entries = {&entry1, &entry2, &entry3, &entry4};
+        hash_->update_objects_for_boxes(boxes.data(), entries.data(), entries.size());
+
+        assert_equal(hash_->cell_count(), 3u);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(), 2.0)).size(), 1u);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(100, 0, 0), 2.0)).size(), 2u);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(200, 0, 0), 2.0)).size(), 1u);
+
+        /* Moving the last one out of a cell removes it */
+        hash_->update_objects_for_boxes(&boxes[0], &entries[2], 1);
+        assert_equal(hash_->cell_count(), 2u);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(), 2.0)).size(), 0u);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(100, 0, 0), 2.0)).size(), 3u);
     }
 
-    void test_adding_objects_to_the_hash() {
-        AABB box1(Vec3(0.5, 0.5, 0.5), 0.5);
-        AABB box2(Vec3(0, 0, 0), 5.0);
-
-        hash_->insert_object_for_box(box1, new_entry_);
+    void test_oversized_objects() {
+        SpatialHashEntry entry;
 
-        assert_equal(new_entry_->keys().size(), 1u);
+        hash_->insert_object_for_box(AABB(Vec3(), 100000.0f), &entry);
 
-        hash_->insert_object_for_box(box2, new_entry_);
+        assert_true(entry.is_oversized());
+        assert_equal(hash_->cell_count(), 0u);
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(10, 10, 10), 1.0)).size(), 1u);
 
-        assert_equal(new_entry_->keys().size(), 9u);
+        hash_->update_object_for_box(AABB(Vec3(), 1.0f), &entry);
+        assert_false(entry.is_oversized());
+        assert_equal(hash_->find_objects_within_box(AABB(Vec3(10, 10, 10), 1.0)).size(), 0u);
     }
 
     void test_retrieving_objects_within_a_box() {
@@ -152,6 +152,166 @@ public:
 
         // FIXME: tex->update_palette(new_palette);
     }
+
+    void test_generate_mipmap_data() {
+        uint8_t data [] = {
+            0, 4, 8, 8,
+            4, 8, 8, 8,
+            100, 100, 0, 0,
+            100, 100, 0, 0
+        };
+
+        auto levels = generate_mipmap_data(data, 4, 4, TEXTURE_FORMAT_R_1UB_8);
+        assert_equal(levels.size(), 2u);
+
+        assert_equal(levels[0].size(), 4u);
+        assert_equal(+levels[0][0], 4);
+        assert_equal(+levels[0][1], 8);
+        assert_equal(+levels[0][2], 100);
+        assert_equal(+levels[0][3], 0);
+
+        assert_equal(levels[1].size(), 1u);
+        assert_equal(+levels[1][0], 28);
+
+        /* Non power-of-two textures are left to the renderer */
+        assert_true(generate_mipmap_data(data, 3, 4, TEXTURE_FORMAT_R_1UB_8).empty());
+    }
+
+    void test_async_texture_load() {
+        auto tex = application->shared_assets->new_texture_from_file_async("flare.tga");
+        tex->set_free_data_mode(TEXTURE_FREE_DATA_NEVER);
+
+        /* The placeholder is available straight away */
+        assert_equal(tex->width(), 8);
+        assert_equal(tex->height(), 8);
+        assert_equal(application->shared_assets->pending_texture_count(), 1u);
+
+        while(application->shared_assets->pending_texture_count()) {
+            application->run_frame();
+        }
+
+        assert_equal(tex->width(), 128);
+        assert_equal(tex->height(), 128);
+        assert_equal(tex->format(), TEXTURE_FORMAT_RGBA_4UB_8888);
+        assert_true(tex->has_mipmaps());
+    }
+
+    void test_async_texture_upload_budget() {
+        auto assets = application->shared_assets.get();
+        assets->set_texture_upload_budget(1);
+
+        auto a = assets->new_texture_from_file_async("flare.tga");
+        auto b = assets->new_texture_from_file_async("flare.tga");
+
+        get_app()->jobs->wait(assets->pending_textures_[1].job);
+        get_app()->jobs->wait(assets->pending_textures_[0].job);
+
+        /* Only one texture fits in the budget each frame */
+        application->run_frame();
+        assert_equal(assets->pending_texture_count(), 1u);
+        assert_equal(a->width(), 128);
+        assert_equal(b->width(), 8);
+
+        application->run_frame();
+        assert_equal(assets->pending_texture_count(), 0u);
+        assert_equal(b->width(), 128);
+
+        assets->set_texture_upload_budget(DEFAULT_TEXTURE_UPLOAD_BUDGET);
+    }
+
+    void test_unused_textures_are_evicted() {
+        auto renderer = window->renderer.get();
+
+        auto tex = application->shared_assets->new_texture(8, 8);
+        tex->set_free_data_mode(TEXTURE_FREE_DATA_NEVER);
+
+        /* No data, and nowhere to load it from */
+        auto generated = application->shared_assets->new_texture(8, 8);
+
+        renderer->set_texture_eviction_age(2);
+
+        application->run_frame();
+        assert_true(renderer->is_texture_resident(tex->id()));
+        assert_true(renderer->is_texture_resident(generated->id()));
+
+        for(int i = 0; i < 3; ++i) {
+            application->run_frame();
+        }
+
+        assert_false(renderer->is_texture_resident(tex->id()));
+        assert_true(renderer->is_texture_resident(generated->id()));
+
+        /* Binding the texture brings it back */
+        renderer->make_texture_resident(tex.get());
+        assert_true(renderer->is_texture_resident(tex->id()));
+        assert_false(tex->_data_dirty());
+
+        renderer->set_texture_eviction_age(0);
+    }
+
+    void test_changed_textures_are_not_evicted() {
+        auto renderer = window->renderer.get();
+
+        auto loaded = application->shared_assets->new_texture_from_file("flare.tga");
+        auto changed = application->shared_assets->new_texture_from_file("flare.tga");
+        assert_true(loaded->_data_from_source());
+
+        /* Reloading this one would lose the change */
+        changed->flip_vertically();
+        assert_false(changed->_data_from_source());
+
+        renderer->set_texture_eviction_age(2);
+
+        for(int i = 0; i < 4; ++i) {
+            application->run_frame();
+        }
+
+        assert_false(renderer->is_texture_resident(loaded->id()));
+        assert_true(renderer->is_texture_resident(changed->id()));
+
+        renderer->set_texture_eviction_age(0);
+    }
+
+    void test_cpu_budget_frees_reloadable_data() {
+        auto renderer = window->renderer.get();
+
+        auto loaded = application->shared_assets->new_texture_from_file("flare.tga");
+        loaded->set_free_data_mode(TEXTURE_FREE_DATA_NEVER);
+
+        /* Nowhere to load this from, so its data must be kept */
+        auto generated = application->shared_assets->new_texture(8, 8);
+        generated->set_free_data_mode(TEXTURE_FREE_DATA_NEVER);
+
+        renderer->set_texture_cpu_budget(1);
+        application->run_frame();
+
+        assert_false(loaded->has_data());
+        assert_true(generated->has_data());
+        assert_true(renderer->is_texture_resident(loaded->id()));
+        assert_equal(application->stats->texture_cpu_bytes(), renderer->texture_cpu_bytes());
+
+        /* Evicting it now means reloading it from the file */
+        renderer->set_texture_cpu_budget(0);
+        renderer->set_texture_eviction_age(2);
+        for(int i = 0; i < 3; ++i) {
+            application->run_frame();
+        }
+
+        assert_false(renderer->is_texture_resident(loaded->id()));
+
+        renderer->make_texture_resident(loaded.get());
+        assert_true(renderer->is_texture_resident(loaded->id()));
+        assert_true(loaded->has_data());
+        assert_equal(loaded->width(), 128);
+
+        renderer->set_texture_eviction_age(0);
+    }
+
+    void test_async_texture_load_missing_loader() {
+        auto tex = application->shared_assets->new_texture_from_file_async("flare.unknown");
+        assert_false(tex);
+        assert_equal(application->shared_assets->pending_texture_count(), 0u);
+    }
 };
 
 